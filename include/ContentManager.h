@@ -118,6 +118,20 @@ namespace onut
             }
         }
 
+        /**
+        Add a resource created in code. It is found by name like the loaded ones, and deleted with them
+        */
+        template <typename Ttype>
+        void addResource(const std::string& name, Ttype* pResource)
+        {
+            auto it = m_resources.find(name);
+            if (it != m_resources.end())
+            {
+                delete it->second;
+            }
+            m_resources[name] = new ResourceHolder<Ttype>(pResource);
+        }
+
         /**
         Delete all content loaded by this ContentManager
         */
@@ -0,0 +1,51 @@
+#pragma once
+#include <cinttypes>
+
+namespace onut
+{
+    /**
+    Where to append in a dynamic GPU buffer that is mapped many times per frame.
+    Batches are written one after the other with NO_OVERWRITE maps, so the GPU keeps reading the
+    previous ones. Only when the end of the buffer is reached does it start over with a DISCARD map.
+    This only tracks offsets, the caller does the mapping.
+    */
+    class DynamicBufferRing
+    {
+    public:
+        enum class eMapMode
+        {
+            NO_OVERWRITE, // Only write after what was already drawn
+            DISCARD // Wrapped around, the GPU could still be reading anywhere
+        };
+
+        /**
+        @param capacity Number of elements in the buffer
+        */
+        DynamicBufferRing(uint32_t capacity);
+
+        /**
+        Room for up to count contiguous elements
+        @param mapMode How the buffer has to be mapped to write there
+        @return Offset of the first element
+        */
+        uint32_t reserve(uint32_t count, eMapMode& mapMode);
+
+        /**
+        Number of elements actually written since reserve(). The rest can be reserved again
+        */
+        void commit(uint32_t count);
+
+        uint32_t getCapacity() const { return m_capacity; }
+        uint32_t getOffset() const { return m_offset; }
+        uint32_t getWrapCount() const { return m_wrapCount; }
+
+    private:
+        uint32_t    m_capacity;
+        uint32_t    m_offset = 0;
+        uint32_t    m_reserved = 0;
+        uint32_t    m_wrapCount = 0;
+        bool        m_isFirstReserve = true;
+    };
+}
+
+using ODynamicBufferRing = onut::DynamicBufferRing;
@@ -0,0 +1,70 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+#include "SimdPath.h"
+
+namespace onut
+{
+    /**
+    Premultiply RGBA8 pixels in place. Each color channel becomes (c * a + 127) / 255.
+    Every path is bit-exact with the scalar one.
+    @param pRGBA Tightly packed RGBA8 pixels
+    @param pixelCount Number of pixels (Not bytes)
+    @param path Force a code path. Mainly for tests and benchmarks
+    */
+    void premultiplyAlpha(uint8_t* pRGBA, size_t pixelCount, eSimdPath path = eSimdPath::AUTO);
+
+    /**
+    Placement of one level inside a mip chain buffer
+    */
+    struct sMipLevel
+    {
+        uint32_t width;
+        uint32_t height;
+        size_t offset; // In bytes from the start of the chain
+        size_t size; // In bytes
+    };
+
+    /**
+    Number of levels in a full chain down to 1x1. Works for non power of two sizes,
+    each level being half the previous one rounded down.
+    */
+    uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+
+    /**
+    Layout of a RGBA8 mip chain with all its levels packed one after the other
+    @param levelCount 0 for the full chain
+    */
+    std::vector<sMipLevel> getMipLevels(uint32_t width, uint32_t height, uint32_t levelCount = 0);
+
+    /**
+    Total size in bytes of a chain returned by getMipLevels
+    */
+    size_t getMipChainSize(const std::vector<sMipLevel>& levels);
+
+    /**
+    Fill levels 1 to N of a RGBA8 mip chain using a 2x2 box filter. Level 0 must already be in the buffer.
+    This only touches pChain so it can safely be called from a worker thread.
+    @param pChain Buffer of getMipChainSize(levels) bytes
+    @param levels Layout returned by getMipLevels
+    @param gammaCorrect Average colors in linear space, treating them as sRGB. Alpha is always linear
+    @param path Force a code path. Mainly for tests and benchmarks
+    */
+    void generateMipChain(uint8_t* pChain, const std::vector<sMipLevel>& levels, bool gammaCorrect = false, eSimdPath path = eSimdPath::AUTO);
+
+    /**
+    Read the size of a PNG from its header, without decoding it
+    */
+    bool getPngSize(const uint8_t* pData, size_t size, uint32_t& width, uint32_t& height);
+
+    /**
+    Decode a PNG to RGBA8 straight into a buffer owned by the caller, like a mip chain or a mapped texture.
+    Rows are converted and premultiplied one at a time while they are still in cache, and the encoded
+    data is only read, so it can come from a MappedFile.
+    @param pitch Bytes from the start of one row to the next. At least width * 4
+    @param width Must match getPngSize
+    @param height Must match getPngSize
+    */
+    bool decodePng(const uint8_t* pData, size_t size, uint8_t* pDst, size_t pitch, uint32_t width, uint32_t height, bool premultiply = true);
+}
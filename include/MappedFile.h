@@ -0,0 +1,53 @@
+#pragma once
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+
+namespace onut
+{
+    /**
+    Read only view of a whole file mapped in memory. Pages are loaded by the OS as they are touched.
+    */
+    class MappedFile final
+    {
+    public:
+        /**
+        @param isCopyOnWrite Pages can be written to with getWritableData(). They are copied on the first write,
+                             the file itself never changes
+        */
+        MappedFile(const std::string& filename, bool isCopyOnWrite = false);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool isValid() const { return m_pData != nullptr; }
+        const uint8_t* getData() const { return m_pData; }
+        uint8_t* getWritableData() const { return m_isCopyOnWrite ? const_cast<uint8_t*>(m_pData) : nullptr; }
+        size_t getSize() const { return m_size; }
+
+    private:
+        const uint8_t* m_pData = nullptr;
+        size_t m_size = 0;
+        bool m_isCopyOnWrite;
+#if defined(WIN32)
+        void* m_hFile = nullptr;
+        void* m_hMapping = nullptr;
+#endif
+    };
+
+    /**
+    Size and last write time of a file, used to know if something derived from it is stale.
+    The time is as fine as the OS keeps it, 100 ns ticks on Windows and nanoseconds elsewhere
+    @return false if the file doesn't exist
+    */
+    bool getFileStamp(const std::string& filename, uint64_t& size, uint64_t& modifiedTime);
+
+    /**
+    Move a file over another in one step, so the destination is never missing
+    @return false if it failed. Windows refuses while the destination is mapped
+    */
+    bool replaceFile(const std::string& from, const std::string& to);
+}
+
+using OMappedFile = onut::MappedFile;
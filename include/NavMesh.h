@@ -1,13 +1,12 @@
 #pragma once
 
-struct sMarchingLine
-{
-    float x1, y1;
-    float x2, y2;
-};
-
 namespace onut
 {
+    /**
+    Walkable area of a tile grid, as triangles linked to their neighbors. The outline of the walkable
+    tiles is traced by marching squares between the tile centers, so corners are cut at 45 degrees and
+    tiles only touching by a corner aren't connected. Positions are in tiles.
+    */
     class NavMesh
     {
     public:
@@ -15,7 +14,7 @@ namespace onut
 
         struct sNeighbor
         {
-            float heuristic;
+            float cost; // Distance between the node centers
             sNode *pNode;
         };
 
@@ -23,10 +22,14 @@ namespace onut
         {
             sNeighbor *pNeighbors;
             int neighborCount;
-            float x, y, z;
+            float x, y, z; // Center
+            float corners[6]; // x, y of each corner, turning from +x toward +y
         };
 
-        NavMesh(bool *pCollisionTiles, int width, int height);
+        /**
+        @param pCollisionTiles width * height, true where it can't be walked. Nor can outside the grid
+        */
+        NavMesh(const bool *pCollisionTiles, int width, int height);
         virtual ~NavMesh();
 
         sNode *getNodes(int &count) const;
@@ -34,5 +37,6 @@ namespace onut
     private:
         sNode *m_nodes = nullptr;
         int m_nodeCount = 0;
+        sNeighbor *m_neighbors = nullptr; // Of all the nodes
     };
 };
@@ -1,54 +1,90 @@
 #pragma once
+#include "ImageUtils.h"
+#include "RenderBackend.h"
 #include "SimpleMath.h"
 #include "Texture.h"
+
+#include <vector>
 using namespace DirectX::SimpleMath;
 
 namespace onut
 {
-    enum class ePrimitiveType
+    /**
+    How thick polyline segments are connected
+    */
+    enum class eLineJoin
     {
-        POINTS,
-        LINES,
-        LINE_STRIP,
-        TRIANGLES
+        NONE, // Segments only overlap
+        BEVEL,
+        MITER, // Beveled when longer than twice the thickness
+        ROUND
     };
 
+    /**
+    Vertices are written to the backend as they are drawn. The draw*() shapes are tessellated to triangles,
+    so the batch must be begun with ePrimitiveType::TRIANGLES for them. Big shapes are split between triangles.
+    */
     class PrimitiveBatch
     {
     public:
-        PrimitiveBatch();
+        /**
+        @param pBackend Where batches are sent. nullptr for the renderer's device
+        */
+        PrimitiveBatch(IRenderBackend* pBackend = nullptr);
         virtual ~PrimitiveBatch();
 
         void begin(ePrimitiveType primitiveType, Texture* pTexture = nullptr);
         void draw(const Vector2& position, const Color& color = Color::White, const Vector2& texCoord = Vector2::Zero);
         void end();
 
-    private:
-#ifndef EASY_GRAPHIX
-        struct SVertexP2T2C4
-        {
-            Vector2 position;
-            Vector2 texCoord;
-            Color   color;
-        };
+        /**
+        Independent segments, from pPoints[i * 2] to pPoints[i * 2 + 1]. The cheapest for large debug overlays,
+        corners are generated 4 segments at a time. Every path is bit-exact with the scalar one.
+        @param path Force a code path. Mainly for tests and benchmarks
+        */
+        void drawLines(const Vector2* pPoints, size_t segmentCount, float thickness, const Color& color = Color::White, eSimdPath path = eSimdPath::AUTO);
+        void drawLines(const std::vector<Vector2>& points, float thickness, const Color& color = Color::White, eSimdPath path = eSimdPath::AUTO);
 
-        static const int MAX_VERTEX_COUNT = 1200;
+        /**
+        Connected segments, with joins between them
+        @param closed Also connect the last point to the first
+        */
+        void drawPolyline(const Vector2* pPoints, size_t pointCount, float thickness, const Color& color = Color::White, eLineJoin join = eLineJoin::MITER, bool closed = false);
+        void drawPolyline(const std::vector<Vector2>& points, float thickness, const Color& color = Color::White, eLineJoin join = eLineJoin::MITER, bool closed = false);
 
-        void flush();
+        /**
+        @param segmentCount 0 to keep the error under a quarter pixel
+        */
+        void drawCircle(const Vector2& center, float radius, const Color& color = Color::White, uint32_t segmentCount = 0);
+        void drawCircleOutline(const Vector2& center, float radius, float thickness, const Color& color = Color::White, uint32_t segmentCount = 0);
 
-        ID3D11Buffer*               m_pVertexBuffer = nullptr;
-        D3D11_MAPPED_SUBRESOURCE    m_pMappedVertexBuffer;
+        /**
+        Filled polygon, convex or concave, in either winding. Edges must not cross
+        */
+        void drawPolygon(const Vector2* pPoints, size_t pointCount, const Color& color = Color::White);
+        void drawPolygon(const std::vector<Vector2>& points, const Color& color = Color::White);
 
-        static const unsigned int   m_stride = sizeof(SVertexP2T2C4);
-        static const unsigned int   m_offset = 0;
+    private:
+        void flush();
+        sRenderVertex* beginTriangles(uint32_t& vertexCount);
+        void endTriangles(uint32_t vertexCount);
+        void drawSegments(const Vector2* pPoints, size_t stride, size_t segmentCount, float halfThickness, const Color& color, eSimdPath path);
+        void addTriangle(const Vector2& a, const Vector2& b, const Vector2& c, const Color& color);
+
+        IRenderBackend*             m_pBackend = nullptr;
+        RenderStats*                m_pStats = nullptr;
+        sRenderVertex*              m_pVertices = nullptr;
+        unsigned int                m_maxVertexCount = 0;
         unsigned int                m_vertexCount = 0;
 
         bool                        m_isDrawing = false;
 
-        Texture*                    m_pTexWhite = nullptr;
         Texture*                    m_pTexture = nullptr;
 
         ePrimitiveType              m_primitiveType;
-#endif /* !EASY_GRAPHIX */
+
+        // Scratch for the tessellation, kept to not allocate every shape
+        std::vector<Vector2>        m_points;
+        std::vector<uint32_t>       m_links;
     };
 }
@@ -0,0 +1,33 @@
+#pragma once
+#include <cinttypes>
+#include <vector>
+
+namespace onut
+{
+    struct sSortKey
+    {
+        uint64_t key;
+        uint32_t index; // What the key was built for, usually an index in another array
+    };
+
+    /**
+    Stable LSD radix sort over the 64 bits keys, 8 bits at a time.
+    Bytes that are the same in every key are skipped, so small keys only cost one or two passes.
+    @param scratch Reused between calls to avoid allocations
+    */
+    void radixSort(std::vector<sSortKey>& keys, std::vector<sSortKey>& scratch);
+
+    /**
+    Bits of a float that sort, as unsigned integers, in the same order as the float
+    */
+    inline uint32_t getSortableFloatBits(float value)
+    {
+        union
+        {
+            float f;
+            uint32_t u;
+        } bits;
+        bits.f = value;
+        return (bits.u & 0x80000000) ? ~bits.u : (bits.u | 0x80000000);
+    }
+}
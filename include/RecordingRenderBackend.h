@@ -0,0 +1,102 @@
+#pragma once
+#include "RenderBackend.h"
+#include "RenderStats.h"
+#include "Texture.h"
+
+#include <memory>
+#include <vector>
+
+namespace onut
+{
+    /**
+    Backend that draws nothing and keeps every batch in memory instead.
+    Lets the batching code run without a device, for tests and benchmarks.
+    */
+    class RecordingRenderBackend final : public IRenderBackend
+    {
+    public:
+        enum class eCommandType
+        {
+            SPRITES,
+            PACKED_SPRITES,
+            PRIMITIVES,
+            SCISSOR
+        };
+
+        struct sCommand
+        {
+            eCommandType    type;
+            ePrimitiveType  primitiveType; // PRIMITIVES only
+            Texture*        pTexture;
+            uint32_t        firstVertex; // In getVertices(), or getPackedSprites() for PACKED_SPRITES
+            uint32_t        vertexCount; // Sprites for PACKED_SPRITES
+            bool            scissorEnabled; // SCISSOR only
+            Rect            scissor;
+        };
+
+        /**
+        @param captureVertices Set to false to only keep the commands, when benchmarking vertex generation
+        */
+        RecordingRenderBackend(uint32_t maxSpriteCount = 300, uint32_t maxPrimitiveVertexCount = 1200, bool captureVertices = true);
+
+        /**
+        Texture without any device resource, only a size
+        @param isOwned Deleted with the backend. Set to false to give it to a ContentManager
+        */
+        Texture* createTexture(const Texture::sSize& size, bool isOwned = true);
+
+        const std::vector<sCommand>& getCommands() const { return m_commands; }
+        const std::vector<sRenderVertex>& getVertices() const { return m_vertices; }
+        const std::vector<sPackedSprite>& getPackedSprites() const { return m_packedSprites; }
+        size_t getDrawCallCount() const { return m_drawCallCount; }
+        void clear();
+
+        /**
+        Instanced sprites are not supported by default, like a device without the shader for them
+        */
+        void setMaxPackedSpriteCount(uint32_t maxPackedSpriteCount);
+
+        Texture* getWhiteTexture() override { return m_pWhiteTexture; }
+
+        uint32_t getMaxSpriteCount() const override { return m_maxSpriteCount; }
+        sRenderVertex* beginSprites(bool forceWrite) override;
+        sRenderVertex* drawSprites(Texture* pTexture, uint32_t spriteCount) override;
+        void endSprites() override {}
+
+        uint32_t getMaxPackedSpriteCount() const override { return m_maxPackedSpriteCount; }
+        sPackedSprite* mapPackedSprites(uint32_t spriteCount) override;
+        void drawPackedSprites(Texture* pTexture, uint32_t spriteCount) override;
+
+        uint32_t getMaxPrimitiveVertexCount() const override { return m_maxPrimitiveVertexCount; }
+        sRenderVertex* beginPrimitives() override;
+        sRenderVertex* drawPrimitives(ePrimitiveType primitiveType, Texture* pTexture, uint32_t vertexCount) override;
+        void endPrimitives() override {}
+
+        void setScissor(bool enabled, const Rect& rect) override;
+
+        /**
+        Own counters, call nextFrame() on them between frames
+        */
+        RenderStats* getStats() override { return &m_stats; }
+
+    private:
+        void record(eCommandType type, ePrimitiveType primitiveType, Texture* pTexture, const sRenderVertex* pVertices, uint32_t vertexCount);
+
+        uint32_t                    m_maxSpriteCount;
+        uint32_t                    m_maxPrimitiveVertexCount;
+        uint32_t                    m_maxPackedSpriteCount = 0;
+        bool                        m_captureVertices;
+        std::vector<std::unique_ptr<Texture>> m_textures;
+        Texture*                    m_pWhiteTexture;
+        std::vector<sRenderVertex>  m_spriteStaging;
+        std::vector<sRenderVertex>  m_primitiveStaging;
+        std::vector<sPackedSprite>  m_packedStaging;
+        std::vector<sCommand>       m_commands;
+        std::vector<sRenderVertex>  m_vertices;
+        std::vector<sPackedSprite>  m_packedSprites;
+        size_t                      m_drawCallCount = 0;
+        RenderStats                 m_stats;
+    };
+}
+
+using ORecordingRenderBackend = onut::RecordingRenderBackend;
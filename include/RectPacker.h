@@ -0,0 +1,51 @@
+#pragma once
+#include <cinttypes>
+#include <vector>
+
+namespace onut
+{
+    /**
+    MaxRects bin packer, using the best short side fit heuristic.
+    It keeps every maximal free rectangle of the bin, so it packs tighter than shelf or skyline packers
+    at the cost of a slower insert.
+    */
+    class RectPacker final
+    {
+    public:
+        struct sRect
+        {
+            uint32_t x;
+            uint32_t y;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        RectPacker(uint32_t width, uint32_t height);
+
+        /**
+        Find room for a rectangle and reserve it
+        @return false if it doesn't fit anywhere
+        */
+        bool insert(uint32_t width, uint32_t height, sRect& placed);
+
+        uint32_t getWidth() const { return m_width; }
+        uint32_t getHeight() const { return m_height; }
+
+        /**
+        Ratio of the bin area used by inserted rectangles. From 0 to 1
+        */
+        float getOccupancy() const;
+
+    private:
+        void splitFreeRects(const sRect& placed);
+        void pruneFreeRects();
+
+        uint32_t m_width;
+        uint32_t m_height;
+        uint64_t m_usedArea = 0;
+        std::vector<sRect> m_freeRects;
+        std::vector<sRect> m_newFreeRects;
+    };
+}
+
+using ORectPacker = onut::RectPacker;
@@ -0,0 +1,85 @@
+#pragma once
+#include "SimpleMath.h"
+
+#include <cinttypes>
+using namespace DirectX::SimpleMath;
+
+namespace onut
+{
+    class RenderStats;
+    class Texture;
+
+    enum class ePrimitiveType
+    {
+        POINTS,
+        LINES,
+        LINE_STRIP,
+        TRIANGLES
+    };
+
+    struct sRenderVertex
+    {
+        Vector2 position;
+        Vector2 texCoord;
+        Color   color;
+    };
+
+    /**
+    One whole sprite, expanded to a quad by the vertex shader. 40 bytes instead of 4 sRenderVertex
+    */
+    struct sPackedSprite
+    {
+        Vector2     position; // Center
+        Vector2     halfSize; // Scale included
+        Vector4     uvs;
+        float       rotation; // Radians
+        uint32_t    color; // RGBA8, red in the lowest byte
+    };
+
+    /**
+    Receives the batches built by SpriteBatch and PrimitiveBatch.
+    The batches write vertices straight into the memory returned by begin*() and draw*(),
+    then hand it back with a texture and a count.
+    */
+    class IRenderBackend
+    {
+    public:
+        virtual ~IRenderBackend() {}
+
+        /**
+        Used in place of a null texture
+        */
+        virtual Texture* getWhiteTexture() = 0;
+
+        /**
+        Sprites are quads of 4 vertices, drawn as 2 triangles
+        */
+        virtual uint32_t getMaxSpriteCount() const = 0;
+        virtual sRenderVertex* beginSprites(bool forceWrite) = 0;
+        virtual sRenderVertex* drawSprites(Texture* pTexture, uint32_t spriteCount) = 0;
+        virtual void endSprites() = 0;
+
+        /**
+        Instanced sprites, one sPackedSprite each. Optional, getMaxPackedSpriteCount() is 0 when not supported.
+        Called between beginSprites() and endSprites(), after the sprites written so far were drawn.
+        */
+        virtual uint32_t getMaxPackedSpriteCount() const { return 0; }
+        virtual sPackedSprite* mapPackedSprites(uint32_t spriteCount) { return nullptr; }
+        virtual void drawPackedSprites(Texture* pTexture, uint32_t spriteCount) {}
+
+        virtual uint32_t getMaxPrimitiveVertexCount() const = 0;
+        virtual sRenderVertex* beginPrimitives() = 0;
+        virtual sRenderVertex* drawPrimitives(ePrimitiveType primitiveType, Texture* pTexture, uint32_t vertexCount) = 0;
+        virtual void endPrimitives() = 0;
+
+        virtual void setScissor(bool enabled, const Rect& rect) = 0;
+
+        /**
+        Counters updated by the batches drawing with this backend. nullptr to not count,
+        like for backends filled from worker threads.
+        */
+        virtual RenderStats* getStats() { return nullptr; }
+    };
+}
+
+using ORenderBackend = onut::IRenderBackend;
@@ -0,0 +1,76 @@
+#pragma once
+#include <cinttypes>
+#include <ostream>
+#include <vector>
+
+namespace onut
+{
+    /**
+    What was sent to the backend during one frame
+    */
+    struct sFrameStats
+    {
+        uint32_t    spriteBatchCount = 0; // SpriteBatch begin()/end() pairs
+        uint32_t    spriteCount = 0; // Quads and packed
+        uint32_t    spriteFlushCount = 0; // Draws sent by SpriteBatch
+        uint32_t    textureSwitchCount = 0; // Of those, the ones caused by a texture change
+        uint32_t    primitiveBatchCount = 0;
+        uint32_t    primitiveFlushCount = 0;
+        uint32_t    vertexCount = 0; // Written by the CPU. Packed sprites are one each
+        uint32_t    scissorChangeCount = 0;
+        uint32_t    renderTargetChangeCount = 0;
+
+        uint32_t getDrawCallCount() const { return spriteFlushCount + primitiveFlushCount; }
+    };
+
+    /**
+    Counters of the last frames, kept in a ring buffer. Cheap enough to always be on.
+    The batches drawing with a backend update the stats it returns from getStats(), see Renderer::getStats().
+    */
+    class RenderStats
+    {
+    public:
+        /**
+        @param historySize Number of complete frames kept
+        */
+        RenderStats(uint32_t historySize = 120);
+
+        /**
+        Counters being updated
+        */
+        sFrameStats& getCurrentFrame() { return m_current; }
+
+        /**
+        Keep the current counters in the history and start from 0. Renderer::beginFrame() calls it
+        */
+        void nextFrame();
+
+        /**
+        Number of complete frames in the history
+        */
+        uint32_t getFrameCount() const { return m_frameCount; }
+
+        /**
+        @param framesAgo 0 for the last complete frame
+        */
+        const sFrameStats& getFrame(uint32_t framesAgo = 0) const;
+
+        /**
+        Highest value of each counter over the history
+        */
+        sFrameStats getPeak() const;
+
+        /**
+        Write the history as CSV, one line per frame from the oldest
+        */
+        void dump(std::ostream& stream) const;
+
+    private:
+        sFrameStats                 m_current;
+        std::vector<sFrameStats>    m_history;
+        uint32_t                    m_next = 0;
+        uint32_t                    m_frameCount = 0;
+    };
+}
+
+using ORenderStats = onut::RenderStats;
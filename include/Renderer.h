@@ -4,11 +4,13 @@
 #else
 #include <d3d11.h>
 #endif
+#include "RenderStats.h"
 #include "SimpleMath.h"
 using namespace DirectX::SimpleMath;
 
 namespace onut
 {
+    class IRenderBackend;
     class Window;
     class Texture;
 
@@ -43,6 +45,16 @@ namespace onut
 
         void                    bindRenderTarget(Texture *pTexture = nullptr);
 
+        /**
+        Backend drawing the sprite and primitive batches with this renderer's device
+        */
+        IRenderBackend*         getBackend();
+
+        /**
+        Counters of the last frames drawn with getBackend(). The frame changes in beginFrame()
+        */
+        RenderStats&            getStats() { return m_stats; }
+
 #ifdef EASY_GRAPHIX
         EGDevice                getDevice();
 #else
@@ -97,6 +109,8 @@ namespace onut
 #endif /* EASY_GRAPHIX */
 
         eRenderSetup                m_renderSetup = eRenderSetup::SETUP_NONE;
+        IRenderBackend*             m_pBackend = nullptr;
+        RenderStats                 m_stats;
 
         // Camera
         Vector3                     m_cameraPos;
@@ -4,6 +4,7 @@
 #include <unordered_map>
 #include <string>
 #include <atomic>
+#include <cinttypes>
 #include <thread>
 
 namespace onut
@@ -29,6 +30,20 @@ namespace onut
         bool                getIsFixedStep() const { return m_isFixedStep; }
         void                setIsFixedStep(bool isFixedStep);
 
+        /**
+        Where decoded textures are cached to skip PNG decoding on the next start. Empty, the default, disables the cache.
+        Must be set before onut::run.
+        */
+        const std::string&  getTextureCachePath() const { return m_textureCachePath; }
+        void                setTextureCachePath(const std::string& textureCachePath);
+
+        /**
+        Number of sprites the dynamic vertex buffer of the SpriteBatch holds before wrapping around.
+        Must be set before onut::run.
+        */
+        uint32_t            getSpriteBufferCapacity() const { return m_spriteBufferCapacity; }
+        void                setSpriteBufferCapacity(uint32_t spriteBufferCapacity);
+
         void                setUserSettingDefault(const std::string& key, const std::string& value);
         void                setUserSetting(const std::string& key, const std::string& value);
         const std::string&  getUserSetting(const std::string& key) const;
@@ -39,6 +54,8 @@ namespace onut
         bool                m_isResizableWindow = false;
         bool                m_isFixedStep = true;
         bool                m_isBorderLessFullscreen = false;
+        std::string         m_textureCachePath;
+        uint32_t            m_spriteBufferCapacity = 32768;
 
         std::atomic<bool>   m_isDirty = false;
         std::atomic<bool>   m_requestShutdown = false;
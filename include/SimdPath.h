@@ -0,0 +1,27 @@
+#pragma once
+
+namespace onut
+{
+    /**
+    Vectorized code paths the image, sprite and codec kernels can run on.
+    AUTO picks the widest one supported by the running CPU.
+    */
+    enum class eSimdPath
+    {
+        AUTO,
+        SCALAR,
+        SSE2,
+        AVX2,
+        NEON
+    };
+
+    /**
+    Returns true if the path was compiled in and the running CPU supports it
+    */
+    bool isSimdPathSupported(eSimdPath path);
+
+    /**
+    Resolve AUTO to the widest supported path
+    */
+    eSimdPath getBestSimdPath();
+}
@@ -1,10 +1,40 @@
 #pragma once
+#include "ImageUtils.h"
+#include "RadixSort.h"
+#include "RenderBackend.h"
 #include "SimpleMath.h"
 #include "Texture.h"
+
+#include <unordered_map>
+#include <vector>
 using namespace DirectX::SimpleMath;
 
 namespace onut
 {
+    struct AtlasRegion;
+    class SpriteCommandList;
+
+    /**
+    One sprite for SpriteBatch::drawSprites. Same as a drawSpriteWithUVs call
+    */
+    struct SpriteInstance
+    {
+        Texture*    pTexture = nullptr;
+        Vector2     position;
+        Vector4     uvs = {0, 0, 1, 1};
+        Color       color = Color::White;
+        float       rotation = 0.f; // Degrees
+        float       scale = 1.f;
+    };
+
+    /**
+    Convert sprites to the instanced format expanded by the vertex shader. Colors are clamped and rounded to 8 bits.
+    Every path is bit-exact with the scalar one.
+    @param textureSize Size of the texture all the sprites use
+    @param path Force a code path. Mainly for tests and benchmarks
+    */
+    void packSprites(const SpriteInstance* pInstances, size_t count, const Vector2& textureSize, sPackedSprite* pPacked, eSimdPath path = eSimdPath::AUTO);
+
     class SpriteBatch
     {
     public:
@@ -14,10 +44,31 @@ namespace onut
             FORCE_WRITE,
         };
 
-        SpriteBatch();
+        /**
+        How sprites are ordered between begin() and end().
+        Sorted modes record the sprites and only draw them at end(), with as few batches as possible.
+        */
+        enum class eSortMode
+        {
+            IMMEDIATE, // Call order, a new batch on every texture change
+            TEXTURE, // Grouped by texture. Only for sprites that don't overlap
+            DEPTH, // By setDepth(), lowest first. Call order is kept for equal depths
+            DEPTH_TEXTURE, // By depth, then grouped by texture within the same depth
+        };
+
+        /**
+        @param pBackend Where batches are sent. nullptr for the renderer's device
+        */
+        SpriteBatch(IRenderBackend* pBackend = nullptr);
         virtual ~SpriteBatch();
 
-        void begin(eBlendMode blendMode = eBlendMode::PRE_MULT);
+        void begin(eBlendMode blendMode = eBlendMode::PRE_MULT, eSortMode sortMode = eSortMode::IMMEDIATE);
+
+        /**
+        Depth of the following draws. Only used by the DEPTH sort modes
+        */
+        void setDepth(float depth) { m_depth = depth; }
+
         void drawAbsoluteRect(Texture* pTexture, const Rect& rect, const Color& color = Color::White);
         void drawRect(Texture* pTexture, const Rect& rect, const Color& color = Color::White);
         void drawInclinedRect(Texture* pTexture, const Rect& rect, float inclinedRatio = -1.f, const Color& color = Color::White);
@@ -30,42 +81,94 @@ namespace onut
         void drawSprite(Texture* pTexture, const Vector2& position, const Color& color = Color::White);
         void drawSprite(Texture* pTexture, const Vector2& position, const Color& color, float rotation, float scale = 1.f);
         void drawSpriteWithUVs(Texture* pTexture, const Vector2& position, const Vector4& uvs, const Color& color, float rotation, float scale = 1.f);
+        void drawRectWithUVs(const AtlasRegion& region, const Rect& rect, const Color& color = Color::White);
+        void drawSpriteWithUVs(const AtlasRegion& region, const Vector2& position, const Color& color = Color::White, float rotation = 0.f, float scale = 1.f);
+
+        /**
+        Draw many rotated and scaled sprites at once. Corners are generated 4 or 8 sprites at a time,
+        with a fast sin/cos accurate to about 1e-7. Consecutive sprites sharing a texture are the cheapest.
+        Outside of the sorted modes, when the backend supports it, sprites are instead packed in 40 bytes
+        and expanded by the vertex shader. See packSprites().
+        @param path Force a code path. Mainly for tests and benchmarks
+        */
+        void drawSprites(const SpriteInstance* pInstances, size_t count, eSimdPath path = eSimdPath::AUTO);
+        void drawSprites(const std::vector<SpriteInstance>& instances, eSimdPath path = eSimdPath::AUTO);
+
+        /**
+        Copy sprites recorded on another thread. Lists drawn one after the other
+        keep their order, and merge into one batch when their textures allow it.
+        */
+        void draw(const SpriteCommandList& commandList);
+        void draw(const SpriteCommandList& commandList, const Matrix& transform);
+
         void drawBeam(Texture* pTexture, const Vector2& from, const Vector2& to, float size, const Color& color, float uOffset = 0.f, float uScale = 1.f);
         void end();
 
+        /**
+        Sprites drawn so far use the previous scissor. In sorted modes, they are sorted up to here
+        */
+        void setScissor(bool enabled, const Rect& rect);
+        bool isScissorEnabled() const { return m_userScissorEnabled; } // From setScissor(), not the clip's
+        const Rect& getScissor() const { return m_userScissor; }
+
+        /**
+        Clip the following sprites to a rect, without breaking the batch. Sprites outside are culled, and axis aligned
+        ones crossing the edge are cut on the CPU. Only rotated ones crossing it need the scissor, set to the clip within
+        the one from setScissor(), which is put back after them. Clips are kept per sprite in the sorted modes, and stay
+        set after end(). Only this batch's sprites are clipped: primitives and other batches drawn meanwhile need
+        setScissor().
+        */
+        void setClip(bool enabled, const Rect& rect);
+
         bool isInBatch() const { return m_isDrawing; };
 
     private:
-#ifndef EASY_GRAPHIX
-        struct SVertexP2T2C4
+        struct sDeferredSprite
         {
-            Vector2 position;
-            Vector2 texCoord;
-            Color   color;
+            Texture*    pTexture;
+            float       depth;
+            uint32_t    clipIndex;
         };
 
-        static const int MAX_SPRITE_COUNT = 300;
+        static const uint32_t NO_CLIP = 0xFFFFFFFF;
 
+        sRenderVertex* beginQuad(Texture* pTexture);
+        void endQuad();
+        sRenderVertex* beginImmediateQuad(Texture* pTexture);
+        void endImmediateQuad();
+        sRenderVertex* beginQuads(Texture* pTexture, uint32_t& count);
+        void endQuads(uint32_t count);
+        bool clipQuad();
+        void changeScissor(bool enabled, const Rect& rect);
+        void drawDeferred();
+        void drawCommandList(const SpriteCommandList& commandList, const Matrix* pTransform);
+        void flush();
 
-        ID3D11Buffer*               m_pVertexBuffer = nullptr;
-        ID3D11Buffer*               m_pIndexBuffer = nullptr;
-        D3D11_MAPPED_SUBRESOURCE    m_pMappedVertexBuffer;
-
-        static const unsigned int   m_stride = sizeof(SVertexP2T2C4);
-        static const unsigned int   m_offset = 0;
-
+        IRenderBackend*             m_pBackend = nullptr;
+        RenderStats*                m_pStats = nullptr;
+        sRenderVertex*              m_pVertices = nullptr;
+        unsigned int                m_maxSpriteCount = 0;
         bool                        m_isDrawing = false;
 
-        Texture*                    m_pTexWhite = nullptr;
-#else
-        static const int MAX_SPRITE_COUNT = 2000;
-
-#endif /* !EASY_GRAPHIX */
-        void flush();
-
         Texture*                    m_pTexture = nullptr;
         unsigned int                m_spriteCount = 0;
-        eBlendMode                  m_curBlendMode = eBlendMode::PRE_MULT;
-        ID3D11BlendState*           m_pForceWriteBlend = nullptr;
+
+        eSortMode                   m_sortMode = eSortMode::IMMEDIATE;
+        float                       m_depth = 0.f;
+        std::vector<sDeferredSprite> m_deferredSprites;
+        std::vector<sRenderVertex>  m_deferredVertices;
+        std::vector<sSortKey>       m_sortKeys;
+        std::vector<sSortKey>       m_sortScratch;
+        std::unordered_map<Texture*, uint32_t> m_textureIds;
+
+        std::vector<Rect>           m_clips; // Indexed by the sprites
+        uint32_t                    m_clipIndex = NO_CLIP;
+        bool                        m_scissorEnabled = false;
+        bool                        m_clipScissor = false; // Set for a rotated sprite, until no longer needed
+        Rect                        m_scissor;
+        bool                        m_userScissorEnabled = false; // From setScissor(), put back after the clip's
+        Rect                        m_userScissor;
     };
 }
+
+using OSpriteInstance = onut::SpriteInstance;
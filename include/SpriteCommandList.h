@@ -0,0 +1,76 @@
+#pragma once
+#include "RenderBackend.h"
+
+#include <vector>
+
+namespace onut
+{
+    /**
+    Sprites recorded away from the main thread, to be drawn later with SpriteBatch::draw().
+    Give each job its own list and its own SpriteBatch writing into it:
+        SpriteBatch spriteBatch(&commandList);
+    Vertices are generated by the recording thread, drawing the list only copies them.
+    Lists are drawn in the order they are passed, so the result doesn't depend on thread timing.
+    */
+    class SpriteCommandList final : public IRenderBackend
+    {
+    public:
+        /**
+        Consecutive sprites sharing a texture
+        */
+        struct sRun
+        {
+            Texture*    pTexture;
+            uint32_t    firstVertex;
+            uint32_t    spriteCount;
+        };
+
+        /**
+        @param pBackend Backend the list will be drawn with. Only its white texture is used, so this
+                        has to be created on the main thread. nullptr for the renderer's device
+        */
+        SpriteCommandList(IRenderBackend* pBackend = nullptr);
+
+        const std::vector<sRun>& getRuns() const { return m_runs; }
+        const sRenderVertex* getVertices() const { return m_vertices.data(); }
+        uint32_t getSpriteCount() const { return m_vertexCount / 4; }
+
+        /**
+        Forget the sprites but keep the memory, for the next frame
+        */
+        void clear();
+
+        /**
+        Append sprites already made of 4 vertices each. No room is kept for a full batch after them,
+        like when a SpriteBatch records, so many small lists can be kept for a long time
+        */
+        void addSprites(Texture* pTexture, const sRenderVertex* pVertices, uint32_t spriteCount);
+
+        Texture* getWhiteTexture() override { return m_pWhiteTexture; }
+
+        uint32_t getMaxSpriteCount() const override { return MAX_SPRITE_COUNT; }
+        sRenderVertex* beginSprites(bool forceWrite) override;
+        sRenderVertex* drawSprites(Texture* pTexture, uint32_t spriteCount) override;
+        void endSprites() override {}
+
+        // Only sprites can be recorded
+        uint32_t getMaxPrimitiveVertexCount() const override { return 0; }
+        sRenderVertex* beginPrimitives() override;
+        sRenderVertex* drawPrimitives(ePrimitiveType primitiveType, Texture* pTexture, uint32_t vertexCount) override;
+        void endPrimitives() override {}
+        void setScissor(bool enabled, const Rect& rect) override;
+
+    private:
+        static const uint32_t MAX_SPRITE_COUNT = 4096;
+
+        sRenderVertex* getWritePointer();
+        void addRun(Texture* pTexture, uint32_t spriteCount);
+
+        Texture*                    m_pWhiteTexture;
+        std::vector<sRun>           m_runs;
+        std::vector<sRenderVertex>  m_vertices;
+        uint32_t                    m_vertexCount = 0;
+    };
+}
+
+using OSpriteCommandList = onut::SpriteCommandList;
@@ -0,0 +1,73 @@
+#pragma once
+#include "SpriteCommandList.h"
+
+#include <map>
+#include <utility>
+
+namespace onut
+{
+    class SpriteBatch;
+
+    /**
+    Sprites recorded once and drawn every frame without generating them again, like tilemap layers or
+    UI backgrounds. They are kept per square region, so a part can be recorded again without touching the rest,
+    and regions outside of the scissor are skipped.
+    Order is kept within a region. Sprites of different regions that overlap can be drawn in any order.
+    */
+    class StaticSpriteBatch
+    {
+    public:
+        /**
+        @param pBackend Backend it will be drawn with, like SpriteCommandList. nullptr for the renderer's device
+        @param regionSize Size of the regions in the recorded coordinates
+        */
+        StaticSpriteBatch(IRenderBackend* pBackend = nullptr, float regionSize = 512.f);
+
+        /**
+        Keep sprites recorded in a command list. Each one goes to the region under its center
+        */
+        void add(const SpriteCommandList& commandList);
+
+        /**
+        Forget the sprites of every region touching rect
+        @return The area that was cleared, made of whole regions. Sprites centered in it have to be added again
+        */
+        Rect invalidate(const Rect& rect);
+
+        void clear();
+
+        /**
+        Draw with a sprite batch, between its begin() and end()
+        @param transform Applied to the recorded positions
+        */
+        void draw(SpriteBatch& spriteBatch, const Matrix& transform = Matrix::Identity) const;
+
+        /**
+        Same, but only the regions touching scissor are drawn, with the scissor on. Within the sprite batch's
+        scissor, if it has one, which is put back after
+        @param scissor In the transformed coordinates
+        */
+        void draw(SpriteBatch& spriteBatch, const Matrix& transform, const Rect& scissor) const;
+
+        size_t getSpriteCount() const;
+        size_t getRegionCount() const { return m_regions.size(); }
+
+    private:
+        struct sRegion
+        {
+            SpriteCommandList   sprites;
+            Vector2             min; // Bounds of the vertices
+            Vector2             max;
+        };
+
+        using RegionKey = std::pair<int, int>;
+
+        void drawRegions(SpriteBatch& spriteBatch, const Matrix& transform, const Rect* pScissor) const;
+
+        IRenderBackend*                 m_pBackend;
+        float                           m_regionSize;
+        std::map<RegionKey, sRegion>    m_regions; // Ordered, so drawing doesn't depend on hashing
+    };
+}
+
+using OStaticSpriteBatch = onut::StaticSpriteBatch;
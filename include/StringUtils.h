@@ -1,4 +1,5 @@
 #pragma once
+#include <cinttypes>
 #include <string>
 #include <vector>
 
@@ -10,6 +11,33 @@ namespace onut
     std::vector<std::string>    splitString(const std::string& in_string, char in_delimiter);
     std::vector<std::string>    splitString(const std::string& in_string, const std::string& in_delimiters);
 
+    enum class eParseError
+    {
+        NONE,
+        EXPECTED_NUMBER,        // Nothing, or not a digit, where a number should be
+        UNEXPECTED_CHARACTER,   // After a number, something else than whitespace or the delimiter
+        OUT_OF_RANGE,           // Doesn't fit the type
+        TOO_MANY_NUMBERS        // More than the capacity
+    };
+
+    struct sParseResult
+    {
+        eParseError error = eParseError::NONE;
+        size_t      count = 0;      // Numbers written
+        size_t      position = 0;   // Of the error, from the start
+        int         line = 0;       // Of the error, from 1
+        int         column = 0;     // Of the error, from 1
+    };
+
+    /**
+    Parse delimited integers, like Tiled's csv layers, in one pass and without allocating.
+    Spaces, tabs and line breaks can be around the numbers. Nothing but whitespace gives no numbers.
+    Stops at the first error, with what was parsed before it written.
+    @param pOut capacity numbers
+    */
+    sParseResult                parseIntList(const char* pStr, size_t length, uint32_t* pOut, size_t capacity, char delimiter = ',');
+    sParseResult                parseIntList(const char* pStr, size_t length, int32_t* pOut, size_t capacity, char delimiter = ',');
+
     template<bool TuseAssert = true>
     std::string                 findFile(const std::string& name, const std::string& lookIn = ".", bool deepSearch = true);
     std::string                 getPath(const std::string& filename);
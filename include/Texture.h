@@ -9,6 +9,8 @@ using namespace DirectX::SimpleMath;
 
 namespace onut
 {
+    class RecordingRenderBackend;
+
     class Texture
     {
     public:
@@ -29,6 +31,12 @@ namespace onut
         static Texture* createFromFileData(const unsigned char* in_pData, uint32_t in_size, bool in_generateMipmaps = true);
         static Texture* createFromData(const sSize& size, const unsigned char* in_pData, bool in_generateMipmaps = true);
 
+        /**
+        Create from a mip chain already laid out by onut::getMipLevels. Use it to build the mips on a worker thread,
+        then only do the upload on the main thread.
+        */
+        static Texture* createFromMipChain(const sSize& size, const unsigned char* in_pMipChain, uint32_t in_levelCount);
+
         void setData(const uint8_t *in_pData);
 
         Texture() {}
@@ -55,6 +63,8 @@ namespace onut
 #endif
 
     private:
+        friend class RecordingRenderBackend;
+
 #ifdef EASY_GRAPHIX
         EGTexture                   m_pTextureView = 0;
 #else
@@ -62,7 +72,7 @@ namespace onut
         ID3D11ShaderResourceView*   m_pTextureView = nullptr;
         ID3D11RenderTargetView*     m_pRenderTargetView = nullptr;
 #endif
-        sSize                       m_size;
+        sSize                       m_size = {0, 0};
     };
 }
 
@@ -0,0 +1,88 @@
+#pragma once
+#include "RectPacker.h"
+#include "SimpleMath.h"
+#include "Texture.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace DirectX::SimpleMath;
+
+namespace onut
+{
+    /**
+    Sub rectangle of an atlas page. Pass it to SpriteBatch's drawRectWithUVs or drawSpriteWithUVs
+    */
+    struct AtlasRegion
+    {
+        Texture* pTexture = nullptr;
+        Rect rect; // In pixels, inside the page
+        Vector4 uvs = {0, 0, 1, 1};
+
+        /**
+        Convert UVs relative to the original image into page UVs
+        */
+        Vector4 remap(const Vector4& localUVs) const
+        {
+            return{
+                uvs.x + localUVs.x * (uvs.z - uvs.x),
+                uvs.y + localUVs.y * (uvs.w - uvs.y),
+                uvs.x + localUVs.z * (uvs.z - uvs.x),
+                uvs.y + localUVs.w * (uvs.w - uvs.y)};
+        }
+    };
+
+    /**
+    Packs many small images into a few large pages at runtime, so sprites using them can share batches.
+    Add every image, then call build() once.
+    */
+    class TextureAtlas
+    {
+    public:
+        /**
+        @param pageSize Width and height of each page
+        @param padding Pixels around each image. The border pixels are extruded in it so bilinear filtering doesn't bleed
+        */
+        TextureAtlas(uint32_t pageSize = 2048, uint32_t padding = 1);
+        virtual ~TextureAtlas();
+
+        /**
+        Queue a png file
+        */
+        void add(const std::string& name, const std::string& filename);
+
+        /**
+        Queue premultiplied RGBA8 pixels. They are copied
+        */
+        void add(const std::string& name, uint32_t width, uint32_t height, const uint8_t* pRGBA);
+
+        /**
+        Pack all queued images and create the page textures. Images bigger than a page are ignored.
+        Can be called again after adding more images, all pages are rebuilt.
+        */
+        void build(bool generateMipmaps = false);
+
+        const AtlasRegion* getRegion(const std::string& name) const;
+        size_t getPageCount() const { return m_pages.size(); }
+        Texture* getPage(size_t index) const { return m_pages[index]; }
+
+    private:
+        struct sImage
+        {
+            uint32_t width;
+            uint32_t height;
+            std::vector<uint8_t> pixels;
+        };
+
+        void clearPages();
+
+        uint32_t m_pageSize;
+        uint32_t m_padding;
+        std::unordered_map<std::string, sImage> m_images;
+        std::unordered_map<std::string, AtlasRegion> m_regions;
+        std::vector<Texture*> m_pages;
+    };
+}
+
+using OAtlasRegion = onut::AtlasRegion;
+using OTextureAtlas = onut::TextureAtlas;
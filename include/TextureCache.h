@@ -0,0 +1,51 @@
+#pragma once
+#include "MappedFile.h"
+
+#include <cinttypes>
+#include <memory>
+#include <string>
+
+namespace onut
+{
+    /**
+    On disk cache of decoded textures. Each entry holds the premultiplied RGBA8 pixels with their mip chain,
+    laid out by onut::getMipLevels, in a raw file that is memory mapped back on load.
+    Entries are keyed by the source path, and are stale once the source size or modified time, to the OS's finest
+    resolution, changes.
+    */
+    class TextureCache final
+    {
+    public:
+        struct sEntry
+        {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint32_t levelCount = 0;
+            const uint8_t* pMipChain = nullptr;
+            std::unique_ptr<MappedFile> pFile; // Keeps pMipChain mapped
+        };
+
+        TextureCache(const std::string& directory);
+
+        const std::string& getDirectory() const { return m_directory; }
+
+        /**
+        Map the cached pixels of a source image
+        @param filename Source image, as passed to Texture::createFromFile
+        @param withMipmaps The entry needs the full mip chain
+        @return false if there is no entry, or it is stale
+        */
+        bool find(const std::string& filename, bool withMipmaps, sEntry& entry) const;
+
+        /**
+        Write or replace the entry of a source image. The file is written aside and moved over the old one,
+        so a reader never sees a half written or missing entry.
+        */
+        bool store(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* pMipChain, uint32_t levelCount) const;
+
+        std::string getEntryFilename(const std::string& filename) const;
+
+    private:
+        std::string m_directory;
+    };
+}
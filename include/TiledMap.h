@@ -1,17 +1,41 @@
 #pragma once
 #include <string>
 #include "ContentManager.h"
+#include "ImageUtils.h"
+#include "SpriteCommandList.h"
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 extern onut::ContentManager<>* OContentManager;
 
 namespace onut
 {
+    class MappedFile;
+    class SpriteBatch;
     class Texture;
 
     class TiledMap
     {
     public:
+        /**
+        Tiles per side of the chunks layers are drawn by. Each chunk keeps its vertices, grouped by tileset
+        */
+        static const int CHUNK_SIZE = 16;
+
+        /**
+        Tiles per side of the regions streamed maps are loaded by. A multiple of CHUNK_SIZE
+        */
+        static const int REGION_SIZE = 64;
+
+        /**
+        Flips Tiled keeps in the top bits of the gids, as getTileId() returns them. The diagonal one is done first
+        */
+        static const uint32_t FLIPPED_HORIZONTALLY = 0x80000000;
+        static const uint32_t FLIPPED_VERTICALLY = 0x40000000;
+        static const uint32_t FLIPPED_DIAGONALLY = 0x20000000;
+        static const uint32_t FLIP_FLAGS = 0xE0000000;
+
         struct sLayer
         {
             virtual ~sLayer();
@@ -24,7 +48,15 @@ namespace onut
             virtual ~sTileLayer();
             int width;
             int height;
-            uint32_t *tileIds = nullptr;
+            uint32_t *tileIds = nullptr; // nullptr in streamed maps, see getTileId()
+        };
+
+        static const uint32_t NO_PROPERTY = 0xFFFFFFFF;
+
+        struct sProperty
+        {
+            uint32_t key; // See getPropertyKey()
+            std::string value;
         };
 
         struct sObject
@@ -34,7 +66,12 @@ namespace onut
             uint32_t id;
             std::string name;
             std::string type;
-            std::unordered_map<std::string, std::string> properties;
+            std::vector<sProperty> properties; // Sorted by key
+
+            /**
+            nullptr if the object doesn't have it
+            */
+            const std::string *getProperty(uint32_t key) const;
         };
 
         struct sObjectLayer : public sLayer
@@ -44,15 +81,43 @@ namespace onut
             sObject *pObjects = nullptr;
         };
 
-        TiledMap(const std::string &map, onut::ContentManager<> *pContentManager = OContentManager);
+        /**
+        @param map A .tmx, or a map made by compile(). Compiled maps are memory mapped and their tiles used in place.
+                   Streamed ones only load their regions around the focus, see setStreamingFocus()
+        @param pContentManager Loads the tileset textures. nullptr to load the map without them
+        @param pBackend Backend the chunks will be drawn with. nullptr for the renderer's device
+        */
+        TiledMap(const std::string &map, onut::ContentManager<> *pContentManager = OContentManager, IRenderBackend *pBackend = nullptr);
         virtual ~TiledMap();
 
+        /**
+        Offline, compile a .tmx into a binary map that loads without parsing anything. Tiles are already resolved,
+        layers are aligned arrays, and object strings are interned. Tileset images need their size in the .tmx
+        @param isStreamed Store the tiles by region, at the end of the file, for maps too big to keep in memory
+        */
+        static bool compile(const std::string &tmx, const std::string &compiled, bool isStreamed = false);
+
+        /**
+        Write the map, with its current tiles, in the compiled format. Not for streamed maps.
+        The file is replaced in one step, even the one this map was loaded from
+        @return false if it couldn't be written. The old file, if any, is left as is
+        */
+        bool save(const std::string &filename, bool isStreamed = false) const;
+
         const Matrix &getTransform() const { return m_transform; }
         void setTransform(const Matrix &transform) { m_transform = transform; }
 
         int getWidth() const { return m_width; }
         int getHeight() const { return m_height; }
 
+        /**
+        Sprite batch the layers are drawn with. OSB by default
+        */
+        void setSpriteBatch(SpriteBatch *pSpriteBatch) { m_pSpriteBatch = pSpriteBatch; }
+
+        /**
+        Draw the chunks touching rect, in tiles. Chunks are drawn whole
+        */
         void render(const RECT &rect);
         void renderLayer(const RECT &rect, int index);
         void renderLayer(const RECT &rect, const std::string &name);
@@ -62,38 +127,182 @@ namespace onut
         sLayer *getLayer(int index) const { return m_layers[index]; }
         sLayer *getLayer(const std::string &name) const;
 
+        /**
+        Change a tile. Only its chunk is built again, the next time it is drawn
+        */
+        void setTileId(sTileLayer *pLayer, int x, int y, uint32_t tileId);
+
+        /**
+        0 where the region isn't loaded. In streamed maps, changes are lost when their region is unloaded
+        */
+        uint32_t getTileId(sTileLayer *pLayer, int x, int y) const;
+
+        bool isStreamed() const { return m_pStreaming != nullptr; }
+
+        /**
+        Streamed maps. Regions within radius of the focus are loaded in the background, nearest first,
+        and the others unloaded. Only resident regions are drawn.
+        @param focus In tiles
+        @param radius In regions, around the focus one
+        */
+        void setStreamingFocus(const Vector2 &focus, int radius = 1);
+
+        /**
+        Bytes of tiles loaded and being loaded never go over this, counting the vertices their chunks
+        can be built with. Far regions are left out first
+        */
+        void setStreamingMemoryCap(size_t bytes);
+
+        /**
+        Install the regions loaded since the last call, unload the ones out of focus and start loading
+        the new ones. Once per frame
+        */
+        void updateStreaming();
+
+        /**
+        Wait for the regions being loaded and install them. For loading screens
+        */
+        void finishStreaming();
+
+        bool isRegionResident(int regionX, int regionY) const;
+        size_t getResidentMemory() const;
+
+        /**
+        Key of a property name, shared by all the objects of the map. NO_PROPERTY if none has it
+        */
+        uint32_t getPropertyKey(const std::string &name) const;
+        const std::string &getPropertyName(uint32_t key) const { return m_propertyKeys[key]; }
+
+        /**
+        Objects touching a rect, in pixels. They are indexed in a grid when the map loads, so only the
+        objects near the rect are tested. Appended to result, each once, in no particular order
+        */
+        void getObjectsInRect(sObjectLayer *pLayer, const Rect &rect, std::vector<sObject*> &result) const;
+        void getObjectsAt(sObjectLayer *pLayer, const Vector2 &point, std::vector<sObject*> &result) const;
+        void getObjectsInRadius(sObjectLayer *pLayer, const Vector2 &center, float radius, std::vector<sObject*> &result) const;
+
+        /**
+        Index the objects again, after moving, resizing, adding or removing some
+        */
+        void updateObjectIndex(sObjectLayer *pLayer);
+
+        /**
+        Minimap of one pixel per tile, made on the CPU without a renderer. Pixels are the average color of their
+        tiles, with the layers blended over one another, premultiplied. Tile colors are computed from the tileset
+        images the first time, which have to be pngs. Rows are split between threads.
+        Streamed maps only show their resident regions.
+        @param pRGBA getWidth() * getHeight() * 4 bytes
+        @param path Force a code path. Mainly for tests and benchmarks
+        */
+        void buildMinimap(uint8_t *pRGBA, eSimdPath path = eSimdPath::AUTO);
+
+        /**
+        Without EASY_GRAPHIX, a texture of buildMinimap(). Updated on each call
+        */
         onut::Texture *getMinimap();
 
     private:
+        // Past this many chunks in view, tiles are drawn from their gids without building the chunks
+        static const int MAX_CACHED_CHUNK_VIEW = 512;
+
         struct sTileSet
         {
             int firstId;
             int tileWidth;
             int tileHeight;
+            int imageWidth;
+            int imageHeight;
             onut::Texture *pTexture;
             std::string name;
+            std::string image;
+            bool hasColors = false; // In m_tileColors
         };
 
+        /**
+        One per gid, shared by the layers. Cells only keep their gid
+        */
         struct sTile
         {
             sTileSet *pTileset = nullptr;
-            Rect rect;
             Vector4 UVs;
         };
 
+        struct sChunk
+        {
+            sChunk(IRenderBackend *pBackend) : sprites(pBackend) {}
+            SpriteCommandList sprites;
+            bool isDirty = true;
+        };
+
         struct sTileLayerInternal : public sTileLayer
         {
             virtual ~sTileLayerInternal();
-            sTile *tiles = nullptr;
+            bool isMapped = false; // tileIds point in the compiled file
+            int chunkCountX = 0;
+            int chunkCountY = 0;
+            std::vector<sChunk> chunks;
+
+            // Streamed maps. REGION_SIZE * REGION_SIZE gids each, nullptr when not resident
+            int regionCountX = 0;
+            int regionCountY = 0;
+            uint64_t regionsOffset = 0;
+            std::vector<uint32_t*> regions;
+        };
+
+        struct sObjectLayerInternal : public sObjectLayer
+        {
+            // Uniform grid over the objects. Cells list the objects touching them, one after the other
+            Vector2 gridOrigin;
+            Vector2 cellsPerPixel;
+            int cellCountX = 0;
+            int cellCountY = 0;
+            std::vector<uint32_t> cellStarts; // Into cellObjects, one more than there are cells
+            std::vector<uint32_t> cellObjects;
+            std::vector<Vector4> bounds; // Left, top, right, bottom of each object
+
+            // Clamped to the grid
+            int getCellX(float x) const;
+            int getCellY(float y) const;
         };
 
+        struct sStreaming;
+
+        void loadXML(const std::string &map, onut::ContentManager<> *pContentManager);
+        void loadCompiled(uint8_t *pData, size_t size, const std::string &map, onut::ContentManager<> *pContentManager);
+        void loadStreamed(const std::string &map, onut::ContentManager<> *pContentManager);
+        void releaseFile() const;
+        void loadRegion(int index);
+        void installRegion(int index, uint32_t **pTiles);
+        void unloadRegion(int index);
+        uint32_t *getTileRow(sTileLayerInternal *pLayer, int x, int y) const;
+        void computeTileColors(sTileSet &tileSet);
+        uint32_t internPropertyKey(const std::string &name);
+        void setProperty(sObject &object, const std::string &name, const std::string &value);
+        void queryObjects(sObjectLayer *pLayer, const Vector4 &box, const Vector2 *pCenter, float radius, std::vector<sObject*> &result) const;
+        void loadTexture(sTileSet &tileSet, const std::string &map, onut::ContentManager<> *pContentManager);
+        void resolveTiles();
+        void buildChunk(sTileLayerInternal *pLayer, int chunkX, int chunkY);
+        void addChunkTiles(sTileLayerInternal *pLayer, int chunkX, int chunkY, SpriteCommandList &sprites);
+        void drawChunkTiles(SpriteBatch *pSpriteBatch, sTileLayerInternal *pLayer, int chunkX, int chunkY);
+
         int m_width = 0;
         int m_height = 0;
         int m_layerCount = 0;
         int m_tilesetCount = 0;
         sLayer **m_layers = nullptr;
         sTileSet *m_tileSets = nullptr;
+        std::vector<sTile> m_tiles; // Indexed by gid
+        std::vector<uint32_t> m_tileColors; // Average of each tile, premultiplied RGBA. Indexed by gid
+        std::string m_filename;
+        std::vector<std::string> m_propertyKeys;
+        std::unordered_map<std::string, uint32_t> m_propertyKeyIds;
         Matrix m_transform = Matrix::Identity;
         onut::Texture *pMinimap = nullptr;
+        IRenderBackend *m_pBackend = nullptr;
+        mutable std::unique_ptr<MappedFile> m_pFile; // Compiled maps only. Released by save() to replace it
+        std::unique_ptr<sStreaming> m_pStreaming; // Streamed maps only
+        SpriteBatch *m_pSpriteBatch = nullptr;
+        std::vector<sRenderVertex> m_chunkVertices; // Tiles of one tileset while building a chunk
+        std::unique_ptr<SpriteCommandList> m_pZoomedOutSprites; // Chunk drawn without keeping its vertices. Made on first use
     };
 };
@@ -385,6 +385,8 @@ namespace onut
         std::function<void(UIControl*, const sUIRect&, const sUITextComponent&)> drawText = 
             [](UIControl*, const sUIRect&, const sUITextComponent&){};
 
+        /** Called when clipping children. The default one in onut clips OSB's sprites with setClip(), not the scissor,
+            so anything else a draw callback draws (OPB primitives, other batches) isn't clipped */
         std::function<void(bool, const sUIRect&)> onClipping =
             [](bool enableClipping, const sUIRect& rect){};
 
@@ -2,6 +2,7 @@
 #include <cinttypes>
 #include <string>
 #include <vector>
+#include "SimdPath.h"
 
 namespace onut
 {
@@ -10,4 +11,38 @@ namespace onut
     bool validateEmail(const std::string& email);
     std::string base64_encode(uint8_t const* buf, unsigned int bufLen);
     std::vector<uint8_t> base64_decode(std::string const&);
+
+    /**
+    Decode into decoded, reusing its capacity. Empty if encoded isn't valid base64
+    */
+    void base64_decode(const char* encoded, size_t length, std::vector<uint8_t>& decoded);
+
+    /**
+    Characters base64_encode writes for size bytes, padding included
+    */
+    size_t base64_encoded_size(size_t size);
+
+    /**
+    Most bytes base64_decode can write for length characters
+    */
+    size_t base64_decoded_size(size_t length);
+
+    /**
+    Encode into a buffer of the caller, without null terminator.
+    Every path is bit-exact with the scalar one. SSE2 runs SSSE3 kernels, when the CPU has it
+    @param pEncoded base64_encoded_size(size) characters
+    @param path Force a code path. Mainly for tests and benchmarks
+    */
+    void base64_encode(const uint8_t* pData, size_t size, char* pEncoded, eSimdPath path = eSimdPath::AUTO);
+
+    /**
+    Decode into a buffer of the caller. Spaces, tabs and line breaks are skipped anywhere, like the ones
+    Tiled writes around its layers. The padding is optional, but nothing else than whitespace can follow it.
+    Vector paths need 32 bytes of room past the data to decode its end with them, base64_decoded_size() is enough.
+    Every path is bit-exact with the scalar one. SSE2 runs SSSE3 kernels, when the CPU has it
+    @param decodedSize Bytes written, also when it fails
+    @param path Force a code path. Mainly for tests and benchmarks
+    @return false on characters that aren't base64, bad padding, or if capacity is too small
+    */
+    bool base64_decode(const char* encoded, size_t length, uint8_t* pDecoded, size_t capacity, size_t& decodedSize, eSimdPath path = eSimdPath::AUTO);
 };
@@ -4,8 +4,10 @@
 #include "ContentManager.h"
 #include "crypto.h"
 #include "DefineHelpers.h"
+#include "DynamicBufferRing.h"
 #include "EventManager.h"
 #include "http.h"
+#include "ImageUtils.h"
 #include "Input.h"
 #include "GamePad.h"
 #include "List.h"
@@ -13,14 +15,22 @@
 #include "onutUI.h"
 #include "ParticleSystemManager.h"
 #include "PrimitiveBatch.h"
+#include "RecordingRenderBackend.h"
+#include "RectPacker.h"
 #include "RectUtils.h"
+#include "RenderBackend.h"
+#include "RenderStats.h"
 #include "Renderer.h"
 #include "RTS.h"
 #include "Settings.h"
 #include "Sound.h"
 #include "SpriteBatch.h"
+#include "SpriteCommandList.h"
 #include "StateManager.h"
+#include "StaticSpriteBatch.h"
 #include "Synchronous.h"
+#include "TextureAtlas.h"
+#include "TextureCache.h"
 #include "TiledMap.h"
 #include "TimingUtils.h"
 #include "UINodeNav.h"
@@ -31,6 +41,7 @@ extern onut::Renderer*                  ORenderer;
 extern onut::SpriteBatch*               OSpriteBatch;
 extern onut::PrimitiveBatch*            OPrimitiveBatch;
 extern onut::Settings*                  OSettings;
+extern onut::TextureCache*              OTextureCache;
 extern onut::EventManager*              OEvent;
 extern onut::ParticleSystemManager<>*   OParticles;
 extern Vector2                          OMousePos;
@@ -84,6 +95,11 @@ namespace onut
     Debug tool to draw a palette and show it's index in it
     */
     void drawPal(const OPal& pal, OFont* pFont = nullptr);
+
+    /**
+    Debug tool to show the counters of the last frame, see Renderer::getStats()
+    */
+    void drawRenderStats(OFont* pFont, const Vector2& position = Vector2::Zero);
 }
 
 #define ORun onut::run
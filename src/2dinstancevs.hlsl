@@ -0,0 +1,40 @@
+cbuffer MatrixBuffer : register(b0)
+{
+    matrix viewProj2D;
+}
+
+struct VSInput
+{
+    float2 position : POSITION;
+    float2 halfSize : SIZE;
+    float4 uvs : TEXCOORD;
+    float rotation : ROTATION;
+    float4 color : COLOR;
+    uint vertexId : SV_VertexID;
+};
+
+struct VSOutput
+{
+    float4 position : SV_POSITION;
+    float2 texCoord : TEXCOORD;
+    float4 color : COLOR;
+};
+
+VSOutput main(VSInput input)
+{
+    VSOutput output;
+
+    // Same corners as the SpriteBatch quads: top left, bottom left, bottom right, top right
+    float2 corner = float2(input.vertexId >= 2 ? 1 : -1, (input.vertexId == 1 || input.vertexId == 2) ? 1 : -1);
+    float sinTheta, cosTheta;
+    sincos(input.rotation, sinTheta, cosTheta);
+    float2 right = float2(cosTheta, sinTheta) * input.halfSize.x;
+    float2 down = float2(-sinTheta, cosTheta) * input.halfSize.y;
+    float2 position = input.position + right * corner.x + down * corner.y;
+
+    output.position = mul(float4(position, 0, 1), viewProj2D);
+    output.texCoord = float2(corner.x < 0 ? input.uvs.x : input.uvs.z, corner.y < 0 ? input.uvs.y : input.uvs.w);
+    output.color = input.color;
+
+    return output;
+}
@@ -0,0 +1,354 @@
+#include "DeviceRenderBackend.h"
+#include "onut.h"
+
+#include <algorithm>
+#include <vector>
+
+#ifndef EASY_GRAPHIX
+#include <d3dcompiler.h>
+#include "_2dinstancevs.hlsl.h"
+#endif /* !EASY_GRAPHIX */
+
+namespace onut
+{
+    DeviceRenderBackend::DeviceRenderBackend(uint32_t spriteCapacity)
+#ifndef EASY_GRAPHIX
+        : m_spriteRing(std::max(spriteCapacity, 1u) * 4)
+        , m_packedSpriteRing(std::max(spriteCapacity, 1u))
+        // A batch reserves room for its max, a quarter of the ring keeps wraps rare
+        , m_maxSpriteCount(std::min(MAX_INDEXED_SPRITE_COUNT, std::max(spriteCapacity / 4, 1u)))
+#else /* EASY_GRAPHIX */
+        : m_maxSpriteCount(MAX_SPRITE_COUNT)
+#endif /* !EASY_GRAPHIX */
+    {
+        // Create a white texture for rendering "without" texture
+        unsigned char white[4] = {255, 255, 255, 255};
+        m_pTexWhite = Texture::createFromData({1, 1}, white, false);
+
+#ifndef EASY_GRAPHIX
+        auto pDevice = ORenderer->getDevice();
+
+        std::vector<unsigned short> indices(m_maxSpriteCount * 6);
+        for (unsigned int i = 0; i < m_maxSpriteCount; ++i)
+        {
+            indices[i * 6 + 0] = i * 4 + 0;
+            indices[i * 6 + 1] = i * 4 + 1;
+            indices[i * 6 + 2] = i * 4 + 2;
+            indices[i * 6 + 3] = i * 4 + 2;
+            indices[i * 6 + 4] = i * 4 + 3;
+            indices[i * 6 + 5] = i * 4 + 0;
+        }
+
+        // Set up the description of the sprites vertex buffer.
+        D3D11_BUFFER_DESC vertexBufferDesc;
+        vertexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+        vertexBufferDesc.ByteWidth = sizeof(sRenderVertex) * m_spriteRing.getCapacity();
+        vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        vertexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        vertexBufferDesc.MiscFlags = 0;
+        vertexBufferDesc.StructureByteStride = 0;
+
+        // Dynamic, it is always written before being drawn
+        auto ret = pDevice->CreateBuffer(&vertexBufferDesc, nullptr, &m_pSpriteVertexBuffer);
+        assert(ret == S_OK);
+
+        // The primitives one is the same, with its own size
+        vertexBufferDesc.ByteWidth = sizeof(sRenderVertex) * MAX_PRIMITIVE_VERTEX_COUNT;
+        ret = pDevice->CreateBuffer(&vertexBufferDesc, nullptr, &m_pPrimitiveVertexBuffer);
+        assert(ret == S_OK);
+
+        // Set up the description of the static index buffer.
+        D3D11_BUFFER_DESC indexBufferDesc;
+        indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+        indexBufferDesc.ByteWidth = sizeof(unsigned short) * 6 * m_maxSpriteCount;
+        indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+        indexBufferDesc.CPUAccessFlags = 0;
+        indexBufferDesc.MiscFlags = 0;
+        indexBufferDesc.StructureByteStride = 0;
+
+        // Give the subresource structure a pointer to the index data.
+        D3D11_SUBRESOURCE_DATA indexData;
+        indexData.pSysMem = indices.data();
+        indexData.SysMemPitch = 0;
+        indexData.SysMemSlicePitch = 0;
+
+        ret = pDevice->CreateBuffer(&indexBufferDesc, &indexData, &m_pSpriteIndexBuffer);
+        assert(ret == S_OK);
+
+        ret = pDevice->CreateBlendState(&(D3D11_BLEND_DESC{
+            FALSE,
+            FALSE,
+            {{
+                    TRUE,
+                    D3D11_BLEND_ONE,
+                    D3D11_BLEND_ZERO,
+                    D3D11_BLEND_OP_ADD,
+                    D3D11_BLEND_ONE,
+                    D3D11_BLEND_ZERO,
+                    D3D11_BLEND_OP_ADD,
+                    D3D10_COLOR_WRITE_ENABLE_ALL
+                }, {0}, {0}, {0}, {0}, {0}, {0}, {0}}
+        }), &m_pForceWriteBlend);
+        assert(ret == S_OK);
+
+        createPackedSpriteShader();
+        if (m_maxPackedSpriteCount)
+        {
+            vertexBufferDesc.ByteWidth = sizeof(sPackedSprite) * m_packedSpriteRing.getCapacity();
+            ret = pDevice->CreateBuffer(&vertexBufferDesc, nullptr, &m_pPackedSpriteBuffer);
+            assert(ret == S_OK);
+        }
+#endif /* !EASY_GRAPHIX */
+    }
+
+    DeviceRenderBackend::~DeviceRenderBackend()
+    {
+#ifndef EASY_GRAPHIX
+        if (m_pPackedSpriteBuffer) m_pPackedSpriteBuffer->Release();
+        if (m_pPackedSpriteInputLayout) m_pPackedSpriteInputLayout->Release();
+        if (m_pPackedSpriteVertexShader) m_pPackedSpriteVertexShader->Release();
+        if (m_pForceWriteBlend) m_pForceWriteBlend->Release();
+        if (m_pSpriteVertexBuffer) m_pSpriteVertexBuffer->Release();
+        if (m_pSpriteIndexBuffer) m_pSpriteIndexBuffer->Release();
+        if (m_pPrimitiveVertexBuffer) m_pPrimitiveVertexBuffer->Release();
+#endif /* !EASY_GRAPHIX */
+        delete m_pTexWhite;
+    }
+
+#ifdef EASY_GRAPHIX
+    void DeviceRenderBackend::emitVertices(const sRenderVertex* pVertices, uint32_t vertexCount)
+    {
+        for (uint32_t i = 0; i < vertexCount; ++i)
+        {
+            auto& vertex = pVertices[i];
+            egColor4(vertex.color.x, vertex.color.y, vertex.color.z, vertex.color.w);
+            egTexCoord(vertex.texCoord.x, vertex.texCoord.y);
+            egPosition2(vertex.position.x, vertex.position.y);
+        }
+    }
+#else /* EASY_GRAPHIX */
+    sRenderVertex* DeviceRenderBackend::mapSprites()
+    {
+        DynamicBufferRing::eMapMode mapMode;
+        m_spriteBaseVertex = m_spriteRing.reserve(m_maxSpriteCount * 4, mapMode);
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        ORenderer->getDeviceContext()->Map(m_pSpriteVertexBuffer, 0,
+                                           (mapMode == DynamicBufferRing::eMapMode::DISCARD) ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE,
+                                           0, &mapped);
+        return static_cast<sRenderVertex*>(mapped.pData) + m_spriteBaseVertex;
+    }
+
+    void DeviceRenderBackend::unmapSprites(uint32_t spriteCount)
+    {
+        ORenderer->getDeviceContext()->Unmap(m_pSpriteVertexBuffer, 0);
+        m_spriteRing.commit(spriteCount * 4);
+    }
+
+    void DeviceRenderBackend::createPackedSpriteShader()
+    {
+        // Compiled at runtime and d3dcompiler is loaded only for it, without it sprites are drawn as quads
+        auto hCompiler = LoadLibrary(D3DCOMPILER_DLL);
+        if (!hCompiler) return;
+
+        auto pCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(hCompiler, "D3DCompile"));
+        ID3DBlob* pByteCode = nullptr;
+        if (pCompile && pCompile(_2dinstancevs_hlsl, sizeof(_2dinstancevs_hlsl) - 1, "2dinstancevs.hlsl", nullptr, nullptr,
+                                 "main", "vs_4_0", D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &pByteCode, nullptr) == S_OK)
+        {
+            auto pDevice = ORenderer->getDevice();
+
+            // One sPackedSprite per instance
+            D3D11_INPUT_ELEMENT_DESC layout[] = {
+                {"POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+                {"SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+                {"TEXCOORD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+                {"ROTATION", 0, DXGI_FORMAT_R32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+                {"COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+            };
+            if (pDevice->CreateVertexShader(pByteCode->GetBufferPointer(), pByteCode->GetBufferSize(), nullptr, &m_pPackedSpriteVertexShader) == S_OK &&
+                pDevice->CreateInputLayout(layout, 5, pByteCode->GetBufferPointer(), pByteCode->GetBufferSize(), &m_pPackedSpriteInputLayout) == S_OK)
+            {
+                m_maxPackedSpriteCount = std::max(m_packedSpriteRing.getCapacity() / 4, 1u);
+            }
+            pByteCode->Release();
+        }
+
+        // The blob belongs to the dll, released first
+        FreeLibrary(hCompiler);
+    }
+
+    sPackedSprite* DeviceRenderBackend::mapPackedSprites(uint32_t spriteCount)
+    {
+        DynamicBufferRing::eMapMode mapMode;
+        m_packedSpriteBase = m_packedSpriteRing.reserve(spriteCount, mapMode);
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        ORenderer->getDeviceContext()->Map(m_pPackedSpriteBuffer, 0,
+                                           (mapMode == DynamicBufferRing::eMapMode::DISCARD) ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE,
+                                           0, &mapped);
+        return static_cast<sPackedSprite*>(mapped.pData) + m_packedSpriteBase;
+    }
+
+    void DeviceRenderBackend::drawPackedSprites(Texture* pTexture, uint32_t spriteCount)
+    {
+        auto pDeviceContext = ORenderer->getDeviceContext();
+
+        pDeviceContext->Unmap(m_pPackedSpriteBuffer, 0);
+        m_packedSpriteRing.commit(spriteCount);
+
+        // Swap to the instanced shader, then back to the quads one
+        ID3D11InputLayout* pInputLayout = nullptr;
+        ID3D11VertexShader* pVertexShader = nullptr;
+        pDeviceContext->IAGetInputLayout(&pInputLayout);
+        pDeviceContext->VSGetShader(&pVertexShader, nullptr, nullptr);
+        pDeviceContext->IASetInputLayout(m_pPackedSpriteInputLayout);
+        pDeviceContext->VSSetShader(m_pPackedSpriteVertexShader, nullptr, 0);
+
+        // The first 6 indices are the ones of a single quad
+        auto textureView = pTexture->getResource();
+        pDeviceContext->PSSetShaderResources(0, 1, &textureView);
+        pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        pDeviceContext->IASetVertexBuffers(0, 1, &m_pPackedSpriteBuffer, &m_packedStride, &m_offset);
+        pDeviceContext->IASetIndexBuffer(m_pSpriteIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+        pDeviceContext->DrawIndexedInstanced(6, spriteCount, 0, 0, m_packedSpriteBase);
+
+        pDeviceContext->IASetInputLayout(pInputLayout);
+        pDeviceContext->VSSetShader(pVertexShader, nullptr, 0);
+        if (pInputLayout) pInputLayout->Release();
+        if (pVertexShader) pVertexShader->Release();
+    }
+#endif /* !EASY_GRAPHIX */
+
+    sRenderVertex* DeviceRenderBackend::beginSprites(bool forceWrite)
+    {
+        ORenderer->setupFor2D();
+        m_forceWrite = forceWrite;
+#ifdef EASY_GRAPHIX
+        return m_spriteVertices;
+#else /* EASY_GRAPHIX */
+        if (m_forceWrite)
+        {
+            ORenderer->getDeviceContext()->OMSetBlendState(m_pForceWriteBlend, NULL, 0xffffffff);
+        }
+        return mapSprites();
+#endif /* !EASY_GRAPHIX */
+    }
+
+    sRenderVertex* DeviceRenderBackend::drawSprites(Texture* pTexture, uint32_t spriteCount)
+    {
+#ifdef EASY_GRAPHIX
+        pTexture->bind();
+        egBegin(EG_QUADS);
+        emitVertices(m_spriteVertices, spriteCount * 4);
+        egEnd();
+        return m_spriteVertices;
+#else /* EASY_GRAPHIX */
+        auto pDeviceContext = ORenderer->getDeviceContext();
+
+        unmapSprites(spriteCount);
+
+        auto textureView = pTexture->getResource();
+        pDeviceContext->PSSetShaderResources(0, 1, &textureView);
+        pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+        pDeviceContext->IASetVertexBuffers(0, 1, &m_pSpriteVertexBuffer, &m_stride, &m_offset);
+        pDeviceContext->IASetIndexBuffer(m_pSpriteIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+        pDeviceContext->DrawIndexed(6 * spriteCount, 0, static_cast<INT>(m_spriteBaseVertex));
+
+        return mapSprites();
+#endif /* !EASY_GRAPHIX */
+    }
+
+    void DeviceRenderBackend::endSprites()
+    {
+#ifndef EASY_GRAPHIX
+        unmapSprites(0);
+        if (m_forceWrite)
+        {
+            ORenderer->resetState();
+        }
+#endif /* !EASY_GRAPHIX */
+    }
+
+    sRenderVertex* DeviceRenderBackend::beginPrimitives()
+    {
+        ORenderer->setupFor2D();
+#ifdef EASY_GRAPHIX
+        return m_primitiveVertices;
+#else /* EASY_GRAPHIX */
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        ORenderer->getDeviceContext()->Map(m_pPrimitiveVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+        return static_cast<sRenderVertex*>(mapped.pData);
+#endif /* !EASY_GRAPHIX */
+    }
+
+    sRenderVertex* DeviceRenderBackend::drawPrimitives(ePrimitiveType primitiveType, Texture* pTexture, uint32_t vertexCount)
+    {
+#ifdef EASY_GRAPHIX
+        pTexture->bind();
+        switch (primitiveType)
+        {
+            case ePrimitiveType::POINTS:
+                egBegin(EG_POINTS);
+                break;
+            case ePrimitiveType::LINES:
+                egBegin(EG_LINES);
+                break;
+            case ePrimitiveType::LINE_STRIP:
+                egBegin(EG_LINE_STRIP);
+                break;
+            case ePrimitiveType::TRIANGLES:
+                egBegin(EG_TRIANGLES);
+                break;
+        }
+        emitVertices(m_primitiveVertices, vertexCount);
+        egEnd();
+        return m_primitiveVertices;
+#else /* EASY_GRAPHIX */
+        auto pDeviceContext = ORenderer->getDeviceContext();
+
+        pDeviceContext->Unmap(m_pPrimitiveVertexBuffer, 0);
+
+        auto textureView = pTexture->getResource();
+        pDeviceContext->PSSetShaderResources(0, 1, &textureView);
+        switch (primitiveType)
+        {
+            case ePrimitiveType::POINTS:
+                pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+                break;
+            case ePrimitiveType::LINES:
+                pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
+                break;
+            case ePrimitiveType::LINE_STRIP:
+                pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP);
+                break;
+            case ePrimitiveType::TRIANGLES:
+                pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                break;
+        }
+        pDeviceContext->IASetVertexBuffers(0, 1, &m_pPrimitiveVertexBuffer, &m_stride, &m_offset);
+        pDeviceContext->Draw(vertexCount, 0);
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        pDeviceContext->Map(m_pPrimitiveVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+        return static_cast<sRenderVertex*>(mapped.pData);
+#endif /* !EASY_GRAPHIX */
+    }
+
+    void DeviceRenderBackend::endPrimitives()
+    {
+#ifndef EASY_GRAPHIX
+        ORenderer->getDeviceContext()->Unmap(m_pPrimitiveVertexBuffer, 0);
+#endif /* !EASY_GRAPHIX */
+    }
+
+    void DeviceRenderBackend::setScissor(bool enabled, const Rect& rect)
+    {
+        ORenderer->setScissor(enabled, rect);
+    }
+
+    RenderStats* DeviceRenderBackend::getStats()
+    {
+        return &ORenderer->getStats();
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "DynamicBufferRing.h"
+#include "RenderBackend.h"
+#include "Texture.h"
+
+namespace onut
+{
+    /**
+    Draws the batches with the renderer's device. Owned by the Renderer, see Renderer::getBackend()
+    */
+    class DeviceRenderBackend final : public IRenderBackend
+    {
+    public:
+        /**
+        @param spriteCapacity Sprites held by the vertex buffer before it wraps around
+        */
+        DeviceRenderBackend(uint32_t spriteCapacity);
+        virtual ~DeviceRenderBackend();
+
+        Texture* getWhiteTexture() override { return m_pTexWhite; }
+
+        uint32_t getMaxSpriteCount() const override { return m_maxSpriteCount; }
+        sRenderVertex* beginSprites(bool forceWrite) override;
+        sRenderVertex* drawSprites(Texture* pTexture, uint32_t spriteCount) override;
+        void endSprites() override;
+
+#ifndef EASY_GRAPHIX
+        uint32_t getMaxPackedSpriteCount() const override { return m_maxPackedSpriteCount; }
+        sPackedSprite* mapPackedSprites(uint32_t spriteCount) override;
+        void drawPackedSprites(Texture* pTexture, uint32_t spriteCount) override;
+#endif /* !EASY_GRAPHIX */
+
+        uint32_t getMaxPrimitiveVertexCount() const override { return MAX_PRIMITIVE_VERTEX_COUNT; }
+        sRenderVertex* beginPrimitives() override;
+        sRenderVertex* drawPrimitives(ePrimitiveType primitiveType, Texture* pTexture, uint32_t vertexCount) override;
+        void endPrimitives() override;
+
+        void setScissor(bool enabled, const Rect& rect) override;
+        RenderStats* getStats() override;
+
+    private:
+        static const int MAX_PRIMITIVE_VERTEX_COUNT = 12000;
+
+#ifndef EASY_GRAPHIX
+        // 16 bits indices, the ring offset goes in the base vertex
+        static const uint32_t MAX_INDEXED_SPRITE_COUNT = 16384;
+
+        sRenderVertex* mapSprites();
+        void unmapSprites(uint32_t spriteCount);
+        void createPackedSpriteShader();
+
+        DynamicBufferRing           m_spriteRing;
+        DynamicBufferRing           m_packedSpriteRing;
+        uint32_t                    m_spriteBaseVertex = 0;
+        uint32_t                    m_packedSpriteBase = 0;
+        uint32_t                    m_maxPackedSpriteCount = 0; // 0 when the shader couldn't be compiled
+        ID3D11Buffer*               m_pSpriteVertexBuffer = nullptr;
+        ID3D11Buffer*               m_pSpriteIndexBuffer = nullptr;
+        ID3D11Buffer*               m_pPrimitiveVertexBuffer = nullptr;
+        ID3D11BlendState*           m_pForceWriteBlend = nullptr;
+        ID3D11Buffer*               m_pPackedSpriteBuffer = nullptr;
+        ID3D11VertexShader*         m_pPackedSpriteVertexShader = nullptr;
+        ID3D11InputLayout*          m_pPackedSpriteInputLayout = nullptr;
+
+        static const unsigned int   m_stride = sizeof(sRenderVertex);
+        static const unsigned int   m_packedStride = sizeof(sPackedSprite);
+        static const unsigned int   m_offset = 0;
+#else
+        static const int MAX_SPRITE_COUNT = 2000;
+
+        static void emitVertices(const sRenderVertex* pVertices, uint32_t vertexCount);
+
+        sRenderVertex               m_spriteVertices[MAX_SPRITE_COUNT * 4];
+        sRenderVertex               m_primitiveVertices[MAX_PRIMITIVE_VERTEX_COUNT];
+#endif /* !EASY_GRAPHIX */
+
+        uint32_t                    m_maxSpriteCount;
+        Texture*                    m_pTexWhite = nullptr;
+        bool                        m_forceWrite = false;
+    };
+}
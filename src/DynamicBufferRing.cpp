@@ -0,0 +1,42 @@
+#include "DynamicBufferRing.h"
+
+#include <cassert>
+
+namespace onut
+{
+    DynamicBufferRing::DynamicBufferRing(uint32_t capacity)
+        : m_capacity(capacity)
+    {
+        assert(capacity > 0);
+    }
+
+    uint32_t DynamicBufferRing::reserve(uint32_t count, eMapMode& mapMode)
+    {
+        assert(count <= m_capacity); // Would never fit
+        assert(!m_reserved); // commit() the previous reservation first
+
+        mapMode = eMapMode::NO_OVERWRITE;
+        if (m_isFirstReserve)
+        {
+            // Nothing is known about the buffer content yet
+            m_isFirstReserve = false;
+            mapMode = eMapMode::DISCARD;
+        }
+        else if (m_offset + count > m_capacity)
+        {
+            m_offset = 0;
+            ++m_wrapCount;
+            mapMode = eMapMode::DISCARD;
+        }
+
+        m_reserved = count;
+        return m_offset;
+    }
+
+    void DynamicBufferRing::commit(uint32_t count)
+    {
+        assert(count <= m_reserved); // Wrote past the reservation
+        m_offset += count;
+        m_reserved = 0;
+    }
+}
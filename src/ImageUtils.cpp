@@ -0,0 +1,401 @@
+#include "ImageUtils.h"
+#include "LodePNG.h"
+#include "SimdHelpers.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace onut
+{
+    static eSimdPath resolveSimdPath(eSimdPath path)
+    {
+        if (path == eSimdPath::AUTO || !isSimdPathSupported(path))
+        {
+            return getBestSimdPath();
+        }
+        return path;
+    }
+
+    //--- Premultiplied alpha
+    //
+    // Every path computes (c * a + 127) / 255. The division is exact for
+    // v in [0, 255 * 255 + 127] with: v / 255 == (v + 1 + (v >> 8)) >> 8,
+    // which keeps everything in 16 bits lanes.
+
+    static void premultiplyAlphaScalar(uint8_t* pData, size_t pixelCount)
+    {
+        for (size_t i = 0; i < pixelCount; ++i, pData += 4)
+        {
+            uint32_t a = pData[3];
+            pData[0] = static_cast<uint8_t>((pData[0] * a + 127) / 255);
+            pData[1] = static_cast<uint8_t>((pData[1] * a + 127) / 255);
+            pData[2] = static_cast<uint8_t>((pData[2] * a + 127) / 255);
+        }
+    }
+
+#if defined(ONUT_SIMD_X86)
+    static inline __m128i premultiply8x16(__m128i colors, __m128i alphaLane)
+    {
+        // Broadcast alpha to its pixel's 4 lanes, and multiply alpha by 255 so it stays unchanged
+        auto alphas = _mm_shufflehi_epi16(_mm_shufflelo_epi16(colors, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        alphas = _mm_or_si128(_mm_andnot_si128(alphaLane, alphas), _mm_and_si128(alphaLane, _mm_set1_epi16(255)));
+        auto v = _mm_add_epi16(_mm_mullo_epi16(colors, alphas), _mm_set1_epi16(127));
+        v = _mm_add_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), _mm_set1_epi16(1));
+        return _mm_srli_epi16(v, 8);
+    }
+
+    static void premultiplyAlphaSSE2(uint8_t* pData, size_t pixelCount)
+    {
+        const auto zero = _mm_setzero_si128();
+        const auto alphaLane = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        size_t i = 0;
+        for (; i + 4 <= pixelCount; i += 4, pData += 16)
+        {
+            auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData));
+            auto lo = premultiply8x16(_mm_unpacklo_epi8(pixels, zero), alphaLane);
+            auto hi = premultiply8x16(_mm_unpackhi_epi8(pixels, zero), alphaLane);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pData), _mm_packus_epi16(lo, hi));
+        }
+        premultiplyAlphaScalar(pData, pixelCount - i);
+    }
+
+    ONUT_TARGET_AVX2 static void premultiplyAlphaAVX2(uint8_t* pData, size_t pixelCount)
+    {
+        // Same as SSE2, every operation used stays within 128 bits lanes
+        const auto zero = _mm256_setzero_si256();
+        const auto alphaLane = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+        const auto alphaMult = _mm256_set1_epi16(255);
+        const auto bias = _mm256_set1_epi16(127);
+        const auto one = _mm256_set1_epi16(1);
+        size_t i = 0;
+        for (; i + 8 <= pixelCount; i += 8, pData += 32)
+        {
+            auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pData));
+            __m256i halves[2] = {_mm256_unpacklo_epi8(pixels, zero), _mm256_unpackhi_epi8(pixels, zero)};
+            for (auto& colors : halves)
+            {
+                auto alphas = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(colors, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+                alphas = _mm256_blendv_epi8(alphas, alphaMult, alphaLane);
+                auto v = _mm256_add_epi16(_mm256_mullo_epi16(colors, alphas), bias);
+                v = _mm256_add_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), one);
+                colors = _mm256_srli_epi16(v, 8);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pData), _mm256_packus_epi16(halves[0], halves[1]));
+        }
+        premultiplyAlphaSSE2(pData, pixelCount - i);
+    }
+#endif
+
+#if defined(ONUT_SIMD_NEON)
+    static inline uint8x8_t premultiplyChannelNEON(uint8x8_t color, uint8x8_t alpha)
+    {
+        auto v = vaddq_u16(vmull_u8(color, alpha), vdupq_n_u16(127));
+        v = vaddq_u16(vaddq_u16(v, vshrq_n_u16(v, 8)), vdupq_n_u16(1));
+        return vshrn_n_u16(v, 8);
+    }
+
+    static void premultiplyAlphaNEON(uint8_t* pData, size_t pixelCount)
+    {
+        size_t i = 0;
+        for (; i + 8 <= pixelCount; i += 8, pData += 32)
+        {
+            auto pixels = vld4_u8(pData);
+            pixels.val[0] = premultiplyChannelNEON(pixels.val[0], pixels.val[3]);
+            pixels.val[1] = premultiplyChannelNEON(pixels.val[1], pixels.val[3]);
+            pixels.val[2] = premultiplyChannelNEON(pixels.val[2], pixels.val[3]);
+            vst4_u8(pData, pixels);
+        }
+        premultiplyAlphaScalar(pData, pixelCount - i);
+    }
+#endif
+
+    void premultiplyAlpha(uint8_t* pRGBA, size_t pixelCount, eSimdPath path)
+    {
+        switch (resolveSimdPath(path))
+        {
+#if defined(ONUT_SIMD_X86)
+            case eSimdPath::AVX2:
+                premultiplyAlphaAVX2(pRGBA, pixelCount);
+                break;
+            case eSimdPath::SSE2:
+                premultiplyAlphaSSE2(pRGBA, pixelCount);
+                break;
+#endif
+#if defined(ONUT_SIMD_NEON)
+            case eSimdPath::NEON:
+                premultiplyAlphaNEON(pRGBA, pixelCount);
+                break;
+#endif
+            default:
+                premultiplyAlphaScalar(pRGBA, pixelCount);
+                break;
+        }
+    }
+
+    //--- Mip chains
+
+    uint32_t getMipLevelCount(uint32_t width, uint32_t height)
+    {
+        uint32_t levelCount = 1;
+        auto biggest = std::max<>(width, height);
+        while (biggest > 1)
+        {
+            biggest /= 2;
+            ++levelCount;
+        }
+        return levelCount;
+    }
+
+    std::vector<sMipLevel> getMipLevels(uint32_t width, uint32_t height, uint32_t levelCount)
+    {
+        auto maxLevelCount = getMipLevelCount(width, height);
+        if (!levelCount || levelCount > maxLevelCount) levelCount = maxLevelCount;
+
+        std::vector<sMipLevel> levels(levelCount);
+        size_t offset = 0;
+        for (auto& level : levels)
+        {
+            level.width = width;
+            level.height = height;
+            level.offset = offset;
+            level.size = static_cast<size_t>(width) * static_cast<size_t>(height) * 4;
+            offset += level.size;
+            width = std::max<>(1u, width / 2);
+            height = std::max<>(1u, height / 2);
+        }
+        return levels;
+    }
+
+    size_t getMipChainSize(const std::vector<sMipLevel>& levels)
+    {
+        if (levels.empty()) return 0;
+        return levels.back().offset + levels.back().size;
+    }
+
+    // Down sample one row of the destination. pRow0 and pRow1 are the 2 source rows.
+    // Source width is always at least twice the destination's, except for 1 pixel wide sources.
+    static void downSampleRowScalar(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, uint32_t srcWidth, uint32_t x, uint32_t dstWidth)
+    {
+        for (; x < dstWidth; ++x)
+        {
+            auto x0 = x * 2;
+            auto x1 = std::min<>(x0 + 1, srcWidth - 1);
+            for (int k = 0; k < 4; ++k)
+            {
+                pDst[x * 4 + k] = static_cast<uint8_t>((pRow0[x0 * 4 + k] + pRow0[x1 * 4 + k] + pRow1[x0 * 4 + k] + pRow1[x1 * 4 + k] + 2) >> 2);
+            }
+        }
+    }
+
+    struct sGammaTables
+    {
+        uint16_t toLinear[256]; // sRGB byte to linear 16 bits
+        uint8_t toSrgb[4096]; // linear 12 bits to sRGB byte
+
+        sGammaTables()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                auto c = static_cast<double>(i) / 255.0;
+                auto linear = (c <= 0.04045) ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+                toLinear[i] = static_cast<uint16_t>(linear * 65535.0 + .5);
+            }
+            for (int i = 0; i < 4096; ++i)
+            {
+                auto linear = (static_cast<double>(i) + .5) / 4096.0;
+                auto c = (linear <= 0.0031308) ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+                toSrgb[i] = static_cast<uint8_t>(std::min<>(255.0, c * 255.0 + .5));
+            }
+        }
+    };
+
+    static const sGammaTables& getGammaTables()
+    {
+        static const sGammaTables tables;
+        return tables;
+    }
+
+    static void downSampleRowGamma(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, uint32_t srcWidth, uint32_t dstWidth)
+    {
+        auto& tables = getGammaTables();
+        for (uint32_t x = 0; x < dstWidth; ++x)
+        {
+            auto x0 = x * 2;
+            auto x1 = std::min<>(x0 + 1, srcWidth - 1);
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t linear =
+                    tables.toLinear[pRow0[x0 * 4 + k]] +
+                    tables.toLinear[pRow0[x1 * 4 + k]] +
+                    tables.toLinear[pRow1[x0 * 4 + k]] +
+                    tables.toLinear[pRow1[x1 * 4 + k]];
+                pDst[x * 4 + k] = tables.toSrgb[std::min<>((linear + 32) >> 6, 4095u)]; // 4 whites round up to 4096
+            }
+            pDst[x * 4 + 3] = static_cast<uint8_t>((pRow0[x0 * 4 + 3] + pRow0[x1 * 4 + 3] + pRow1[x0 * 4 + 3] + pRow1[x1 * 4 + 3] + 2) >> 2);
+        }
+    }
+
+#if defined(ONUT_SIMD_X86)
+    // Sum 4 source pixels (2 per row) into 1 destination pixel, for 2 destination pixels
+    static inline __m128i sumQuadsSSE2(__m128i row0, __m128i row1, bool isHigh)
+    {
+        const auto zero = _mm_setzero_si128();
+        auto a = isHigh ? _mm_unpackhi_epi8(row0, zero) : _mm_unpacklo_epi8(row0, zero);
+        auto b = isHigh ? _mm_unpackhi_epi8(row1, zero) : _mm_unpacklo_epi8(row1, zero);
+        return _mm_add_epi16(a, b);
+    }
+
+    static void downSampleRowSSE2(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, uint32_t srcWidth, uint32_t dstWidth)
+    {
+        const auto bias = _mm_set1_epi16(2);
+        uint32_t x = 0;
+        if (srcWidth > 1)
+        {
+            for (; x + 4 <= dstWidth; x += 4)
+            {
+                // 8 source pixels per row give 4 destination pixels
+                auto row0a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + x * 8));
+                auto row1a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + x * 8));
+                auto row0b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + x * 8 + 16));
+                auto row1b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + x * 8 + 16));
+
+                // Vertical sums, 2 pixels per register: [p0 p1] [p2 p3]
+                auto s01 = sumQuadsSSE2(row0a, row1a, false);
+                auto s23 = sumQuadsSSE2(row0a, row1a, true);
+                auto s45 = sumQuadsSSE2(row0b, row1b, false);
+                auto s67 = sumQuadsSSE2(row0b, row1b, true);
+
+                // Horizontal sums: [p0 + p1, p2 + p3]
+                auto d01 = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+                auto d23 = _mm_add_epi16(_mm_unpacklo_epi64(s45, s67), _mm_unpackhi_epi64(s45, s67));
+                d01 = _mm_srli_epi16(_mm_add_epi16(d01, bias), 2);
+                d23 = _mm_srli_epi16(_mm_add_epi16(d23, bias), 2);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + x * 4), _mm_packus_epi16(d01, d23));
+            }
+        }
+        downSampleRowScalar(pRow0, pRow1, pDst, srcWidth, x, dstWidth);
+    }
+
+    ONUT_TARGET_AVX2 static void downSampleRowAVX2(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, uint32_t srcWidth, uint32_t dstWidth)
+    {
+        const auto zero = _mm256_setzero_si256();
+        const auto bias = _mm256_set1_epi16(2);
+        uint32_t x = 0;
+        if (srcWidth > 1)
+        {
+            for (; x + 8 <= dstWidth; x += 8)
+            {
+                __m256i dsts[2];
+                for (int half = 0; half < 2; ++half)
+                {
+                    // 8 source pixels per row give 4 destination pixels. The same as SSE2, per 128 bits lane
+                    auto row0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow0 + x * 8 + half * 32));
+                    auto row1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow1 + x * 8 + half * 32));
+                    auto lo = _mm256_add_epi16(_mm256_unpacklo_epi8(row0, zero), _mm256_unpacklo_epi8(row1, zero));
+                    auto hi = _mm256_add_epi16(_mm256_unpackhi_epi8(row0, zero), _mm256_unpackhi_epi8(row1, zero));
+                    auto d = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+                    dsts[half] = _mm256_srli_epi16(_mm256_add_epi16(d, bias), 2);
+                }
+
+                // Pack interleaves the lanes, put the quad words back in order
+                auto packed = _mm256_packus_epi16(dsts[0], dsts[1]);
+                packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + x * 4), packed);
+            }
+        }
+        downSampleRowSSE2(pRow0 + x * 8, pRow1 + x * 8, pDst + x * 4, srcWidth - x * 2, dstWidth - x);
+    }
+#endif
+
+#if defined(ONUT_SIMD_NEON)
+    static void downSampleRowNEON(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDst, uint32_t srcWidth, uint32_t dstWidth)
+    {
+        uint32_t x = 0;
+        if (srcWidth > 1)
+        {
+            for (; x + 8 <= dstWidth; x += 8)
+            {
+                auto row0 = vld4q_u8(pRow0 + x * 8);
+                auto row1 = vld4q_u8(pRow1 + x * 8);
+                uint8x8x4_t result;
+                for (int k = 0; k < 4; ++k)
+                {
+                    auto sum = vaddq_u16(vpaddlq_u8(row0.val[k]), vpaddlq_u8(row1.val[k]));
+                    result.val[k] = vrshrn_n_u16(sum, 2);
+                }
+                vst4_u8(pDst + x * 4, result);
+            }
+        }
+        downSampleRowScalar(pRow0, pRow1, pDst, srcWidth, x, dstWidth);
+    }
+#endif
+
+    void generateMipChain(uint8_t* pChain, const std::vector<sMipLevel>& levels, bool gammaCorrect, eSimdPath path)
+    {
+        path = resolveSimdPath(path);
+        for (size_t i = 1; i < levels.size(); ++i)
+        {
+            auto& src = levels[i - 1];
+            auto& dst = levels[i];
+            auto pSrc = pChain + src.offset;
+            auto pDst = pChain + dst.offset;
+            auto srcPitch = src.width * 4;
+            for (uint32_t y = 0; y < dst.height; ++y)
+            {
+                auto pRow0 = pSrc + (y * 2) * srcPitch;
+                auto pRow1 = pSrc + std::min<>(y * 2 + 1, src.height - 1) * srcPitch;
+                auto pDstRow = pDst + y * dst.width * 4;
+                if (gammaCorrect)
+                {
+                    downSampleRowGamma(pRow0, pRow1, pDstRow, src.width, dst.width);
+                    continue;
+                }
+                switch (path)
+                {
+#if defined(ONUT_SIMD_X86)
+                    case eSimdPath::AVX2:
+                        downSampleRowAVX2(pRow0, pRow1, pDstRow, src.width, dst.width);
+                        break;
+                    case eSimdPath::SSE2:
+                        downSampleRowSSE2(pRow0, pRow1, pDstRow, src.width, dst.width);
+                        break;
+#endif
+#if defined(ONUT_SIMD_NEON)
+                    case eSimdPath::NEON:
+                        downSampleRowNEON(pRow0, pRow1, pDstRow, src.width, dst.width);
+                        break;
+#endif
+                    default:
+                        downSampleRowScalar(pRow0, pRow1, pDstRow, src.width, 0, dst.width);
+                        break;
+                }
+            }
+        }
+    }
+
+    //--- PNG
+
+    bool getPngSize(const uint8_t* pData, size_t size, uint32_t& width, uint32_t& height)
+    {
+        lodepng::State state;
+        unsigned w, h;
+        if (lodepng_inspect(&w, &h, &state, pData, size)) return false;
+        width = w;
+        height = h;
+        return true;
+    }
+
+    static void premultiplyRow(unsigned char* pRow, unsigned width, unsigned y, void* pUser)
+    {
+        premultiplyAlpha(pRow, width, *static_cast<eSimdPath*>(pUser));
+    }
+
+    bool decodePng(const uint8_t* pData, size_t size, uint8_t* pDst, size_t pitch, uint32_t width, uint32_t height, bool premultiply)
+    {
+        lodepng::State state;
+        auto path = resolveSimdPath(eSimdPath::AUTO);
+        auto ret = lodepng_decode_rgba8_into(pDst, pitch, width, height, &state, pData, size,
+                                             premultiply ? premultiplyRow : nullptr, &path);
+        return ret == 0;
+    }
+}
@@ -4110,14 +4110,15 @@ static unsigned readChunk_pHYs(LodePNGInfo* info, const unsigned char* data, siz
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
 /*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-    LodePNGState* state,
-    const unsigned char* in, size_t insize) {
+/*reads the header and all the chunks. idat_data and idat_size point to the compressed image data.
+When there is a single IDAT chunk they point straight inside in, otherwise the chunks are concatenated
+into idat (which must be initialized)*/
+static void decodeChunks(unsigned* w, unsigned* h, LodePNGState* state,
+    const unsigned char* in, size_t insize, ucvector* idat,
+    const unsigned char** idat_data, size_t* idat_size) {
     unsigned char IEND = 0;
     const unsigned char* chunk;
     size_t i;
-    ucvector idat; /*the data from idat chunks*/
-    ucvector scanlines;
 
     /*for unknown chunk order*/
     unsigned unknown = 0;
@@ -4125,13 +4126,11 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-    /*provide some proper output values if error will happen*/
-    *out = 0;
-
     state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
     if (state->error) return;
 
-    ucvector_init(&idat);
+    *idat_data = 0;
+    *idat_size = 0;
     chunk = &in[33]; /*first byte of the first chunk after the header*/
 
     /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
@@ -4156,9 +4155,24 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
         /*IDAT chunk, containing compressed image data*/
         if (lodepng_chunk_type_equals(chunk, "IDAT")) {
-            size_t oldsize = idat.size;
-            if (!ucvector_resize(&idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-            for (i = 0; i < chunkLength; i++) idat.data[oldsize + i] = data[i];
+            if (!*idat_data) {
+                /*first one, no copy*/
+                *idat_data = data;
+                *idat_size = chunkLength;
+            }
+            else {
+                size_t oldsize = idat->size;
+                if (!oldsize) {
+                    /*second one, start concatenating*/
+                    if (!ucvector_resize(idat, *idat_size)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
+                    for (i = 0; i < *idat_size; i++) idat->data[i] = (*idat_data)[i];
+                    oldsize = idat->size;
+                }
+                if (!ucvector_resize(idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
+                for (i = 0; i < chunkLength; i++) idat->data[oldsize + i] = data[i];
+                *idat_data = idat->data;
+                *idat_size = idat->size;
+            }
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
             critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4238,6 +4252,25 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
         if (!IEND) chunk = lodepng_chunk_next_const(chunk);
     }
+}
+
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+    LodePNGState* state,
+    const unsigned char* in, size_t insize) {
+    ucvector idat; /*the data from idat chunks*/
+    const unsigned char* idat_data;
+    size_t idat_size;
+    ucvector scanlines;
+
+    /*provide some proper output values if error will happen*/
+    *out = 0;
+
+    ucvector_init(&idat);
+    decodeChunks(w, h, state, in, insize, &idat, &idat_data, &idat_size);
+    if (state->error) {
+        ucvector_cleanup(&idat);
+        return;
+    }
 
     ucvector_init(&scanlines);
     if (!state->error) {
@@ -4248,8 +4281,8 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     }
     if (!state->error) {
         /*decompress with the Zlib decompressor*/
-        state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
-            idat.size, &state->decoder.zlibsettings);
+        state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat_data,
+            idat_size, &state->decoder.zlibsettings);
     }
     ucvector_cleanup(&idat);
 
@@ -4302,6 +4335,95 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
     return state->error;
 }
 
+unsigned lodepng_decode_rgba8_into(unsigned char* out, size_t pitch, unsigned w, unsigned h,
+    LodePNGState* state, const unsigned char* in, size_t insize,
+    LodePNGRowCallback row_callback, void* user) {
+    ucvector idat;
+    const unsigned char* idat_data;
+    size_t idat_size;
+    ucvector scanlines;
+    unsigned png_w, png_h, bpp, y;
+    LodePNGColorMode mode_out;
+
+    ucvector_init(&idat);
+    decodeChunks(&png_w, &png_h, state, in, insize, &idat, &idat_data, &idat_size);
+    if (!state->error && (png_w != w || png_h != h)) state->error = 92; /*the buffer was sized for another image*/
+    if (!state->error && pitch < (size_t)w * 4) state->error = 92;
+    if (state->error) {
+        ucvector_cleanup(&idat);
+        return state->error;
+    }
+
+    ucvector_init(&scanlines);
+    if (!ucvector_resize(&scanlines, lodepng_get_raw_size(w, h, &state->info_png.color) + h)) {
+        state->error = 83; /*alloc fail*/
+    }
+    if (!state->error) {
+        state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat_data,
+            idat_size, &state->decoder.zlibsettings);
+    }
+    ucvector_cleanup(&idat);
+
+    bpp = lodepng_get_bpp(&state->info_png.color);
+    lodepng_color_mode_init(&mode_out);
+    if (!state->error && state->info_png.interlace_method == 0) {
+        /*unfilter one scanline at a time, converting it right away while it's still in cache*/
+        size_t bytewidth = (bpp + 7) / 8;
+        size_t linebytes = ((size_t)w * bpp + 7) / 8;
+        unsigned is_rgba8 = lodepng_color_mode_equal(&mode_out, &state->info_png.color);
+        const unsigned char* prevline = 0;
+        if (scanlines.size < (linebytes + 1) * h) state->error = 91; /*not enough decompressed data*/
+        for (y = 0; y < h && !state->error; y++) {
+            unsigned char* filtered = &scanlines.data[(linebytes + 1) * y];
+            unsigned char* row = out + pitch * y;
+            if (is_rgba8) {
+                /*same format, unfilter straight into the output. The callback lags one row behind
+                since the next row is unfiltered using this one*/
+                state->error = unfilterScanline(row, filtered + 1, prevline, bytewidth, filtered[0], linebytes);
+                if (!state->error && row_callback && prevline) row_callback(out + pitch * (y - 1), w, y - 1, user);
+                if (!state->error && row_callback && y == h - 1) row_callback(row, w, y, user);
+                prevline = row;
+            }
+            else {
+                /*unfilter in place. The bits of a row always start at a byte, padding bits are never read*/
+                state->error = unfilterScanline(filtered, filtered + 1, prevline, bytewidth, filtered[0], linebytes);
+                prevline = filtered;
+                if (!state->error) {
+                    state->error = getPixelColorsRGBA8(row, w, 1, filtered, &state->info_png.color, state->decoder.fix_png);
+                }
+                if (!state->error && row_callback) row_callback(row, w, y, user);
+            }
+        }
+    }
+    else if (!state->error) {
+        /*Adam7 needs the whole image before any row is complete*/
+        ucvector raw;
+        ucvector_init(&raw);
+        if (!ucvector_resizev(&raw, lodepng_get_raw_size(w, h, &state->info_png.color), 0)) state->error = 83;
+        if (!state->error) state->error = postProcessScanlines(raw.data, scanlines.data, w, h, &state->info_png);
+        for (y = 0; y < h && !state->error; y++) {
+            unsigned char* row = out + pitch * y;
+            size_t rowbits = (size_t)w * bpp * y;
+            if (bpp < 8) {
+                /*rows of a sub byte image aren't byte aligned, go through the generic converter*/
+                size_t x;
+                for (x = 0; x < w && !state->error; x++) {
+                    state->error = getPixelColorRGBA8(&row[x * 4 + 0], &row[x * 4 + 1], &row[x * 4 + 2], &row[x * 4 + 3],
+                        raw.data, (size_t)w * y + x, &state->info_png.color, state->decoder.fix_png);
+                }
+            }
+            else {
+                state->error = getPixelColorsRGBA8(row, w, 1, &raw.data[rowbits / 8], &state->info_png.color, state->decoder.fix_png);
+            }
+            if (!state->error && row_callback) row_callback(row, w, y, user);
+        }
+        ucvector_cleanup(&raw);
+    }
+    lodepng_color_mode_cleanup(&mode_out);
+    ucvector_cleanup(&scanlines);
+    return state->error;
+}
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
     size_t insize, LodePNGColorType colortype, unsigned bitdepth) {
     unsigned error;
@@ -5413,6 +5535,8 @@ const char* lodepng_error_text(unsigned code) {
     case 89: return "text chunk keyword too short or long: must have size 1-79";
         /*the windowsize in the LodePNGCompressSettings. Requiring POT(==> & instead of %) makes encoding 12% faster.*/
     case 90: return "windowsize must be a power of two";
+    case 91: return "decompressed image data is smaller than the image size";
+    case 92: return "output buffer doesn't match the image size";
     }
     return "unknown error code";
 }
@@ -657,6 +657,20 @@ information is placed in the info_png field of the LodePNGState.
 unsigned lodepng_inspect(unsigned* w, unsigned* h,
     LodePNGState* state,
     const unsigned char* in, size_t insize);
+
+/*Called by lodepng_decode_rgba8_into for each row as soon as it is decoded*/
+typedef void(*LodePNGRowCallback)(unsigned char* row, unsigned w, unsigned y, void* user);
+
+/*
+Decodes to RGBA8 straight into a buffer owned by the caller, without allocating the image.
+Call lodepng_inspect first to know the size. in is never modified, so it can be a memory-mapped file.
+out: w * 4 bytes per row, each row starting pitch bytes after the previous one
+w, h: expected size, error 92 if the PNG has another one
+row_callback: optional, called on every row while it is still hot in cache
+*/
+unsigned lodepng_decode_rgba8_into(unsigned char* out, size_t pitch, unsigned w, unsigned h,
+    LodePNGState* state, const unsigned char* in, size_t insize,
+    LodePNGRowCallback row_callback, void* user);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 
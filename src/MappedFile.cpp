@@ -0,0 +1,94 @@
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if defined(WIN32)
+#if !defined(WIN32_LEAN_AND_MEAN)
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace onut
+{
+    MappedFile::MappedFile(const std::string& filename, bool isCopyOnWrite)
+        : m_isCopyOnWrite(isCopyOnWrite)
+    {
+#if defined(WIN32)
+        auto hFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE) return;
+        m_hFile = hFile;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0) return;
+
+        // A mapping of 0 bytes is an error. Empty files stay invalid
+        auto hMapping = CreateFileMappingA(hFile, nullptr, isCopyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+        if (!hMapping) return;
+        m_hMapping = hMapping;
+
+        m_pData = static_cast<const uint8_t*>(MapViewOfFile(hMapping, isCopyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+        if (m_pData) m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        auto fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            auto pData = mmap(nullptr, static_cast<size_t>(info.st_size), isCopyOnWrite ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_PRIVATE, fd, 0);
+            if (pData != MAP_FAILED)
+            {
+                m_pData = static_cast<const uint8_t*>(pData);
+                m_size = static_cast<size_t>(info.st_size);
+            }
+        }
+        close(fd); // The mapping keeps its own reference on the file
+#endif
+    }
+
+    MappedFile::~MappedFile()
+    {
+#if defined(WIN32)
+        if (m_pData) UnmapViewOfFile(m_pData);
+        if (m_hMapping) CloseHandle(m_hMapping);
+        if (m_hFile) CloseHandle(m_hFile);
+#else
+        if (m_pData) munmap(const_cast<uint8_t*>(m_pData), m_size);
+#endif
+    }
+
+    bool getFileStamp(const std::string& filename, uint64_t& size, uint64_t& modifiedTime)
+    {
+#if defined(WIN32)
+        WIN32_FILE_ATTRIBUTE_DATA info;
+        if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &info)) return false;
+        size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+        modifiedTime = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+        struct stat info;
+        if (stat(filename.c_str(), &info) != 0) return false;
+        size = static_cast<uint64_t>(info.st_size);
+#if defined(__APPLE__)
+        auto& time = info.st_mtimespec;
+#else
+        auto& time = info.st_mtim;
+#endif
+        modifiedTime = static_cast<uint64_t>(time.tv_sec) * 1000000000ull + static_cast<uint64_t>(time.tv_nsec);
+#endif
+        return true;
+    }
+
+    bool replaceFile(const std::string& from, const std::string& to)
+    {
+#if defined(WIN32)
+        return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+    }
+}
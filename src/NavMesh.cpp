@@ -1,106 +1,478 @@
 #include "NavMesh.h"
-#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <set>
 #include <unordered_map>
+#include <vector>
 
-struct sMarchingPoint
+namespace onut
 {
-    float x, y;
-    bool operator==(const sMarchingPoint &other) const
+    // Contours are in half tiles, so they stay integers. Tile centers are odd, and the midpoints
+    // between them, where contours go through, are even on one of the axes
+    struct sContourPoint
+    {
+        int x, y;
+    };
+
+    // Walkable corners of a marching cell (1 top left, 2 top right, 4 bottom left, 8 bottom right) to up
+    // to 2 segments between the midpoints of its sides: 0 top, 1 right, 2 bottom, 3 left. The walkable
+    // side is on the left of the segments, turning from +x toward +y. Opposite corners aren't joined
+    static const int MARCHING_SEGMENTS[16][4] = {
+        {-1, -1, -1, -1}, // 0000
+        {0, 3, -1, -1}, // 0001
+        {1, 0, -1, -1}, // 0010
+        {1, 3, -1, -1}, // 0011
+        {3, 2, -1, -1}, // 0100
+        {0, 2, -1, -1}, // 0101
+        {1, 0, 3, 2}, // 0110
+        {1, 2, -1, -1}, // 0111
+        {2, 1, -1, -1}, // 1000
+        {0, 3, 2, 1}, // 1001
+        {2, 0, -1, -1}, // 1010
+        {2, 3, -1, -1}, // 1011
+        {3, 1, -1, -1}, // 1100
+        {0, 1, -1, -1}, // 1101
+        {3, 0, -1, -1}, // 1110
+        {-1, -1, -1, -1} // 1111
+    };
+
+    // From the top left corner of the cell
+    static const int MARCHING_MIDPOINTS[4][2] = {{1, 0}, {2, 1}, {1, 2}, {0, 1}};
+
+    static uint64_t getPointKey(const sContourPoint &point)
     {
-        return
-            x >= other.x - .1f &&
-            x <= other.x + .1f &&
-            y >= other.y - .1f &&
-            y <= other.y + .1f;
+        return (static_cast<uint64_t>(static_cast<uint32_t>(point.y + 2)) << 32) | static_cast<uint32_t>(point.x + 2);
     }
-    bool operator!=(const sMarchingPoint &other) const
+
+    // Closed contours, one after the other. loopStarts has one more entry than there are loops
+    static void traceContours(const bool *pCollisionTiles, int width, int height, std::vector<sContourPoint> &points, std::vector<int> &loopStarts)
     {
-        return !(
-            x >= other.x - .1f &&
-            x <= other.x + .1f &&
-            y >= other.y - .1f &&
-            y <= other.y + .1f);
+        auto isWalkable = [=](int i, int j)
+        {
+            return i >= 0 && j >= 0 && i < width && j < height && !pCollisionTiles[j * width + i];
+        };
+
+        // The ring of cells around the grid closes the contours
+        std::vector<sContourPoint> segments; // Start, end
+        for (int j = -1; j < height; ++j)
+        {
+            for (int i = -1; i < width; ++i)
+            {
+                int marchId =
+                    (isWalkable(i, j) ? 1 : 0) |
+                    (isWalkable(i + 1, j) ? 2 : 0) |
+                    (isWalkable(i, j + 1) ? 4 : 0) |
+                    (isWalkable(i + 1, j + 1) ? 8 : 0);
+                auto pSegments = MARCHING_SEGMENTS[marchId];
+                for (int k = 0; k < 4 && pSegments[k] >= 0; ++k)
+                {
+                    auto pMidpoint = MARCHING_MIDPOINTS[pSegments[k]];
+                    segments.push_back({i * 2 + 1 + pMidpoint[0], j * 2 + 1 + pMidpoint[1]});
+                }
+            }
+        }
+
+        // Each midpoint starts one segment and ends another, so following the ends joins them
+        auto segmentCount = segments.size() / 2;
+        std::unordered_map<uint64_t, uint32_t> segmentsByStart;
+        segmentsByStart.reserve(segmentCount);
+        for (size_t i = 0; i < segmentCount; ++i)
+        {
+            segmentsByStart[getPointKey(segments[i * 2])] = static_cast<uint32_t>(i);
+        }
+
+        std::vector<bool> isJoined(segmentCount, false);
+        points.reserve(segmentCount);
+        for (size_t first = 0; first < segmentCount; ++first)
+        {
+            if (isJoined[first]) continue;
+            loopStarts.push_back(static_cast<int>(points.size()));
+            auto segment = first;
+            do
+            {
+                isJoined[segment] = true;
+                points.push_back(segments[segment * 2]);
+                auto it = segmentsByStart.find(getPointKey(segments[segment * 2 + 1]));
+                assert(it != segmentsByStart.end());
+                segment = it->second;
+            } while (segment != first);
+        }
+        loopStarts.push_back(static_cast<int>(points.size()));
     }
-};
 
-struct sMarchingLoop
-{
-    std::vector<sMarchingPoint> points;
-};
-
-std::vector<sMarchingLine> edges;
-std::vector<sMarchingLoop> loops;
-
-sMarchingLine *marching[16] = {
-    nullptr, // 0000
-    new sMarchingLine{.5f, 1.5f, 1.5f, .5f}, // 0001
-    new sMarchingLine{.5f, .5f, 1.5f, 1.5f}, // 0010
-    new sMarchingLine{.5f, 1.5f, 1.5f, 1.5f}, // 0011
-    new sMarchingLine{1.5f, 1.5f, .5f, .5f}, // 0100
-    new sMarchingLine{1.5f, 1.5f, 1.5f, .5f}, // 0101
-    nullptr, // 0110
-    nullptr, // 0111
-    new sMarchingLine{1.5f, .5f, .5f, 1.5f}, // 1000
-    nullptr, // 1001
-    new sMarchingLine{.5f, .5f, .5f, 1.5f}, // 1010
-    nullptr, // 1011
-    new sMarchingLine{1.5f, .5f, .5f, .5f}, // 1100
-    nullptr, // 1101
-    nullptr, // 1110
-    nullptr // 1111
-};
+    // Drop the points in the middle of straight runs. The contours keep their exact shape,
+    // so they still can't touch one another
+    static void simplifyContours(std::vector<sContourPoint> &points, std::vector<int> &loopStarts)
+    {
+        std::vector<sContourPoint> simplified;
+        simplified.reserve(points.size());
+        for (size_t loop = 0; loop + 1 < loopStarts.size(); ++loop)
+        {
+            auto from = loopStarts[loop];
+            auto count = loopStarts[loop + 1] - from;
+            loopStarts[loop] = static_cast<int>(simplified.size());
+            for (int i = 0; i < count; ++i)
+            {
+                auto &prev = points[from + (i + count - 1) % count];
+                auto &point = points[from + i];
+                auto &next = points[from + (i + 1) % count];
+                auto cross = (point.x - prev.x) * (next.y - point.y) - (point.y - prev.y) * (next.x - point.x);
+                if (cross) simplified.push_back(point);
+            }
+        }
+        loopStarts.back() = static_cast<int>(simplified.size());
+        points.swap(simplified);
+    }
 
-namespace onut
-{
-    NavMesh::NavMesh(bool *pCollisionTiles, int width, int height)
+    // Splits the walkable area in trapezoids, between a left and a right contour edge and two sweep
+    // lines. A sweep line goes through each point, and only cuts the trapezoids touching it, from
+    // one edge to the next. The sweep runs on the contours sheared by v = y * shear + x, so no two
+    // points are on the same line and no edge is along one. Lines stay straight, so sheared back,
+    // trapezoids are still convex.
+    class TrapezoidSweep
     {
-        // Create marching edges
-        //std::vector<sMarchingLine> edges;
-        for (int j = 0; j < height - 1; ++j)
+    public:
+        struct sTrapezoid
+        {
+            int leftEdge;
+            int rightEdge;
+            int64_t top;
+            int64_t bottom;
+            int aboveCount;
+            int above[2]; // Trapezoids sharing its top line
+        };
+
+        TrapezoidSweep(const std::vector<sContourPoint> &points, const std::vector<int> &loopStarts, int64_t shear)
+            : m_status(sEdgeOrder{this})
         {
-            for (int i = 0; i < width - 1; ++i)
+            // Edges are numbered by their first point
+            auto count = static_cast<int>(points.size());
+            m_u.resize(count);
+            m_v.resize(count);
+            m_next.resize(count);
+            m_prev.resize(count);
+            for (size_t loop = 0; loop + 1 < loopStarts.size(); ++loop)
             {
-                int marchId = 
-                    (pCollisionTiles[(j) * width + (i)] ? 0 : 1) |
-                    (pCollisionTiles[(j) * width + (i + 1)] ? 0 : 1) << 1 | 
-                    (pCollisionTiles[(j + 1) * width + (i)] ? 0 : 1) << 2 | 
-                    (pCollisionTiles[(j + 1) * width + (i + 1)] ? 0 : 1) << 3;
-                auto pM = marching[marchId];
-                if (!pM) continue;
-                auto m = *pM;
-                m.x1 += (float)i;
-                m.x2 += (float)i;
-                m.y1 += (float)j;
-                m.y2 += (float)j;
-                edges.push_back(m);
+                auto from = loopStarts[loop];
+                auto to = loopStarts[loop + 1];
+                for (int i = from; i < to; ++i)
+                {
+                    m_u[i] = points[i].x;
+                    m_v[i] = static_cast<int64_t>(points[i].y) * shear + points[i].x;
+                    m_next[i] = (i + 1 < to) ? i + 1 : from;
+                    m_prev[i] = (i > from) ? i - 1 : to - 1;
+                }
             }
+
+            std::vector<int> order(count);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [this](int a, int b) { return m_v[a] < m_v[b]; });
+
+            m_intervals.resize(count);
+            m_positions.resize(count);
+            for (auto point : order)
+            {
+                sweep(point);
+            }
+            assert(m_status.empty());
         }
 
-        // Create loop objects from those edges
-        for (auto &edge : edges)
+        double getU(int edge, int64_t v) const
         {
-            bool found = false;
-            for (auto &loop : loops)
+            auto a = edge;
+            auto b = m_next[edge];
+            auto t = static_cast<double>(v - m_v[a]) / static_cast<double>(m_v[b] - m_v[a]);
+            return static_cast<double>(m_u[a]) + static_cast<double>(m_u[b] - m_u[a]) * t;
+        }
+
+        std::vector<sTrapezoid> trapezoids;
+
+    private:
+        // Left to right, on the current sweep line. Edges from the same point are ordered by the way they go
+        struct sEdgeOrder
+        {
+            const TrapezoidSweep *pSweep;
+
+            bool operator()(int a, int b) const
             {
-                for (auto &point : loop.points)
+                if (a == b) return false;
+                auto ua = pSweep->getU(a, pSweep->m_sweepV);
+                auto ub = pSweep->getU(b, pSweep->m_sweepV);
+                if (ua != ub) return ua < ub;
+                return pSweep->getSlope(a) < pSweep->getSlope(b);
+            }
+        };
+
+        // Open trapezoid, by its left edge
+        struct sInterval
+        {
+            int rightEdge;
+            int64_t top;
+            int aboveCount;
+            int above[2];
+        };
+
+        using Status = std::set<int, sEdgeOrder>;
+
+        double getSlope(int edge) const
+        {
+            auto b = m_next[edge];
+            return static_cast<double>(m_u[b] - m_u[edge]) / static_cast<double>(m_v[b] - m_v[edge]);
+        }
+
+        bool isBelow(int point, int other) const { return m_v[other] > m_v[point]; }
+
+        // The walkable side is on the left of the edges, so the ones going up have it on their right
+        bool isLeftEdge(int edge) const { return m_v[m_next[edge]] < m_v[edge]; }
+
+        void insert(int edge)
+        {
+            m_positions[edge] = m_status.insert(edge).first;
+        }
+
+        int getLeftOf(int edge) const { return *std::prev(m_positions[edge]); }
+        int getRightOf(int edge) const { return *std::next(m_positions[edge]); }
+
+        void open(int leftEdge, int rightEdge)
+        {
+            m_intervals[leftEdge] = {rightEdge, m_sweepV, 0, {0, 0}};
+            m_opened[m_openedCount++] = leftEdge;
+        }
+
+        void close(int leftEdge)
+        {
+            auto &interval = m_intervals[leftEdge];
+            m_closed[m_closedCount++] = static_cast<int>(trapezoids.size());
+            trapezoids.push_back({leftEdge, interval.rightEdge, interval.top, m_sweepV, interval.aboveCount, {interval.above[0], interval.above[1]}});
+        }
+
+        void sweep(int point)
+        {
+            m_sweepV = m_v[point];
+            m_openedCount = 0;
+            m_closedCount = 0;
+            auto in = m_prev[point];
+            auto out = point;
+            auto isInBelow = isBelow(point, m_prev[point]);
+            auto isOutBelow = isBelow(point, m_next[point]);
+
+            if (isInBelow && isOutBelow)
+            {
+                insert(in);
+                insert(out);
+                auto left = in;
+                auto right = out;
+                if (std::next(m_positions[left]) != m_positions[right]) std::swap(left, right);
+                if (isLeftEdge(left))
+                {
+                    // Top of a walkable area
+                    open(left, right);
+                }
+                else
+                {
+                    // Top of a hole, splitting the trapezoid it is in
+                    auto outerLeft = getLeftOf(left);
+                    auto outerRight = getRightOf(right);
+                    assert(m_intervals[outerLeft].rightEdge == outerRight);
+                    close(outerLeft);
+                    open(outerLeft, left);
+                    open(right, outerRight);
+                }
+            }
+            else if (!isInBelow && !isOutBelow)
+            {
+                auto left = in;
+                auto right = out;
+                if (std::next(m_positions[left]) != m_positions[right]) std::swap(left, right);
+                if (isLeftEdge(left))
+                {
+                    // Bottom of a walkable area
+                    close(left);
+                    m_status.erase(m_positions[left]);
+                    m_status.erase(m_positions[right]);
+                }
+                else
+                {
+                    // Bottom of a hole, merging the trapezoids on its sides
+                    auto outerLeft = getLeftOf(left);
+                    auto outerRight = getRightOf(right);
+                    close(outerLeft);
+                    close(right);
+                    m_status.erase(m_positions[left]);
+                    m_status.erase(m_positions[right]);
+                    open(outerLeft, outerRight);
+                }
+            }
+            else
+            {
+                // Along a side, the edge above is replaced
+                auto above = isInBelow ? out : in;
+                auto below = isInBelow ? in : out;
+                if (isLeftEdge(above))
+                {
+                    auto rightEdge = m_intervals[above].rightEdge;
+                    close(above);
+                    m_status.erase(m_positions[above]);
+                    insert(below);
+                    open(below, rightEdge);
+                }
+                else
                 {
+                    auto leftEdge = getLeftOf(above);
+                    close(leftEdge);
+                    m_status.erase(m_positions[above]);
+                    insert(below);
+                    open(leftEdge, below);
+                }
+            }
+            link();
+        }
 
+        // Trapezoids opened on this line are below the ones closed on it, where they overlap
+        void link()
+        {
+            for (int i = 0; i < m_openedCount; ++i)
+            {
+                auto &interval = m_intervals[m_opened[i]];
+                auto left = getU(m_opened[i], m_sweepV);
+                auto right = getU(interval.rightEdge, m_sweepV);
+                for (int j = 0; j < m_closedCount; ++j)
+                {
+                    auto &trapezoid = trapezoids[m_closed[j]];
+                    auto overlap = std::min(right, getU(trapezoid.rightEdge, m_sweepV)) - std::max(left, getU(trapezoid.leftEdge, m_sweepV));
+                    if (overlap > 1e-6)
+                    {
+                        assert(interval.aboveCount < 2);
+                        interval.above[interval.aboveCount++] = m_closed[j];
+                    }
                 }
             }
         }
-    }
 
-    NavMesh::~NavMesh()
+        std::vector<int> m_u;
+        std::vector<int64_t> m_v;
+        std::vector<int> m_next;
+        std::vector<int> m_prev;
+        std::vector<sInterval> m_intervals;
+        std::vector<Status::iterator> m_positions;
+        Status m_status;
+        int64_t m_sweepV = 0;
+        int m_opened[2];
+        int m_openedCount = 0;
+        int m_closed[2];
+        int m_closedCount = 0;
+    };
+
+    NavMesh::NavMesh(const bool *pCollisionTiles, int width, int height)
     {
-        if (m_nodes)
+        if (width <= 0 || height <= 0) return;
+
+        std::vector<sContourPoint> points;
+        std::vector<int> loopStarts;
+        traceContours(pCollisionTiles, width, height, points, loopStarts);
+        simplifyContours(points, loopStarts);
+
+        // Points go from -1 to width * 2 + 1, one more row of v is past all of them
+        auto shear = static_cast<int64_t>(width) * 2 + 4;
+        TrapezoidSweep sweep(points, loopStarts, shear);
+        auto &trapezoids = sweep.trapezoids;
+
+        // 2 triangles per trapezoid, 1 where its top or its bottom is a point
+        struct sCorner
         {
-            for (auto i = 0; i < m_nodeCount; ++i)
+            double u;
+            int64_t v;
+        };
+        std::vector<sCorner> corners; // 3 per triangle
+        std::vector<int> lastTriangles(trapezoids.size());
+        std::vector<std::pair<int, int>> links;
+        corners.reserve(trapezoids.size() * 6);
+        links.reserve(trapezoids.size() * 2);
+        for (size_t i = 0; i < trapezoids.size(); ++i)
+        {
+            auto &trapezoid = trapezoids[i];
+            sCorner topLeft = {sweep.getU(trapezoid.leftEdge, trapezoid.top), trapezoid.top};
+            sCorner topRight = {sweep.getU(trapezoid.rightEdge, trapezoid.top), trapezoid.top};
+            sCorner bottomLeft = {sweep.getU(trapezoid.leftEdge, trapezoid.bottom), trapezoid.bottom};
+            sCorner bottomRight = {sweep.getU(trapezoid.rightEdge, trapezoid.bottom), trapezoid.bottom};
+            auto first = static_cast<int>(corners.size() / 3);
+            if (topRight.u - topLeft.u < 1e-6)
+            {
+                corners.insert(corners.end(), {topLeft, bottomRight, bottomLeft});
+            }
+            else if (bottomRight.u - bottomLeft.u < 1e-6)
             {
-                auto &pNode = m_nodes[i];
-                delete[] pNode.pNeighbors;
+                corners.insert(corners.end(), {topLeft, topRight, bottomLeft});
+            }
+            else
+            {
+                corners.insert(corners.end(), {topLeft, topRight, bottomRight, topLeft, bottomRight, bottomLeft});
+                links.push_back({first, first + 1});
+            }
+
+            lastTriangles[i] = static_cast<int>(corners.size() / 3) - 1;
+
+            // Bottom triangle of the ones above, which were closed first, to the top one of this one
+            for (int j = 0; j < trapezoid.aboveCount; ++j)
+            {
+                links.push_back({lastTriangles[trapezoid.above[j]], first});
             }
-            delete[] m_nodes;
         }
+
+        m_nodeCount = static_cast<int>(corners.size() / 3);
+        if (!m_nodeCount) return;
+        m_nodes = new sNode[m_nodeCount];
+        for (int i = 0; i < m_nodeCount; ++i)
+        {
+            auto &node = m_nodes[i];
+            node.pNeighbors = nullptr;
+            node.neighborCount = 0;
+            node.x = 0.f;
+            node.y = 0.f;
+            node.z = 0.f;
+            for (int k = 0; k < 3; ++k)
+            {
+                // Sheared back, from half tiles
+                auto &corner = corners[i * 3 + k];
+                auto x = static_cast<float>(corner.u * .5);
+                auto y = static_cast<float>((static_cast<double>(corner.v) - corner.u) / static_cast<double>(shear) * .5);
+                node.corners[k * 2] = x;
+                node.corners[k * 2 + 1] = y;
+                node.x += x / 3.f;
+                node.y += y / 3.f;
+            }
+        }
+
+        for (auto &link : links)
+        {
+            ++m_nodes[link.first].neighborCount;
+            ++m_nodes[link.second].neighborCount;
+        }
+        m_neighbors = new sNeighbor[links.size() * 2];
+        auto pNeighbors = m_neighbors;
+        for (int i = 0; i < m_nodeCount; ++i)
+        {
+            m_nodes[i].pNeighbors = pNeighbors;
+            pNeighbors += m_nodes[i].neighborCount;
+            m_nodes[i].neighborCount = 0;
+        }
+        for (auto &link : links)
+        {
+            auto &a = m_nodes[link.first];
+            auto &b = m_nodes[link.second];
+            auto cost = std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y));
+            a.pNeighbors[a.neighborCount++] = {cost, &b};
+            b.pNeighbors[b.neighborCount++] = {cost, &a};
+        }
+    }
+
+    NavMesh::~NavMesh()
+    {
+        delete[] m_neighbors;
+        delete[] m_nodes;
     }
 
     NavMesh::sNode *NavMesh::getNodes(int &count) const
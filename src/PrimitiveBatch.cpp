@@ -1,102 +1,49 @@
-#include "PrimitiveBatch.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include "onut.h"
+#include "PrimitiveBatch.h"
+#include "RenderStats.h"
+#include "SimdHelpers.h"
 
 namespace onut
 {
-    PrimitiveBatch::PrimitiveBatch()
+    PrimitiveBatch::PrimitiveBatch(IRenderBackend* pBackend)
+        : m_pBackend(pBackend)
     {
-#ifndef EASY_GRAPHIX
-        // Create a white texture for rendering "without" texture
-        unsigned char white[4] = {255, 255, 255, 255};
-        m_pTexWhite = Texture::createFromData({1, 1}, white, false);
-
-        auto pDevice = ORenderer->getDevice();
-        auto pDeviceContext = ORenderer->getDeviceContext();
-
-        SVertexP2T2C4 vertices[MAX_VERTEX_COUNT];
-
-        // Set up the description of the static vertex buffer.
-        D3D11_BUFFER_DESC vertexBufferDesc;
-        vertexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-        vertexBufferDesc.ByteWidth = sizeof(vertices);
-        vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-        vertexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-        vertexBufferDesc.MiscFlags = 0;
-        vertexBufferDesc.StructureByteStride = 0;
-
-        // Give the subresource structure a pointer to the vertex data.
-        D3D11_SUBRESOURCE_DATA vertexData;
-        vertexData.pSysMem = vertices;
-        vertexData.SysMemPitch = 0;
-        vertexData.SysMemSlicePitch = 0;
-
-        auto ret = pDevice->CreateBuffer(&vertexBufferDesc, &vertexData, &m_pVertexBuffer);
-        assert(ret == S_OK);
-#endif /* !EASY_GRAPHIX */
+        if (!m_pBackend) m_pBackend = ORenderer->getBackend();
+        m_maxVertexCount = m_pBackend->getMaxPrimitiveVertexCount();
+        m_pStats = m_pBackend->getStats();
     }
 
     PrimitiveBatch::~PrimitiveBatch()
     {
-#ifndef EASY_GRAPHIX
-        if (m_pVertexBuffer) m_pVertexBuffer->Release();
-        delete m_pTexWhite;
-#endif /* !EASY_GRAPHIX */
     }
 
     void PrimitiveBatch::begin(ePrimitiveType primitiveType, Texture* pTexture)
     {
-#ifdef EASY_GRAPHIX
-        if (pTexture)
-        {
-            pTexture->bind();
-        }
-        else
-        {
-            egBindDiffuse(0);
-        }
-        switch (primitiveType)
-        {
-            case ePrimitiveType::POINTS:
-                egBegin(EG_POINTS);
-                break;
-            case ePrimitiveType::LINES:
-                egBegin(EG_LINES);
-                break;
-            case ePrimitiveType::LINE_STRIP:
-                egBegin(EG_LINE_STRIP);
-                break;
-            case ePrimitiveType::TRIANGLES:
-                egBegin(EG_TRIANGLES);
-                break;
-        }
-#else /* EASY_GRAPHIX */
         assert(!m_isDrawing); // Cannot call begin() twice without calling end()
 
-        if (!pTexture) pTexture = m_pTexWhite;
+        if (!pTexture) pTexture = m_pBackend->getWhiteTexture();
         m_pTexture = pTexture;
 
         m_primitiveType = primitiveType;
-        ORenderer->setupFor2D();
         m_isDrawing = true;
-        ORenderer->getDeviceContext()->Map(m_pVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &m_pMappedVertexBuffer);
-#endif /* !EASY_GRAPHIX */
+        m_vertexCount = 0;
+        m_pVertices = m_pBackend->beginPrimitives();
+        if (m_pStats) ++m_pStats->getCurrentFrame().primitiveBatchCount;
     }
 
     void PrimitiveBatch::draw(const Vector2& position, const Color& color, const Vector2& texCoord)
     {
-#ifdef EASY_GRAPHIX
-        egColor4(color.x, color.y, color.z, color.w);
-        egTexCoord(texCoord.x, texCoord.y);
-        egPosition2(position.x, position.y);
-#else /* EASY_GRAPHIX */
-        SVertexP2T2C4* pVerts = static_cast<SVertexP2T2C4*>(m_pMappedVertexBuffer.pData) + m_vertexCount;
+        auto pVerts = m_pVertices + m_vertexCount;
         pVerts->position = position;
         pVerts->texCoord = texCoord;
         pVerts->color = color;
 
         ++m_vertexCount;
 
-        if (m_vertexCount == MAX_VERTEX_COUNT)
+        if (m_vertexCount == m_maxVertexCount)
         {
             if (m_primitiveType == ePrimitiveType::LINE_STRIP)
             {
@@ -104,8 +51,7 @@ namespace onut
 
                 flush();
 
-                auto pFirstVert = static_cast<SVertexP2T2C4*>(m_pMappedVertexBuffer.pData);
-                *pFirstVert = lastVert;
+                *m_pVertices = lastVert;
                 ++m_vertexCount;
             }
             else
@@ -113,14 +59,10 @@ namespace onut
                 flush();
             }
         }
-#endif /* !EASY_GRAPHIX */
     }
 
     void PrimitiveBatch::end()
     {
-#ifdef EASY_GRAPHIX
-        egEnd();
-#else /* EASY_GRAPHIX */
         assert(m_isDrawing); // Should call begin() before calling end()
 
         m_isDrawing = false;
@@ -128,11 +70,9 @@ namespace onut
         {
             flush();
         }
-        ORenderer->getDeviceContext()->Unmap(m_pVertexBuffer, 0);
-#endif /* !EASY_GRAPHIX */
+        m_pBackend->endPrimitives();
     }
 
-#ifndef EASY_GRAPHIX
     void PrimitiveBatch::flush()
     {
         if (!m_vertexCount)
@@ -140,33 +80,424 @@ namespace onut
             return; // Nothing to flush
         }
 
-        auto pDeviceContext = ORenderer->getDeviceContext();
+        m_pVertices = m_pBackend->drawPrimitives(m_primitiveType, m_pTexture, m_vertexCount);
+        if (m_pStats)
+        {
+            auto& frame = m_pStats->getCurrentFrame();
+            frame.vertexCount += m_vertexCount;
+            ++frame.primitiveFlushCount;
+        }
 
-        pDeviceContext->Unmap(m_pVertexBuffer, 0);
+        m_vertexCount = 0;
+    }
+
+    sRenderVertex* PrimitiveBatch::beginTriangles(uint32_t& vertexCount)
+    {
+        assert(m_isDrawing); // Should call begin() before calling draw()
+        assert(m_primitiveType == ePrimitiveType::TRIANGLES); // Shapes are tessellated to triangles
+        assert(m_vertexCount % 3 == 0); // Finish the triangle being drawn first
+
+        // Whole triangles only, so a flush never splits one
+        auto available = (m_maxVertexCount - m_vertexCount) / 3 * 3;
+        if (!available)
+        {
+            flush();
+            available = m_maxVertexCount / 3 * 3;
+        }
+        vertexCount = std::min(vertexCount, available);
+        return m_pVertices + m_vertexCount;
+    }
 
-        auto textureView = m_pTexture->getResource();
-        pDeviceContext->PSSetShaderResources(0, 1, &textureView);
-        switch (m_primitiveType)
+    void PrimitiveBatch::endTriangles(uint32_t vertexCount)
+    {
+        m_vertexCount += vertexCount;
+        if (m_vertexCount == m_maxVertexCount)
         {
-            case ePrimitiveType::POINTS:
-                pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
-                break;
-            case ePrimitiveType::LINES:
-                pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
-                break;
-            case ePrimitiveType::LINE_STRIP:
-                pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP);
-                break;
-            case ePrimitiveType::TRIANGLES:
-                pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-                break;
+            flush();
         }
-        pDeviceContext->IASetVertexBuffers(0, 1, &m_pVertexBuffer, &m_stride, &m_offset);
-        pDeviceContext->Draw(m_vertexCount, 0);
+    }
 
-        pDeviceContext->Map(m_pVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &m_pMappedVertexBuffer);
+    void PrimitiveBatch::addTriangle(const Vector2& a, const Vector2& b, const Vector2& c, const Color& color)
+    {
+        assert(m_isDrawing); // Should call begin() before calling draw()
+        assert(m_primitiveType == ePrimitiveType::TRIANGLES); // Shapes are tessellated to triangles
+        assert(m_vertexCount % 3 == 0); // Finish the triangle being drawn first
 
-        m_vertexCount = 0;
+        if (m_vertexCount + 3 > m_maxVertexCount)
+        {
+            flush();
+        }
+        auto pVerts = m_pVertices + m_vertexCount;
+        pVerts[0].position = a;
+        pVerts[0].texCoord = Vector2::Zero;
+        pVerts[0].color = color;
+        pVerts[1].position = b;
+        pVerts[1].texCoord = Vector2::Zero;
+        pVerts[1].color = color;
+        pVerts[2].position = c;
+        pVerts[2].texCoord = Vector2::Zero;
+        pVerts[2].color = color;
+        m_vertexCount += 3;
+    }
+
+    static inline void storeVertex(sRenderVertex* pVert, float x, float y, const Color& color)
+    {
+        pVert->position.x = x;
+        pVert->position.y = y;
+        pVert->texCoord = Vector2::Zero;
+        pVert->color = color;
+    }
+
+    // Scaled to half the thickness. Joins use it too, so they meet the segments' corners exactly
+    static inline Vector2 getLineNormal(const Vector2& a, const Vector2& b, float halfThickness)
+    {
+        auto dx = b.x - a.x;
+        auto dy = b.y - a.y;
+        auto lengthSq = dx * dx + dy * dy;
+        auto scale = (lengthSq > 0.f) ? halfThickness / std::sqrt(lengthSq) : 0.f;
+        return Vector2(-dy * scale, dx * scale);
+    }
+
+    // 2 triangles per segment: (a+, a-, b+) and (b+, a-, b-), with +/- the normal.
+    // Segment i goes from pPoints[i * stride] to the point after it: stride is 2 for separate segments, 1 for a polyline.
+    static void generateLineQuadsScalar(const Vector2* pPoints, size_t stride, size_t count, float halfThickness, const Color& color, sRenderVertex* pVerts)
+    {
+        for (size_t i = 0; i < count; ++i, pVerts += 6)
+        {
+            auto& a = pPoints[i * stride];
+            auto& b = pPoints[i * stride + 1];
+            auto normal = getLineNormal(a, b, halfThickness);
+            auto nx = normal.x;
+            auto ny = normal.y;
+            storeVertex(pVerts + 0, a.x + nx, a.y + ny, color);
+            storeVertex(pVerts + 1, a.x - nx, a.y - ny, color);
+            storeVertex(pVerts + 2, b.x + nx, b.y + ny, color);
+            storeVertex(pVerts + 3, b.x + nx, b.y + ny, color);
+            storeVertex(pVerts + 4, a.x - nx, a.y - ny, color);
+            storeVertex(pVerts + 5, b.x - nx, b.y - ny, color);
+        }
+    }
+
+#if defined(ONUT_SIMD_X86)
+    static void generateLineQuadsSSE2(const Vector2* pPoints, size_t stride, size_t count, float halfThickness, const Color& color, sRenderVertex* pVerts)
+    {
+        auto half = _mm_set1_ps(halfThickness);
+        auto zero = _mm_setzero_ps();
+        auto colorV = _mm_loadu_ps(&color.x);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            // Segments are 4 floats, transposed to 4 segments per register
+            auto pIn = &pPoints[i * stride].x;
+            auto floatStride = stride * 2;
+            auto ax = _mm_loadu_ps(pIn);
+            auto ay = _mm_loadu_ps(pIn + floatStride);
+            auto bx = _mm_loadu_ps(pIn + floatStride * 2);
+            auto by = _mm_loadu_ps(pIn + floatStride * 3);
+            _MM_TRANSPOSE4_PS(ax, ay, bx, by);
+
+            auto dx = _mm_sub_ps(bx, ax);
+            auto dy = _mm_sub_ps(by, ay);
+            auto lengthSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            auto scale = _mm_and_ps(_mm_div_ps(half, _mm_sqrt_ps(lengthSq)), _mm_cmpgt_ps(lengthSq, zero));
+            auto nx = _mm_xor_ps(_mm_mul_ps(dy, scale), _mm_set1_ps(-0.f)); // Same as (-dy) * scale
+            auto ny = _mm_mul_ps(dx, scale);
+
+            // Back to one segment per register: a+ a- b+ b-, as x,y pairs
+            auto apx = _mm_add_ps(ax, nx), apy = _mm_add_ps(ay, ny);
+            auto amx = _mm_sub_ps(ax, nx), amy = _mm_sub_ps(ay, ny);
+            auto bpx = _mm_add_ps(bx, nx), bpy = _mm_add_ps(by, ny);
+            auto bmx = _mm_sub_ps(bx, nx), bmy = _mm_sub_ps(by, ny);
+            auto ap = _mm_unpacklo_ps(apx, apy), ap2 = _mm_unpackhi_ps(apx, apy);
+            auto am = _mm_unpacklo_ps(amx, amy), am2 = _mm_unpackhi_ps(amx, amy);
+            auto bp = _mm_unpacklo_ps(bpx, bpy), bp2 = _mm_unpackhi_ps(bpx, bpy);
+            auto bm = _mm_unpacklo_ps(bmx, bmy), bm2 = _mm_unpackhi_ps(bmx, bmy);
+            __m128 corners[4][4] = {
+                {_mm_movelh_ps(ap, zero), _mm_movelh_ps(am, zero), _mm_movelh_ps(bp, zero), _mm_movelh_ps(bm, zero)},
+                {_mm_movehl_ps(zero, ap), _mm_movehl_ps(zero, am), _mm_movehl_ps(zero, bp), _mm_movehl_ps(zero, bm)},
+                {_mm_movelh_ps(ap2, zero), _mm_movelh_ps(am2, zero), _mm_movelh_ps(bp2, zero), _mm_movelh_ps(bm2, zero)},
+                {_mm_movehl_ps(zero, ap2), _mm_movehl_ps(zero, am2), _mm_movehl_ps(zero, bp2), _mm_movehl_ps(zero, bm2)}};
+            for (int k = 0; k < 4; ++k, pVerts += 6)
+            {
+                // Position and texCoord are the first 16 bytes of a vertex
+                _mm_storeu_ps(&pVerts[0].position.x, corners[k][0]);
+                _mm_storeu_ps(&pVerts[1].position.x, corners[k][1]);
+                _mm_storeu_ps(&pVerts[2].position.x, corners[k][2]);
+                _mm_storeu_ps(&pVerts[3].position.x, corners[k][2]);
+                _mm_storeu_ps(&pVerts[4].position.x, corners[k][1]);
+                _mm_storeu_ps(&pVerts[5].position.x, corners[k][3]);
+                for (int v = 0; v < 6; ++v) _mm_storeu_ps(&pVerts[v].color.x, colorV);
+            }
+        }
+        generateLineQuadsScalar(pPoints + i * stride, stride, count - i, halfThickness, color, pVerts);
+    }
+#endif
+
+    static void generateLineQuads(const Vector2* pPoints, size_t stride, size_t count, float halfThickness, const Color& color, sRenderVertex* pVerts, eSimdPath path)
+    {
+        switch (path)
+        {
+#if defined(ONUT_SIMD_X86)
+            // Bound by the vertex stores, wider registers don't help
+            case eSimdPath::AVX2:
+            case eSimdPath::SSE2:
+                generateLineQuadsSSE2(pPoints, stride, count, halfThickness, color, pVerts);
+                return;
+#endif
+            default:
+                generateLineQuadsScalar(pPoints, stride, count, halfThickness, color, pVerts);
+                return;
+        }
+    }
+
+    void PrimitiveBatch::drawSegments(const Vector2* pPoints, size_t stride, size_t segmentCount, float halfThickness, const Color& color, eSimdPath path)
+    {
+        static_assert(sizeof(sRenderVertex) == 32, "The SSE2 path stores position and texCoord together");
+
+        while (segmentCount)
+        {
+            auto vertexCount = static_cast<uint32_t>(std::min<size_t>(segmentCount, m_maxVertexCount / 6) * 6);
+            auto pVerts = beginTriangles(vertexCount);
+            vertexCount = vertexCount / 6 * 6;
+            if (!vertexCount)
+            {
+                flush(); // Room for a triangle but not a segment
+                continue;
+            }
+            auto count = vertexCount / 6;
+            generateLineQuads(pPoints, stride, count, halfThickness, color, pVerts, path);
+            endTriangles(vertexCount);
+            pPoints += count * stride;
+            segmentCount -= count;
+        }
+    }
+
+    void PrimitiveBatch::drawLines(const Vector2* pPoints, size_t segmentCount, float thickness, const Color& color, eSimdPath path)
+    {
+        if (path == eSimdPath::AUTO || !isSimdPathSupported(path))
+        {
+            path = getBestSimdPath();
+        }
+        drawSegments(pPoints, 2, segmentCount, thickness * .5f, color, path);
+    }
+
+    void PrimitiveBatch::drawLines(const std::vector<Vector2>& points, float thickness, const Color& color, eSimdPath path)
+    {
+        drawLines(points.data(), points.size() / 2, thickness, color, path);
+    }
+
+    void PrimitiveBatch::drawPolyline(const Vector2* pPoints, size_t pointCount, float thickness, const Color& color, eLineJoin join, bool closed)
+    {
+        static const float MITER_LIMIT = 4.f; // In half thicknesses
+        static const float ROUND_JOIN_STEP = .5f; // Radians
+
+        // Repeated points have no direction
+        m_points.clear();
+        for (size_t i = 0; i < pointCount; ++i)
+        {
+            if (m_points.empty() || pPoints[i] != m_points.back()) m_points.push_back(pPoints[i]);
+        }
+        if (closed && m_points.size() > 1 && m_points.front() == m_points.back()) m_points.pop_back();
+        auto count = m_points.size();
+        if (count < 2) return;
+        if (count == 2) closed = false;
+        if (closed) m_points.push_back(m_points.front()); // So the segments are consecutive
+
+        // Same segments as drawLines
+        auto halfThickness = thickness * .5f;
+        auto segmentCount = closed ? count : count - 1;
+        drawSegments(m_points.data(), 1, segmentCount, halfThickness, color, getBestSimdPath());
+        if (join == eLineJoin::NONE) return;
+
+        // Joins fill the gaps between the segments' corners, so they use the exact same normals
+        auto firstJoint = closed ? 0 : 1;
+        auto jointEnd = closed ? count : count - 1;
+        auto normalIn = getLineNormal(m_points[(firstJoint + segmentCount - 1) % segmentCount], m_points[firstJoint], halfThickness);
+        Vector2 normalOut;
+        for (size_t i = firstJoint; i < jointEnd; ++i, normalIn = normalOut)
+        {
+            auto& point = m_points[i];
+            normalOut = getLineNormal(point, m_points[i + 1], halfThickness);
+            auto cross = normalIn.x * normalOut.y - normalIn.y * normalOut.x;
+            if (cross == 0.f && normalIn.Dot(normalOut) > 0.f) continue; // Straight
+
+            // The gap is on the outside of the turn
+            auto side = (cross > 0.f) ? -1.f : 1.f;
+            auto outerIn = point + normalIn * side;
+            auto outerOut = point + normalOut * side;
+            switch (join)
+            {
+                case eLineJoin::MITER:
+                {
+                    auto miterDir = normalIn + normalOut;
+                    auto miterDirLength = miterDir.Length();
+                    if (miterDirLength > 0.f)
+                    {
+                        miterDir /= miterDirLength;
+                        auto cosHalfAngle = miterDir.Dot(normalIn) / halfThickness;
+                        if (cosHalfAngle * MITER_LIMIT > 1.f)
+                        {
+                            auto tip = point + miterDir * (side * halfThickness / cosHalfAngle);
+                            addTriangle(point, outerIn, tip, color);
+                            addTriangle(point, tip, outerOut, color);
+                            break;
+                        }
+                    }
+                    addTriangle(point, outerIn, outerOut, color);
+                    break;
+                }
+                case eLineJoin::ROUND:
+                {
+                    // Rotate the outer normal towards the next one, the same way the line turns
+                    auto angle = std::acos(std::max(-1.f, std::min(1.f, normalIn.Dot(normalOut) / (halfThickness * halfThickness))));
+                    auto stepCount = std::max(1, static_cast<int>(std::ceil(angle / ROUND_JOIN_STEP)));
+                    auto step = angle / static_cast<float>(stepCount) * ((cross > 0.f) ? 1.f : -1.f);
+                    auto c = std::cos(step);
+                    auto s = std::sin(step);
+                    auto offset = normalIn * side;
+                    auto previous = outerIn;
+                    for (int k = 1; k < stepCount; ++k)
+                    {
+                        offset = Vector2(offset.x * c - offset.y * s, offset.x * s + offset.y * c);
+                        auto next = point + offset;
+                        addTriangle(point, previous, next, color);
+                        previous = next;
+                    }
+                    addTriangle(point, previous, outerOut, color);
+                    break;
+                }
+                default:
+                    addTriangle(point, outerIn, outerOut, color);
+                    break;
+            }
+        }
+    }
+
+    void PrimitiveBatch::drawPolyline(const std::vector<Vector2>& points, float thickness, const Color& color, eLineJoin join, bool closed)
+    {
+        drawPolyline(points.data(), points.size(), thickness, color, join, closed);
+    }
+
+    static uint32_t getCircleSegmentCount(float radius, uint32_t segmentCount)
+    {
+        static const float MAX_ERROR = .25f; // Pixels between the arc and a segment
+
+        if (segmentCount) return std::max(segmentCount, 3u);
+        if (radius <= MAX_ERROR) return 8;
+        auto angle = 2.f * std::acos(1.f - MAX_ERROR / radius);
+        return std::max(8u, std::min(512u, static_cast<uint32_t>(std::ceil(DirectX::XM_2PI / angle))));
+    }
+
+    void PrimitiveBatch::drawCircle(const Vector2& center, float radius, const Color& color, uint32_t segmentCount)
+    {
+        segmentCount = getCircleSegmentCount(radius, segmentCount);
+        auto step = DirectX::XM_2PI / static_cast<float>(segmentCount);
+        auto previous = center + Vector2(radius, 0.f);
+        for (uint32_t i = 1; i <= segmentCount; ++i)
+        {
+            auto theta = step * static_cast<float>(i % segmentCount);
+            auto next = center + Vector2(std::cos(theta), std::sin(theta)) * radius;
+            addTriangle(center, previous, next, color);
+            previous = next;
+        }
+    }
+
+    void PrimitiveBatch::drawCircleOutline(const Vector2& center, float radius, float thickness, const Color& color, uint32_t segmentCount)
+    {
+        segmentCount = getCircleSegmentCount(radius + thickness * .5f, segmentCount);
+        auto innerRadius = std::max(0.f, radius - thickness * .5f);
+        auto outerRadius = radius + thickness * .5f;
+        auto step = DirectX::XM_2PI / static_cast<float>(segmentCount);
+        Vector2 previousDir(1.f, 0.f);
+        for (uint32_t i = 1; i <= segmentCount; ++i)
+        {
+            auto theta = step * static_cast<float>(i % segmentCount);
+            Vector2 dir(std::cos(theta), std::sin(theta));
+            auto innerFrom = center + previousDir * innerRadius;
+            auto innerTo = center + dir * innerRadius;
+            auto outerFrom = center + previousDir * outerRadius;
+            auto outerTo = center + dir * outerRadius;
+            addTriangle(innerFrom, outerFrom, outerTo, color);
+            addTriangle(innerFrom, outerTo, innerTo, color);
+            previousDir = dir;
+        }
+    }
+
+    static inline float getCross(const Vector2& a, const Vector2& b, const Vector2& c)
+    {
+        return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    }
+
+    void PrimitiveBatch::drawPolygon(const Vector2* pPoints, size_t pointCount, const Color& color)
+    {
+        if (pointCount > 1 && pPoints[0] == pPoints[pointCount - 1]) --pointCount; // Closed by repeating the first point
+        if (pointCount < 3) return;
+
+        // Positive when the ears have to turn the same way as the polygon
+        float area = 0.f;
+        for (size_t i = 0, j = pointCount - 1; i < pointCount; j = i++)
+        {
+            area += pPoints[j].x * pPoints[i].y - pPoints[i].x * pPoints[j].y;
+        }
+        auto winding = (area < 0.f) ? -1.f : 1.f;
+
+        // Ear clipping, on a linked list of the remaining points
+        auto count = static_cast<uint32_t>(pointCount);
+        m_links.resize(count * 2);
+        auto pPrev = m_links.data();
+        auto pNext = m_links.data() + count;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            pPrev[i] = (i + count - 1) % count;
+            pNext[i] = (i + 1) % count;
+        }
+
+        auto remaining = count;
+        uint32_t current = 0;
+        uint32_t triesLeft = remaining;
+        while (remaining > 3)
+        {
+            auto prev = pPrev[current];
+            auto next = pNext[current];
+            auto& a = pPoints[prev];
+            auto& b = pPoints[current];
+            auto& c = pPoints[next];
+            auto isEar = getCross(a, b, c) * winding > 0.f;
+            if (isEar)
+            {
+                for (auto other = pNext[next]; other != prev; other = pNext[other])
+                {
+                    auto& p = pPoints[other];
+                    if (getCross(a, b, p) * winding > 0.f &&
+                        getCross(b, c, p) * winding > 0.f &&
+                        getCross(c, a, p) * winding > 0.f)
+                    {
+                        isEar = false;
+                        break;
+                    }
+                }
+            }
+
+            // Without any ear left the polygon crosses itself, clip anyway to finish
+            if (isEar || !triesLeft--)
+            {
+                addTriangle(a, b, c, color);
+                pNext[prev] = next;
+                pPrev[next] = prev;
+                --remaining;
+                triesLeft = remaining;
+                current = prev; // It has a new neighbor
+            }
+            else
+            {
+                current = next;
+            }
+        }
+        addTriangle(pPoints[pPrev[current]], pPoints[current], pPoints[pNext[current]], color);
+    }
+
+    void PrimitiveBatch::drawPolygon(const std::vector<Vector2>& points, const Color& color)
+    {
+        drawPolygon(points.data(), points.size(), color);
     }
-#endif /* !EASY_GRAPHIX */
 }
@@ -0,0 +1,55 @@
+#include "RadixSort.h"
+
+#include <cstring>
+
+namespace onut
+{
+    void radixSort(std::vector<sSortKey>& keys, std::vector<sSortKey>& scratch)
+    {
+        auto count = keys.size();
+        if (count < 2) return;
+        scratch.resize(count);
+
+        // All histograms in one read
+        uint32_t histograms[8][256];
+        memset(histograms, 0, sizeof(histograms));
+        for (auto& key : keys)
+        {
+            auto k = key.key;
+            for (int byte = 0; byte < 8; ++byte)
+            {
+                ++histograms[byte][(k >> (byte * 8)) & 0xff];
+            }
+        }
+
+        auto pSrc = &keys;
+        auto pDst = &scratch;
+        for (int byte = 0; byte < 8; ++byte)
+        {
+            auto histogram = histograms[byte];
+
+            // Every key has the same byte here, nothing would move
+            if (histogram[((*pSrc)[0].key >> (byte * 8)) & 0xff] == count) continue;
+
+            uint32_t offset = 0;
+            for (int i = 0; i < 256; ++i)
+            {
+                auto bucketCount = histogram[i];
+                histogram[i] = offset;
+                offset += bucketCount;
+            }
+            auto shift = byte * 8;
+            auto pOut = pDst->data();
+            for (auto& key : *pSrc)
+            {
+                pOut[histogram[(key.key >> shift) & 0xff]++] = key;
+            }
+            std::swap(pSrc, pDst);
+        }
+
+        if (pSrc != &keys)
+        {
+            keys.swap(scratch);
+        }
+    }
+}
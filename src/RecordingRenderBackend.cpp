@@ -0,0 +1,116 @@
+#include "RecordingRenderBackend.h"
+
+#include <cassert>
+
+namespace onut
+{
+    RecordingRenderBackend::RecordingRenderBackend(uint32_t maxSpriteCount, uint32_t maxPrimitiveVertexCount, bool captureVertices)
+        : m_maxSpriteCount(maxSpriteCount)
+        , m_maxPrimitiveVertexCount(maxPrimitiveVertexCount)
+        , m_captureVertices(captureVertices)
+        , m_spriteStaging(maxSpriteCount * 4)
+        , m_primitiveStaging(maxPrimitiveVertexCount)
+    {
+        m_pWhiteTexture = createTexture({1, 1});
+    }
+
+    Texture* RecordingRenderBackend::createTexture(const Texture::sSize& size, bool isOwned)
+    {
+        auto pTexture = new Texture();
+        pTexture->m_size = size;
+        if (isOwned) m_textures.push_back(std::unique_ptr<Texture>(pTexture));
+        return pTexture;
+    }
+
+    void RecordingRenderBackend::clear()
+    {
+        m_commands.clear();
+        m_vertices.clear();
+        m_packedSprites.clear();
+        m_drawCallCount = 0;
+    }
+
+    sRenderVertex* RecordingRenderBackend::beginSprites(bool forceWrite)
+    {
+        return m_spriteStaging.data();
+    }
+
+    sRenderVertex* RecordingRenderBackend::drawSprites(Texture* pTexture, uint32_t spriteCount)
+    {
+        record(eCommandType::SPRITES, ePrimitiveType::TRIANGLES, pTexture, m_spriteStaging.data(), spriteCount * 4);
+        return m_spriteStaging.data();
+    }
+
+    void RecordingRenderBackend::setMaxPackedSpriteCount(uint32_t maxPackedSpriteCount)
+    {
+        m_maxPackedSpriteCount = maxPackedSpriteCount;
+        m_packedStaging.resize(maxPackedSpriteCount);
+    }
+
+    sPackedSprite* RecordingRenderBackend::mapPackedSprites(uint32_t spriteCount)
+    {
+        assert(spriteCount <= m_maxPackedSpriteCount);
+        return m_packedStaging.data();
+    }
+
+    void RecordingRenderBackend::drawPackedSprites(Texture* pTexture, uint32_t spriteCount)
+    {
+        ++m_drawCallCount;
+
+        sCommand command;
+        command.type = eCommandType::PACKED_SPRITES;
+        command.primitiveType = ePrimitiveType::TRIANGLES;
+        command.pTexture = pTexture;
+        command.firstVertex = static_cast<uint32_t>(m_packedSprites.size());
+        command.vertexCount = spriteCount;
+        command.scissorEnabled = false;
+        m_commands.push_back(command);
+        if (m_captureVertices)
+        {
+            m_packedSprites.insert(m_packedSprites.end(), m_packedStaging.begin(), m_packedStaging.begin() + spriteCount);
+        }
+    }
+
+    sRenderVertex* RecordingRenderBackend::beginPrimitives()
+    {
+        return m_primitiveStaging.data();
+    }
+
+    sRenderVertex* RecordingRenderBackend::drawPrimitives(ePrimitiveType primitiveType, Texture* pTexture, uint32_t vertexCount)
+    {
+        record(eCommandType::PRIMITIVES, primitiveType, pTexture, m_primitiveStaging.data(), vertexCount);
+        return m_primitiveStaging.data();
+    }
+
+    void RecordingRenderBackend::setScissor(bool enabled, const Rect& rect)
+    {
+        sCommand command;
+        command.type = eCommandType::SCISSOR;
+        command.primitiveType = ePrimitiveType::TRIANGLES;
+        command.pTexture = nullptr;
+        command.firstVertex = 0;
+        command.vertexCount = 0;
+        command.scissorEnabled = enabled;
+        command.scissor = rect;
+        m_commands.push_back(command);
+        ++m_stats.getCurrentFrame().scissorChangeCount;
+    }
+
+    void RecordingRenderBackend::record(eCommandType type, ePrimitiveType primitiveType, Texture* pTexture, const sRenderVertex* pVertices, uint32_t vertexCount)
+    {
+        ++m_drawCallCount;
+
+        sCommand command;
+        command.type = type;
+        command.primitiveType = primitiveType;
+        command.pTexture = pTexture;
+        command.firstVertex = static_cast<uint32_t>(m_vertices.size());
+        command.vertexCount = vertexCount;
+        command.scissorEnabled = false;
+        m_commands.push_back(command);
+        if (m_captureVertices)
+        {
+            m_vertices.insert(m_vertices.end(), pVertices, pVertices + vertexCount);
+        }
+    }
+}
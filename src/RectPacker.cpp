@@ -0,0 +1,114 @@
+#include "RectPacker.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace onut
+{
+    static bool isContainedIn(const RectPacker::sRect& a, const RectPacker::sRect& b)
+    {
+        return a.x >= b.x && a.y >= b.y &&
+            a.x + a.width <= b.x + b.width &&
+            a.y + a.height <= b.y + b.height;
+    }
+
+    RectPacker::RectPacker(uint32_t width, uint32_t height)
+        : m_width(width)
+        , m_height(height)
+    {
+        m_freeRects.push_back({0, 0, width, height});
+    }
+
+    bool RectPacker::insert(uint32_t width, uint32_t height, sRect& placed)
+    {
+        if (!width || !height) return false;
+
+        // Best short side fit, ties broken by long side
+        auto bestShortSide = std::numeric_limits<uint32_t>::max();
+        auto bestLongSide = std::numeric_limits<uint32_t>::max();
+        bool found = false;
+        for (auto& freeRect : m_freeRects)
+        {
+            if (freeRect.width < width || freeRect.height < height) continue;
+            auto leftoverX = freeRect.width - width;
+            auto leftoverY = freeRect.height - height;
+            auto shortSide = std::min<>(leftoverX, leftoverY);
+            auto longSide = std::max<>(leftoverX, leftoverY);
+            if (shortSide < bestShortSide || (shortSide == bestShortSide && longSide < bestLongSide))
+            {
+                placed = {freeRect.x, freeRect.y, width, height};
+                bestShortSide = shortSide;
+                bestLongSide = longSide;
+                found = true;
+            }
+        }
+        if (!found) return false;
+
+        splitFreeRects(placed);
+        pruneFreeRects();
+        m_usedArea += static_cast<uint64_t>(width) * static_cast<uint64_t>(height);
+        return true;
+    }
+
+    float RectPacker::getOccupancy() const
+    {
+        return static_cast<float>(static_cast<double>(m_usedArea) / (static_cast<double>(m_width) * static_cast<double>(m_height)));
+    }
+
+    void RectPacker::splitFreeRects(const sRect& placed)
+    {
+        m_newFreeRects.clear();
+        for (auto& freeRect : m_freeRects)
+        {
+            if (placed.x >= freeRect.x + freeRect.width || placed.x + placed.width <= freeRect.x ||
+                placed.y >= freeRect.y + freeRect.height || placed.y + placed.height <= freeRect.y)
+            {
+                m_newFreeRects.push_back(freeRect);
+                continue;
+            }
+
+            // Keep the maximal rectangles left on each side of the placed one
+            if (placed.x > freeRect.x)
+            {
+                m_newFreeRects.push_back({freeRect.x, freeRect.y, placed.x - freeRect.x, freeRect.height});
+            }
+            if (placed.x + placed.width < freeRect.x + freeRect.width)
+            {
+                auto x = placed.x + placed.width;
+                m_newFreeRects.push_back({x, freeRect.y, freeRect.x + freeRect.width - x, freeRect.height});
+            }
+            if (placed.y > freeRect.y)
+            {
+                m_newFreeRects.push_back({freeRect.x, freeRect.y, freeRect.width, placed.y - freeRect.y});
+            }
+            if (placed.y + placed.height < freeRect.y + freeRect.height)
+            {
+                auto y = placed.y + placed.height;
+                m_newFreeRects.push_back({freeRect.x, y, freeRect.width, freeRect.y + freeRect.height - y});
+            }
+        }
+        m_freeRects.swap(m_newFreeRects);
+    }
+
+    void RectPacker::pruneFreeRects()
+    {
+        // Remove free rectangles fully covered by another one
+        for (size_t i = 0; i < m_freeRects.size(); ++i)
+        {
+            for (size_t j = i + 1; j < m_freeRects.size(); ++j)
+            {
+                if (isContainedIn(m_freeRects[i], m_freeRects[j]))
+                {
+                    m_freeRects.erase(m_freeRects.begin() + i);
+                    --i;
+                    break;
+                }
+                if (isContainedIn(m_freeRects[j], m_freeRects[i]))
+                {
+                    m_freeRects.erase(m_freeRects.begin() + j);
+                    --j;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#include "RenderStats.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace onut
+{
+    RenderStats::RenderStats(uint32_t historySize)
+        : m_history(historySize)
+    {
+        assert(historySize > 0);
+    }
+
+    void RenderStats::nextFrame()
+    {
+        m_history[m_next] = m_current;
+        m_next = (m_next + 1) % static_cast<uint32_t>(m_history.size());
+        m_frameCount = std::min(m_frameCount + 1, static_cast<uint32_t>(m_history.size()));
+        m_current = sFrameStats();
+    }
+
+    const sFrameStats& RenderStats::getFrame(uint32_t framesAgo) const
+    {
+        assert(framesAgo < m_frameCount);
+        auto historySize = static_cast<uint32_t>(m_history.size());
+        return m_history[(m_next + historySize - 1 - framesAgo) % historySize];
+    }
+
+    sFrameStats RenderStats::getPeak() const
+    {
+        sFrameStats peak;
+        for (uint32_t i = 0; i < m_frameCount; ++i)
+        {
+            auto& frame = getFrame(i);
+            peak.spriteBatchCount = std::max(peak.spriteBatchCount, frame.spriteBatchCount);
+            peak.spriteCount = std::max(peak.spriteCount, frame.spriteCount);
+            peak.spriteFlushCount = std::max(peak.spriteFlushCount, frame.spriteFlushCount);
+            peak.textureSwitchCount = std::max(peak.textureSwitchCount, frame.textureSwitchCount);
+            peak.primitiveBatchCount = std::max(peak.primitiveBatchCount, frame.primitiveBatchCount);
+            peak.primitiveFlushCount = std::max(peak.primitiveFlushCount, frame.primitiveFlushCount);
+            peak.vertexCount = std::max(peak.vertexCount, frame.vertexCount);
+            peak.scissorChangeCount = std::max(peak.scissorChangeCount, frame.scissorChangeCount);
+            peak.renderTargetChangeCount = std::max(peak.renderTargetChangeCount, frame.renderTargetChangeCount);
+        }
+        return peak;
+    }
+
+    void RenderStats::dump(std::ostream& stream) const
+    {
+        stream << "frame,spriteBatches,sprites,spriteFlushes,textureSwitches,primitiveBatches,primitiveFlushes,vertices,scissorChanges,renderTargetChanges,drawCalls\n";
+        for (uint32_t i = m_frameCount; i-- > 0;)
+        {
+            auto& frame = getFrame(i);
+            stream << (m_frameCount - 1 - i) << ','
+                << frame.spriteBatchCount << ','
+                << frame.spriteCount << ','
+                << frame.spriteFlushCount << ','
+                << frame.textureSwitchCount << ','
+                << frame.primitiveBatchCount << ','
+                << frame.primitiveFlushCount << ','
+                << frame.vertexCount << ','
+                << frame.scissorChangeCount << ','
+                << frame.renderTargetChangeCount << ','
+                << frame.getDrawCallCount() << '\n';
+        }
+    }
+}
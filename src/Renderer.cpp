@@ -1,3 +1,4 @@
+#include "DeviceRenderBackend.h"
 #include "onut.h"
 #include "Renderer.h"
 #include "Window.h"
@@ -23,6 +24,7 @@ namespace onut
 
     Renderer::~Renderer()
     {
+        delete m_pBackend;
 #ifdef EASY_GRAPHIX
         egDestroyDevice(&m_device);
 #else
@@ -266,6 +268,8 @@ namespace onut
 
     void Renderer::beginFrame()
     {
+        m_stats.nextFrame();
+
 #ifdef EASY_GRAPHIX
         auto resolution = getResolution();
         egViewPort(0, 0, static_cast<uint32_t>(resolution.x), static_cast<uint32_t>(resolution.y));
@@ -296,6 +300,8 @@ namespace onut
 
     void Renderer::bindRenderTarget(Texture *pTexture)
     {
+        ++m_stats.getCurrentFrame().renderTargetChangeCount;
+
 #ifdef EASY_GRAPHIX
         if (pTexture == nullptr)
         {
@@ -452,8 +458,20 @@ namespace onut
         m_renderSetup = eRenderSetup::SETUP_3D;
     }
 
+    IRenderBackend* Renderer::getBackend()
+    {
+        // Created on first use, it needs ORenderer to be set
+        if (!m_pBackend)
+        {
+            m_pBackend = new DeviceRenderBackend(OSettings->getSpriteBufferCapacity());
+        }
+        return m_pBackend;
+    }
+
     void Renderer::setScissor(bool enabled, const Rect& rect)
     {
+        ++m_stats.getCurrentFrame().scissorChangeCount;
+
 #ifdef EASY_GRAPHIX
         if (enabled)
         {
@@ -94,6 +94,16 @@ namespace onut
         m_isFixedStep = isFixedStep;
     }
 
+    void Settings::setTextureCachePath(const std::string& textureCachePath)
+    {
+        m_textureCachePath = textureCachePath;
+    }
+
+    void Settings::setSpriteBufferCapacity(uint32_t spriteBufferCapacity)
+    {
+        m_spriteBufferCapacity = spriteBufferCapacity;
+    }
+
     void Settings::setUserSettingDefault(const std::string& key, const std::string& value)
     {
         auto it = m_userSettings.find(key);
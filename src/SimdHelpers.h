@@ -0,0 +1,89 @@
+#pragma once
+// Compile time detection of the vector instruction sets, plus runtime CPU checks.
+// Kernels are compiled for every set the compiler can emit, and picked at runtime.
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define ONUT_SIMD_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define ONUT_TARGET_SSSE3
+#define ONUT_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define ONUT_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define ONUT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define ONUT_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace onut
+{
+    namespace simd
+    {
+#if defined(ONUT_SIMD_X86)
+        struct sCpuFeatures
+        {
+            bool ssse3 = false;
+            bool avx2 = false;
+
+            sCpuFeatures()
+            {
+                int regs[4] = {0};
+                cpuid(regs, 0);
+                auto maxLeaf = regs[0];
+                if (maxLeaf < 1) return;
+
+                cpuid(regs, 1);
+                ssse3 = (regs[2] & (1 << 9)) != 0;
+                bool osxsave = (regs[2] & (1 << 27)) != 0;
+                bool avx = (regs[2] & (1 << 28)) != 0;
+                if (!osxsave || !avx || maxLeaf < 7) return;
+
+                // The OS has to save the YMM registers on context switches
+                if ((xgetbv() & 0x6) != 0x6) return;
+
+                cpuid(regs, 7);
+                avx2 = (regs[1] & (1 << 5)) != 0;
+            }
+
+        private:
+            static void cpuid(int regs[4], int leaf)
+            {
+#if defined(_MSC_VER)
+                __cpuidex(regs, leaf, 0);
+#else
+                __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+            }
+
+            static unsigned long long xgetbv()
+            {
+#if defined(_MSC_VER)
+                return _xgetbv(0);
+#else
+                unsigned int eax, edx;
+                __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+                return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+            }
+        };
+
+        inline const sCpuFeatures& getCpuFeatures()
+        {
+            static const sCpuFeatures features;
+            return features;
+        }
+
+        inline bool hasSSSE3() { return getCpuFeatures().ssse3; }
+        inline bool hasAVX2() { return getCpuFeatures().avx2; }
+#else
+        inline bool hasSSSE3() { return false; }
+        inline bool hasAVX2() { return false; }
+#endif
+    }
+}
@@ -0,0 +1,38 @@
+#include "SimdHelpers.h"
+#include "SimdPath.h"
+
+namespace onut
+{
+    bool isSimdPathSupported(eSimdPath path)
+    {
+        switch (path)
+        {
+            case eSimdPath::AUTO:
+            case eSimdPath::SCALAR:
+                return true;
+#if defined(ONUT_SIMD_X86)
+            case eSimdPath::SSE2:
+                return true;
+            case eSimdPath::AVX2:
+                return simd::hasAVX2();
+#elif defined(ONUT_SIMD_NEON)
+            case eSimdPath::NEON:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    eSimdPath getBestSimdPath()
+    {
+        static const eSimdPath bestPath = []
+        {
+            if (isSimdPathSupported(eSimdPath::AVX2)) return eSimdPath::AVX2;
+            if (isSimdPathSupported(eSimdPath::SSE2)) return eSimdPath::SSE2;
+            if (isSimdPathSupported(eSimdPath::NEON)) return eSimdPath::NEON;
+            return eSimdPath::SCALAR;
+        }();
+        return bestPath;
+    }
+}
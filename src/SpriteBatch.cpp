@@ -1,168 +1,245 @@
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include "onut.h"
+#include "RenderStats.h"
+#include "SimdHelpers.h"
 #include "SpriteBatch.h"
+#include "SpriteCommandList.h"
+#include "TextureAtlas.h"
 
 namespace onut
 {
-    SpriteBatch::SpriteBatch()
-    {
-#ifndef EASY_GRAPHIX
-        auto pDevice = ORenderer->getDevice();
-        auto pDeviceContext = ORenderer->getDeviceContext();
-
-        // Create a white texture for rendering "without" texture
-        unsigned char white[4] = {255, 255, 255, 255};
-        m_pTexWhite = Texture::createFromData({1, 1}, white, false);
-
-        SVertexP2T2C4 vertices[MAX_SPRITE_COUNT * 4];
-        unsigned short indices[MAX_SPRITE_COUNT * 6];
-        for (unsigned int i = 0; i < MAX_SPRITE_COUNT; ++i)
-        {
-            indices[i * 6 + 0] = i * 4 + 0;
-            indices[i * 6 + 1] = i * 4 + 1;
-            indices[i * 6 + 2] = i * 4 + 2;
-            indices[i * 6 + 3] = i * 4 + 2;
-            indices[i * 6 + 4] = i * 4 + 3;
-            indices[i * 6 + 5] = i * 4 + 0;
-        }
-
-        // Set up the description of the static vertex buffer.
-        D3D11_BUFFER_DESC vertexBufferDesc;
-        vertexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-        vertexBufferDesc.ByteWidth = sizeof(vertices);
-        vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-        vertexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-        vertexBufferDesc.MiscFlags = 0;
-        vertexBufferDesc.StructureByteStride = 0;
-
-        // Give the subresource structure a pointer to the vertex data.
-        D3D11_SUBRESOURCE_DATA vertexData;
-        vertexData.pSysMem = vertices;
-        vertexData.SysMemPitch = 0;
-        vertexData.SysMemSlicePitch = 0;
-
-        auto ret = pDevice->CreateBuffer(&vertexBufferDesc, &vertexData, &m_pVertexBuffer);
-        assert(ret == S_OK);
-
-        // Set up the description of the static index buffer.
-        D3D11_BUFFER_DESC indexBufferDesc;
-        indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
-        indexBufferDesc.ByteWidth = sizeof(unsigned short) * 6 * MAX_SPRITE_COUNT;
-        indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-        indexBufferDesc.CPUAccessFlags = 0;
-        indexBufferDesc.MiscFlags = 0;
-        indexBufferDesc.StructureByteStride = 0;
-
-        // Give the subresource structure a pointer to the index data.
-        D3D11_SUBRESOURCE_DATA indexData;
-        indexData.pSysMem = indices;
-        indexData.SysMemPitch = 0;
-        indexData.SysMemSlicePitch = 0;
-
-        ret = pDevice->CreateBuffer(&indexBufferDesc, &indexData, &m_pIndexBuffer);
-        assert(ret == S_OK);
-
-        ret = pDevice->CreateBlendState(&(D3D11_BLEND_DESC{
-            FALSE,
-            FALSE,
-            {{
-                    TRUE,
-                    D3D11_BLEND_ONE,
-                    D3D11_BLEND_ZERO,
-                    D3D11_BLEND_OP_ADD,
-                    D3D11_BLEND_ONE,
-                    D3D11_BLEND_ZERO,
-                    D3D11_BLEND_OP_ADD,
-                    D3D10_COLOR_WRITE_ENABLE_ALL
-                }, {0}, {0}, {0}, {0}, {0}, {0}, {0}}
-        }), &m_pForceWriteBlend);
-        assert(ret == S_OK);
-#endif /* !EASY_GRAPHIX */
+    SpriteBatch::SpriteBatch(IRenderBackend* pBackend)
+        : m_pBackend(pBackend)
+    {
+        if (!m_pBackend) m_pBackend = ORenderer->getBackend();
+        m_maxSpriteCount = m_pBackend->getMaxSpriteCount();
+        m_pStats = m_pBackend->getStats();
     }
 
     SpriteBatch::~SpriteBatch()
     {
-#ifndef EASY_GRAPHIX
-        if (m_pForceWriteBlend) m_pForceWriteBlend->Release();
-        if (m_pVertexBuffer) m_pVertexBuffer->Release();
-        if (m_pIndexBuffer) m_pIndexBuffer->Release();
-        delete m_pTexWhite;
-#endif /* !EASY_GRAPHIX */
     }
 
-    void SpriteBatch::begin(eBlendMode blendMode)
+    void SpriteBatch::begin(eBlendMode blendMode, eSortMode sortMode)
     {
-#ifdef EASY_GRAPHIX
-        ORenderer->setupFor2D();
+        assert(!m_isDrawing); // Cannot call begin() twice without calling end()
+
+        m_sortMode = sortMode;
+        m_depth = 0.f;
+        m_scissorEnabled = false;
+        m_userScissorEnabled = false;
+        m_clipScissor = false;
         m_pTexture = nullptr;
         m_spriteCount = 0;
-#else /* EASY_GRAPHIX */
-        assert(!m_isDrawing); // Cannot call begin() twice without calling end()
+        m_isDrawing = true;
+        m_pVertices = m_pBackend->beginSprites(blendMode == eBlendMode::FORCE_WRITE);
+        if (m_pStats) ++m_pStats->getCurrentFrame().spriteBatchCount;
+    }
+
+    sRenderVertex* SpriteBatch::beginQuad(Texture* pTexture)
+    {
+        assert(m_isDrawing); // Should call begin() before calling draw()
 
-        ORenderer->setupFor2D();
-        m_curBlendMode = blendMode;
-        if (m_curBlendMode == eBlendMode::FORCE_WRITE)
+        if (!pTexture) pTexture = m_pBackend->getWhiteTexture();
+        if (m_sortMode == eSortMode::IMMEDIATE)
         {
-            ORenderer->getDeviceContext()->OMSetBlendState(m_pForceWriteBlend, NULL, 0xffffffff);
+            return beginImmediateQuad(pTexture);
         }
-        m_pTexture = nullptr;
-        m_isDrawing = true;
-        ORenderer->getDeviceContext()->Map(m_pVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &m_pMappedVertexBuffer);
-#endif /* !EASY_GRAPHIX */
+
+        // Keep it for end()
+        m_deferredSprites.push_back({pTexture, m_depth, m_clipIndex});
+        m_deferredVertices.resize(m_deferredVertices.size() + 4);
+        return &m_deferredVertices[m_deferredVertices.size() - 4];
     }
 
-    void SpriteBatch::drawRectWithColors(Texture* pTexture, const Rect& rect, const std::vector<Color>& colors)
+    void SpriteBatch::endQuad()
+    {
+        if (m_sortMode == eSortMode::IMMEDIATE)
+        {
+            endImmediateQuad();
+        }
+    }
+
+    sRenderVertex* SpriteBatch::beginImmediateQuad(Texture* pTexture)
     {
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
+        if (pTexture != m_pTexture)
+        {
+            if (m_pStats && m_spriteCount) ++m_pStats->getCurrentFrame().textureSwitchCount;
+            flush();
+        }
         m_pTexture = pTexture;
-        if (!m_spriteCount)
+        return m_pVertices + (m_spriteCount * 4);
+    }
+
+    void SpriteBatch::endImmediateQuad()
+    {
+        if ((m_clipIndex != NO_CLIP || m_clipScissor) && !clipQuad())
         {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
+            return; // Culled, the next quad goes over it
+        }
+
+        ++m_spriteCount;
+
+        if (m_spriteCount == m_maxSpriteCount)
+        {
+            flush();
+        }
+    }
+
+    sRenderVertex* SpriteBatch::beginQuads(Texture* pTexture, uint32_t& count)
+    {
+        if (m_sortMode == eSortMode::IMMEDIATE)
+        {
+            auto pVerts = beginImmediateQuad(pTexture);
+            count = std::min(count, m_maxSpriteCount - m_spriteCount);
+            if (m_clipIndex != NO_CLIP || m_clipScissor)
             {
-                egBindDiffuse(0);
+                count = 1; // Each one can be culled or need a scissor
             }
-            egBegin(EG_QUADS);
+            return pVerts;
         }
 
-        egColor4(colors[0].x, colors[0].y, colors[0].z, colors[0].w);
-        egTexCoord(0, 0);
-        egPosition2(rect.x, rect.y);
+        m_deferredSprites.insert(m_deferredSprites.end(), count, {pTexture, m_depth, m_clipIndex});
+        m_deferredVertices.resize(m_deferredVertices.size() + count * 4);
+        return &m_deferredVertices[m_deferredVertices.size() - count * 4];
+    }
 
-        egColor4(colors[1].x, colors[1].y, colors[1].z, colors[1].w);
-        egTexCoord(0, 1);
-        egPosition2(rect.x, rect.y + rect.w);
+    void SpriteBatch::endQuads(uint32_t count)
+    {
+        if (m_sortMode == eSortMode::IMMEDIATE)
+        {
+            if (m_clipIndex != NO_CLIP || m_clipScissor)
+            {
+                endImmediateQuad();
+                return;
+            }
+            m_spriteCount += count;
+            if (m_spriteCount == m_maxSpriteCount)
+            {
+                flush();
+            }
+        }
+    }
 
-        egColor4(colors[2].x, colors[2].y, colors[2].z, colors[2].w);
-        egTexCoord(1, 1);
-        egPosition2(rect.x + rect.z, rect.y + rect.w);
+    // Corners of an axis aligned quad, possibly mirrored, moved inside the clip.
+    // Texture coordinates and colors are interpolated. False when the quad is rotated.
+    static bool cutQuad(sRenderVertex* pVerts, const Vector2& quadMin, const Vector2& quadMax, const Vector2& clipMin, const Vector2& clipMax)
+    {
+        // Which vertex is on each corner, bit 0 for the right and bit 1 for the bottom
+        int corners[4] = {-1, -1, -1, -1};
+        for (int i = 0; i < 4; ++i)
+        {
+            auto& position = pVerts[i].position;
+            if ((position.x != quadMin.x && position.x != quadMax.x) ||
+                (position.y != quadMin.y && position.y != quadMax.y)) return false;
+            auto corner = ((position.x == quadMax.x) ? 1 : 0) | ((position.y == quadMax.y) ? 2 : 0);
+            if (corners[corner] != -1) return false;
+            corners[corner] = i;
+        }
 
-        egColor4(colors[3].x, colors[3].y, colors[3].z, colors[3].w);
-        egTexCoord(1, 0);
-        egPosition2(rect.x + rect.z, rect.y);
+        sRenderVertex original[4];
+        memcpy(original, pVerts, sizeof(original));
+        auto& topLeft = original[corners[0]];
+        auto& topRight = original[corners[1]];
+        auto& bottomLeft = original[corners[2]];
+        auto& bottomRight = original[corners[3]];
+        auto cutMin = Vector2::Max(quadMin, clipMin);
+        auto cutMax = Vector2::Min(quadMax, clipMax);
+        auto size = quadMax - quadMin;
+        for (int corner = 0; corner < 4; ++corner)
+        {
+            auto& vert = pVerts[corners[corner]];
+            vert.position.x = (corner & 1) ? cutMax.x : cutMin.x;
+            vert.position.y = (corner & 2) ? cutMax.y : cutMin.y;
+            auto tx = (vert.position.x - quadMin.x) / size.x;
+            auto ty = (vert.position.y - quadMin.y) / size.y;
+            vert.texCoord = Vector2::Lerp(Vector2::Lerp(topLeft.texCoord, topRight.texCoord, tx),
+                                          Vector2::Lerp(bottomLeft.texCoord, bottomRight.texCoord, tx), ty);
+            vert.color = Color::Lerp(Color::Lerp(topLeft.color, topRight.color, tx),
+                                     Color::Lerp(bottomLeft.color, bottomRight.color, tx), ty);
+        }
+        return true;
+    }
 
-        ++m_spriteCount;
+    bool SpriteBatch::clipQuad()
+    {
+        auto pVerts = m_pVertices + m_spriteCount * 4;
+        auto quadMin = pVerts[0].position;
+        auto quadMax = quadMin;
+        for (int i = 1; i < 4; ++i)
+        {
+            quadMin = Vector2::Min(quadMin, pVerts[i].position);
+            quadMax = Vector2::Max(quadMax, pVerts[i].position);
+        }
 
-        if (m_spriteCount == MAX_SPRITE_COUNT)
+        if (m_clipIndex != NO_CLIP)
         {
-            flush();
+            auto& clip = m_clips[m_clipIndex];
+            Vector2 clipMin(clip.x, clip.y);
+            Vector2 clipMax(clip.x + clip.z, clip.y + clip.w);
+            if (quadMax.x <= clipMin.x || quadMax.y <= clipMin.y ||
+                quadMin.x >= clipMax.x || quadMin.y >= clipMax.y)
+            {
+                return false;
+            }
+            if (quadMin.x < clipMin.x || quadMin.y < clipMin.y ||
+                quadMax.x > clipMax.x || quadMax.y > clipMax.y)
+            {
+                if (!cutQuad(pVerts, quadMin, quadMax, clipMin, clipMax))
+                {
+                    // Within the scissor from setScissor() too
+                    auto scissor = clip;
+                    if (m_userScissorEnabled)
+                    {
+                        auto scissorMin = Vector2::Max(clipMin, Vector2(m_userScissor.x, m_userScissor.y));
+                        auto scissorMax = Vector2::Min(clipMax, Vector2(m_userScissor.x + m_userScissor.z, m_userScissor.y + m_userScissor.w));
+                        if (scissorMax.x <= scissorMin.x || scissorMax.y <= scissorMin.y) return false;
+                        scissor = Rect(scissorMin.x, scissorMin.y, scissorMax.x - scissorMin.x, scissorMax.y - scissorMin.y);
+                    }
+                    if (!m_scissorEnabled || m_scissor != scissor)
+                    {
+                        changeScissor(true, scissor);
+                        m_clipScissor = true;
+                    }
+                    return true;
+                }
+                quadMin = Vector2::Max(quadMin, clipMin);
+                quadMax = Vector2::Min(quadMax, clipMax);
+            }
         }
-#else /* EASY_GRAPHIX */
-        assert(m_isDrawing); // Should call begin() before calling draw()
-        assert(colors.size() == 4); // Needs 4 colors
 
-        if (!pTexture) pTexture = m_pTexWhite;
-        if (pTexture != m_pTexture)
+        // Not clipped by the GPU, so the scissor set for a previous sprite must not cut it. Back to setScissor()'s
+        if (m_clipScissor &&
+            (quadMin.x < m_scissor.x || quadMin.y < m_scissor.y ||
+             quadMax.x > m_scissor.x + m_scissor.z || quadMax.y > m_scissor.y + m_scissor.w))
         {
-            flush();
+            changeScissor(m_userScissorEnabled, m_userScissor);
+            m_clipScissor = false;
         }
+        return true;
+    }
+
+    void SpriteBatch::changeScissor(bool enabled, const Rect& rect)
+    {
+        // The quad being written is drawn after the change
+        sRenderVertex quad[4];
+        memcpy(quad, m_pVertices + m_spriteCount * 4, sizeof(quad));
+        auto pTexture = m_pTexture;
+        flush();
+        m_pBackend->setScissor(enabled, rect);
+        m_scissorEnabled = enabled;
+        m_scissor = rect;
         m_pTexture = pTexture;
+        memcpy(m_pVertices, quad, sizeof(quad));
+    }
+
+    void SpriteBatch::drawRectWithColors(Texture* pTexture, const Rect& rect, const std::vector<Color>& colors)
+    {
+        assert(colors.size() == 4); // Needs 4 colors
 
-        SVertexP2T2C4* pVerts = static_cast<SVertexP2T2C4*>(m_pMappedVertexBuffer.pData) + (m_spriteCount * 4);
+        auto pVerts = beginQuad(pTexture);
         pVerts[0].position = {rect.x, rect.y};
         pVerts[0].texCoord = {0, 0};
         pVerts[0].color = colors[0];
@@ -178,14 +255,7 @@ namespace onut
         pVerts[3].position = {rect.x + rect.z, rect.y};
         pVerts[3].texCoord = {1, 0};
         pVerts[3].color = colors[3];
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#endif /* !EASY_GRAPHIX */
+        endQuad();
     }
 
     void SpriteBatch::drawAbsoluteRect(Texture* pTexture, const Rect& rect, const Color& color)
@@ -195,52 +265,7 @@ namespace onut
 
     void SpriteBatch::drawRect(Texture* pTexture, const Rect& rect, const Color& color)
     {
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
-
-        egColor4(color.x, color.y, color.z, color.w);
-        egTexCoord(0, 0);
-        egPosition2(rect.x, rect.y);
-
-        egTexCoord(0, 1);
-        egPosition2(rect.x, rect.y + rect.w);
-
-        egTexCoord(1, 1);
-        egPosition2(rect.x + rect.z, rect.y + rect.w);
-
-        egTexCoord(1, 0);
-        egPosition2(rect.x + rect.z, rect.y);
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#else /* EASY_GRAPHIX */
-        assert(m_isDrawing); // Should call begin() before calling draw()
-
-        if (!pTexture) pTexture = m_pTexWhite;
-        if (pTexture != m_pTexture)
-        {
-            flush();
-        }
-        m_pTexture = pTexture;
-
-        SVertexP2T2C4* pVerts = static_cast<SVertexP2T2C4*>(m_pMappedVertexBuffer.pData) + (m_spriteCount * 4);
+        auto pVerts = beginQuad(pTexture);
         pVerts[0].position = {rect.x, rect.y};
         pVerts[0].texCoord = {0, 0};
         pVerts[0].color = color;
@@ -256,38 +281,12 @@ namespace onut
         pVerts[3].position = {rect.x + rect.z, rect.y};
         pVerts[3].texCoord = {1, 0};
         pVerts[3].color = color;
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#endif /* !EASY_GRAPHIX */
+        endQuad();
     }
 
     void SpriteBatch::drawRectScaled9(Texture* pTexture, const Rect& rect, const Vector4& padding, const Color& color)
     {
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
-#else /* EASY_GRAPHIX */
-        assert(m_isDrawing); // Should call begin() before calling draw()
-
-        if (!pTexture) pTexture = m_pTexWhite;
-#endif /* !EASY_GRAPHIX */
+        if (!pTexture) pTexture = m_pBackend->getWhiteTexture();
 
         auto textureSize = pTexture->getSize();
         auto sizexf = static_cast<float>(textureSize.x);
@@ -327,26 +326,7 @@ namespace onut
 
     void SpriteBatch::drawRectScaled9RepeatCenters(Texture* pTexture, const Rect& rect, const Vector4& padding, const Color& color)
     {
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
-#else /* EASY_GRAPHIX */
-        assert(m_isDrawing); // Should call begin() before calling draw()
-
-        if (!pTexture) pTexture = m_pTexWhite;
-#endif /* !EASY_GRAPHIX */
+        if (!pTexture) pTexture = m_pBackend->getWhiteTexture();
 
         auto textureSize = pTexture->getSize();
         auto sizexf = static_cast<float>(textureSize.x);
@@ -422,52 +402,7 @@ namespace onut
 
     void SpriteBatch::drawInclinedRect(Texture* pTexture, const Rect& rect, float inclinedRatio, const Color& color)
     {
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
-
-        egColor4(color.x, color.y, color.z, color.w);
-        egTexCoord(0, 0);
-        egPosition2(rect.x, rect.y);
-
-        egTexCoord(0, 1);
-        egPosition2(rect.x + inclinedRatio * rect.w, rect.y + rect.w);
-
-        egTexCoord(1, 1);
-        egPosition2(rect.x + rect.z + inclinedRatio * rect.w, rect.y + rect.w);
-
-        egTexCoord(1, 0);
-        egPosition2(rect.x + rect.z, rect.y);
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#else /* EASY_GRAPHIX */
-        assert(m_isDrawing); // Should call begin() before calling draw()
-
-        if (!pTexture) pTexture = m_pTexWhite;
-        if (pTexture != m_pTexture)
-        {
-            flush();
-        }
-        m_pTexture = pTexture;
-
-        SVertexP2T2C4* pVerts = static_cast<SVertexP2T2C4*>(m_pMappedVertexBuffer.pData) + (m_spriteCount * 4);
+        auto pVerts = beginQuad(pTexture);
         pVerts[0].position = {rect.x, rect.y};
         pVerts[0].texCoord = {0, 0};
         pVerts[0].color = color;
@@ -483,64 +418,12 @@ namespace onut
         pVerts[3].position = {rect.x + rect.z, rect.y};
         pVerts[3].texCoord = {1, 0};
         pVerts[3].color = color;
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#endif /* !EASY_GRAPHIX */
+        endQuad();
     }
 
     void SpriteBatch::drawRectWithUVs(Texture* pTexture, const Rect& rect, const Vector4& uvs, const Color& color)
     {
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
-
-        egColor4(color.x, color.y, color.z, color.w);
-        egTexCoord(uvs.x, uvs.y);
-        egPosition2(rect.x, rect.y);
-
-        egTexCoord(uvs.x, uvs.w);
-        egPosition2(rect.x, rect.y + rect.w);
-
-        egTexCoord(uvs.z, uvs.w);
-        egPosition2(rect.x + rect.z, rect.y + rect.w);
-
-        egTexCoord(uvs.z, uvs.y);
-        egPosition2(rect.x + rect.z, rect.y);
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#else /* EASY_GRAPHIX */
-        assert(m_isDrawing); // Should call begin() before calling draw()
-
-        if (!pTexture) pTexture = m_pTexWhite;
-        if (pTexture != m_pTexture)
-        {
-            flush();
-        }
-        m_pTexture = pTexture;
-
-        SVertexP2T2C4* pVerts = static_cast<SVertexP2T2C4*>(m_pMappedVertexBuffer.pData) + (m_spriteCount * 4);
+        auto pVerts = beginQuad(pTexture);
         pVerts[0].position = {rect.x, rect.y};
         pVerts[0].texCoord = {uvs.x, uvs.y};
         pVerts[0].color = color;
@@ -556,68 +439,14 @@ namespace onut
         pVerts[3].position = {rect.x + rect.z, rect.y};
         pVerts[3].texCoord = {uvs.z, uvs.y};
         pVerts[3].color = color;
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#endif /* !EASY_GRAPHIX */
+        endQuad();
     }
 
     void SpriteBatch::drawRectWithUVsColors(Texture* pTexture, const Rect& rect, const Vector4& uvs, const std::vector<Color>& colors)
     {
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
-
-        egColor4(colors[0].x, colors[0].y, colors[0].z, colors[0].w);
-        egTexCoord(uvs.x, uvs.y);
-        egPosition2(rect.x, rect.y);
-
-        egColor4(colors[1].x, colors[1].y, colors[1].z, colors[1].w);
-        egTexCoord(uvs.x, uvs.w);
-        egPosition2(rect.x, rect.y + rect.w);
-
-        egColor4(colors[2].x, colors[2].y, colors[2].z, colors[2].w);
-        egTexCoord(uvs.z, uvs.w);
-        egPosition2(rect.x + rect.z, rect.y + rect.w);
-
-        egColor4(colors[3].x, colors[3].y, colors[3].z, colors[3].w);
-        egTexCoord(uvs.z, uvs.y);
-        egPosition2(rect.x + rect.z, rect.y);
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#else /* EASY_GRAPHIX */
-        assert(m_isDrawing); // Should call begin() before calling draw()
         assert(colors.size() == 4); // Needs 4 colors
 
-        if (!pTexture) pTexture = m_pTexWhite;
-        if (pTexture != m_pTexture)
-        {
-            flush();
-        }
-        m_pTexture = pTexture;
-
-        SVertexP2T2C4* pVerts = static_cast<SVertexP2T2C4*>(m_pMappedVertexBuffer.pData) + (m_spriteCount * 4);
+        auto pVerts = beginQuad(pTexture);
         pVerts[0].position = {rect.x, rect.y};
         pVerts[0].texCoord = {uvs.x, uvs.y};
         pVerts[0].color = colors[0];
@@ -633,36 +462,12 @@ namespace onut
         pVerts[3].position = {rect.x + rect.z, rect.y};
         pVerts[3].texCoord = {uvs.z, uvs.y};
         pVerts[3].color = colors[3];
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#endif /* !EASY_GRAPHIX */
+        endQuad();
     }
 
     void SpriteBatch::draw4Corner(Texture* pTexture, const Rect& rect, const Color& color)
     {
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
-#else /* EASY_GRAPHIX */
-        if (!pTexture) pTexture = m_pTexWhite;
-#endif /* !EASY_GRAPHIX */
+        if (!pTexture) pTexture = m_pBackend->getWhiteTexture();
 
         auto textureSize = pTexture->getSize();
         auto sizexf = static_cast<float>(textureSize.x);
@@ -677,24 +482,6 @@ namespace onut
     void SpriteBatch::drawSprite(Texture* pTexture, const Vector2& position, const Color& color)
     {
         if (!pTexture) return;
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
-#else /* EASY_GRAPHIX */
-        if (!pTexture) pTexture = m_pTexWhite;
-#endif /* !EASY_GRAPHIX */
 
         auto& textureSize = pTexture->getSize();
         auto sizexf = static_cast<float>(textureSize.x);
@@ -718,100 +505,46 @@ namespace onut
         Vector2 right{cosTheta * hSize.x, sinTheta * hSize.x};
         Vector2 down{-sinTheta * hSize.y, cosTheta * hSize.y};
 
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
-
-        egColor4(color.x, color.y, color.z, color.w);
-        egTexCoord(uvs.x, uvs.y);
-        egPosition2(position.x - right.x - down.x, position.y - right.y - down.y);
-
-        egTexCoord(uvs.x, uvs.w);
-        egPosition2(position.x - right.x + down.x, position.y - right.y + down.y);
-
-        egTexCoord(uvs.z, uvs.w);
-        egPosition2(position.x + right.x + down.x, position.y + right.y + down.y);
-
-        egTexCoord(uvs.z, uvs.y);
-        egPosition2(position.x + right.x - down.x, position.y + right.y - down.y);
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#else /* EASY_GRAPHIX */
-        if (!pTexture) pTexture = m_pTexWhite;
-        if (pTexture != m_pTexture)
-        {
-            flush();
-        }
-        m_pTexture = pTexture;
-
-        SVertexP2T2C4* pVerts = static_cast<SVertexP2T2C4*>(m_pMappedVertexBuffer.pData) + (m_spriteCount * 4);
+        auto pVerts = beginQuad(pTexture);
         pVerts[0].position = position;
         pVerts[0].position -= right;
         pVerts[0].position -= down;
-        pVerts[0].texCoord = {0, 0};
+        pVerts[0].texCoord = {uvs.x, uvs.y};
         pVerts[0].color = color;
 
         pVerts[1].position = position;
         pVerts[1].position -= right;
         pVerts[1].position += down;
-        pVerts[1].texCoord = {0, 1};
+        pVerts[1].texCoord = {uvs.x, uvs.w};
         pVerts[1].color = color;
 
         pVerts[2].position = position;
         pVerts[2].position += right;
         pVerts[2].position += down;
-        pVerts[2].texCoord = {1, 1};
+        pVerts[2].texCoord = {uvs.z, uvs.w};
         pVerts[2].color = color;
 
         pVerts[3].position = position;
         pVerts[3].position += right;
         pVerts[3].position -= down;
-        pVerts[3].texCoord = {1, 0};
+        pVerts[3].texCoord = {uvs.z, uvs.y};
         pVerts[3].color = color;
+        endQuad();
+    }
 
-        ++m_spriteCount;
+    void SpriteBatch::drawRectWithUVs(const AtlasRegion& region, const Rect& rect, const Color& color)
+    {
+        drawRectWithUVs(region.pTexture, rect, region.uvs, color);
+    }
 
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#endif /* !EASY_GRAPHIX */
+    void SpriteBatch::drawSpriteWithUVs(const AtlasRegion& region, const Vector2& position, const Color& color, float rotation, float scale)
+    {
+        drawSpriteWithUVs(region.pTexture, position, region.uvs, color, rotation, scale);
     }
 
     void SpriteBatch::drawBeam(Texture* pTexture, const Vector2& from, const Vector2& to, float size, const Color& color, float uOffset, float uScale)
     {
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
+        if (!pTexture) pTexture = m_pBackend->getWhiteTexture();
 
         auto texSize = pTexture->getSizef();
         Vector2 dir = to - from;
@@ -821,42 +554,7 @@ namespace onut
         Vector2 right{-dir.y, dir.x};
         right *= size * .5f;
 
-        egColor4(color.x, color.y, color.z, color.w);
-        egTexCoord(uOffset, 0);
-        egPosition2(from.x - right.x, from.y - right.y);
-
-        egTexCoord(uOffset, 1);
-        egPosition2(from.x + right.x, from.y + right.y);
-
-        egTexCoord(uOffset + len * uScale / texSize.x, 1);
-        egPosition2(to.x + right.x, to.y + right.y);
-
-        egTexCoord(uOffset + len * uScale / texSize.x, 0);
-        egPosition2(to.x - right.x, to.y - right.y);
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#else
-        if (!pTexture) pTexture = m_pTexWhite;
-        if (pTexture != m_pTexture)
-        {
-            flush();
-        }
-        m_pTexture = pTexture;
-
-        auto texSize = m_pTexture->getSizef();
-        Vector2 dir = to - from;
-        float len = dir.Length();
-        if (len == 0) return;
-        dir /= len;
-        Vector2 right{-dir.y, dir.x};
-        right *= size * .5f;
-
-        SVertexP2T2C4* pVerts = static_cast<SVertexP2T2C4*>(m_pMappedVertexBuffer.pData) + (m_spriteCount * 4);
+        auto pVerts = beginQuad(pTexture);
         pVerts[0].position = Vector2(from.x - right.x, from.y - right.y);
         pVerts[0].texCoord = {uOffset, 0};
         pVerts[0].color = color;
@@ -872,14 +570,7 @@ namespace onut
         pVerts[3].position = Vector2(to.x - right.x, to.y - right.y);
         pVerts[3].texCoord = {uOffset + len * uScale / texSize.x, 0};
         pVerts[3].color = color;
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#endif
+        endQuad();
     }
 
     void SpriteBatch::drawSprite(Texture* pTexture, const Vector2& position, const Color& color, float rotation, float scale)
@@ -896,50 +587,7 @@ namespace onut
         Vector2 right{cosTheta * hSize.x, sinTheta * hSize.x};
         Vector2 down{-sinTheta * hSize.y, cosTheta * hSize.y};
 
-#ifdef EASY_GRAPHIX
-        if (pTexture != m_pTexture) flush();
-        m_pTexture = pTexture;
-        if (!m_spriteCount)
-        {
-            if (m_pTexture)
-            {
-                m_pTexture->bind();
-            }
-            else
-            {
-                egBindDiffuse(0);
-            }
-            egBegin(EG_QUADS);
-        }
-
-        egColor4(color.x, color.y, color.z, color.w);
-        egTexCoord(0, 0);
-        egPosition2(position.x - right.x - down.x, position.y - right.y - down.y);
-
-        egTexCoord(0, 1);
-        egPosition2(position.x - right.x + down.x, position.y - right.y + down.y);
-
-        egTexCoord(1, 1);
-        egPosition2(position.x + right.x + down.x, position.y + right.y + down.y);
-
-        egTexCoord(1, 0);
-        egPosition2(position.x + right.x - down.x, position.y + right.y - down.y);
-
-        ++m_spriteCount;
-
-        if (m_spriteCount == MAX_SPRITE_COUNT)
-        {
-            flush();
-        }
-#else /* EASY_GRAPHIX */
-        if (!pTexture) pTexture = m_pTexWhite;
-        if (pTexture != m_pTexture)
-        {
-            flush();
-        }
-        m_pTexture = pTexture;
-
-        SVertexP2T2C4* pVerts = static_cast<SVertexP2T2C4*>(m_pMappedVertexBuffer.pData) + (m_spriteCount * 4);
+        auto pVerts = beginQuad(pTexture);
         pVerts[0].position = position;
         pVerts[0].position -= right;
         pVerts[0].position -= down;
@@ -963,35 +611,575 @@ namespace onut
         pVerts[3].position -= down;
         pVerts[3].texCoord = {1, 0};
         pVerts[3].color = color;
+        endQuad();
+    }
 
-        ++m_spriteCount;
+    static_assert(sizeof(sRenderVertex) == 32, "Quad kernels store position and texCoord together, then color");
+
+    // sin/cos of an angle in degrees. Reduced to [-45, 45] by quadrant exactly in degrees,
+    // then minimax polynomials (Cephes). Every path does the same float operations, rounds the
+    // quadrant to nearest even and negates by flipping the sign bit, so signed zeros match too.
+    // ARMv7 NEON flushes denormals to zero, so denormal angles are the one difference there.
+    static const float SINCOS_S1 = -1.6666654611e-1f;
+    static const float SINCOS_S2 = 8.3321608736e-3f;
+    static const float SINCOS_S3 = -1.9515295891e-4f;
+    static const float SINCOS_C1 = 4.166664568298827e-2f;
+    static const float SINCOS_C2 = -1.388731625493765e-3f;
+    static const float SINCOS_C3 = 2.443315711809948e-5f;
+    static const float DEG_TO_RAD = 0.01745329251994329577f;
+
+    static inline void fastSinCosDegrees(float degrees, float& outSin, float& outCos)
+    {
+        auto quadrant = static_cast<int32_t>(std::lrint(degrees * (1.f / 90.f)));
+        auto r = (degrees - static_cast<float>(quadrant) * 90.f) * DEG_TO_RAD;
+        auto r2 = r * r;
+        auto s = r + r * r2 * (SINCOS_S1 + r2 * (SINCOS_S2 + r2 * SINCOS_S3));
+        auto c = 1.f - .5f * r2 + r2 * r2 * (SINCOS_C1 + r2 * (SINCOS_C2 + r2 * SINCOS_C3));
+        if (quadrant & 1) std::swap(s, c);
+        outSin = (quadrant & 2) ? -s : s;
+        outCos = ((quadrant + 1) & 2) ? -c : c;
+    }
+
+    // Like drawSpriteWithUVs, the quad is the size of the uvs rect
+    static inline float getScaleX(const SpriteInstance& instance)
+    {
+        return instance.scale * (instance.uvs.z - instance.uvs.x);
+    }
+
+    static inline float getScaleY(const SpriteInstance& instance)
+    {
+        return instance.scale * (instance.uvs.w - instance.uvs.y);
+    }
 
-        if (m_spriteCount == MAX_SPRITE_COUNT)
+    static void generateSpriteQuadsScalar(const SpriteInstance* pInstances, uint32_t count, const Vector2& halfSize, sRenderVertex* pVerts)
+    {
+        for (uint32_t i = 0; i < count; ++i, pVerts += 4)
         {
-            flush();
+            auto& instance = pInstances[i];
+            float sinTheta, cosTheta;
+            fastSinCosDegrees(instance.rotation, sinTheta, cosTheta);
+            auto& uvs = instance.uvs;
+            auto hx = halfSize.x * getScaleX(instance);
+            auto hy = halfSize.y * getScaleY(instance);
+            auto rx = cosTheta * hx;
+            auto ry = sinTheta * hx;
+            auto dx = -sinTheta * hy;
+            auto dy = cosTheta * hy;
+            auto px = instance.position.x;
+            auto py = instance.position.y;
+
+            pVerts[0].position = {px - rx - dx, py - ry - dy};
+            pVerts[0].texCoord = {uvs.x, uvs.y};
+            pVerts[1].position = {px - rx + dx, py - ry + dy};
+            pVerts[1].texCoord = {uvs.x, uvs.w};
+            pVerts[2].position = {px + rx + dx, py + ry + dy};
+            pVerts[2].texCoord = {uvs.z, uvs.w};
+            pVerts[3].position = {px + rx - dx, py + ry - dy};
+            pVerts[3].texCoord = {uvs.z, uvs.y};
+            for (int k = 0; k < 4; ++k) pVerts[k].color = instance.color;
+        }
+    }
+
+#if defined(ONUT_SIMD_X86)
+    static inline void fastSinCosDegreesSSE2(__m128 degrees, __m128& outSin, __m128& outCos)
+    {
+        auto quadrant = _mm_cvtps_epi32(_mm_mul_ps(degrees, _mm_set1_ps(1.f / 90.f)));
+        auto r = _mm_mul_ps(_mm_sub_ps(degrees, _mm_mul_ps(_mm_cvtepi32_ps(quadrant), _mm_set1_ps(90.f))), _mm_set1_ps(DEG_TO_RAD));
+        auto r2 = _mm_mul_ps(r, r);
+        auto s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SINCOS_S3), r2), _mm_set1_ps(SINCOS_S2));
+        s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(SINCOS_S1));
+        s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), s));
+        auto c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SINCOS_C3), r2), _mm_set1_ps(SINCOS_C2));
+        c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(SINCOS_C1));
+        c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.f), _mm_mul_ps(_mm_set1_ps(.5f), r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), c));
+
+        // Odd quadrants swap sin and cos, then the sign comes from bit 1
+        auto one = _mm_set1_epi32(1);
+        auto swapMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+        auto sinResult = _mm_or_ps(_mm_and_ps(swapMask, c), _mm_andnot_ps(swapMask, s));
+        auto cosResult = _mm_or_ps(_mm_and_ps(swapMask, s), _mm_andnot_ps(swapMask, c));
+        auto two = _mm_set1_epi32(2);
+        outSin = _mm_xor_ps(sinResult, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30)));
+        outCos = _mm_xor_ps(cosResult, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30)));
+    }
+
+    // Interleave one corner of 4 sprites with their texCoords. U and V index the uvs rect
+    template<int U, int V>
+    static inline void storeCornersSSE2(sRenderVertex* pVerts, __m128 x, __m128 y, const SpriteInstance* pInstances)
+    {
+        auto lo = _mm_unpacklo_ps(x, y);
+        auto hi = _mm_unpackhi_ps(x, y);
+        _mm_storeu_ps(&pVerts[0].position.x, _mm_shuffle_ps(lo, _mm_loadu_ps(&pInstances[0].uvs.x), _MM_SHUFFLE(V, U, 1, 0)));
+        _mm_storeu_ps(&pVerts[4].position.x, _mm_shuffle_ps(lo, _mm_loadu_ps(&pInstances[1].uvs.x), _MM_SHUFFLE(V, U, 3, 2)));
+        _mm_storeu_ps(&pVerts[8].position.x, _mm_shuffle_ps(hi, _mm_loadu_ps(&pInstances[2].uvs.x), _MM_SHUFFLE(V, U, 1, 0)));
+        _mm_storeu_ps(&pVerts[12].position.x, _mm_shuffle_ps(hi, _mm_loadu_ps(&pInstances[3].uvs.x), _MM_SHUFFLE(V, U, 3, 2)));
+    }
+
+    static inline void storeQuadsSSE2(sRenderVertex* pVerts, const SpriteInstance* pInstances,
+                                      __m128 px, __m128 py, __m128 rx, __m128 ry, __m128 dx, __m128 dy)
+    {
+        storeCornersSSE2<0, 1>(pVerts + 0, _mm_sub_ps(_mm_sub_ps(px, rx), dx), _mm_sub_ps(_mm_sub_ps(py, ry), dy), pInstances);
+        storeCornersSSE2<0, 3>(pVerts + 1, _mm_add_ps(_mm_sub_ps(px, rx), dx), _mm_add_ps(_mm_sub_ps(py, ry), dy), pInstances);
+        storeCornersSSE2<2, 3>(pVerts + 2, _mm_add_ps(_mm_add_ps(px, rx), dx), _mm_add_ps(_mm_add_ps(py, ry), dy), pInstances);
+        storeCornersSSE2<2, 1>(pVerts + 3, _mm_sub_ps(_mm_add_ps(px, rx), dx), _mm_sub_ps(_mm_add_ps(py, ry), dy), pInstances);
+        for (int i = 0; i < 4; ++i)
+        {
+            auto color = _mm_loadu_ps(&pInstances[i].color.x);
+            for (int k = 0; k < 4; ++k) _mm_storeu_ps(&pVerts[i * 4 + k].color.x, color);
+        }
+    }
+
+    static void generateSpriteQuadsSSE2(const SpriteInstance* pInstances, uint32_t count, const Vector2& halfSize, sRenderVertex* pVerts)
+    {
+        uint32_t i = 0;
+        for (; i + 4 <= count; i += 4, pVerts += 16)
+        {
+            auto p = pInstances + i;
+            auto px = _mm_setr_ps(p[0].position.x, p[1].position.x, p[2].position.x, p[3].position.x);
+            auto py = _mm_setr_ps(p[0].position.y, p[1].position.y, p[2].position.y, p[3].position.y);
+            auto rotation = _mm_setr_ps(p[0].rotation, p[1].rotation, p[2].rotation, p[3].rotation);
+            auto hx = _mm_mul_ps(_mm_set1_ps(halfSize.x), _mm_setr_ps(getScaleX(p[0]), getScaleX(p[1]), getScaleX(p[2]), getScaleX(p[3])));
+            auto hy = _mm_mul_ps(_mm_set1_ps(halfSize.y), _mm_setr_ps(getScaleY(p[0]), getScaleY(p[1]), getScaleY(p[2]), getScaleY(p[3])));
+
+            __m128 sinTheta, cosTheta;
+            fastSinCosDegreesSSE2(rotation, sinTheta, cosTheta);
+            auto dx = _mm_mul_ps(_mm_xor_ps(sinTheta, _mm_set1_ps(-0.f)), hy);
+            storeQuadsSSE2(pVerts, p, px, py, _mm_mul_ps(cosTheta, hx), _mm_mul_ps(sinTheta, hx), dx, _mm_mul_ps(cosTheta, hy));
         }
-#endif /* !EASY_GRAPHIX */
+        generateSpriteQuadsScalar(pInstances + i, count - i, halfSize, pVerts);
+    }
+
+    ONUT_TARGET_AVX2 static void generateSpriteQuadsAVX2(const SpriteInstance* pInstances, uint32_t count, const Vector2& halfSize, sRenderVertex* pVerts)
+    {
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8, pVerts += 32)
+        {
+            auto p = pInstances + i;
+            auto px = _mm256_setr_ps(p[0].position.x, p[1].position.x, p[2].position.x, p[3].position.x,
+                                     p[4].position.x, p[5].position.x, p[6].position.x, p[7].position.x);
+            auto py = _mm256_setr_ps(p[0].position.y, p[1].position.y, p[2].position.y, p[3].position.y,
+                                     p[4].position.y, p[5].position.y, p[6].position.y, p[7].position.y);
+            auto degrees = _mm256_setr_ps(p[0].rotation, p[1].rotation, p[2].rotation, p[3].rotation,
+                                          p[4].rotation, p[5].rotation, p[6].rotation, p[7].rotation);
+            auto hx = _mm256_mul_ps(_mm256_set1_ps(halfSize.x), _mm256_setr_ps(getScaleX(p[0]), getScaleX(p[1]), getScaleX(p[2]), getScaleX(p[3]),
+                                                                               getScaleX(p[4]), getScaleX(p[5]), getScaleX(p[6]), getScaleX(p[7])));
+            auto hy = _mm256_mul_ps(_mm256_set1_ps(halfSize.y), _mm256_setr_ps(getScaleY(p[0]), getScaleY(p[1]), getScaleY(p[2]), getScaleY(p[3]),
+                                                                               getScaleY(p[4]), getScaleY(p[5]), getScaleY(p[6]), getScaleY(p[7])));
+
+            // Same steps as fastSinCosDegreesSSE2
+            auto quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(degrees, _mm256_set1_ps(1.f / 90.f)));
+            auto r = _mm256_mul_ps(_mm256_sub_ps(degrees, _mm256_mul_ps(_mm256_cvtepi32_ps(quadrant), _mm256_set1_ps(90.f))), _mm256_set1_ps(DEG_TO_RAD));
+            auto r2 = _mm256_mul_ps(r, r);
+            auto s = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SINCOS_S3), r2), _mm256_set1_ps(SINCOS_S2));
+            s = _mm256_add_ps(_mm256_mul_ps(s, r2), _mm256_set1_ps(SINCOS_S1));
+            s = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), s));
+            auto c = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SINCOS_C3), r2), _mm256_set1_ps(SINCOS_C2));
+            c = _mm256_add_ps(_mm256_mul_ps(c, r2), _mm256_set1_ps(SINCOS_C1));
+            c = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), _mm256_mul_ps(_mm256_set1_ps(.5f), r2)), _mm256_mul_ps(_mm256_mul_ps(r2, r2), c));
+            auto one = _mm256_set1_epi32(1);
+            auto two = _mm256_set1_epi32(2);
+            auto swapMask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+            auto sinTheta = _mm256_xor_ps(_mm256_blendv_ps(s, c, swapMask), _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, two), 30)));
+            auto cosTheta = _mm256_xor_ps(_mm256_blendv_ps(c, s, swapMask), _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, one), two), 30)));
+
+            auto rx = _mm256_mul_ps(cosTheta, hx);
+            auto ry = _mm256_mul_ps(sinTheta, hx);
+            auto dx = _mm256_mul_ps(_mm256_xor_ps(sinTheta, _mm256_set1_ps(-0.f)), hy);
+            auto dy = _mm256_mul_ps(cosTheta, hy);
+            storeQuadsSSE2(pVerts, p,
+                           _mm256_castps256_ps128(px), _mm256_castps256_ps128(py), _mm256_castps256_ps128(rx),
+                           _mm256_castps256_ps128(ry), _mm256_castps256_ps128(dx), _mm256_castps256_ps128(dy));
+            storeQuadsSSE2(pVerts + 16, p + 4,
+                           _mm256_extractf128_ps(px, 1), _mm256_extractf128_ps(py, 1), _mm256_extractf128_ps(rx, 1),
+                           _mm256_extractf128_ps(ry, 1), _mm256_extractf128_ps(dx, 1), _mm256_extractf128_ps(dy, 1));
+        }
+        generateSpriteQuadsSSE2(pInstances + i, count - i, halfSize, pVerts);
+    }
+#endif
+
+#if defined(ONUT_SIMD_NEON)
+    static void generateSpriteQuadsNEON(const SpriteInstance* pInstances, uint32_t count, const Vector2& halfSize, sRenderVertex* pVerts)
+    {
+        uint32_t i = 0;
+        for (; i + 4 <= count; i += 4, pVerts += 16)
+        {
+            auto p = pInstances + i;
+            float lanes[4];
+            for (int k = 0; k < 4; ++k) lanes[k] = p[k].rotation;
+            auto degrees = vld1q_f32(lanes);
+            for (int k = 0; k < 4; ++k) lanes[k] = getScaleX(p[k]);
+            auto hx = vmulq_n_f32(vld1q_f32(lanes), halfSize.x);
+            for (int k = 0; k < 4; ++k) lanes[k] = getScaleY(p[k]);
+            auto hy = vmulq_n_f32(vld1q_f32(lanes), halfSize.y);
+
+            auto scaled = vmulq_n_f32(degrees, 1.f / 90.f);
+#if defined(__aarch64__) || defined(_M_ARM64)
+            auto quadrant = vcvtnq_s32_f32(scaled);
+#else
+            // No round to nearest even conversion on ARMv7, but its adds round that way. Adding then
+            // removing 2^23 drops the fraction. From 2^23 on, floats are already whole
+            auto magic = vbslq_f32(vdupq_n_u32(0x80000000), scaled, vdupq_n_f32(8388608.f));
+            auto isSmall = vcltq_f32(vabsq_f32(scaled), vdupq_n_f32(8388608.f));
+            auto quadrant = vcvtq_s32_f32(vbslq_f32(isSmall, vsubq_f32(vaddq_f32(scaled, magic), magic), scaled));
+#endif
+            auto r = vmulq_n_f32(vsubq_f32(degrees, vmulq_n_f32(vcvtq_f32_s32(quadrant), 90.f)), DEG_TO_RAD);
+            auto r2 = vmulq_f32(r, r);
+            auto s = vaddq_f32(vmulq_n_f32(r2, SINCOS_S3), vdupq_n_f32(SINCOS_S2));
+            s = vaddq_f32(vmulq_f32(s, r2), vdupq_n_f32(SINCOS_S1));
+            s = vaddq_f32(r, vmulq_f32(vmulq_f32(r, r2), s));
+            auto c = vaddq_f32(vmulq_n_f32(r2, SINCOS_C3), vdupq_n_f32(SINCOS_C2));
+            c = vaddq_f32(vmulq_f32(c, r2), vdupq_n_f32(SINCOS_C1));
+            c = vaddq_f32(vsubq_f32(vdupq_n_f32(1.f), vmulq_n_f32(r2, .5f)), vmulq_f32(vmulq_f32(r2, r2), c));
+            auto swapMask = vtstq_s32(quadrant, vdupq_n_s32(1));
+            auto sinSign = vshlq_n_u32(vreinterpretq_u32_s32(vandq_s32(quadrant, vdupq_n_s32(2))), 30);
+            auto cosSign = vshlq_n_u32(vreinterpretq_u32_s32(vandq_s32(vaddq_s32(quadrant, vdupq_n_s32(1)), vdupq_n_s32(2))), 30);
+            auto sinTheta = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(swapMask, c, s)), sinSign));
+            auto cosTheta = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(swapMask, s, c)), cosSign));
+
+            float rx[4], ry[4], dx[4], dy[4];
+            vst1q_f32(rx, vmulq_f32(cosTheta, hx));
+            vst1q_f32(ry, vmulq_f32(sinTheta, hx));
+            vst1q_f32(dx, vnegq_f32(vmulq_f32(sinTheta, hy)));
+            vst1q_f32(dy, vmulq_f32(cosTheta, hy));
+            for (int k = 0; k < 4; ++k)
+            {
+                auto& instance = p[k];
+                auto pQuad = pVerts + k * 4;
+                auto px = instance.position.x;
+                auto py = instance.position.y;
+                auto& uvs = instance.uvs;
+                pQuad[0].position = {px - rx[k] - dx[k], py - ry[k] - dy[k]};
+                pQuad[0].texCoord = {uvs.x, uvs.y};
+                pQuad[1].position = {px - rx[k] + dx[k], py - ry[k] + dy[k]};
+                pQuad[1].texCoord = {uvs.x, uvs.w};
+                pQuad[2].position = {px + rx[k] + dx[k], py + ry[k] + dy[k]};
+                pQuad[2].texCoord = {uvs.z, uvs.w};
+                pQuad[3].position = {px + rx[k] - dx[k], py + ry[k] - dy[k]};
+                pQuad[3].texCoord = {uvs.z, uvs.y};
+                for (int v = 0; v < 4; ++v) pQuad[v].color = instance.color;
+            }
+        }
+        generateSpriteQuadsScalar(pInstances + i, count - i, halfSize, pVerts);
+    }
+#endif
+
+    static void generateSpriteQuads(const SpriteInstance* pInstances, uint32_t count, const Vector2& halfSize, sRenderVertex* pVerts, eSimdPath path)
+    {
+        switch (path)
+        {
+#if defined(ONUT_SIMD_X86)
+            case eSimdPath::AVX2:
+                generateSpriteQuadsAVX2(pInstances, count, halfSize, pVerts);
+                return;
+            case eSimdPath::SSE2:
+                generateSpriteQuadsSSE2(pInstances, count, halfSize, pVerts);
+                return;
+#endif
+#if defined(ONUT_SIMD_NEON)
+            case eSimdPath::NEON:
+                generateSpriteQuadsNEON(pInstances, count, halfSize, pVerts);
+                return;
+#endif
+            default:
+                generateSpriteQuadsScalar(pInstances, count, halfSize, pVerts);
+                return;
+        }
+    }
+
+    static inline uint32_t packColor(const Color& color)
+    {
+        auto r = static_cast<uint32_t>(std::lrint(std::min(std::max(color.x, 0.f), 1.f) * 255.f));
+        auto g = static_cast<uint32_t>(std::lrint(std::min(std::max(color.y, 0.f), 1.f) * 255.f));
+        auto b = static_cast<uint32_t>(std::lrint(std::min(std::max(color.z, 0.f), 1.f) * 255.f));
+        auto a = static_cast<uint32_t>(std::lrint(std::min(std::max(color.w, 0.f), 1.f) * 255.f));
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    static void packSpritesScalar(const SpriteInstance* pInstances, size_t count, const Vector2& halfSize, sPackedSprite* pPacked)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto& instance = pInstances[i];
+            auto& packed = pPacked[i];
+            packed.position = instance.position;
+            packed.halfSize = {halfSize.x * getScaleX(instance), halfSize.y * getScaleY(instance)};
+            packed.uvs = instance.uvs;
+            packed.rotation = instance.rotation * DEG_TO_RAD;
+            packed.color = packColor(instance.color);
+        }
+    }
+
+#if defined(ONUT_SIMD_X86)
+    static inline __m128i convertColorSSE2(const Color& color)
+    {
+        auto clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&color.x), _mm_setzero_ps()), _mm_set1_ps(1.f));
+        return _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(255.f)));
+    }
+
+    static void packSpritesSSE2(const SpriteInstance* pInstances, size_t count, const Vector2& halfSize, sPackedSprite* pPacked)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            auto p = pInstances + i;
+            auto hx = _mm_mul_ps(_mm_set1_ps(halfSize.x), _mm_setr_ps(getScaleX(p[0]), getScaleX(p[1]), getScaleX(p[2]), getScaleX(p[3])));
+            auto hy = _mm_mul_ps(_mm_set1_ps(halfSize.y), _mm_setr_ps(getScaleY(p[0]), getScaleY(p[1]), getScaleY(p[2]), getScaleY(p[3])));
+            auto rotation = _mm_mul_ps(_mm_setr_ps(p[0].rotation, p[1].rotation, p[2].rotation, p[3].rotation), _mm_set1_ps(DEG_TO_RAD));
+
+            // 4 float4 colors down to 4 RGBA8
+            auto colors = _mm_packus_epi16(_mm_packs_epi32(convertColorSSE2(p[0].color), convertColorSSE2(p[1].color)),
+                                           _mm_packs_epi32(convertColorSSE2(p[2].color), convertColorSSE2(p[3].color)));
+
+            auto halfSizes01 = _mm_unpacklo_ps(hx, hy);
+            auto halfSizes23 = _mm_unpackhi_ps(hx, hy);
+            auto pOut = pPacked + i;
+            _mm_storel_pi(reinterpret_cast<__m64*>(&pOut[0].halfSize.x), halfSizes01);
+            _mm_storeh_pi(reinterpret_cast<__m64*>(&pOut[1].halfSize.x), halfSizes01);
+            _mm_storel_pi(reinterpret_cast<__m64*>(&pOut[2].halfSize.x), halfSizes23);
+            _mm_storeh_pi(reinterpret_cast<__m64*>(&pOut[3].halfSize.x), halfSizes23);
+
+            alignas(16) float rotations[4];
+            alignas(16) uint32_t packedColors[4];
+            _mm_store_ps(rotations, rotation);
+            _mm_store_si128(reinterpret_cast<__m128i*>(packedColors), colors);
+            for (int k = 0; k < 4; ++k)
+            {
+                pOut[k].position = p[k].position;
+                _mm_storeu_ps(&pOut[k].uvs.x, _mm_loadu_ps(&p[k].uvs.x));
+                pOut[k].rotation = rotations[k];
+                pOut[k].color = packedColors[k];
+            }
+        }
+        packSpritesScalar(pInstances + i, count - i, halfSize, pPacked + i);
+    }
+#endif
+
+    void packSprites(const SpriteInstance* pInstances, size_t count, const Vector2& textureSize, sPackedSprite* pPacked, eSimdPath path)
+    {
+        static_assert(sizeof(sPackedSprite) == 40, "Must match the instanced sprites input layout");
+
+        if (path == eSimdPath::AUTO || !isSimdPathSupported(path))
+        {
+            path = getBestSimdPath();
+        }
+
+        auto halfSize = textureSize * .5f;
+        switch (path)
+        {
+#if defined(ONUT_SIMD_X86)
+            // Mostly copies, wider registers don't help
+            case eSimdPath::AVX2:
+            case eSimdPath::SSE2:
+                packSpritesSSE2(pInstances, count, halfSize, pPacked);
+                return;
+#endif
+            default:
+                packSpritesScalar(pInstances, count, halfSize, pPacked);
+                return;
+        }
+    }
+
+    void SpriteBatch::drawSprites(const SpriteInstance* pInstances, size_t count, eSimdPath path)
+    {
+        assert(m_isDrawing); // Should call begin() before calling draw()
+
+        if (path == eSimdPath::AUTO || !isSimdPathSupported(path))
+        {
+            path = getBestSimdPath();
+        }
+
+        size_t i = 0;
+        while (i < count)
+        {
+            // Run of sprites using the same texture
+            auto pTexture = pInstances[i].pTexture;
+            auto runEnd = i + 1;
+            while (runEnd < count && pInstances[runEnd].pTexture == pTexture) ++runEnd;
+            if (!pTexture)
+            {
+                i = runEnd; // Same as drawSprite
+                continue;
+            }
+            // Instanced, they don't need to be kept for sorting
+            auto maxPackedCount = (m_sortMode == eSortMode::IMMEDIATE && m_clipIndex == NO_CLIP && !m_clipScissor) ? m_pBackend->getMaxPackedSpriteCount() : 0;
+            if (maxPackedCount)
+            {
+                flush(); // Sprites before these are drawn first
+                while (i < runEnd)
+                {
+                    auto spriteCount = static_cast<uint32_t>(std::min<size_t>(runEnd - i, maxPackedCount));
+                    packSprites(pInstances + i, spriteCount, pTexture->getSizef(), m_pBackend->mapPackedSprites(spriteCount), path);
+                    m_pBackend->drawPackedSprites(pTexture, spriteCount);
+                    if (m_pStats)
+                    {
+                        auto& frame = m_pStats->getCurrentFrame();
+                        frame.spriteCount += spriteCount;
+                        frame.vertexCount += spriteCount;
+                        ++frame.spriteFlushCount;
+                    }
+                    i += spriteCount;
+                }
+                continue;
+            }
+
+            auto halfSize = pTexture->getSizef() * .5f;
+            while (i < runEnd)
+            {
+                auto quadCount = static_cast<uint32_t>(std::min<size_t>(runEnd - i, m_maxSpriteCount));
+                auto pVerts = beginQuads(pTexture, quadCount);
+                generateSpriteQuads(pInstances + i, quadCount, halfSize, pVerts, path);
+                endQuads(quadCount);
+                i += quadCount;
+            }
+        }
+    }
+
+    void SpriteBatch::drawSprites(const std::vector<SpriteInstance>& instances, eSimdPath path)
+    {
+        drawSprites(instances.data(), instances.size(), path);
+    }
+
+    void SpriteBatch::draw(const SpriteCommandList& commandList)
+    {
+        drawCommandList(commandList, nullptr);
+    }
+
+    void SpriteBatch::draw(const SpriteCommandList& commandList, const Matrix& transform)
+    {
+        drawCommandList(commandList, &transform);
+    }
+
+    void SpriteBatch::drawCommandList(const SpriteCommandList& commandList, const Matrix* pTransform)
+    {
+        assert(m_isDrawing); // Should call begin() before calling draw()
+
+        auto pVertices = commandList.getVertices();
+        for (auto& run : commandList.getRuns())
+        {
+            auto pRunVertices = pVertices + run.firstVertex;
+            auto remaining = run.spriteCount;
+            while (remaining)
+            {
+                auto quadCount = std::min(remaining, m_maxSpriteCount);
+                auto pVerts = beginQuads(run.pTexture, quadCount);
+                memcpy(pVerts, pRunVertices, sizeof(sRenderVertex) * 4 * quadCount);
+                if (pTransform)
+                {
+                    for (uint32_t i = 0; i < quadCount * 4; ++i)
+                    {
+                        pVerts[i].position = Vector2::Transform(pVerts[i].position, *pTransform);
+                    }
+                }
+                endQuads(quadCount);
+                pRunVertices += quadCount * 4;
+                remaining -= quadCount;
+            }
+        }
+    }
+
+    void SpriteBatch::drawDeferred()
+    {
+        auto spriteCount = m_deferredSprites.size();
+        if (!spriteCount) return;
+
+        // Textures get small ids in first use order, so equal keys keep a stable order
+        m_sortKeys.resize(spriteCount);
+        for (size_t i = 0; i < spriteCount; ++i)
+        {
+            auto& sprite = m_deferredSprites[i];
+            uint64_t textureId = 0;
+            if (m_sortMode != eSortMode::DEPTH)
+            {
+                auto it = m_textureIds.find(sprite.pTexture);
+                if (it == m_textureIds.end())
+                {
+                    it = m_textureIds.insert({sprite.pTexture, static_cast<uint32_t>(m_textureIds.size())}).first;
+                }
+                textureId = it->second;
+            }
+            uint64_t depthBits = (m_sortMode != eSortMode::TEXTURE) ? getSortableFloatBits(sprite.depth) : 0;
+            m_sortKeys[i] = {(depthBits << 32) | textureId, static_cast<uint32_t>(i)};
+        }
+        radixSort(m_sortKeys, m_sortScratch);
+
+        // Same path as immediate draws, it will only flush when the texture or the scissor changes
+        auto clipIndex = m_clipIndex;
+        for (auto& sortKey : m_sortKeys)
+        {
+            auto& sprite = m_deferredSprites[sortKey.index];
+            m_clipIndex = sprite.clipIndex;
+            auto pVerts = beginImmediateQuad(sprite.pTexture);
+            memcpy(pVerts, &m_deferredVertices[sortKey.index * 4], sizeof(sRenderVertex) * 4);
+            endImmediateQuad();
+        }
+
+        // Only the current clip is still needed
+        if (clipIndex != NO_CLIP)
+        {
+            auto clip = m_clips[clipIndex];
+            m_clips.assign(1, clip);
+            clipIndex = 0;
+        }
+        else
+        {
+            m_clips.clear();
+        }
+        m_clipIndex = clipIndex;
+
+        m_deferredSprites.clear();
+        m_deferredVertices.clear();
+        m_textureIds.clear();
     }
 
     void SpriteBatch::end()
     {
-#ifdef EASY_GRAPHIX
-        flush();
-#else /* EASY_GRAPHIX */
         assert(m_isDrawing); // Should call begin() before calling end()
 
-        m_isDrawing = false;
-        if (m_spriteCount)
+        drawDeferred();
+        flush();
+        if (m_clipScissor)
         {
-            flush();
+            m_pBackend->setScissor(m_userScissorEnabled, m_userScissor);
+            m_scissorEnabled = m_userScissorEnabled;
+            m_scissor = m_userScissor;
+            m_clipScissor = false;
         }
-        ORenderer->getDeviceContext()->Unmap(m_pVertexBuffer, 0);
+        m_pBackend->endSprites();
+        m_isDrawing = false;
+    }
 
-        if (m_curBlendMode == eBlendMode::FORCE_WRITE)
+    void SpriteBatch::setScissor(bool enabled, const Rect& rect)
+    {
+        assert(m_isDrawing); // Should call begin() before calling setScissor()
+
+        drawDeferred();
+        flush();
+        m_pBackend->setScissor(enabled, rect);
+        m_scissorEnabled = enabled;
+        m_scissor = rect;
+        m_userScissorEnabled = enabled;
+        m_userScissor = rect;
+        m_clipScissor = false;
+    }
+
+    void SpriteBatch::setClip(bool enabled, const Rect& rect)
+    {
+        assert(m_isDrawing); // Should call begin() before calling setClip()
+
+        if (!enabled)
         {
-            ORenderer->resetState();
+            m_clipIndex = NO_CLIP;
+        }
+        else if (m_deferredSprites.empty())
+        {
+            m_clips.assign(1, rect); // Only sorted sprites waiting for end() need the previous ones
+            m_clipIndex = 0;
+        }
+        else if (m_clipIndex == NO_CLIP || m_clips[m_clipIndex] != rect)
+        {
+            m_clipIndex = static_cast<uint32_t>(m_clips.size());
+            m_clips.push_back(rect);
         }
-#endif /* !EASY_GRAPHIX */
     }
 
     void SpriteBatch::flush()
@@ -1000,22 +1188,15 @@ namespace onut
         {
             return; // Nothing to flush
         }
-#ifdef EASY_GRAPHIX
-        egEnd();
-#else /* EASY_GRAPHIX */
-        auto pDeviceContext = ORenderer->getDeviceContext();
-
-        pDeviceContext->Unmap(m_pVertexBuffer, 0);
 
-        auto textureView = m_pTexture->getResource();
-        pDeviceContext->PSSetShaderResources(0, 1, &textureView);
-        pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        pDeviceContext->IASetVertexBuffers(0, 1, &m_pVertexBuffer, &m_stride, &m_offset);
-        pDeviceContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-        pDeviceContext->DrawIndexed(6 * m_spriteCount, 0, 0);
-
-        pDeviceContext->Map(m_pVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &m_pMappedVertexBuffer);
-#endif /* !EASY_GRAPHIX */
+        m_pVertices = m_pBackend->drawSprites(m_pTexture, m_spriteCount);
+        if (m_pStats)
+        {
+            auto& frame = m_pStats->getCurrentFrame();
+            frame.spriteCount += m_spriteCount;
+            frame.vertexCount += m_spriteCount * 4;
+            ++frame.spriteFlushCount;
+        }
 
         m_spriteCount = 0;
         m_pTexture = nullptr;
@@ -0,0 +1,85 @@
+#include "onut.h"
+#include "SpriteCommandList.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace onut
+{
+    SpriteCommandList::SpriteCommandList(IRenderBackend* pBackend)
+    {
+        if (!pBackend) pBackend = ORenderer->getBackend();
+        m_pWhiteTexture = pBackend->getWhiteTexture();
+    }
+
+    void SpriteCommandList::clear()
+    {
+        m_runs.clear();
+        m_vertexCount = 0;
+    }
+
+    sRenderVertex* SpriteCommandList::getWritePointer()
+    {
+        // The batch writes straight after the last sprite, there is always room for a full batch
+        auto requiredSize = static_cast<size_t>(m_vertexCount) + MAX_SPRITE_COUNT * 4;
+        if (m_vertices.size() < requiredSize)
+        {
+            m_vertices.resize(std::max(requiredSize, m_vertices.size() * 2));
+        }
+        return m_vertices.data() + m_vertexCount;
+    }
+
+    sRenderVertex* SpriteCommandList::beginSprites(bool forceWrite)
+    {
+        assert(!forceWrite); // The blend mode is the one of the batch drawing the list
+        return getWritePointer();
+    }
+
+    void SpriteCommandList::addRun(Texture* pTexture, uint32_t spriteCount)
+    {
+        if (!m_runs.empty() && m_runs.back().pTexture == pTexture)
+        {
+            m_runs.back().spriteCount += spriteCount;
+        }
+        else
+        {
+            m_runs.push_back({pTexture, m_vertexCount, spriteCount});
+        }
+        m_vertexCount += spriteCount * 4;
+    }
+
+    void SpriteCommandList::addSprites(Texture* pTexture, const sRenderVertex* pVertices, uint32_t spriteCount)
+    {
+        if (!spriteCount) return;
+        auto requiredSize = static_cast<size_t>(m_vertexCount) + spriteCount * 4;
+        if (m_vertices.size() < requiredSize)
+        {
+            m_vertices.resize(requiredSize);
+        }
+        memcpy(m_vertices.data() + m_vertexCount, pVertices, sizeof(sRenderVertex) * 4 * spriteCount);
+        addRun(pTexture, spriteCount);
+    }
+
+    sRenderVertex* SpriteCommandList::drawSprites(Texture* pTexture, uint32_t spriteCount)
+    {
+        addRun(pTexture, spriteCount);
+        return getWritePointer();
+    }
+
+    sRenderVertex* SpriteCommandList::beginPrimitives()
+    {
+        assert(false); // Only sprites can be recorded
+        return nullptr;
+    }
+
+    sRenderVertex* SpriteCommandList::drawPrimitives(ePrimitiveType primitiveType, Texture* pTexture, uint32_t vertexCount)
+    {
+        assert(false); // Only sprites can be recorded
+        return nullptr;
+    }
+
+    void SpriteCommandList::setScissor(bool enabled, const Rect& rect)
+    {
+        assert(false); // Scissor changes go on the batch drawing the list
+    }
+}
@@ -0,0 +1,179 @@
+#include "onut.h"
+#include "SpriteBatch.h"
+#include "StaticSpriteBatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace onut
+{
+    StaticSpriteBatch::StaticSpriteBatch(IRenderBackend* pBackend, float regionSize)
+        : m_pBackend(pBackend)
+        , m_regionSize(regionSize)
+    {
+        assert(regionSize > 0.f);
+        if (!m_pBackend) m_pBackend = ORenderer->getBackend();
+    }
+
+    void StaticSpriteBatch::add(const SpriteCommandList& commandList)
+    {
+        struct sSpriteKey
+        {
+            RegionKey region;
+            Texture* pTexture;
+            uint32_t firstVertex;
+        };
+
+        // Sprites are grouped by region, keeping their order, then appended a texture run at a time
+        std::vector<sSpriteKey> keys;
+        keys.reserve(commandList.getSpriteCount());
+        auto pVertices = commandList.getVertices();
+        for (auto& run : commandList.getRuns())
+        {
+            for (uint32_t i = 0; i < run.spriteCount; ++i)
+            {
+                auto firstVertex = run.firstVertex + i * 4;
+                auto pQuad = pVertices + firstVertex;
+                auto center = (pQuad[0].position + pQuad[1].position + pQuad[2].position + pQuad[3].position) * .25f;
+                keys.push_back({RegionKey(static_cast<int>(std::floor(center.x / m_regionSize)), static_cast<int>(std::floor(center.y / m_regionSize))), run.pTexture, firstVertex});
+            }
+        }
+        std::stable_sort(keys.begin(), keys.end(), [](const sSpriteKey& a, const sSpriteKey& b)
+        {
+            return a.region < b.region;
+        });
+
+        std::vector<sRenderVertex> group;
+        for (size_t first = 0; first < keys.size();)
+        {
+            auto& key = keys[first].region;
+            auto it = m_regions.find(key);
+            if (it == m_regions.end())
+            {
+                auto& position = pVertices[keys[first].firstVertex].position;
+                it = m_regions.insert({key, sRegion{SpriteCommandList(m_pBackend), position, position}}).first;
+            }
+            auto& region = it->second;
+
+            while (first < keys.size() && keys[first].region == key)
+            {
+                auto pTexture = keys[first].pTexture;
+                group.clear();
+                for (; first < keys.size() && keys[first].region == key && keys[first].pTexture == pTexture; ++first)
+                {
+                    auto pQuad = pVertices + keys[first].firstVertex;
+                    group.insert(group.end(), pQuad, pQuad + 4);
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        region.min = Vector2::Min(region.min, pQuad[k].position);
+                        region.max = Vector2::Max(region.max, pQuad[k].position);
+                    }
+                }
+                region.sprites.addSprites(pTexture, group.data(), static_cast<uint32_t>(group.size() / 4));
+            }
+        }
+    }
+
+    Rect StaticSpriteBatch::invalidate(const Rect& rect)
+    {
+        auto minX = static_cast<int>(std::floor(rect.x / m_regionSize));
+        auto minY = static_cast<int>(std::floor(rect.y / m_regionSize));
+        // A rect ending on a region boundary doesn't touch the next one
+        auto maxX = std::max<>(static_cast<int>(std::ceil((rect.x + rect.z) / m_regionSize)) - 1, minX);
+        auto maxY = std::max<>(static_cast<int>(std::ceil((rect.y + rect.w) / m_regionSize)) - 1, minY);
+        for (auto it = m_regions.begin(); it != m_regions.end();)
+        {
+            auto& key = it->first;
+            if (key.first >= minX && key.first <= maxX && key.second >= minY && key.second <= maxY)
+            {
+                it = m_regions.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        return Rect(static_cast<float>(minX) * m_regionSize, static_cast<float>(minY) * m_regionSize,
+                    static_cast<float>(maxX - minX + 1) * m_regionSize, static_cast<float>(maxY - minY + 1) * m_regionSize);
+    }
+
+    void StaticSpriteBatch::clear()
+    {
+        m_regions.clear();
+    }
+
+    size_t StaticSpriteBatch::getSpriteCount() const
+    {
+        size_t spriteCount = 0;
+        for (auto& kv : m_regions)
+        {
+            spriteCount += kv.second.sprites.getSpriteCount();
+        }
+        return spriteCount;
+    }
+
+    void StaticSpriteBatch::draw(SpriteBatch& spriteBatch, const Matrix& transform) const
+    {
+        drawRegions(spriteBatch, transform, nullptr);
+    }
+
+    void StaticSpriteBatch::draw(SpriteBatch& spriteBatch, const Matrix& transform, const Rect& scissor) const
+    {
+        auto wasScissorEnabled = spriteBatch.isScissorEnabled();
+        auto previousScissor = spriteBatch.getScissor();
+        auto rect = scissor;
+        if (wasScissorEnabled)
+        {
+            auto rectMin = Vector2::Max(Vector2(scissor.x, scissor.y), Vector2(previousScissor.x, previousScissor.y));
+            auto rectMax = Vector2::Min(Vector2(scissor.x + scissor.z, scissor.y + scissor.w),
+                                        Vector2(previousScissor.x + previousScissor.z, previousScissor.y + previousScissor.w));
+            if (rectMax.x <= rectMin.x || rectMax.y <= rectMin.y) return; // Nothing visible
+            rect = Rect(rectMin.x, rectMin.y, rectMax.x - rectMin.x, rectMax.y - rectMin.y);
+        }
+        spriteBatch.setScissor(true, rect);
+        drawRegions(spriteBatch, transform, &rect);
+        spriteBatch.setScissor(wasScissorEnabled, previousScissor);
+    }
+
+    void StaticSpriteBatch::drawRegions(SpriteBatch& spriteBatch, const Matrix& transform, const Rect* pScissor) const
+    {
+        auto isIdentity = transform == Matrix::Identity;
+        for (auto& kv : m_regions)
+        {
+            auto& region = kv.second;
+            if (pScissor)
+            {
+                // Bounds of the transformed region
+                Vector2 corners[4] = {
+                    Vector2::Transform(region.min, transform),
+                    Vector2::Transform(Vector2(region.max.x, region.min.y), transform),
+                    Vector2::Transform(region.max, transform),
+                    Vector2::Transform(Vector2(region.min.x, region.max.y), transform)
+                };
+                auto min = corners[0];
+                auto max = corners[0];
+                for (int k = 1; k < 4; ++k)
+                {
+                    min = Vector2::Min(min, corners[k]);
+                    max = Vector2::Max(max, corners[k]);
+                }
+                if (max.x < pScissor->x || max.y < pScissor->y ||
+                    min.x > pScissor->x + pScissor->z || min.y > pScissor->y + pScissor->w)
+                {
+                    continue;
+                }
+            }
+
+            if (isIdentity)
+            {
+                spriteBatch.draw(region.sprites);
+            }
+            else
+            {
+                spriteBatch.draw(region.sprites, transform);
+            }
+        }
+    }
+}
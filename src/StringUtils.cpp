@@ -1,7 +1,9 @@
 ﻿#include <algorithm>
 #include <codecvt>
 #include <cassert>
+#include <limits>
 #include <sstream>
+#include <type_traits>
 #include "dirent.h"
 #include "StringUtils.h"
 
@@ -45,6 +47,100 @@ namespace onut
         return elems;
     }
 
+    static inline bool isListWhitespace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    template<typename Tint>
+    static sParseResult parseIntListImpl(const char* pStr, size_t length, Tint* pOut, size_t capacity, char delimiter)
+    {
+        static const uint64_t maxValue = static_cast<uint64_t>(std::numeric_limits<Tint>::max());
+        sParseResult result;
+        auto p = pStr;
+        auto pEnd = pStr + length;
+        auto error = eParseError::NONE;
+
+        while (p != pEnd && isListWhitespace(*p)) ++p;
+        while (p != pEnd)
+        {
+            // Number
+            auto pNumber = p;
+            auto isNegative = std::is_signed<Tint>::value && *p == '-';
+            if (isNegative) ++p;
+            if (p == pEnd || static_cast<unsigned>(*p - '0') > 9)
+            {
+                error = eParseError::EXPECTED_NUMBER;
+                break;
+            }
+            uint64_t value = 0;
+            auto limit = maxValue + (isNegative ? 1 : 0);
+            do
+            {
+                value = value * 10 + static_cast<unsigned>(*p - '0');
+                if (value > limit) break;
+                ++p;
+            } while (p != pEnd && static_cast<unsigned>(*p - '0') <= 9);
+            if (value > limit)
+            {
+                error = eParseError::OUT_OF_RANGE;
+                p = pNumber;
+                break;
+            }
+            if (result.count == capacity)
+            {
+                error = eParseError::TOO_MANY_NUMBERS;
+                p = pNumber;
+                break;
+            }
+            pOut[result.count++] = static_cast<Tint>(isNegative ? 0 - value : value);
+
+            // Delimiter, then whitespace up to the next number
+            while (p != pEnd && isListWhitespace(*p)) ++p;
+            if (p == pEnd) break;
+            if (*p != delimiter)
+            {
+                error = eParseError::UNEXPECTED_CHARACTER;
+                break;
+            }
+            ++p;
+            while (p != pEnd && isListWhitespace(*p)) ++p;
+            if (p == pEnd)
+            {
+                error = eParseError::EXPECTED_NUMBER;
+                break;
+            }
+        }
+
+        if (error != eParseError::NONE)
+        {
+            result.error = error;
+            result.position = static_cast<size_t>(p - pStr);
+            result.line = 1;
+            auto pLine = pStr;
+            for (auto pChar = pStr; pChar != p; ++pChar)
+            {
+                if (*pChar == '\n')
+                {
+                    ++result.line;
+                    pLine = pChar + 1;
+                }
+            }
+            result.column = static_cast<int>(p - pLine) + 1;
+        }
+        return result;
+    }
+
+    sParseResult parseIntList(const char* pStr, size_t length, uint32_t* pOut, size_t capacity, char delimiter)
+    {
+        return parseIntListImpl(pStr, length, pOut, capacity, delimiter);
+    }
+
+    sParseResult parseIntList(const char* pStr, size_t length, int32_t* pOut, size_t capacity, char delimiter)
+    {
+        return parseIntListImpl(pStr, length, pOut, capacity, delimiter);
+    }
+
     int hash(const char* pStr)
     {
         int hash = 0;
@@ -1,6 +1,8 @@
-#include "LodePNG.h"
+#include "ImageUtils.h"
+#include "MappedFile.h"
 #include "onut.h"
 #include "Texture.h"
+#include "TextureCache.h"
 
 #include <cassert>
 #include <vector>
@@ -128,49 +130,50 @@ namespace onut
 
     Texture* Texture::createFromFile(const std::string& filename, bool generateMipmaps)
     {
-        Texture* pRet = NULL;
-
-        std::vector<unsigned char> image; //the raw pixels (holy crap that must be slow)
-        unsigned int w, h;
-        auto ret = lodepng::decode(image, w, h, filename);
-        assert(!ret);
-        sSize size{w, h};
-        byte* pData = &(image[0]);
-        ULONG len = size.x * size.y;
-
-        // Pre multiplied
-        for (ULONG i = 0; i < len; ++i, pData += 4)
+        // Warm start, the decoded pixels are already on disk
+        TextureCache::sEntry cached;
+        if (OTextureCache && OTextureCache->find(filename, generateMipmaps, cached))
         {
-            pData[0] = pData[0] * pData[3] / 255;
-            pData[1] = pData[1] * pData[3] / 255;
-            pData[2] = pData[2] * pData[3] / 255;
+            return createFromMipChain({cached.width, cached.height}, cached.pMipChain, generateMipmaps ? cached.levelCount : 1);
         }
 
-        return createFromData(size, &(image[0]), generateMipmaps);
+        // Decode straight into the first level of the mip chain, premultiplying as rows come out
+        MappedFile file(filename);
+        assert(file.isValid());
+        sSize size;
+        auto ret = getPngSize(file.getData(), file.getSize(), size.x, size.y);
+        assert(ret);
+        if (!ret) return nullptr;
+
+        auto levels = getMipLevels(size.x, size.y, generateMipmaps ? 0 : 1);
+        std::vector<uint8_t> image(getMipChainSize(levels));
+        ret = decodePng(file.getData(), file.getSize(), image.data(), size.x * 4, size.x, size.y);
+        assert(ret);
+        generateMipChain(image.data(), levels);
+        auto levelCount = static_cast<uint32_t>(levels.size());
+
+        if (OTextureCache)
+        {
+            OTextureCache->store(filename, size.x, size.y, image.data(), levelCount);
+        }
+
+        return createFromMipChain(size, image.data(), levelCount);
     }
 
     Texture* Texture::createFromFileData(const unsigned char* in_pData, uint32_t in_size, bool in_generateMipmaps)
     {
-        Texture* pRet = NULL;
-
-        std::vector<unsigned char> image; //the raw pixels (holy crap that must be slow)
-        unsigned int w, h;
-        lodepng::State state;
-        auto ret = lodepng::decode(image, w, h, state, in_pData, in_size);
-        assert(!ret);
-        sSize size{w, h};
-        byte* pData = &(image[0]);
-        ULONG len = size.x * size.y;
-
-        // Pre multiplied
-        for (ULONG i = 0; i < len; ++i, pData += 4)
-        {
-            pData[0] = pData[0] * pData[3] / 255;
-            pData[1] = pData[1] * pData[3] / 255;
-            pData[2] = pData[2] * pData[3] / 255;
-        }
-
-        return createFromData(size, &(image[0]), in_generateMipmaps);
+        sSize size;
+        auto ret = getPngSize(in_pData, in_size, size.x, size.y);
+        assert(ret);
+        if (!ret) return nullptr;
+
+        auto levels = getMipLevels(size.x, size.y, in_generateMipmaps ? 0 : 1);
+        std::vector<uint8_t> image(getMipChainSize(levels));
+        ret = decodePng(in_pData, in_size, image.data(), size.x * 4, size.x, size.y);
+        assert(ret);
+        generateMipChain(image.data(), levels);
+
+        return createFromMipChain(size, image.data(), static_cast<uint32_t>(levels.size()));
     }
 
     Texture* Texture::createFromData(const sSize& size, const unsigned char* in_pData, bool in_generateMipmaps)
@@ -183,94 +186,44 @@ namespace onut
                                                  in_generateMipmaps ? EG_GENERATE_MIPMAPS : static_cast<EG_TEXTURE_FLAGS>(0));
         pRet->m_size = size;
         return pRet;
+#else /* EASY_GRAPHIX */
+        if (!in_generateMipmaps)
+        {
+            return createFromMipChain(size, in_pData, 1);
+        }
+
+        // Generate mip levels on the CPU. Non power of two sizes get a chain too
+        auto levels = getMipLevels(size.x, size.y);
+        std::vector<uint8_t> mipChain(getMipChainSize(levels));
+        memcpy(mipChain.data(), in_pData, levels[0].size);
+        generateMipChain(mipChain.data(), levels);
+
+        return createFromMipChain(size, mipChain.data(), static_cast<uint32_t>(levels.size()));
+#endif /* EASY_GRAPHIX */
+    }
+
+    Texture* Texture::createFromMipChain(const sSize& size, const unsigned char* in_pMipChain, uint32_t in_levelCount)
+    {
+#ifdef EASY_GRAPHIX
+        return createFromData(size, in_pMipChain, in_levelCount > 1);
 #else /* EASY_GRAPHIX */
         ID3D11Texture2D* pTexture = NULL;
         ID3D11ShaderResourceView* pTextureView = NULL;
         auto pRet = new Texture();
 
-        // Manually generate mip levels
-        bool allowMipMaps = true;
-        UINT w2 = 1;
-        UINT h2 = 1;
-        while (w2 < (UINT)size.x) w2 *= 2;
-        if (size.x != w2) allowMipMaps = false;
-        while (h2 < (UINT)size.y) h2 *= 2;
-        if (size.y != h2) allowMipMaps = false;
-        unsigned char* pMipMaps = NULL;
-        int mipLevels = 1;
-        D3D11_SUBRESOURCE_DATA* mipsData = NULL;
-        allowMipMaps = allowMipMaps && in_generateMipmaps;
-        if (allowMipMaps)
+        auto levels = getMipLevels(size.x, size.y, in_levelCount);
+        std::vector<D3D11_SUBRESOURCE_DATA> mipsData(levels.size());
+        for (size_t i = 0; i < levels.size(); ++i)
         {
-            UINT biggest = max(w2, h2);
-            UINT w2t = w2;
-            UINT h2t = h2;
-            UINT totalSize = w2t * h2t * 4;
-            while (!(w2t == 1 && h2t == 1))
-            {
-                ++mipLevels;
-                w2t /= 2;
-                if (w2t < 1) w2t = 1;
-                h2t /= 2;
-                if (h2t < 1) h2t = 1;
-                totalSize += w2t * h2t * 4;
-            }
-            pMipMaps = new byte[totalSize];
-            memcpy(pMipMaps, in_pData, size.x * size.y * 4);
-
-            mipsData = new D3D11_SUBRESOURCE_DATA[mipLevels];
-
-            w2t = w2;
-            h2t = h2;
-            totalSize = 0;
-            int mipTarget = mipLevels;
-            mipLevels = 0;
-            byte* prev;
-            byte* cur;
-            while (mipLevels != mipTarget)
-            {
-                prev = pMipMaps + totalSize;
-                mipsData[mipLevels].pSysMem = prev;
-                mipsData[mipLevels].SysMemPitch = w2t * 4;
-                mipsData[mipLevels].SysMemSlicePitch = 0;
-                totalSize += w2t * h2t * 4;
-                cur = pMipMaps + totalSize;
-                w2t /= 2;
-                if (w2t < 1) w2t = 1;
-                h2t /= 2;
-                if (h2t < 1) h2t = 1;
-                ++mipLevels;
-                if (mipLevels == mipTarget) break;
-                int accum;
-
-                // Generate the mips
-                int multX = w2 / w2t;
-                int multY = h2 / h2t;
-                for (UINT y = 0; y < h2t; ++y)
-                {
-                    for (UINT x = 0; x < w2t; ++x)
-                    {
-                        for (UINT k = 0; k < 4; ++k)
-                        {
-                            accum = 0;
-                            accum += prev[(y * multY * w2 + x * multX) * 4 + k];
-                            accum += prev[(y * multY * w2 + (x + multX / 2) * multX) * 4 + k];
-                            accum += prev[((y + multY / 2) * multY * w2 + x * multX) * 4 + k];
-                            accum += prev[((y + multY / 2) * multY * w2 + (x + multX / 2) * multX) * 4 + k];
-                            cur[(y * w2t + x) * 4 + k] = accum / 4;
-                        }
-                    }
-                }
-
-                w2 = w2t;
-                h2 = h2t;
-            }
+            mipsData[i].pSysMem = in_pMipChain + levels[i].offset;
+            mipsData[i].SysMemPitch = levels[i].width * 4;
+            mipsData[i].SysMemSlicePitch = 0;
         }
 
         D3D11_TEXTURE2D_DESC desc;
         desc.Width = size.x;
         desc.Height = size.y;
-        desc.MipLevels = mipLevels;
+        desc.MipLevels = static_cast<UINT>(levels.size());
         desc.ArraySize = 1;
         desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
         desc.SampleDesc.Count = 1;
@@ -280,20 +233,13 @@ namespace onut
         desc.CPUAccessFlags = 0;
         desc.MiscFlags = 0;
 
-        D3D11_SUBRESOURCE_DATA data;
-        data.pSysMem = (pMipMaps) ? pMipMaps : in_pData;
-        data.SysMemPitch = size.x * 4;
-        data.SysMemSlicePitch = 0;
-
         auto pDevice = ORenderer->getDevice();
-        auto ret = pDevice->CreateTexture2D(&desc, (mipsData) ? mipsData : &data, &pTexture);
+        auto ret = pDevice->CreateTexture2D(&desc, mipsData.data(), &pTexture);
         assert(ret == S_OK);
         ret = pDevice->CreateShaderResourceView(pTexture, NULL, &pTextureView);
         assert(ret == S_OK);
 
         pTexture->Release();
-        if (pMipMaps) delete[] pMipMaps;
-        if (mipsData) delete[] mipsData;
 
         pRet->m_size = size;
         pRet->m_pTextureView = pTextureView;
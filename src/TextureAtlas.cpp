@@ -0,0 +1,145 @@
+#include "ImageUtils.h"
+#include "MappedFile.h"
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace onut
+{
+    TextureAtlas::TextureAtlas(uint32_t pageSize, uint32_t padding)
+        : m_pageSize(pageSize)
+        , m_padding(padding)
+    {
+    }
+
+    TextureAtlas::~TextureAtlas()
+    {
+        clearPages();
+    }
+
+    void TextureAtlas::clearPages()
+    {
+        for (auto pPage : m_pages)
+        {
+            delete pPage;
+        }
+        m_pages.clear();
+        m_regions.clear();
+    }
+
+    void TextureAtlas::add(const std::string& name, const std::string& filename)
+    {
+        MappedFile file(filename);
+        assert(file.isValid());
+        sImage image;
+        if (!getPngSize(file.getData(), file.getSize(), image.width, image.height)) return;
+        image.pixels.resize(image.width * image.height * 4);
+        auto ret = decodePng(file.getData(), file.getSize(), image.pixels.data(), image.width * 4, image.width, image.height);
+        assert(ret);
+        if (!ret) return;
+        m_images[name] = std::move(image);
+    }
+
+    void TextureAtlas::add(const std::string& name, uint32_t width, uint32_t height, const uint8_t* pRGBA)
+    {
+        sImage image;
+        image.width = width;
+        image.height = height;
+        image.pixels.assign(pRGBA, pRGBA + width * height * 4);
+        m_images[name] = std::move(image);
+    }
+
+    void TextureAtlas::build(bool generateMipmaps)
+    {
+        clearPages();
+
+        // Biggest first packs a lot tighter
+        std::vector<std::pair<const std::string*, const sImage*>> sorted;
+        sorted.reserve(m_images.size());
+        for (auto& kv : m_images)
+        {
+            sorted.push_back({&kv.first, &kv.second});
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const std::pair<const std::string*, const sImage*>& a,
+                                                   const std::pair<const std::string*, const sImage*>& b)
+        {
+            auto maxA = std::max<>(a.second->width, a.second->height);
+            auto maxB = std::max<>(b.second->width, b.second->height);
+            if (maxA != maxB) return maxA > maxB;
+            return *a.first < *b.first;
+        });
+
+        std::vector<RectPacker> packers;
+        std::vector<std::vector<uint8_t>> pagePixels;
+        std::vector<std::pair<const std::string*, size_t>> placedPages;
+        auto pageBytes = static_cast<size_t>(m_pageSize) * m_pageSize * 4;
+        auto padding2 = m_padding * 2;
+
+        for (auto& entry : sorted)
+        {
+            auto& image = *entry.second;
+            if (image.width + padding2 > m_pageSize || image.height + padding2 > m_pageSize) continue;
+
+            RectPacker::sRect placed;
+            size_t pageIndex = 0;
+            for (; pageIndex < packers.size(); ++pageIndex)
+            {
+                if (packers[pageIndex].insert(image.width + padding2, image.height + padding2, placed)) break;
+            }
+            if (pageIndex == packers.size())
+            {
+                packers.emplace_back(m_pageSize, m_pageSize);
+                pagePixels.emplace_back(pageBytes, 0);
+                packers.back().insert(image.width + padding2, image.height + padding2, placed);
+            }
+
+            // Copy the rows, extruding the borders into the padding
+            auto pDst = pagePixels[pageIndex].data();
+            auto dstPitch = static_cast<size_t>(m_pageSize) * 4;
+            auto srcPitch = static_cast<size_t>(image.width) * 4;
+            auto x = placed.x + m_padding;
+            auto y = placed.y + m_padding;
+            for (uint32_t row = 0; row < placed.height; ++row)
+            {
+                auto srcRow = std::min<>(std::max<>(static_cast<int>(row) - static_cast<int>(m_padding), 0), static_cast<int>(image.height) - 1);
+                auto pSrcRow = image.pixels.data() + srcRow * srcPitch;
+                auto pDstRow = pDst + (placed.y + row) * dstPitch + placed.x * 4;
+                for (uint32_t i = 0; i < m_padding; ++i)
+                {
+                    memcpy(pDstRow + i * 4, pSrcRow, 4);
+                    memcpy(pDstRow + (m_padding + image.width + i) * 4, pSrcRow + srcPitch - 4, 4);
+                }
+                memcpy(pDstRow + m_padding * 4, pSrcRow, srcPitch);
+            }
+
+            auto pageSizef = static_cast<float>(m_pageSize);
+            AtlasRegion region;
+            region.rect = Rect(static_cast<float>(x), static_cast<float>(y),
+                               static_cast<float>(image.width), static_cast<float>(image.height));
+            region.uvs = Vector4(static_cast<float>(x) / pageSizef,
+                                 static_cast<float>(y) / pageSizef,
+                                 static_cast<float>(x + image.width) / pageSizef,
+                                 static_cast<float>(y + image.height) / pageSizef);
+            m_regions[*entry.first] = region;
+            placedPages.push_back({entry.first, pageIndex});
+        }
+
+        for (auto& pixels : pagePixels)
+        {
+            m_pages.push_back(Texture::createFromData({m_pageSize, m_pageSize}, pixels.data(), generateMipmaps));
+        }
+        for (auto& placedPage : placedPages)
+        {
+            m_regions[*placedPage.first].pTexture = m_pages[placedPage.second];
+        }
+    }
+
+    const AtlasRegion* TextureAtlas::getRegion(const std::string& name) const
+    {
+        auto it = m_regions.find(name);
+        if (it == m_regions.end()) return nullptr;
+        return &it->second;
+    }
+}
@@ -0,0 +1,130 @@
+#include "crypto.h"
+#include "ImageUtils.h"
+#include "TextureCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <utility>
+#include <vector>
+#if defined(WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace onut
+{
+    static const uint32_t CACHE_MAGIC = 0x3143544f; // "OTC1"
+    static const uint32_t CACHE_VERSION = 2; // Finer source times
+    static const uint64_t CACHE_DATA_ALIGNMENT = 64;
+
+    struct sCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceSize;
+        uint64_t sourceTime;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+        uint32_t pathLength; // Source path follows the header, to detect hash collisions
+        uint64_t dataOffset;
+    };
+
+    static void createDirectories(const std::string& path)
+    {
+        for (size_t i = 1; i <= path.size(); ++i)
+        {
+            if (i == path.size() || path[i] == '/' || path[i] == '\\')
+            {
+                auto subPath = path.substr(0, i);
+#if defined(WIN32)
+                _mkdir(subPath.c_str());
+#else
+                mkdir(subPath.c_str(), 0755);
+#endif
+            }
+        }
+    }
+
+    TextureCache::TextureCache(const std::string& directory)
+        : m_directory(directory)
+    {
+        createDirectories(m_directory);
+    }
+
+    std::string TextureCache::getEntryFilename(const std::string& filename) const
+    {
+        return m_directory + "/" + sha1(filename) + ".otc";
+    }
+
+    bool TextureCache::find(const std::string& filename, bool withMipmaps, sEntry& entry) const
+    {
+        uint64_t sourceSize, sourceTime;
+        if (!getFileStamp(filename, sourceSize, sourceTime)) return false;
+
+        std::unique_ptr<MappedFile> pFile(new MappedFile(getEntryFilename(filename)));
+        if (!pFile->isValid() || pFile->getSize() < sizeof(sCacheHeader)) return false;
+
+        sCacheHeader header;
+        memcpy(&header, pFile->getData(), sizeof(header));
+        if (header.magic != CACHE_MAGIC ||
+            header.version != CACHE_VERSION ||
+            header.sourceSize != sourceSize ||
+            header.sourceTime != sourceTime ||
+            header.pathLength != filename.size() ||
+            sizeof(header) + header.pathLength > header.dataOffset ||
+            !header.width || !header.height || !header.levelCount)
+        {
+            return false;
+        }
+        if (memcmp(pFile->getData() + sizeof(header), filename.c_str(), header.pathLength)) return false;
+
+        auto levels = getMipLevels(header.width, header.height, header.levelCount);
+        if (levels.size() != header.levelCount) return false;
+        if (withMipmaps && header.levelCount != getMipLevelCount(header.width, header.height)) return false;
+        if (header.dataOffset + getMipChainSize(levels) > pFile->getSize()) return false;
+
+        entry.width = header.width;
+        entry.height = header.height;
+        entry.levelCount = header.levelCount;
+        entry.pMipChain = pFile->getData() + header.dataOffset;
+        entry.pFile = std::move(pFile);
+        return true;
+    }
+
+    bool TextureCache::store(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* pMipChain, uint32_t levelCount) const
+    {
+        sCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        if (!getFileStamp(filename, header.sourceSize, header.sourceTime)) return false;
+        header.magic = CACHE_MAGIC;
+        header.version = CACHE_VERSION;
+        header.width = width;
+        header.height = height;
+        header.levelCount = levelCount;
+        header.pathLength = static_cast<uint32_t>(filename.size());
+        header.dataOffset = (sizeof(header) + header.pathLength + CACHE_DATA_ALIGNMENT - 1) / CACHE_DATA_ALIGNMENT * CACHE_DATA_ALIGNMENT;
+
+        auto entryFilename = getEntryFilename(filename);
+        auto tmpFilename = entryFilename + ".tmp";
+        {
+            std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+            if (file.fail()) return false;
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(filename.c_str(), filename.size());
+            std::vector<char> padding(static_cast<size_t>(header.dataOffset) - sizeof(header) - filename.size(), 0);
+            file.write(padding.data(), padding.size());
+            file.write(reinterpret_cast<const char*>(pMipChain), getMipChainSize(getMipLevels(width, height, levelCount)));
+            if (file.fail()) return false;
+        }
+
+        if (!replaceFile(tmpFilename, entryFilename))
+        {
+            std::remove(tmpFilename.c_str());
+            return false;
+        }
+        return true;
+    }
+}
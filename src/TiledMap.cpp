@@ -1,11 +1,265 @@
 #include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <thread>
 #include "tinyxml2.h"
 #include "onut.h"
 #include "crypto.h"
+#include "MappedFile.h"
+#include "SimdHelpers.h"
 #include "zlib/zlib.h"
 
 namespace onut
 {
+    // Compiled maps. Little endian, every array starts on COMPILED_ALIGNMENT from the start of the file
+    static const uint32_t COMPILED_MAGIC = 0x314d544f; // "OTM1"
+    static const uint32_t COMPILED_VERSION = 1;
+    static const uint64_t COMPILED_ALIGNMENT = 64;
+    static const uint32_t COMPILED_NO_TILESET = 0xFFFFFFFF;
+    static const uint32_t STREAMED_MAGIC = 0x3153544f; // "OTS1"
+    static const uint64_t REGION_BYTES = sizeof(uint32_t) * TiledMap::REGION_SIZE * TiledMap::REGION_SIZE;
+    static const uint64_t REGION_CHUNK_BYTES = sizeof(sRenderVertex) * 4 * TiledMap::REGION_SIZE * TiledMap::REGION_SIZE; // At most, once drawn
+    static_assert(TiledMap::REGION_SIZE % TiledMap::CHUNK_SIZE == 0, "Chunks can't cross regions");
+
+    enum class eCompiledLayerType : uint32_t
+    {
+        TILES,
+        OBJECTS
+    };
+
+    struct sCompiledHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        int32_t width;
+        int32_t height;
+        uint32_t tilesetCount;
+        uint32_t tileCount;
+        uint32_t layerCount;
+        uint32_t stringCount;
+        uint64_t tilesetsOffset; // sCompiledTileset[tilesetCount]
+        uint64_t tilesOffset; // sCompiledTile[tileCount], indexed by gid
+        uint64_t layersOffset; // sCompiledLayer[layerCount]
+        uint64_t stringsOffset; // sCompiledString[stringCount], then the characters
+    };
+
+    // Streamed maps. Everything up to regionsOffset is loaded at once. Then for each tile layer, its
+    // regions row by row, REGION_SIZE * REGION_SIZE gids each with zeros past the layer's edges
+    struct sStreamedHeader
+    {
+        sCompiledHeader header;
+        uint64_t regionsOffset;
+    };
+
+    // Strings are interned, and referred to by index. 0 is the empty string
+    struct sCompiledString
+    {
+        uint32_t offset; // From stringsOffset, null terminated
+        uint32_t length;
+    };
+
+    struct sCompiledTileset
+    {
+        int32_t firstId;
+        int32_t tileWidth;
+        int32_t tileHeight;
+        int32_t imageWidth;
+        int32_t imageHeight;
+        uint32_t name;
+        uint32_t image; // Relative to the map
+    };
+
+    struct sCompiledTile
+    {
+        uint32_t tileset; // COMPILED_NO_TILESET for gid 0
+        float UVs[4];
+    };
+
+    struct sCompiledLayer
+    {
+        eCompiledLayerType type;
+        uint32_t name;
+        uint32_t isVisible;
+        int32_t width; // TILES
+        int32_t height;
+        uint32_t objectCount; // OBJECTS
+        uint32_t propertyCount;
+        uint32_t padding;
+        uint64_t dataOffset; // uint32_t gids[width * height] or sCompiledObject[objectCount]
+        uint64_t propertiesOffset; // sCompiledProperty[propertyCount]
+    };
+
+    struct sCompiledObject
+    {
+        float x;
+        float y;
+        float width;
+        float height;
+        uint32_t id;
+        uint32_t name;
+        uint32_t type;
+        uint32_t firstProperty;
+        uint32_t propertyCount;
+    };
+
+    struct sCompiledProperty
+    {
+        uint32_t name;
+        uint32_t value;
+    };
+
+    struct TiledMap::sStreaming
+    {
+        struct sRegion
+        {
+            bool isResident = false;
+            bool isLoading = false;
+            bool isWanted = false;
+        };
+
+        std::ifstream file; // Shared by the loading threads
+        std::mutex fileMutex;
+        uint64_t fileSize = 0;
+        int regionCountX = 0;
+        int regionCountY = 0;
+        size_t regionBytes = 0; // Gids and chunk vertices of all the tile layers
+        std::vector<sRegion> regions;
+        std::vector<int> wantedRegions; // Nearest first
+        std::vector<int> activeRegions; // Resident or loading
+        bool hasFocus = false;
+        Vector2 focus;
+        int radius = 1;
+        size_t memoryCap = std::numeric_limits<size_t>::max();
+        Synchronous<> loadedRegions; // Installed by updateStreaming()
+        std::vector<std::future<void>> loads;
+    };
+
+    // A layer's <data>, decoded on a worker thread while loading a .tmx
+    struct sEncodedLayer
+    {
+        uint32_t *pTileIds;
+        int tileCount;
+        uint32_t gidCount; // Valid gids are below
+        const char *szData;
+        const char *szEncoding;
+        const char *szCompression;
+    };
+
+    // One per worker. The inflate state and the decoded base64 are reused from one layer to the next
+    class LayerDecoder
+    {
+    public:
+        ~LayerDecoder()
+        {
+            if (m_isInflateReady) inflateEnd(&m_stream);
+        }
+
+        void decode(const sEncodedLayer &layer)
+        {
+            auto len = layer.tileCount;
+            if (!strcmp(layer.szEncoding, "csv"))
+            {
+                auto result = parseIntList(layer.szData, strlen(layer.szData), layer.pTileIds, len);
+                assert(result.error == eParseError::NONE); // See result.line and result.column
+                assert(result.count == static_cast<size_t>(len));
+            }
+            else if (!strcmp(layer.szEncoding, "base64"))
+            {
+                auto length = strlen(layer.szData);
+                if (!layer.szCompression)
+                {
+                    // Straight into the tiles
+                    size_t size = 0;
+                    if (!base64_decode(layer.szData, length, reinterpret_cast<uint8_t*>(layer.pTileIds), 4 * len, size)) size = 0;
+                    assert(size == static_cast<size_t>(len) * 4);
+                }
+                else
+                {
+                    assert(!strcmp(layer.szCompression, "gzip") || !strcmp(layer.szCompression, "zlib"));
+                    base64_decode(layer.szData, length, m_decoded);
+                    inflateTiles(layer);
+                }
+            }
+            else
+            {
+                assert(false); // Unknown encoding
+            }
+
+            for (int i = 0; i < len; ++i)
+            {
+                assert((layer.pTileIds[i] & ~TiledMap::FLIP_FLAGS) < layer.gidCount); // Unknown gid
+            }
+        }
+
+    private:
+        void inflateTiles(const sEncodedLayer &layer)
+        {
+            int err;
+            if (!m_isInflateReady)
+            {
+                m_stream.zalloc = (alloc_func)0;
+                m_stream.zfree = (free_func)0;
+                m_stream.opaque = (voidpf)0;
+                m_stream.next_in = Z_NULL;
+                m_stream.avail_in = 0;
+                err = inflateInit2(&m_stream, 15 + 32); // gzip or zlib header
+                assert(err == Z_OK);
+                m_isInflateReady = true;
+            }
+            else
+            {
+                err = inflateReset(&m_stream);
+                assert(err == Z_OK);
+            }
+
+            m_stream.next_in = reinterpret_cast<Bytef*>(m_decoded.data());
+            m_stream.avail_in = static_cast<uInt>(m_decoded.size());
+            m_stream.next_out = reinterpret_cast<Bytef*>(layer.pTileIds);
+            m_stream.avail_out = static_cast<uInt>(layer.tileCount * 4);
+            err = inflate(&m_stream, Z_FINISH);
+            assert(err == Z_STREAM_END);
+            assert(m_stream.total_out == static_cast<uLong>(layer.tileCount * 4));
+        }
+
+        z_stream m_stream;
+        bool m_isInflateReady = false;
+        std::vector<uint8_t> m_decoded;
+    };
+
+    // Layers are split between workers, biggest first. Each writes its own tiles, so the result is the same as in order
+    static void decodeLayers(std::vector<sEncodedLayer> &layers)
+    {
+        if (layers.empty()) return;
+        std::sort(layers.begin(), layers.end(), [](const sEncodedLayer &a, const sEncodedLayer &b)
+        {
+            return a.tileCount > b.tileCount;
+        });
+
+        auto workerCount = std::min<size_t>(layers.size(), std::max(1u, std::thread::hardware_concurrency()));
+        if (workerCount == 1)
+        {
+            LayerDecoder decoder;
+            for (auto &layer : layers) decoder.decode(layer);
+            return;
+        }
+
+        std::atomic<size_t> next(0);
+        std::vector<std::function<void()>> workers(workerCount, [&layers, &next]
+        {
+            LayerDecoder decoder;
+            for (auto i = next++; i < layers.size(); i = next++)
+            {
+                decoder.decode(layers[i]);
+            }
+        });
+        ORunTasks(workers);
+    }
+
     TiledMap::sLayer::~sLayer()
     {
     }
@@ -22,13 +276,54 @@ namespace onut
 
     TiledMap::sTileLayerInternal::~sTileLayerInternal()
     {
-        if (tiles) delete[] tiles;
+        if (isMapped) tileIds = nullptr; // Owned by the file
+        for (auto pRegion : regions)
+        {
+            if (pRegion) delete[] pRegion;
+        }
+    }
+
+    TiledMap::TiledMap(const std::string &map, onut::ContentManager<> *pContentManager, IRenderBackend *pBackend)
+        : m_filename(map)
+        , m_pBackend(pBackend)
+    {
+        // Streamed maps are read a region at a time
+        uint32_t magic = 0;
+        {
+            std::ifstream file(map, std::ios::binary);
+            file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        }
+        if (magic == STREAMED_MAGIC)
+        {
+            loadStreamed(map, pContentManager);
+            return;
+        }
+
+        // Compiled maps are used in place. Copy on write, so tiles can still be changed
+        m_pFile.reset(new MappedFile(map, true));
+        assert(m_pFile->isValid());
+        if (m_pFile->getSize() >= sizeof(sCompiledHeader) &&
+            reinterpret_cast<const sCompiledHeader*>(m_pFile->getData())->magic == COMPILED_MAGIC)
+        {
+            loadCompiled(m_pFile->getWritableData(), m_pFile->getSize(), map, pContentManager);
+        }
+        else
+        {
+            loadXML(map, pContentManager);
+            m_pFile.reset();
+        }
+    }
+
+    bool TiledMap::compile(const std::string &tmx, const std::string &compiled, bool isStreamed)
+    {
+        TiledMap tiledMap(tmx, nullptr);
+        return tiledMap.save(compiled, isStreamed);
     }
 
-    TiledMap::TiledMap(const std::string &map, onut::ContentManager<> *pContentManager)
+    void TiledMap::loadXML(const std::string &map, onut::ContentManager<> *pContentManager)
     {
         tinyxml2::XMLDocument doc;
-        doc.LoadFile(map.c_str());
+        doc.Parse(reinterpret_cast<const char*>(m_pFile->getData()), m_pFile->getSize());
         assert(!doc.Error());
         auto pXMLMap = doc.FirstChildElement("map");
         assert(pXMLMap);
@@ -57,11 +352,14 @@ namespace onut
             assert(pXMLImage);
             auto szImageFilename = pXMLImage->Attribute("source");
             assert(szImageFilename);
-            auto filename = getPath(map) + "/" + szImageFilename;
-            pTileSet.pTexture = pContentManager->getResource<Texture>(filename);
+            pTileSet.image = szImageFilename;
+            pTileSet.imageWidth = pXMLImage->IntAttribute("width");
+            pTileSet.imageHeight = pXMLImage->IntAttribute("height");
+            loadTexture(pTileSet, map, pContentManager);
 
             ++m_tilesetCount;
         }
+        resolveTiles();
 
         // Layers
         for (auto pXMLLayer = pXMLMap->FirstChildElement(); pXMLLayer; pXMLLayer = pXMLLayer->NextSiblingElement())
@@ -75,6 +373,7 @@ namespace onut
         assert(m_layerCount);
         m_layers = new sLayer*[m_layerCount];
         m_layerCount = 0;
+        std::vector<sEncodedLayer> encodedLayers;
         for (auto pXMLLayer = pXMLMap->FirstChildElement(); pXMLLayer; pXMLLayer = pXMLLayer->NextSiblingElement())
         {
             if (!strcmp(pXMLLayer->Name(), "layer"))
@@ -107,125 +406,32 @@ namespace onut
                     int i = 0;
                     for (auto pXMLTile = pXMLData->FirstChildElement("tile"); pXMLTile; pXMLTile = pXMLTile->NextSiblingElement("tile"), ++i)
                     {
-                        auto id = pXMLTile->IntAttribute("gid");
+                        auto id = pXMLTile->UnsignedAttribute("gid");
                         assert(i < len);
                         pLayer.tileIds[i] = id;
                     }
                     assert(i == len);
+                    for (int i = 0; i < len; ++i)
+                    {
+                        assert((pLayer.tileIds[i] & ~FLIP_FLAGS) < m_tiles.size()); // Unknown gid
+                    }
                 }
                 else
                 {
+                    // Decoded after all the layers are created. Texts are read here, tinyxml2 fixes them up on first access
                     auto szData = pXMLData->GetText();
                     assert(szData);
-                    auto pos = std::string(szData).find_first_not_of("\n ");
-                    assert(pos < strlen(szData));
-                    szData = szData + pos;
-
-                    if (!strcmp(szEncoding, "csv"))
-                    {
-                        auto csvData = splitString(szData, ',');
-                        assert(static_cast<int>(csvData.size()) == len);
-                        for (int i = 0; i < len; ++i)
-                        {
-                            try
-                            {
-                                pLayer.tileIds[i] = static_cast<uint32_t>(std::stoul(csvData[i]));
-                            }
-                            catch (std::exception e)
-                            {
-                                assert(false);
-                            }
-                        }
-                    }
-                    else if (!strcmp(szEncoding, "base64"))
-                    {
-                        auto decoded = base64_decode(szData);
-                        if (!szCompression)
-                        {
-                            assert(static_cast<int>(decoded.size()) == len * 4);
-                            memcpy(pLayer.tileIds, decoded.data(), 4 * len);
-                        }
-                        else if (!strcmp(szCompression, "gzip"))
-                        {
-                            int err;
-                            z_stream d_stream; // decompression stream
-
-                            d_stream.zalloc = (alloc_func)0;
-                            d_stream.zfree = (free_func)0;
-                            d_stream.opaque = (voidpf)0;
-
-                            d_stream.next_in = reinterpret_cast<Bytef*>(decoded.data()); // where deflated is a pointer the the compressed data buffer
-                            d_stream.avail_in = static_cast<uInt>(decoded.size()); // where deflatedLen is the length of the compressed data
-                            d_stream.next_out = reinterpret_cast<Bytef*>(pLayer.tileIds); // where inflated is a pointer to the resulting uncompressed data buffer
-                            d_stream.avail_out = static_cast<uInt>(len * 4); // where inflatedLen is the size of the uncompressed data buffer
-
-                            err = inflateInit2(&d_stream, 31);
-                            assert(err == Z_OK);
-                            err = inflate(&d_stream, Z_FINISH);
-                            assert(err == Z_STREAM_END);
-                            err = inflateEnd(&d_stream);
-                            assert(err == Z_OK);
-                        }
-                        else if (!strcmp(szCompression, "zlib"))
-                        {
-                            int err;
-                            z_stream d_stream; // decompression stream
-
-                            d_stream.zalloc = (alloc_func)0;
-                            d_stream.zfree = (free_func)0;
-                            d_stream.opaque = (voidpf)0;
-
-                            d_stream.next_in = reinterpret_cast<Bytef*>(decoded.data()); // where deflated is a pointer the the compressed data buffer
-                            d_stream.avail_in = static_cast<uInt>(decoded.size()); // where deflatedLen is the length of the compressed data
-                            d_stream.next_out = reinterpret_cast<Bytef*>(pLayer.tileIds); // where inflated is a pointer to the resulting uncompressed data buffer
-                            d_stream.avail_out = static_cast<uInt>(len * 4); // where inflatedLen is the size of the uncompressed data buffer
-
-                            err = inflateInit2(&d_stream, 15 + 32);
-                            assert(err == Z_OK);
-                            err = inflate(&d_stream, Z_FINISH);
-                            assert(err == Z_STREAM_END);
-                            err = inflateEnd(&d_stream);
-                            assert(err == Z_OK);
-                        }
-                    }
-                }
-
-                // Resolve the tiles to tilesets
-                pLayer.tiles = new sTile[len];
-                for (int i = 0; i < len; ++i)
-                {
-                    auto pTile = pLayer.tiles + i;
-                    auto tileId = pLayer.tileIds[i];
-                    if (tileId == 0)
-                    {
-                        continue;
-                    }
-                    auto pTileSet = m_tileSets;
-                    for (int j = 0; j < m_tilesetCount; ++j, pTileSet)
-                    {
-                        if (pTileSet->firstId > static_cast<int>(tileId)) break;
-                    }
-                    pTile->pTileset = pTileSet;
-                    auto texSize = pTileSet->pTexture->getSize();
-                    auto fitW = texSize.x / pTile->pTileset->tileWidth;
-                    auto fitH = texSize.y / pTile->pTileset->tileHeight;
-                    auto onTextureId = tileId - pTileSet->firstId;
-                    pTile->UVs.x = static_cast<float>((onTextureId % fitW) * pTileSet->tileWidth) / static_cast<float>(texSize.x);
-                    pTile->UVs.y = static_cast<float>((onTextureId / fitH) * pTileSet->tileHeight) / static_cast<float>(texSize.y);
-                    pTile->UVs.z = static_cast<float>((onTextureId % fitW + 1) * pTileSet->tileWidth) / static_cast<float>(texSize.x);
-                    pTile->UVs.w = static_cast<float>((onTextureId / fitH + 1) * pTileSet->tileHeight) / static_cast<float>(texSize.y);
-                    pTile->rect.x = static_cast<float>((i % pLayer.width) * pTileSet->tileWidth);
-                    pTile->rect.y = static_cast<float>((i / pLayer.height) * pTileSet->tileHeight);
-                    pTile->rect.z = static_cast<float>(pTileSet->tileWidth);
-                    pTile->rect.w = static_cast<float>(pTileSet->tileHeight);
+                    while (*szData == '\n' || *szData == '\r' || *szData == ' ' || *szData == '\t') ++szData;
+                    assert(*szData);
+                    encodedLayers.push_back({pLayer.tileIds, len, static_cast<uint32_t>(m_tiles.size()), szData, szEncoding, szCompression});
                 }
 
                 ++m_layerCount;
             }
             else if (!strcmp(pXMLLayer->Name(), "objectgroup"))
             {
-                m_layers[m_layerCount] = new sObjectLayer();
-                auto &pLayer = *(sObjectLayer*)m_layers[m_layerCount];
+                m_layers[m_layerCount] = new sObjectLayerInternal();
+                auto &pLayer = *(sObjectLayerInternal*)m_layers[m_layerCount];
 
                 pLayer.name = pXMLLayer->Attribute("name");
                 if (pXMLLayer->Attribute("visible"))
@@ -260,21 +466,358 @@ namespace onut
                             if (pXMLProperty->Attribute("name") &&
                                 pXMLProperty->Attribute("value"))
                             {
-                                object.properties[pXMLProperty->Attribute("name")] = pXMLProperty->Attribute("value");
+                                setProperty(object, pXMLProperty->Attribute("name"), pXMLProperty->Attribute("value"));
                             }
                         }
                     }
                 }
+                updateObjectIndex(&pLayer);
 
                 ++m_layerCount;
             }
         }
 
-        //TODO: Compile the graphics by batch of 16x16 terrain chunks
+        decodeLayers(encodedLayers);
+    }
+
+    void TiledMap::loadCompiled(uint8_t *pData, size_t size, const std::string &map, onut::ContentManager<> *pContentManager)
+    {
+        auto &header = *reinterpret_cast<const sCompiledHeader*>(pData);
+        assert(header.version == COMPILED_VERSION); // Compile the map again
+        assert(header.tilesetsOffset + sizeof(sCompiledTileset) * header.tilesetCount <= size);
+        assert(header.tilesOffset + sizeof(sCompiledTile) * header.tileCount <= size);
+        assert(header.layersOffset + sizeof(sCompiledLayer) * header.layerCount <= size);
+        assert(header.stringsOffset + sizeof(sCompiledString) * header.stringCount <= size);
+
+        auto pStrings = reinterpret_cast<const sCompiledString*>(pData + header.stringsOffset);
+        auto getString = [&](uint32_t index)
+        {
+            assert(index < header.stringCount);
+            auto &string = pStrings[index];
+            assert(header.stringsOffset + string.offset + string.length < size);
+            return std::string(reinterpret_cast<const char*>(pData + header.stringsOffset + string.offset), string.length);
+        };
+
+        m_width = header.width;
+        m_height = header.height;
+
+        // Tilesets
+        m_tilesetCount = static_cast<int>(header.tilesetCount);
+        assert(m_tilesetCount);
+        m_tileSets = new sTileSet[m_tilesetCount];
+        auto pCompiledTilesets = reinterpret_cast<const sCompiledTileset*>(pData + header.tilesetsOffset);
+        for (int i = 0; i < m_tilesetCount; ++i)
+        {
+            auto &compiledTileset = pCompiledTilesets[i];
+            auto &tileSet = m_tileSets[i];
+            tileSet.firstId = compiledTileset.firstId;
+            tileSet.tileWidth = compiledTileset.tileWidth;
+            tileSet.tileHeight = compiledTileset.tileHeight;
+            tileSet.imageWidth = compiledTileset.imageWidth;
+            tileSet.imageHeight = compiledTileset.imageHeight;
+            tileSet.name = getString(compiledTileset.name);
+            tileSet.image = getString(compiledTileset.image);
+            loadTexture(tileSet, map, pContentManager);
+        }
+
+        // Tiles, already resolved
+        m_tiles.resize(header.tileCount);
+        auto pCompiledTiles = reinterpret_cast<const sCompiledTile*>(pData + header.tilesOffset);
+        for (uint32_t i = 0; i < header.tileCount; ++i)
+        {
+            auto &compiledTile = pCompiledTiles[i];
+            auto &tile = m_tiles[i];
+            if (compiledTile.tileset == COMPILED_NO_TILESET) continue;
+            assert(compiledTile.tileset < header.tilesetCount);
+            tile.pTileset = m_tileSets + compiledTile.tileset;
+            tile.UVs = Vector4(compiledTile.UVs[0], compiledTile.UVs[1], compiledTile.UVs[2], compiledTile.UVs[3]);
+        }
+
+        // Layers
+        m_layerCount = static_cast<int>(header.layerCount);
+        assert(m_layerCount);
+        m_layers = new sLayer*[m_layerCount];
+        auto pCompiledLayers = reinterpret_cast<const sCompiledLayer*>(pData + header.layersOffset);
+        for (int i = 0; i < m_layerCount; ++i)
+        {
+            auto &compiledLayer = pCompiledLayers[i];
+            if (compiledLayer.type == eCompiledLayerType::TILES)
+            {
+                auto pLayer = new sTileLayerInternal();
+                m_layers[i] = pLayer;
+                pLayer->name = getString(compiledLayer.name);
+                pLayer->isVisible = compiledLayer.isVisible != 0;
+                pLayer->width = compiledLayer.width;
+                pLayer->height = compiledLayer.height;
+                if (m_pStreaming)
+                {
+                    pLayer->regionCountX = (pLayer->width + REGION_SIZE - 1) / REGION_SIZE;
+                    pLayer->regionCountY = (pLayer->height + REGION_SIZE - 1) / REGION_SIZE;
+                    pLayer->regionsOffset = compiledLayer.dataOffset;
+                    pLayer->regions.resize(pLayer->regionCountX * pLayer->regionCountY, nullptr);
+                    assert(compiledLayer.dataOffset + REGION_BYTES * pLayer->regions.size() <= m_pStreaming->fileSize);
+                    continue;
+                }
+                assert(compiledLayer.dataOffset + sizeof(uint32_t) * pLayer->width * pLayer->height <= size);
+                pLayer->tileIds = reinterpret_cast<uint32_t*>(pData + compiledLayer.dataOffset);
+                pLayer->isMapped = true;
+            }
+            else
+            {
+                assert(compiledLayer.type == eCompiledLayerType::OBJECTS);
+                auto pLayer = new sObjectLayerInternal();
+                m_layers[i] = pLayer;
+                pLayer->name = getString(compiledLayer.name);
+                pLayer->isVisible = compiledLayer.isVisible != 0;
+                assert(compiledLayer.dataOffset + sizeof(sCompiledObject) * compiledLayer.objectCount <= size);
+                assert(compiledLayer.propertiesOffset + sizeof(sCompiledProperty) * compiledLayer.propertyCount <= size);
+                auto pCompiledObjects = reinterpret_cast<const sCompiledObject*>(pData + compiledLayer.dataOffset);
+                auto pCompiledProperties = reinterpret_cast<const sCompiledProperty*>(pData + compiledLayer.propertiesOffset);
+                pLayer->objectCount = compiledLayer.objectCount;
+                pLayer->pObjects = new sObject[pLayer->objectCount];
+                for (uint32_t j = 0; j < pLayer->objectCount; ++j)
+                {
+                    auto &compiledObject = pCompiledObjects[j];
+                    auto &object = pLayer->pObjects[j];
+                    object.id = compiledObject.id;
+                    object.name = getString(compiledObject.name);
+                    object.type = getString(compiledObject.type);
+                    object.position = Vector2(compiledObject.x, compiledObject.y);
+                    object.size = Vector2(compiledObject.width, compiledObject.height);
+                    assert(compiledObject.firstProperty + compiledObject.propertyCount <= compiledLayer.propertyCount);
+                    for (uint32_t k = 0; k < compiledObject.propertyCount; ++k)
+                    {
+                        auto &compiledProperty = pCompiledProperties[compiledObject.firstProperty + k];
+                        setProperty(object, getString(compiledProperty.name), getString(compiledProperty.value));
+                    }
+                }
+                updateObjectIndex(pLayer);
+            }
+        }
+    }
+
+    void TiledMap::loadStreamed(const std::string &map, onut::ContentManager<> *pContentManager)
+    {
+        m_pStreaming.reset(new sStreaming());
+        auto &streaming = *m_pStreaming;
+        streaming.file.open(map, std::ios::binary);
+        assert(!streaming.file.fail());
+        streaming.file.seekg(0, std::ios::end);
+        streaming.fileSize = static_cast<uint64_t>(streaming.file.tellg());
+        streaming.file.seekg(0);
+
+        // Everything but the tiles
+        sStreamedHeader streamedHeader;
+        streaming.file.read(reinterpret_cast<char*>(&streamedHeader), sizeof(streamedHeader));
+        assert(!streaming.file.fail());
+        assert(streamedHeader.regionsOffset <= streaming.fileSize);
+        std::vector<uint8_t> data(static_cast<size_t>(streamedHeader.regionsOffset));
+        streaming.file.seekg(0);
+        streaming.file.read(reinterpret_cast<char*>(data.data()), data.size());
+        assert(!streaming.file.fail());
+        loadCompiled(data.data(), data.size(), map, pContentManager);
+
+        streaming.regionCountX = (m_width + REGION_SIZE - 1) / REGION_SIZE;
+        streaming.regionCountY = (m_height + REGION_SIZE - 1) / REGION_SIZE;
+        streaming.regions.resize(streaming.regionCountX * streaming.regionCountY);
+        for (int i = 0; i < m_layerCount; ++i)
+        {
+            if (dynamic_cast<sTileLayerInternal*>(m_layers[i])) streaming.regionBytes += static_cast<size_t>(REGION_BYTES + REGION_CHUNK_BYTES);
+        }
+    }
+
+    bool TiledMap::save(const std::string &filename, bool isStreamed) const
+    {
+        assert(!m_pStreaming); // Only part of the tiles are loaded
+        std::vector<uint8_t> data(isStreamed ? sizeof(sStreamedHeader) : sizeof(sCompiledHeader), 0);
+        auto align = [&data]()
+        {
+            data.resize(static_cast<size_t>((data.size() + COMPILED_ALIGNMENT - 1) / COMPILED_ALIGNMENT * COMPILED_ALIGNMENT), 0);
+            return static_cast<uint64_t>(data.size());
+        };
+        auto append = [&data](const void *pSrc, size_t size)
+        {
+            auto pBytes = reinterpret_cast<const uint8_t*>(pSrc);
+            data.insert(data.end(), pBytes, pBytes + size);
+        };
+
+        std::vector<std::string> strings;
+        std::unordered_map<std::string, uint32_t> stringIds;
+        auto intern = [&](const std::string &string)
+        {
+            auto it = stringIds.find(string);
+            if (it != stringIds.end()) return it->second;
+            auto id = static_cast<uint32_t>(strings.size());
+            stringIds[string] = id;
+            strings.push_back(string);
+            return id;
+        };
+        intern("");
+
+        sCompiledHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = isStreamed ? STREAMED_MAGIC : COMPILED_MAGIC;
+        header.version = COMPILED_VERSION;
+        header.width = m_width;
+        header.height = m_height;
+
+        // Tilesets
+        header.tilesetCount = static_cast<uint32_t>(m_tilesetCount);
+        header.tilesetsOffset = align();
+        for (int i = 0; i < m_tilesetCount; ++i)
+        {
+            auto &tileSet = m_tileSets[i];
+            sCompiledTileset compiledTileset = {tileSet.firstId, tileSet.tileWidth, tileSet.tileHeight, tileSet.imageWidth, tileSet.imageHeight,
+                                                intern(tileSet.name), intern(tileSet.image)};
+            append(&compiledTileset, sizeof(compiledTileset));
+        }
+
+        // Tiles
+        header.tileCount = static_cast<uint32_t>(m_tiles.size());
+        header.tilesOffset = align();
+        for (auto &tile : m_tiles)
+        {
+            sCompiledTile compiledTile = {tile.pTileset ? static_cast<uint32_t>(tile.pTileset - m_tileSets) : COMPILED_NO_TILESET,
+                                          {tile.UVs.x, tile.UVs.y, tile.UVs.z, tile.UVs.w}};
+            append(&compiledTile, sizeof(compiledTile));
+        }
+
+        // Layer data, then the layers pointing to it
+        std::vector<sCompiledLayer> compiledLayers(m_layerCount);
+        for (int i = 0; i < m_layerCount; ++i)
+        {
+            auto &compiledLayer = compiledLayers[i];
+            memset(&compiledLayer, 0, sizeof(compiledLayer));
+            compiledLayer.name = intern(m_layers[i]->name);
+            compiledLayer.isVisible = m_layers[i]->isVisible ? 1 : 0;
+
+            auto pTileLayer = dynamic_cast<sTileLayer*>(m_layers[i]);
+            if (pTileLayer)
+            {
+                compiledLayer.type = eCompiledLayerType::TILES;
+                compiledLayer.width = pTileLayer->width;
+                compiledLayer.height = pTileLayer->height;
+                if (isStreamed) continue; // Regions go last
+                compiledLayer.dataOffset = align();
+                append(pTileLayer->tileIds, sizeof(uint32_t) * pTileLayer->width * pTileLayer->height);
+                continue;
+            }
+
+            auto pObjectLayer = dynamic_cast<sObjectLayer*>(m_layers[i]);
+            assert(pObjectLayer);
+            compiledLayer.type = eCompiledLayerType::OBJECTS;
+            compiledLayer.objectCount = pObjectLayer->objectCount;
+            std::vector<sCompiledProperty> compiledProperties;
+            compiledLayer.dataOffset = align();
+            for (uint32_t j = 0; j < pObjectLayer->objectCount; ++j)
+            {
+                auto &object = pObjectLayer->pObjects[j];
+                sCompiledObject compiledObject = {object.position.x, object.position.y, object.size.x, object.size.y,
+                                                  object.id, intern(object.name), intern(object.type),
+                                                  static_cast<uint32_t>(compiledProperties.size()), static_cast<uint32_t>(object.properties.size())};
+                append(&compiledObject, sizeof(compiledObject));
+
+                for (auto &property : object.properties)
+                {
+                    compiledProperties.push_back({intern(m_propertyKeys[property.key]), intern(property.value)});
+                }
+            }
+            compiledLayer.propertyCount = static_cast<uint32_t>(compiledProperties.size());
+            compiledLayer.propertiesOffset = align();
+            append(compiledProperties.data(), sizeof(sCompiledProperty) * compiledProperties.size());
+        }
+        header.layerCount = static_cast<uint32_t>(m_layerCount);
+        header.layersOffset = align();
+        append(compiledLayers.data(), sizeof(sCompiledLayer) * compiledLayers.size());
+
+        // Strings
+        header.stringCount = static_cast<uint32_t>(strings.size());
+        header.stringsOffset = align();
+        auto offset = static_cast<uint32_t>(sizeof(sCompiledString) * strings.size());
+        for (auto &string : strings)
+        {
+            sCompiledString compiledString = {offset, static_cast<uint32_t>(string.size())};
+            append(&compiledString, sizeof(compiledString));
+            offset += compiledString.length + 1;
+        }
+        for (auto &string : strings)
+        {
+            append(string.c_str(), string.size() + 1);
+        }
+
+        if (isStreamed)
+        {
+            sStreamedHeader streamedHeader;
+            streamedHeader.regionsOffset = align();
+            std::vector<uint32_t> region(REGION_SIZE * REGION_SIZE);
+            for (int i = 0; i < m_layerCount; ++i)
+            {
+                auto pTileLayer = dynamic_cast<sTileLayer*>(m_layers[i]);
+                if (!pTileLayer) continue;
+                compiledLayers[i].dataOffset = static_cast<uint64_t>(data.size());
+                for (int regionY = 0; regionY < pTileLayer->height; regionY += REGION_SIZE)
+                {
+                    for (int regionX = 0; regionX < pTileLayer->width; regionX += REGION_SIZE)
+                    {
+                        std::fill(region.begin(), region.end(), 0);
+                        auto toX = std::min<>(regionX + REGION_SIZE, pTileLayer->width);
+                        auto toY = std::min<>(regionY + REGION_SIZE, pTileLayer->height);
+                        for (int y = regionY; y < toY; ++y)
+                        {
+                            memcpy(region.data() + (y - regionY) * REGION_SIZE, pTileLayer->tileIds + y * pTileLayer->width + regionX, sizeof(uint32_t) * (toX - regionX));
+                        }
+                        append(region.data(), REGION_BYTES);
+                    }
+                }
+            }
+            memcpy(data.data() + header.layersOffset, compiledLayers.data(), sizeof(sCompiledLayer) * compiledLayers.size());
+            streamedHeader.header = header;
+            memcpy(data.data(), &streamedHeader, sizeof(streamedHeader));
+        }
+        else
+        {
+            memcpy(data.data(), &header, sizeof(header));
+        }
+
+        // Written aside and moved over, so a reader never sees a half written or missing map
+        auto tmpFilename = filename + ".tmp";
+        {
+            std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+            if (file.fail()) return false;
+            file.write(reinterpret_cast<const char*>(data.data()), data.size());
+            if (file.fail()) return false;
+        }
+        if (!replaceFile(tmpFilename, filename))
+        {
+            // Windows doesn't replace a mapped file, which this map's own is
+            if (m_pFile) releaseFile();
+            if (!replaceFile(tmpFilename, filename))
+            {
+                std::remove(tmpFilename.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void TiledMap::releaseFile() const
+    {
+        // Tiles were used in place, they get their own copy
+        for (int i = 0; i < m_layerCount; ++i)
+        {
+            auto pLayer = dynamic_cast<sTileLayerInternal*>(m_layers[i]);
+            if (!pLayer || !pLayer->isMapped) continue;
+            auto pTileIds = new uint32_t[pLayer->width * pLayer->height];
+            memcpy(pTileIds, pLayer->tileIds, sizeof(uint32_t) * pLayer->width * pLayer->height);
+            pLayer->tileIds = pTileIds;
+            pLayer->isMapped = false;
+        }
+        m_pFile.reset();
     }
 
     TiledMap::~TiledMap()
     {
+        if (m_pStreaming) finishStreaming();
         if (m_layers)
         {
             for (auto i = 0; i < m_layerCount; ++i)
@@ -284,6 +827,7 @@ namespace onut
             delete[] m_layers;
         }
         if (m_tileSets) delete[] m_tileSets;
+        if (pMinimap) delete pMinimap;
     }
 
     TiledMap::sLayer *TiledMap::getLayer(const std::string &name) const
@@ -313,62 +857,854 @@ namespace onut
         renderLayer(rect, getLayer(name));
     }
 
-    void TiledMap::renderLayer(const RECT &in_rect, sLayer *in_pLayer)
+    void TiledMap::renderLayer(const RECT &rect, sLayer *in_pLayer)
     {
-#if defined(EASY_GRAPHIX)
         if (!in_pLayer->isVisible) return;
 
         auto pLayer = dynamic_cast<sTileLayerInternal*>(in_pLayer);
         if (!pLayer) return;
 
-        RECT rect = in_rect;
-        rect.left = std::max<>(0l, rect.left);
-        rect.top = std::max<>(0l, rect.top);
-        rect.right = std::min<>(static_cast<LONG>(m_width - 1), rect.right);
-        rect.bottom = std::min<>(static_cast<LONG>(m_height - 1), rect.bottom);
+        auto left = std::max<LONG>(0, rect.left);
+        auto top = std::max<LONG>(0, rect.top);
+        auto right = std::min<LONG>(pLayer->width - 1, rect.right);
+        auto bottom = std::min<LONG>(pLayer->height - 1, rect.bottom);
+        if (right < left || bottom < top) return;
 
+        auto pSpriteBatch = m_pSpriteBatch ? m_pSpriteBatch : OSB;
+
+#if defined(EASY_GRAPHIX)
         egModelPush();
         egModelIdentity();
         egModelMult(&m_transform._11);
+#endif
 
-        OSB->begin();
+        pSpriteBatch->begin();
+#if defined(EASY_GRAPHIX)
         egFilter(EG_FILTER_NEAREST);
-        for (LONG y = rect.top; y <= rect.bottom; ++y)
+#endif
+        auto fromChunkX = left / CHUNK_SIZE;
+        auto fromChunkY = top / CHUNK_SIZE;
+        auto toChunkX = right / CHUNK_SIZE;
+        auto toChunkY = bottom / CHUNK_SIZE;
+
+        // Zoomed out, copying the vertices of every chunk costs more than reading the gids again
+        auto isZoomedOut = (toChunkX - fromChunkX + 1) * (toChunkY - fromChunkY + 1) > MAX_CACHED_CHUNK_VIEW;
+        if (!isZoomedOut && pLayer->chunks.empty())
+        {
+            // Built the first time they are drawn, only the parts seen use memory
+            pLayer->chunkCountX = (pLayer->width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            pLayer->chunkCountY = (pLayer->height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            pLayer->chunks.reserve(pLayer->chunkCountX * pLayer->chunkCountY);
+            for (int i = 0; i < pLayer->chunkCountX * pLayer->chunkCountY; ++i)
+            {
+                pLayer->chunks.emplace_back(m_pBackend);
+            }
+        }
+
+        for (LONG chunkY = fromChunkY; chunkY <= toChunkY; ++chunkY)
         {
-            sTile *pTile = pLayer->tiles + y * m_width + rect.left;
-            for (LONG x = rect.left; x <= rect.right; ++x, ++pTile)
+            for (LONG chunkX = fromChunkX; chunkX <= toChunkX; ++chunkX)
             {
-                if (!pTile->pTileset) continue;
-                OSB->drawRectWithUVs(pTile->pTileset->pTexture, pTile->rect, pTile->UVs);
+                if (isZoomedOut)
+                {
+                    // Skips the regions not loaded
+                    drawChunkTiles(pSpriteBatch, pLayer, chunkX, chunkY);
+                    continue;
+                }
+                auto &chunk = pLayer->chunks[chunkY * pLayer->chunkCountX + chunkX];
+                if (m_pStreaming && !getTileRow(pLayer, chunkX * CHUNK_SIZE, chunkY * CHUNK_SIZE)) continue; // Region not loaded
+                if (chunk.isDirty)
+                {
+                    buildChunk(pLayer, chunkX, chunkY);
+                }
+                // Consecutive chunks using the same tileset merge in the same batch
+                pSpriteBatch->draw(chunk.sprites);
             }
         }
-        OSB->end();
+        pSpriteBatch->end();
 
+#if defined(EASY_GRAPHIX)
         egModelPop();
-#else
-        if (!in_pLayer->isVisible) return;
+#endif
+    }
 
+    void TiledMap::setTileId(sTileLayer *in_pLayer, int x, int y, uint32_t tileId)
+    {
         auto pLayer = dynamic_cast<sTileLayerInternal*>(in_pLayer);
-        if (!pLayer) return;
+        assert(pLayer);
+        assert(x >= 0 && y >= 0 && x < pLayer->width && y < pLayer->height);
+
+        assert((tileId & ~FLIP_FLAGS) < m_tiles.size()); // Unknown gid
+
+        auto pTileId = getTileRow(pLayer, x, y);
+        assert(pTileId); // Region not loaded
+        *pTileId = tileId;
+        if (!pLayer->chunks.empty())
+        {
+            pLayer->chunks[(y / CHUNK_SIZE) * pLayer->chunkCountX + x / CHUNK_SIZE].isDirty = true;
+        }
+    }
 
-        RECT rect = in_rect;
-        rect.left = std::max<>(0l, rect.left);
-        rect.top = std::max<>(0l, rect.top);
-        rect.right = std::min<>(static_cast<LONG>(m_width - 1), rect.right);
-        rect.bottom = std::min<>(static_cast<LONG>(m_height - 1), rect.bottom);
+    uint32_t TiledMap::getTileId(sTileLayer *in_pLayer, int x, int y) const
+    {
+        auto pLayer = dynamic_cast<sTileLayerInternal*>(in_pLayer);
+        assert(pLayer);
+        assert(x >= 0 && y >= 0 && x < pLayer->width && y < pLayer->height);
+        auto pTileId = getTileRow(pLayer, x, y);
+        return pTileId ? *pTileId : 0;
+    }
+
+    uint32_t *TiledMap::getTileRow(sTileLayerInternal *pLayer, int x, int y) const
+    {
+        if (!m_pStreaming) return pLayer->tileIds + y * pLayer->width + x;
+        auto pRegion = pLayer->regions[(y / REGION_SIZE) * pLayer->regionCountX + x / REGION_SIZE];
+        if (!pRegion) return nullptr;
+        return pRegion + (y % REGION_SIZE) * REGION_SIZE + x % REGION_SIZE;
+    }
+
+    void TiledMap::setStreamingFocus(const Vector2 &focus, int radius)
+    {
+        assert(m_pStreaming);
+        assert(radius >= 0);
+        m_pStreaming->hasFocus = true;
+        m_pStreaming->focus = focus;
+        m_pStreaming->radius = radius;
+    }
+
+    void TiledMap::setStreamingMemoryCap(size_t bytes)
+    {
+        assert(m_pStreaming);
+        m_pStreaming->memoryCap = bytes;
+    }
+
+    void TiledMap::updateStreaming()
+    {
+        if (!m_pStreaming) return;
+        auto &streaming = *m_pStreaming;
+        streaming.loadedRegions.processQueue();
+        streaming.loads.erase(std::remove_if(streaming.loads.begin(), streaming.loads.end(), [](std::future<void> &load)
+        {
+            return load.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }), streaming.loads.end());
+        if (!streaming.hasFocus || !streaming.regionBytes) return;
 
-        OSB->begin();
-        for (LONG y = rect.top; y <= rect.bottom; ++y)
+        // Regions around the focus one, nearest first, as many as the memory cap allows
+        for (auto index : streaming.wantedRegions) streaming.regions[index].isWanted = false;
+        streaming.wantedRegions.clear();
+        auto focusX = static_cast<int>(std::floor(streaming.focus.x / static_cast<float>(REGION_SIZE)));
+        auto focusY = static_cast<int>(std::floor(streaming.focus.y / static_cast<float>(REGION_SIZE)));
+        auto fromX = std::max<>(0, focusX - streaming.radius);
+        auto fromY = std::max<>(0, focusY - streaming.radius);
+        auto toX = std::min<>(streaming.regionCountX - 1, focusX + streaming.radius);
+        auto toY = std::min<>(streaming.regionCountY - 1, focusY + streaming.radius);
+        for (auto regionY = fromY; regionY <= toY; ++regionY)
         {
-            sTile *pTile = pLayer->tiles + y * m_width + rect.left;
-            for (LONG x = rect.left; x <= rect.right; ++x, ++pTile)
+            for (auto regionX = fromX; regionX <= toX; ++regionX)
             {
-                if (!pTile->pTileset) continue;
-                OSB->drawRectWithUVs(pTile->pTileset->pTexture, pTile->rect, pTile->UVs);
+                streaming.wantedRegions.push_back(regionY * streaming.regionCountX + regionX);
             }
         }
-        OSB->end();
+        auto distance = [&streaming](int index)
+        {
+            auto center = Vector2(static_cast<float>(index % streaming.regionCountX) + .5f, static_cast<float>(index / streaming.regionCountX) + .5f);
+            return Vector2::DistanceSquared(center * static_cast<float>(REGION_SIZE), streaming.focus);
+        };
+        std::stable_sort(streaming.wantedRegions.begin(), streaming.wantedRegions.end(), [&distance](int a, int b)
+        {
+            return distance(a) < distance(b);
+        });
+        auto maxRegions = streaming.memoryCap / streaming.regionBytes;
+        if (streaming.wantedRegions.size() > maxRegions) streaming.wantedRegions.resize(maxRegions);
+        for (auto index : streaming.wantedRegions) streaming.regions[index].isWanted = true;
+
+        // Unload the others. Loads no longer wanted are dropped when they arrive, they count until then
+        for (size_t i = 0; i < streaming.activeRegions.size();)
+        {
+            auto index = streaming.activeRegions[i];
+            auto &region = streaming.regions[index];
+            if (region.isResident && !region.isWanted)
+            {
+                unloadRegion(index);
+                streaming.activeRegions[i] = streaming.activeRegions.back();
+                streaming.activeRegions.pop_back();
+                continue;
+            }
+            ++i;
+        }
+
+        for (auto index : streaming.wantedRegions)
+        {
+            if (streaming.activeRegions.size() >= maxRegions) break;
+            auto &region = streaming.regions[index];
+            if (region.isResident || region.isLoading) continue;
+            loadRegion(index);
+        }
+    }
+
+    void TiledMap::finishStreaming()
+    {
+        if (!m_pStreaming) return;
+        for (auto &load : m_pStreaming->loads)
+        {
+            load.wait();
+        }
+        m_pStreaming->loads.clear();
+        m_pStreaming->loadedRegions.processQueue();
+    }
+
+    bool TiledMap::isRegionResident(int regionX, int regionY) const
+    {
+        if (!m_pStreaming) return true;
+        if (regionX < 0 || regionY < 0 || regionX >= m_pStreaming->regionCountX || regionY >= m_pStreaming->regionCountY) return false;
+        return m_pStreaming->regions[regionY * m_pStreaming->regionCountX + regionX].isResident;
+    }
+
+    size_t TiledMap::getResidentMemory() const
+    {
+        if (!m_pStreaming) return 0;
+        size_t residentCount = 0;
+        for (auto index : m_pStreaming->activeRegions)
+        {
+            if (m_pStreaming->regions[index].isResident) ++residentCount;
+        }
+        return residentCount * m_pStreaming->regionBytes;
+    }
+
+    void TiledMap::loadRegion(int index)
+    {
+        auto &streaming = *m_pStreaming;
+        streaming.regions[index].isLoading = true;
+        streaming.activeRegions.push_back(index);
+        auto regionX = index % streaming.regionCountX;
+        auto regionY = index / streaming.regionCountX;
+        streaming.loads.push_back(OAsync([this, index, regionX, regionY]
+        {
+            // Layers don't change after loading, only their regions, which this doesn't touch
+            auto &streaming = *m_pStreaming;
+            auto pTiles = new uint32_t*[m_layerCount]; // Deleted by installRegion()
+            std::lock_guard<std::mutex> lock(streaming.fileMutex);
+            for (int i = 0; i < m_layerCount; ++i)
+            {
+                auto pLayer = dynamic_cast<sTileLayerInternal*>(m_layers[i]);
+                pTiles[i] = nullptr;
+                if (!pLayer || regionX >= pLayer->regionCountX || regionY >= pLayer->regionCountY) continue;
+                pTiles[i] = new uint32_t[REGION_SIZE * REGION_SIZE];
+                streaming.file.seekg(pLayer->regionsOffset + REGION_BYTES * (regionY * pLayer->regionCountX + regionX));
+                streaming.file.read(reinterpret_cast<char*>(pTiles[i]), REGION_BYTES);
+                assert(!streaming.file.fail());
+            }
+            streaming.loadedRegions.sync([this, index, pTiles]
+            {
+                installRegion(index, pTiles);
+            });
+        }));
+    }
+
+    void TiledMap::installRegion(int index, uint32_t **pTiles)
+    {
+        auto &streaming = *m_pStreaming;
+        auto &region = streaming.regions[index];
+        region.isLoading = false;
+        if (!region.isWanted)
+        {
+            // Out of focus while it was loading
+            for (int i = 0; i < m_layerCount; ++i)
+            {
+                if (pTiles[i]) delete[] pTiles[i];
+            }
+            delete[] pTiles;
+            streaming.activeRegions.erase(std::find(streaming.activeRegions.begin(), streaming.activeRegions.end(), index));
+            return;
+        }
+
+        region.isResident = true;
+        auto regionX = index % streaming.regionCountX;
+        auto regionY = index / streaming.regionCountX;
+        for (int i = 0; i < m_layerCount; ++i)
+        {
+            if (!pTiles[i]) continue;
+            auto pLayer = static_cast<sTileLayerInternal*>(m_layers[i]);
+            pLayer->regions[regionY * pLayer->regionCountX + regionX] = pTiles[i];
+        }
+        delete[] pTiles;
+    }
+
+    void TiledMap::unloadRegion(int index)
+    {
+        auto &streaming = *m_pStreaming;
+        streaming.regions[index].isResident = false;
+        auto regionX = index % streaming.regionCountX;
+        auto regionY = index / streaming.regionCountX;
+        for (int i = 0; i < m_layerCount; ++i)
+        {
+            auto pLayer = dynamic_cast<sTileLayerInternal*>(m_layers[i]);
+            if (!pLayer || regionX >= pLayer->regionCountX || regionY >= pLayer->regionCountY) continue;
+            auto &pRegion = pLayer->regions[regionY * pLayer->regionCountX + regionX];
+            delete[] pRegion;
+            pRegion = nullptr;
+
+            // Its chunks give their memory back, and are built again if the region comes back
+            if (pLayer->chunks.empty()) continue;
+            auto fromChunkX = regionX * REGION_SIZE / CHUNK_SIZE;
+            auto fromChunkY = regionY * REGION_SIZE / CHUNK_SIZE;
+            auto toChunkX = std::min<>(fromChunkX + REGION_SIZE / CHUNK_SIZE, pLayer->chunkCountX);
+            auto toChunkY = std::min<>(fromChunkY + REGION_SIZE / CHUNK_SIZE, pLayer->chunkCountY);
+            for (auto chunkY = fromChunkY; chunkY < toChunkY; ++chunkY)
+            {
+                for (auto chunkX = fromChunkX; chunkX < toChunkX; ++chunkX)
+                {
+                    auto &chunk = pLayer->chunks[chunkY * pLayer->chunkCountX + chunkX];
+                    chunk.sprites = SpriteCommandList(m_pBackend);
+                    chunk.isDirty = true;
+                }
+            }
+        }
+    }
+
+    const std::string *TiledMap::sObject::getProperty(uint32_t key) const
+    {
+        auto it = std::lower_bound(properties.begin(), properties.end(), key, [](const sProperty &property, uint32_t key)
+        {
+            return property.key < key;
+        });
+        if (it == properties.end() || it->key != key) return nullptr;
+        return &it->value;
+    }
+
+    uint32_t TiledMap::getPropertyKey(const std::string &name) const
+    {
+        auto it = m_propertyKeyIds.find(name);
+        if (it == m_propertyKeyIds.end()) return NO_PROPERTY;
+        return it->second;
+    }
+
+    uint32_t TiledMap::internPropertyKey(const std::string &name)
+    {
+        auto it = m_propertyKeyIds.find(name);
+        if (it != m_propertyKeyIds.end()) return it->second;
+        auto key = static_cast<uint32_t>(m_propertyKeys.size());
+        m_propertyKeyIds[name] = key;
+        m_propertyKeys.push_back(name);
+        return key;
+    }
+
+    void TiledMap::setProperty(sObject &object, const std::string &name, const std::string &value)
+    {
+        auto key = internPropertyKey(name);
+        auto it = std::lower_bound(object.properties.begin(), object.properties.end(), key, [](const sProperty &property, uint32_t key)
+        {
+            return property.key < key;
+        });
+        if (it != object.properties.end() && it->key == key)
+        {
+            it->value = value;
+            return;
+        }
+        object.properties.insert(it, {key, value});
+    }
+
+    void TiledMap::updateObjectIndex(sObjectLayer *in_pLayer)
+    {
+        auto pLayer = dynamic_cast<sObjectLayerInternal*>(in_pLayer);
+        assert(pLayer);
+        auto objectCount = pLayer->objectCount;
+        pLayer->bounds.resize(objectCount);
+        pLayer->cellStarts.clear();
+        pLayer->cellObjects.clear();
+        pLayer->cellCountX = 0;
+        pLayer->cellCountY = 0;
+        if (!objectCount) return;
+
+        Vector4 extent(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            auto &object = pLayer->pObjects[i];
+            auto &bounds = pLayer->bounds[i];
+            bounds = Vector4(object.position.x, object.position.y, object.position.x + object.size.x, object.position.y + object.size.y);
+            extent.x = std::min<>(extent.x, bounds.x);
+            extent.y = std::min<>(extent.y, bounds.y);
+            extent.z = std::max<>(extent.z, bounds.z);
+            extent.w = std::max<>(extent.w, bounds.w);
+        }
+
+        // About 2 objects per cell
+        auto cellsPerSide = static_cast<int>(std::sqrt(static_cast<float>(objectCount) / 2.f));
+        cellsPerSide = std::max<>(1, std::min<>(1024, cellsPerSide));
+        pLayer->cellCountX = cellsPerSide;
+        pLayer->cellCountY = cellsPerSide;
+        pLayer->gridOrigin = Vector2(extent.x, extent.y);
+        pLayer->cellsPerPixel = Vector2(static_cast<float>(cellsPerSide) / std::max<>(1.f, extent.z - extent.x),
+                                        static_cast<float>(cellsPerSide) / std::max<>(1.f, extent.w - extent.y));
+
+        // Counted, then filled
+        auto cellCount = pLayer->cellCountX * pLayer->cellCountY;
+        pLayer->cellStarts.assign(cellCount + 1, 0);
+        for (auto &bounds : pLayer->bounds)
+        {
+            for (auto y = pLayer->getCellY(bounds.y); y <= pLayer->getCellY(bounds.w); ++y)
+            {
+                for (auto x = pLayer->getCellX(bounds.x); x <= pLayer->getCellX(bounds.z); ++x)
+                {
+                    ++pLayer->cellStarts[y * pLayer->cellCountX + x + 1];
+                }
+            }
+        }
+        for (int i = 0; i < cellCount; ++i)
+        {
+            pLayer->cellStarts[i + 1] += pLayer->cellStarts[i];
+        }
+        pLayer->cellObjects.resize(pLayer->cellStarts[cellCount]);
+        std::vector<uint32_t> cellEnds(pLayer->cellStarts.begin(), pLayer->cellStarts.end() - 1);
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            auto &bounds = pLayer->bounds[i];
+            for (auto y = pLayer->getCellY(bounds.y); y <= pLayer->getCellY(bounds.w); ++y)
+            {
+                for (auto x = pLayer->getCellX(bounds.x); x <= pLayer->getCellX(bounds.z); ++x)
+                {
+                    pLayer->cellObjects[cellEnds[y * pLayer->cellCountX + x]++] = i;
+                }
+            }
+        }
+    }
+
+    int TiledMap::sObjectLayerInternal::getCellX(float x) const
+    {
+        return std::max<>(0, std::min<>(cellCountX - 1, static_cast<int>(std::floor((x - gridOrigin.x) * cellsPerPixel.x))));
+    }
+
+    int TiledMap::sObjectLayerInternal::getCellY(float y) const
+    {
+        return std::max<>(0, std::min<>(cellCountY - 1, static_cast<int>(std::floor((y - gridOrigin.y) * cellsPerPixel.y))));
+    }
+
+    void TiledMap::getObjectsInRect(sObjectLayer *pLayer, const Rect &rect, std::vector<sObject*> &result) const
+    {
+        queryObjects(pLayer, Vector4(rect.x, rect.y, rect.x + rect.z, rect.y + rect.w), nullptr, 0.f, result);
+    }
+
+    void TiledMap::getObjectsAt(sObjectLayer *pLayer, const Vector2 &point, std::vector<sObject*> &result) const
+    {
+        queryObjects(pLayer, Vector4(point.x, point.y, point.x, point.y), nullptr, 0.f, result);
+    }
+
+    void TiledMap::getObjectsInRadius(sObjectLayer *pLayer, const Vector2 &center, float radius, std::vector<sObject*> &result) const
+    {
+        queryObjects(pLayer, Vector4(center.x - radius, center.y - radius, center.x + radius, center.y + radius), &center, radius, result);
+    }
+
+    void TiledMap::queryObjects(sObjectLayer *in_pLayer, const Vector4 &box, const Vector2 *pCenter, float radius, std::vector<sObject*> &result) const
+    {
+        auto pLayer = dynamic_cast<sObjectLayerInternal*>(in_pLayer);
+        assert(pLayer);
+        if (!pLayer->cellCountX) return;
+
+        // Boxes past the grid are clamped to its edge cells, which is where the objects stop
+        auto fromX = pLayer->getCellX(box.x);
+        auto fromY = pLayer->getCellY(box.y);
+        auto toX = pLayer->getCellX(box.z);
+        auto toY = pLayer->getCellY(box.w);
+        for (auto y = fromY; y <= toY; ++y)
+        {
+            for (auto x = fromX; x <= toX; ++x)
+            {
+                auto cell = y * pLayer->cellCountX + x;
+                for (auto i = pLayer->cellStarts[cell]; i < pLayer->cellStarts[cell + 1]; ++i)
+                {
+                    auto index = pLayer->cellObjects[i];
+                    auto &bounds = pLayer->bounds[index];
+                    if (bounds.x > box.z || bounds.z < box.x || bounds.y > box.w || bounds.w < box.y) continue;
+
+                    // Objects over many cells are only taken from the first one they share with the box
+                    if (x != std::max<>(fromX, pLayer->getCellX(bounds.x)) || y != std::max<>(fromY, pLayer->getCellY(bounds.y))) continue;
+
+                    if (pCenter)
+                    {
+                        auto closest = Vector2(std::max<>(bounds.x, std::min<>(pCenter->x, bounds.z)), std::max<>(bounds.y, std::min<>(pCenter->y, bounds.w)));
+                        if (Vector2::DistanceSquared(closest, *pCenter) > radius * radius) continue;
+                    }
+                    result.push_back(pLayer->pObjects + index);
+                }
+            }
+        }
+    }
+
+    void TiledMap::loadTexture(sTileSet &tileSet, const std::string &map, onut::ContentManager<> *pContentManager)
+    {
+        tileSet.pTexture = nullptr;
+        if (pContentManager)
+        {
+            tileSet.pTexture = pContentManager->getResource<Texture>(getPath(map) + "/" + tileSet.image);
+        }
+        if ((!tileSet.imageWidth || !tileSet.imageHeight) && tileSet.pTexture)
+        {
+            tileSet.imageWidth = static_cast<int>(tileSet.pTexture->getSize().x);
+            tileSet.imageHeight = static_cast<int>(tileSet.pTexture->getSize().y);
+        }
+        assert(tileSet.imageWidth && tileSet.imageHeight); // Needs the image size, or its texture
+    }
+
+    void TiledMap::resolveTiles()
+    {
+        // Tilesets are sorted by first gid, each one goes up to the next
+        uint32_t tileCount = 1;
+        for (int i = 0; i < m_tilesetCount; ++i)
+        {
+            auto &tileSet = m_tileSets[i];
+            auto fitW = tileSet.imageWidth / tileSet.tileWidth;
+            auto fitH = tileSet.imageHeight / tileSet.tileHeight;
+            tileCount = std::max<>(tileCount, static_cast<uint32_t>(tileSet.firstId + fitW * fitH));
+        }
+
+        // gid 0 stays empty
+        m_tiles.resize(tileCount);
+        for (int i = 0; i < m_tilesetCount; ++i)
+        {
+            auto pTileSet = m_tileSets + i;
+            auto fitW = static_cast<uint32_t>(pTileSet->imageWidth / pTileSet->tileWidth);
+            auto fitH = static_cast<uint32_t>(pTileSet->imageHeight / pTileSet->tileHeight);
+            auto imageWidth = static_cast<float>(pTileSet->imageWidth);
+            auto imageHeight = static_cast<float>(pTileSet->imageHeight);
+            auto lastId = (i + 1 < m_tilesetCount) ? static_cast<uint32_t>(m_tileSets[i + 1].firstId) : tileCount;
+            for (auto tileId = static_cast<uint32_t>(pTileSet->firstId); tileId < lastId; ++tileId)
+            {
+                auto onTextureId = tileId - pTileSet->firstId;
+                if (onTextureId >= fitW * fitH) break;
+                auto &tile = m_tiles[tileId];
+                tile.pTileset = pTileSet;
+                tile.UVs.x = static_cast<float>((onTextureId % fitW) * pTileSet->tileWidth) / imageWidth;
+                tile.UVs.y = static_cast<float>((onTextureId / fitW) * pTileSet->tileHeight) / imageHeight;
+                tile.UVs.z = static_cast<float>((onTextureId % fitW + 1) * pTileSet->tileWidth) / imageWidth;
+                tile.UVs.w = static_cast<float>((onTextureId / fitW + 1) * pTileSet->tileHeight) / imageHeight;
+            }
+        }
+    }
+
+    // Corners turn from the top left, down first, like drawRectWithUVs. Flips swap the uvs they read
+    static inline void setTileTexCoords(sRenderVertex *pVerts, const Vector4 &uvs, uint32_t tileId)
+    {
+        if (!(tileId & TiledMap::FLIP_FLAGS))
+        {
+            pVerts[0].texCoord = {uvs.x, uvs.y};
+            pVerts[1].texCoord = {uvs.x, uvs.w};
+            pVerts[2].texCoord = {uvs.z, uvs.w};
+            pVerts[3].texCoord = {uvs.z, uvs.y};
+            return;
+        }
+        static const int corners[4][2] = {{0, 0}, {0, 1}, {1, 1}, {1, 0}};
+        for (int i = 0; i < 4; ++i)
+        {
+            // Undone in reverse order: vertical, horizontal, then diagonal
+            auto u = corners[i][0];
+            auto v = corners[i][1];
+            if (tileId & TiledMap::FLIPPED_VERTICALLY) v = 1 - v;
+            if (tileId & TiledMap::FLIPPED_HORIZONTALLY) u = 1 - u;
+            if (tileId & TiledMap::FLIPPED_DIAGONALLY) std::swap(u, v);
+            pVerts[i].texCoord = {u ? uvs.z : uvs.x, v ? uvs.w : uvs.y};
+        }
+    }
+
+    void TiledMap::buildChunk(sTileLayerInternal *pLayer, int chunkX, int chunkY)
+    {
+        auto &chunk = pLayer->chunks[chunkY * pLayer->chunkCountX + chunkX];
+        chunk.isDirty = false;
+        addChunkTiles(pLayer, chunkX, chunkY, chunk.sprites);
+    }
+
+    void TiledMap::addChunkTiles(sTileLayerInternal *pLayer, int chunkX, int chunkY, SpriteCommandList &sprites)
+    {
+        sprites.clear();
+        auto fromX = chunkX * CHUNK_SIZE;
+        auto fromY = chunkY * CHUNK_SIZE;
+        auto toX = std::min<>(fromX + CHUNK_SIZE, pLayer->width);
+        auto toY = std::min<>(fromY + CHUNK_SIZE, pLayer->height);
+        m_chunkVertices.resize(CHUNK_SIZE * CHUNK_SIZE * 4);
+
+        // One run per tileset. Tiles of a layer don't overlap, so the order doesn't matter
+        for (int i = 0; i < m_tilesetCount; ++i)
+        {
+            auto pTileSet = m_tileSets + i;
+            auto tileWidth = static_cast<float>(pTileSet->tileWidth);
+            auto tileHeight = static_cast<float>(pTileSet->tileHeight);
+            auto pVerts = m_chunkVertices.data();
+            for (auto y = fromY; y < toY; ++y)
+            {
+                auto pTileId = getTileRow(pLayer, fromX, y);
+                for (auto x = fromX; x < toX; ++x, ++pTileId)
+                {
+                    auto gid = *pTileId & ~FLIP_FLAGS;
+                    if (gid >= m_tiles.size()) continue; // Unknown gid
+                    auto &tile = m_tiles[gid];
+                    if (tile.pTileset != pTileSet) continue;
+                    Rect rect(static_cast<float>(x) * tileWidth, static_cast<float>(y) * tileHeight, tileWidth, tileHeight);
+
+                    pVerts[0].position = {rect.x, rect.y};
+                    pVerts[1].position = {rect.x, rect.y + rect.w};
+                    pVerts[2].position = {rect.x + rect.z, rect.y + rect.w};
+                    pVerts[3].position = {rect.x + rect.z, rect.y};
+                    setTileTexCoords(pVerts, tile.UVs, *pTileId);
+                    for (int k = 0; k < 4; ++k) pVerts[k].color = Color::White;
+                    pVerts += 4;
+                }
+            }
+            auto spriteCount = static_cast<uint32_t>(pVerts - m_chunkVertices.data()) / 4;
+            sprites.addSprites(pTileSet->pTexture, m_chunkVertices.data(), spriteCount);
+        }
+    }
+
+    void TiledMap::drawChunkTiles(SpriteBatch *pSpriteBatch, sTileLayerInternal *pLayer, int chunkX, int chunkY)
+    {
+        if (!getTileRow(pLayer, chunkX * CHUNK_SIZE, chunkY * CHUNK_SIZE)) return; // Region not loaded
+
+        // Same vertices as buildChunk(), not kept
+        if (!m_pZoomedOutSprites) m_pZoomedOutSprites.reset(new SpriteCommandList(m_pBackend));
+        addChunkTiles(pLayer, chunkX, chunkY, *m_pZoomedOutSprites);
+        pSpriteBatch->draw(*m_pZoomedOutSprites);
+    }
+
+    //--- Minimap
+    //
+    // A row of tiles blended over the minimap, premultiplied: dst = src + (dst * (255 - srcA) + 127) / 255.
+    // Colors are looked up by gid, flips left out, 0 for the ones out of the table. Every path is bit-exact with the scalar one.
+
+    static void splatTilesScalar(const uint32_t *pGids, uint32_t count, const uint32_t *pColors, uint32_t colorCount, uint8_t *pDst)
+    {
+        for (uint32_t i = 0; i < count; ++i, pDst += 4)
+        {
+            auto gid = pGids[i] & ~TiledMap::FLIP_FLAGS;
+            auto color = (gid < colorCount) ? pColors[gid] : 0;
+            auto invAlpha = 255 - (color >> 24);
+            for (int c = 0; c < 4; ++c)
+            {
+                pDst[c] = static_cast<uint8_t>(((color >> (c * 8)) & 0xFF) + (pDst[c] * invAlpha + 127) / 255);
+            }
+        }
+    }
+
+#if defined(ONUT_SIMD_X86)
+    static inline __m128i splat8x16(__m128i src, __m128i dst)
+    {
+        auto invAlphas = _mm_sub_epi16(_mm_set1_epi16(255), _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)));
+        auto v = _mm_add_epi16(_mm_mullo_epi16(dst, invAlphas), _mm_set1_epi16(127));
+        v = _mm_add_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), _mm_set1_epi16(1));
+        return _mm_add_epi16(src, _mm_srli_epi16(v, 8));
+    }
+
+    static void splatTilesSSE2(const uint32_t *pGids, uint32_t count, const uint32_t *pColors, uint32_t colorCount, uint8_t *pDst)
+    {
+        const auto zero = _mm_setzero_si128();
+        uint32_t i = 0;
+        for (; i + 4 <= count; i += 4, pDst += 16)
+        {
+            // No gather before AVX2
+            uint32_t colors[4];
+            for (int k = 0; k < 4; ++k)
+            {
+                auto gid = pGids[i + k] & ~TiledMap::FLIP_FLAGS;
+                colors[k] = (gid < colorCount) ? pColors[gid] : 0;
+            }
+            auto src = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colors));
+            auto dst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDst));
+            auto lo = splat8x16(_mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(dst, zero));
+            auto hi = splat8x16(_mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(dst, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), _mm_packus_epi16(lo, hi));
+        }
+        splatTilesScalar(pGids + i, count - i, pColors, colorCount, pDst);
+    }
+
+    ONUT_TARGET_AVX2 static void splatTilesAVX2(const uint32_t *pGids, uint32_t count, const uint32_t *pColors, uint32_t colorCount, uint8_t *pDst)
+    {
+        // Same as SSE2, every operation used stays within 128 bits lanes. Unknown gids read the color of gid 0
+        const auto zero = _mm256_setzero_si256();
+        const auto lastGid = _mm256_set1_epi32(static_cast<int>(colorCount - 1));
+        const auto gidMask = _mm256_set1_epi32(static_cast<int>(~TiledMap::FLIP_FLAGS));
+        const auto opaque = _mm256_set1_epi16(255);
+        const auto bias = _mm256_set1_epi16(127);
+        const auto one = _mm256_set1_epi16(1);
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8, pDst += 32)
+        {
+            auto gids = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pGids + i)), gidMask);
+            auto isKnown = _mm256_cmpeq_epi32(_mm256_min_epu32(gids, lastGid), gids);
+            auto src = _mm256_i32gather_epi32(reinterpret_cast<const int*>(pColors), _mm256_and_si256(gids, isKnown), 4);
+            src = _mm256_and_si256(src, isKnown);
+            auto dst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pDst));
+            __m256i srcs[2] = {_mm256_unpacklo_epi8(src, zero), _mm256_unpackhi_epi8(src, zero)};
+            __m256i dsts[2] = {_mm256_unpacklo_epi8(dst, zero), _mm256_unpackhi_epi8(dst, zero)};
+            for (int k = 0; k < 2; ++k)
+            {
+                auto invAlphas = _mm256_sub_epi16(opaque, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(srcs[k], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)));
+                auto v = _mm256_add_epi16(_mm256_mullo_epi16(dsts[k], invAlphas), bias);
+                v = _mm256_add_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), one);
+                dsts[k] = _mm256_add_epi16(srcs[k], _mm256_srli_epi16(v, 8));
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst), _mm256_packus_epi16(dsts[0], dsts[1]));
+        }
+        splatTilesSSE2(pGids + i, count - i, pColors, colorCount, pDst);
+    }
 #endif
+
+#if defined(ONUT_SIMD_NEON)
+    static inline uint8x8_t splatChannelNEON(uint8x8_t src, uint8x8_t dst, uint8x8_t invAlpha)
+    {
+        auto v = vaddq_u16(vmull_u8(dst, invAlpha), vdupq_n_u16(127));
+        v = vaddq_u16(vaddq_u16(v, vshrq_n_u16(v, 8)), vdupq_n_u16(1));
+        return vqadd_u8(src, vshrn_n_u16(v, 8));
+    }
+
+    static void splatTilesNEON(const uint32_t *pGids, uint32_t count, const uint32_t *pColors, uint32_t colorCount, uint8_t *pDst)
+    {
+        uint32_t i = 0;
+        for (; i + 8 <= count; i += 8, pDst += 32)
+        {
+            uint32_t colors[8];
+            for (int k = 0; k < 8; ++k)
+            {
+                auto gid = pGids[i + k] & ~TiledMap::FLIP_FLAGS;
+                colors[k] = (gid < colorCount) ? pColors[gid] : 0;
+            }
+            auto src = vld4_u8(reinterpret_cast<const uint8_t*>(colors));
+            auto dst = vld4_u8(pDst);
+            auto invAlpha = vmvn_u8(src.val[3]);
+            for (int c = 0; c < 4; ++c)
+            {
+                dst.val[c] = splatChannelNEON(src.val[c], dst.val[c], invAlpha);
+            }
+            vst4_u8(pDst, dst);
+        }
+        splatTilesScalar(pGids + i, count - i, pColors, colorCount, pDst);
+    }
+#endif
+
+    static void splatTiles(const uint32_t *pGids, uint32_t count, const uint32_t *pColors, uint32_t colorCount, uint8_t *pDst, eSimdPath path)
+    {
+        switch (path)
+        {
+#if defined(ONUT_SIMD_X86)
+            case eSimdPath::AVX2:
+                splatTilesAVX2(pGids, count, pColors, colorCount, pDst);
+                return;
+            case eSimdPath::SSE2:
+                splatTilesSSE2(pGids, count, pColors, colorCount, pDst);
+                return;
+#endif
+#if defined(ONUT_SIMD_NEON)
+            case eSimdPath::NEON:
+                splatTilesNEON(pGids, count, pColors, colorCount, pDst);
+                return;
+#endif
+            default:
+                splatTilesScalar(pGids, count, pColors, colorCount, pDst);
+                return;
+        }
+    }
+
+    void TiledMap::computeTileColors(sTileSet &tileSet)
+    {
+        tileSet.hasColors = true;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> pixels;
+        MappedFile file(getPath(m_filename) + "/" + tileSet.image);
+        auto isDecoded = file.isValid() && getPngSize(file.getData(), file.getSize(), width, height);
+        if (isDecoded)
+        {
+            pixels.resize(static_cast<size_t>(width) * height * 4);
+            isDecoded = decodePng(file.getData(), file.getSize(), pixels.data(), width * 4, width, height);
+        }
+        assert(isDecoded); // Tileset images have to be pngs
+
+        for (size_t gid = 0; gid < m_tiles.size(); ++gid)
+        {
+            auto &tile = m_tiles[gid];
+            if (tile.pTileset != &tileSet) continue;
+            if (!isDecoded)
+            {
+                m_tileColors[gid] = 0xFF808080;
+                continue;
+            }
+
+            auto left = std::min<>(width, static_cast<uint32_t>(std::lrint(tile.UVs.x * static_cast<float>(width))));
+            auto top = std::min<>(height, static_cast<uint32_t>(std::lrint(tile.UVs.y * static_cast<float>(height))));
+            auto right = std::min<>(width, static_cast<uint32_t>(std::lrint(tile.UVs.z * static_cast<float>(width))));
+            auto bottom = std::min<>(height, static_cast<uint32_t>(std::lrint(tile.UVs.w * static_cast<float>(height))));
+            uint64_t sums[4] = {0};
+            for (auto y = top; y < bottom; ++y)
+            {
+                auto pPixel = pixels.data() + (static_cast<size_t>(y) * width + left) * 4;
+                for (auto x = left; x < right; ++x, pPixel += 4)
+                {
+                    for (int c = 0; c < 4; ++c) sums[c] += pPixel[c];
+                }
+            }
+            uint64_t pixelCount = static_cast<uint64_t>(right - left) * (bottom - top);
+            uint32_t color = 0;
+            for (int c = 0; pixelCount && c < 4; ++c)
+            {
+                color |= static_cast<uint32_t>((sums[c] + pixelCount / 2) / pixelCount) << (c * 8);
+            }
+            m_tileColors[gid] = color;
+        }
+    }
+
+    void TiledMap::buildMinimap(uint8_t *pRGBA, eSimdPath path)
+    {
+        if (path == eSimdPath::AUTO || !isSimdPathSupported(path))
+        {
+            path = getBestSimdPath();
+        }
+
+        m_tileColors.resize(m_tiles.size(), 0);
+        for (int i = 0; i < m_tilesetCount; ++i)
+        {
+            if (!m_tileSets[i].hasColors) computeTileColors(m_tileSets[i]);
+        }
+        memset(pRGBA, 0, static_cast<size_t>(m_width) * m_height * 4);
+        if (m_tileColors.empty()) return;
+
+        // Bands of rows, each with all the layers in order while its part of the minimap is in cache
+        static const int BAND_HEIGHT = 16;
+        auto splatBand = [this, pRGBA, path](int band)
+        {
+            auto fromY = band * BAND_HEIGHT;
+            for (int i = 0; i < m_layerCount; ++i)
+            {
+                auto pLayer = dynamic_cast<sTileLayerInternal*>(m_layers[i]);
+                if (!pLayer || !pLayer->isVisible) continue;
+                auto toY = std::min<>(fromY + BAND_HEIGHT, std::min<>(pLayer->height, m_height));
+                auto width = std::min<>(pLayer->width, m_width);
+
+                // Streamed maps are read one region at a time
+                auto spanWidth = m_pStreaming ? REGION_SIZE : width;
+                for (auto y = fromY; y < toY; ++y)
+                {
+                    for (int x = 0; x < width; x += spanWidth)
+                    {
+                        auto pGids = getTileRow(pLayer, x, y);
+                        if (!pGids) continue;
+                        splatTiles(pGids, static_cast<uint32_t>(std::min<>(spanWidth, width - x)), m_tileColors.data(), static_cast<uint32_t>(m_tileColors.size()),
+                                   pRGBA + (static_cast<size_t>(y) * m_width + x) * 4, path);
+                    }
+                }
+            }
+        };
+
+        auto bandCount = (m_height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+        if (bandCount == 1)
+        {
+            splatBand(0);
+            return;
+        }
+        std::atomic<int> nextBand(0);
+        auto workerCount = std::min<>(bandCount, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+        std::vector<std::function<void()>> workers(workerCount, [&splatBand, &nextBand, bandCount]
+        {
+            for (auto band = nextBand++; band < bandCount; band = nextBand++)
+            {
+                splatBand(band);
+            }
+        });
+        ORunTasks(workers);
     }
 
     onut::Texture *TiledMap::getMinimap()
@@ -396,7 +1732,15 @@ namespace onut
         ORenderer->bindRenderTarget(nullptr);
         return pMinimap;
 #else
-        return nullptr;
+        if (!m_width || !m_height) return nullptr;
+        std::vector<uint8_t> pixels(static_cast<size_t>(m_width) * m_height * 4);
+        buildMinimap(pixels.data());
+        if (!pMinimap)
+        {
+            pMinimap = OTexture::createDynamic({static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height)});
+        }
+        pMinimap->setData(pixels.data());
+        return pMinimap;
 #endif
     }
 };
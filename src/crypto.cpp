@@ -323,106 +323,331 @@ misrepresented as being the original source code.
 Ren Nyffenegger rene.nyffenegger@adp-gmbh.ch
 */
 
-#include <iostream>
-
-static const std::string base64_chars =
-"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-"abcdefghijklmnopqrstuvwxyz"
-"0123456789+/";
-
-static inline bool is_base64(uint8_t c)
-{
-    return (isalnum(c) || (c == '+') || (c == '/'));
-}
+#include <cstring>
+#include "SimdHelpers.h"
 
 namespace onut
 {
-    std::string base64_encode(uint8_t const* buf, unsigned int bufLen)
+    static const char BASE64_CHARS[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+        "abcdefghijklmnopqrstuvwxyz"
+        "0123456789+/";
+
+    static const uint8_t BASE64_WHITESPACE = 0xFE;
+    static const uint8_t BASE64_INVALID = 0xFF;
+
+    // Value of each character, or one of the above
+    struct sBase64DecodeTable
     {
-        std::string ret;
-        int i = 0;
-        int j = 0;
-        uint8_t char_array_3[3];
-        uint8_t char_array_4[4];
+        uint8_t values[256];
 
-        while (bufLen--)
+        sBase64DecodeTable()
         {
-            char_array_3[i++] = *(buf++);
-            if (i == 3)
-            {
-                char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-                char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-                char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-                char_array_4[3] = char_array_3[2] & 0x3f;
-
-                for (i = 0; (i < 4); i++)
-                    ret += base64_chars[char_array_4[i]];
-                i = 0;
-            }
+            memset(values, BASE64_INVALID, sizeof(values));
+            for (uint8_t i = 0; i < 64; ++i) values[static_cast<uint8_t>(BASE64_CHARS[i])] = i;
+            values[' '] = values['\t'] = values['\n'] = values['\r'] = BASE64_WHITESPACE;
         }
+    };
 
-        if (i)
-        {
-            for (j = i; j < 3; j++)
-                char_array_3[j] = '\0';
+    static const sBase64DecodeTable base64DecodeTable;
+
+    size_t base64_encoded_size(size_t size)
+    {
+        return (size + 2) / 3 * 4;
+    }
 
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
+    size_t base64_decoded_size(size_t length)
+    {
+        return (length + 3) / 4 * 3;
+    }
 
-            for (j = 0; (j < i + 1); j++)
-                ret += base64_chars[char_array_4[j]];
+    //--- Encoding
+    //
+    // The vector paths are Wojciech Mula's: bytes are shuffled so each 32 bits lane holds
+    // the 3 bytes of one group, the 4 indices are moved in place with two multiplies, then
+    // turned into characters by adding an offset picked from the index range.
 
-            while ((i++ < 3))
-                ret += '=';
+    static void encodeScalar(const uint8_t *&pIn, const uint8_t *pInEnd, char *&pOut)
+    {
+        while (pInEnd - pIn >= 3)
+        {
+            uint32_t group = (pIn[0] << 16) | (pIn[1] << 8) | pIn[2];
+            pOut[0] = BASE64_CHARS[group >> 18];
+            pOut[1] = BASE64_CHARS[(group >> 12) & 0x3F];
+            pOut[2] = BASE64_CHARS[(group >> 6) & 0x3F];
+            pOut[3] = BASE64_CHARS[group & 0x3F];
+            pIn += 3;
+            pOut += 4;
         }
+        if (pIn != pInEnd)
+        {
+            auto isPair = pInEnd - pIn == 2;
+            uint32_t group = (pIn[0] << 16) | (isPair ? (pIn[1] << 8) : 0);
+            pOut[0] = BASE64_CHARS[group >> 18];
+            pOut[1] = BASE64_CHARS[(group >> 12) & 0x3F];
+            pOut[2] = isPair ? BASE64_CHARS[(group >> 6) & 0x3F] : '=';
+            pOut[3] = '=';
+            pIn = pInEnd;
+            pOut += 4;
+        }
+    }
 
-        return ret;
+#if defined(ONUT_SIMD_X86)
+    // 16 bytes are read for 12 used
+    ONUT_TARGET_SSSE3 static void encodeSSSE3(const uint8_t *&pIn, const uint8_t *pInEnd, char *&pOut)
+    {
+        const __m128i groups = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        while (pInEnd - pIn >= 16)
+        {
+            auto in = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn)), groups);
+            auto ac = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+            auto bd = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+            auto indices = _mm_or_si128(ac, bd);
+
+            // 0 for 26..51, 1..12 for 52..63 and 13 for 0..25
+            auto range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+            range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut), _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices));
+            pIn += 12;
+            pOut += 16;
+        }
     }
 
-    std::vector<uint8_t> base64_decode(std::string const& encoded_string)
+    // Each lane gets its own 12 bytes, 28 bytes are read for 24 used
+    ONUT_TARGET_AVX2 static void encodeAVX2(const uint8_t *&pIn, const uint8_t *pInEnd, char *&pOut)
     {
-        int in_len = encoded_string.size();
-        int i = 0;
-        int j = 0;
-        int in_ = 0;
-        uint8_t char_array_4[4], char_array_3[3];
-        std::vector<uint8_t> ret;
+        const __m256i groups = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                                 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        while (pInEnd - pIn >= 28)
+        {
+            auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn));
+            auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + 12));
+            auto in = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), groups);
+            auto ac = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+            auto bd = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+            auto indices = _mm256_or_si256(ac, bd);
+
+            auto range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+            range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pOut), _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), indices));
+            pIn += 24;
+            pOut += 32;
+        }
+        encodeSSSE3(pIn, pInEnd, pOut);
+    }
+#endif
 
-        while (in_len-- && (encoded_string[in_] != '=') && is_base64(encoded_string[in_]))
+    void base64_encode(const uint8_t *pData, size_t size, char *pEncoded, eSimdPath path)
+    {
+        if (path == eSimdPath::AUTO || !isSimdPathSupported(path)) path = getBestSimdPath();
+        auto pInEnd = pData + size;
+        switch (path)
         {
-            char_array_4[i++] = encoded_string[in_]; in_++;
-            if (i == 4)
-            {
-                for (i = 0; i < 4; i++)
-                    char_array_4[i] = base64_chars.find(char_array_4[i]);
+#if defined(ONUT_SIMD_X86)
+            case eSimdPath::AVX2:
+                encodeAVX2(pData, pInEnd, pEncoded);
+                break;
+            case eSimdPath::SSE2:
+                if (simd::hasSSSE3()) encodeSSSE3(pData, pInEnd, pEncoded);
+                break;
+#endif
+            default:
+                break;
+        }
+        encodeScalar(pData, pInEnd, pEncoded);
+    }
 
-                char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-                char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-                char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+    std::string base64_encode(uint8_t const* buf, unsigned int bufLen)
+    {
+        std::string ret(base64_encoded_size(bufLen), '\0');
+        if (bufLen) base64_encode(buf, bufLen, &ret[0]);
+        return ret;
+    }
 
-                for (i = 0; (i < 3); i++)
-                    ret.push_back(char_array_3[i]);
-                i = 0;
-            }
+    //--- Decoding
+    //
+    // The vector paths decode whole blocks of 16 or 32 characters, and stop at the first
+    // one holding something else than base64, like whitespace or the padding. The scalar
+    // loop takes it from there, and hands back to them once it is at a group boundary.
+    // Characters are validated and mapped to their values with two nibble lookups: the
+    // low and high nibbles each select a set of classes, which only intersect for
+    // characters that aren't base64. Stores are 16 or 32 bytes wide, past the 12 or 24
+    // decoded, so they need that much room left.
+
+#if defined(ONUT_SIMD_X86)
+    ONUT_TARGET_SSSE3 static void decodeSSSE3(const char *&pIn, const char *pInEnd, uint8_t *&pOut, const uint8_t *pOutEnd)
+    {
+        const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+        const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+        while (pInEnd - pIn >= 16 && pOutEnd - pOut >= 16)
+        {
+            auto in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn));
+            auto hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), nibbleMask);
+            auto loNibbles = _mm_and_si128(in, nibbleMask);
+            auto classes = _mm_and_si128(_mm_shuffle_epi8(lutLo, loNibbles), _mm_shuffle_epi8(lutHi, hiNibbles));
+            if (_mm_movemask_epi8(_mm_cmpgt_epi8(classes, _mm_setzero_si128()))) break;
+
+            // '/' shares its high nibble with '+', it is moved to its own offset
+            auto roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(in, _mm_set1_epi8('/')), hiNibbles));
+            auto values = _mm_add_epi8(in, roll);
+            auto pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+            auto groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut), _mm_shuffle_epi8(groups, pack));
+            pIn += 16;
+            pOut += 12;
         }
+    }
 
-        if (i)
+    ONUT_TARGET_AVX2 static void decodeAVX2(const char *&pIn, const char *pInEnd, uint8_t *&pOut, const uint8_t *pOutEnd)
+    {
+        const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                               0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                               0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                              2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+        const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+        while (pInEnd - pIn >= 32 && pOutEnd - pOut >= 32)
         {
-            for (j = i; j < 4; j++)
-                char_array_4[j] = 0;
+            auto in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pIn));
+            auto hiNibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibbleMask);
+            auto loNibbles = _mm256_and_si256(in, nibbleMask);
+            auto classes = _mm256_and_si256(_mm256_shuffle_epi8(lutLo, loNibbles), _mm256_shuffle_epi8(lutHi, hiNibbles));
+            if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(classes, _mm256_setzero_si256()))) break;
+
+            auto roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')), hiNibbles));
+            auto values = _mm256_add_epi8(in, roll);
+            auto pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+            auto groups = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+            auto packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(groups, pack), lanes);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pOut), packed);
+            pIn += 32;
+            pOut += 24;
+        }
+        decodeSSSE3(pIn, pInEnd, pOut, pOutEnd);
+    }
+#endif
 
-            for (j = 0; j < 4; j++)
-                char_array_4[j] = base64_chars.find(char_array_4[j]);
+    bool base64_decode(const char *encoded, size_t length, uint8_t *pDecoded, size_t capacity, size_t &decodedSize, eSimdPath path)
+    {
+        if (path == eSimdPath::AUTO || !isSimdPathSupported(path)) path = getBestSimdPath();
+#if defined(ONUT_SIMD_X86)
+        if (path == eSimdPath::SSE2 && !simd::hasSSSE3()) path = eSimdPath::SCALAR;
+#endif
+        auto pIn = encoded;
+        auto pInEnd = encoded + length;
+        auto pOut = pDecoded;
+        auto pOutEnd = pDecoded + capacity;
+        uint32_t group = 0;
+        int count = 0; // Characters in group
+        int padding = 0;
+        auto isValid = true;
+
+        while (pIn != pInEnd)
+        {
+            if (!count)
+            {
+                switch (path)
+                {
+#if defined(ONUT_SIMD_X86)
+                    case eSimdPath::AVX2:
+                        decodeAVX2(pIn, pInEnd, pOut, pOutEnd);
+                        break;
+                    case eSimdPath::SSE2:
+                        decodeSSSE3(pIn, pInEnd, pOut, pOutEnd);
+                        break;
+#endif
+                    default:
+                        break;
+                }
+                if (pIn == pInEnd) break;
+            }
 
-            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+            auto c = static_cast<uint8_t>(*pIn++);
+            auto value = base64DecodeTable.values[c];
+            if (value < 64)
+            {
+                group = (group << 6) | value;
+                if (++count == 4)
+                {
+                    if (pOutEnd - pOut < 3)
+                    {
+                        isValid = false;
+                        break;
+                    }
+                    pOut[0] = static_cast<uint8_t>(group >> 16);
+                    pOut[1] = static_cast<uint8_t>(group >> 8);
+                    pOut[2] = static_cast<uint8_t>(group);
+                    pOut += 3;
+                    group = 0;
+                    count = 0;
+                }
+            }
+            else if (c == '=')
+            {
+                // Only more padding and whitespace can follow
+                ++padding;
+                while (pIn != pInEnd && isValid)
+                {
+                    c = static_cast<uint8_t>(*pIn++);
+                    if (c == '=') ++padding;
+                    else if (base64DecodeTable.values[c] != BASE64_WHITESPACE) isValid = false;
+                }
+                if (count < 2 || count + padding != 4) isValid = false;
+                break;
+            }
+            else if (value != BASE64_WHITESPACE)
+            {
+                isValid = false;
+                break;
+            }
+        }
 
-            for (j = 0; (j < i - 1); j++) ret.push_back(char_array_3[j]);
+        // Last group, padded or not
+        if (isValid && count)
+        {
+            auto byteCount = count - 1;
+            if (!byteCount || pOutEnd - pOut < byteCount)
+            {
+                isValid = false;
+            }
+            else
+            {
+                group <<= 6 * (4 - count);
+                pOut[0] = static_cast<uint8_t>(group >> 16);
+                if (byteCount == 2) pOut[1] = static_cast<uint8_t>(group >> 8);
+                pOut += byteCount;
+            }
         }
 
+        decodedSize = static_cast<size_t>(pOut - pDecoded);
+        return isValid;
+    }
+
+    std::vector<uint8_t> base64_decode(std::string const& encoded_string)
+    {
+        std::vector<uint8_t> ret;
+        base64_decode(encoded_string.c_str(), encoded_string.size(), ret);
         return ret;
     }
+
+    void base64_decode(const char* encoded_string, size_t length, std::vector<uint8_t>& ret)
+    {
+        size_t size = 0;
+        ret.resize(base64_decoded_size(length));
+        if (!base64_decode(encoded_string, length, ret.data(), ret.size(), size)) size = 0;
+        ret.resize(size);
+    }
 }
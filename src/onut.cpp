@@ -18,6 +18,7 @@ onut::PrimitiveBatch*               OPrimitiveBatch = nullptr;
 onut::GamePad*                      g_gamePads[4] = {nullptr};
 onut::EventManager*                 OEvent = nullptr;
 onut::ContentManager<>*             OContentManager = nullptr;
+onut::TextureCache*                 OTextureCache = nullptr;
 AudioEngine*                        g_pAudioEngine = nullptr;
 onut::TimeInfo<>                    g_timeInfo;
 onut::Synchronous<onut::Pool<>>     g_mainSync;
@@ -44,9 +45,7 @@ namespace onut
 
         OUIContext->onClipping = [](bool enabled, const onut::sUIRect& rect)
         {
-            OSB->end();
-            ORenderer->setScissor(enabled, onut::UI2Onut(rect));
-            OSB->begin();
+            OSB->setClip(enabled, onut::UI2Onut(rect));
         };
 
 #if EASY_GRAPHIX
@@ -210,6 +209,10 @@ namespace onut
         OPB = new PrimitiveBatch();
 
         // Content
+        if (!OSettings->getTextureCachePath().empty())
+        {
+            OTextureCache = new TextureCache(OSettings->getTextureCachePath());
+        }
         OContentManager = new ContentManager<>();
         OContentManager->addDefaultSearchPaths();
 
@@ -292,6 +295,7 @@ namespace onut
         delete OInput;
         delete g_inputDevice;
         delete OContentManager;
+        delete OTextureCache;
         delete OPB;
         delete OSB;
         delete ORenderer;
@@ -416,4 +420,25 @@ namespace onut
         }
         OSB->end();
     }
+
+    void drawRenderStats(OFont* pFont, const Vector2& position)
+    {
+        auto& stats = ORenderer->getStats();
+        if (!stats.getFrameCount()) return;
+        auto& frame = stats.getFrame();
+        auto peak = stats.getPeak();
+
+        std::stringstream ss;
+        ss << "Draw calls: " << frame.getDrawCallCount() << " (peak " << peak.getDrawCallCount() << ")\n";
+        ss << "Sprites: " << frame.spriteCount << " in " << frame.spriteFlushCount << " flushes, " << frame.spriteBatchCount << " batches\n";
+        ss << "Texture switches: " << frame.textureSwitchCount << "\n";
+        ss << "Primitives: " << frame.primitiveFlushCount << " flushes, " << frame.primitiveBatchCount << " batches\n";
+        ss << "Vertices: " << frame.vertexCount << "\n";
+        ss << "Scissor changes: " << frame.scissorChangeCount << "\n";
+        ss << "Render target changes: " << frame.renderTargetChangeCount;
+
+        OSB->begin();
+        pFont->draw(ss.str(), position);
+        OSB->end();
+    }
 }
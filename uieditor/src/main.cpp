@@ -37,9 +37,7 @@ void init()
     g_pUIContext = new onut::UIContext(onut::sUIVector2{OScreenWf, OScreenHf});
     g_pUIContext->onClipping = [](bool enabled, const onut::sUIRect& rect)
     {
-        OSB->end();
-        ORenderer->setScissor(enabled, onut::UI2Onut(rect));
-        OSB->begin();
+        OSB->setClip(enabled, onut::UI2Onut(rect));
     };
     createUIStyles(g_pUIContext);
 
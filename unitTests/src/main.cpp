@@ -1,9 +1,14 @@
-﻿#include <direct.h>
+﻿#include <algorithm>
+#include <chrono>
+#include <direct.h>
+#include <fstream>
 #include <future>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include "LodePNG.h"
 #include "onut.h"
+#include "zlib/zlib.h"
 using namespace std;
 
 #ifdef WIN32
@@ -69,6 +74,27 @@ void checkTest(bool cond, TtextType testName)
     }
 }
 
+/**
+Runs fn iterationCount times and prints the average time per run in milliseconds.
+@return Average milliseconds per run
+*/
+template<typename TtextType, typename Tfn>
+double benchmark(TtextType testName, int iterationCount, Tfn fn)
+{
+    ++testCount;
+    stringstream ss;
+    ss << majorTestCount << "." << subTestCount << "." << testCount;
+    auto start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterationCount; ++i)
+    {
+        fn();
+    }
+    auto elapsed = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() / static_cast<double>(iterationCount);
+    cout << setColor(7) << setw(10) << ss.str() << " - " << setColor(11) << "Bench  " << setColor(7) << testName << ": " << fixed << setprecision(3) << elapsed << " ms" << endl;
+    cout.unsetf(ios_base::floatfield);
+    return elapsed;
+}
+
 template<uintptr_t TloopCount>
 bool testRandomPool()
 {
@@ -355,6 +381,41 @@ public:
     float b = 10.75f;
 };
 
+// The mip generation Texture::createFromData used before onut::generateMipChain. Kept for benchmarking.
+void legacyGenerateMips(uint8_t* pMipMaps, uint32_t w2, uint32_t h2)
+{
+    uint32_t w2t = w2 / 2;
+    uint32_t h2t = h2 / 2;
+    uint8_t* prev = pMipMaps;
+    uint8_t* cur = pMipMaps + w2 * h2 * 4;
+    while (w2t >= 1 && h2t >= 1)
+    {
+        int multX = w2 / w2t;
+        int multY = h2 / h2t;
+        for (uint32_t y = 0; y < h2t; ++y)
+        {
+            for (uint32_t x = 0; x < w2t; ++x)
+            {
+                for (uint32_t k = 0; k < 4; ++k)
+                {
+                    int accum = 0;
+                    accum += prev[(y * multY * w2 + x * multX) * 4 + k];
+                    accum += prev[(y * multY * w2 + (x + multX / 2) * multX) * 4 + k];
+                    accum += prev[((y + multY / 2) * multY * w2 + x * multX) * 4 + k];
+                    accum += prev[((y + multY / 2) * multY * w2 + (x + multX / 2) * multX) * 4 + k];
+                    cur[(y * w2t + x) * 4 + k] = accum / 4;
+                }
+            }
+        }
+        prev = cur;
+        cur += w2t * h2t * 4;
+        w2 = w2t;
+        h2 = h2t;
+        w2t /= 2;
+        h2t /= 2;
+    }
+}
+
 int main(int argc, char** args)
 {
 #ifdef WIN32
@@ -552,6 +613,217 @@ int main(int argc, char** args)
             if (split.size() >= 3) checkTest(split[2] == " ", "split[1] = \" \"");
         }
         cout << setColor(7) << endl;
+
+        subTest("Integer lists");
+        {
+            uint32_t ids[8];
+            auto parse = [&](const char* szList, size_t capacity = 8)
+            {
+                return onut::parseIntList(szList, strlen(szList), ids, capacity);
+            };
+            {
+                auto result = parse("\n1,2,3,\n4,5,6\n");
+                checkTest(result.error == onut::eParseError::NONE && result.count == 6 && ids[0] == 1 && ids[5] == 6, "Tiled csv with its line breaks");
+            }
+            {
+                auto result = parse(" 7 ,\t8 , 4294967295 ");
+                checkTest(result.error == onut::eParseError::NONE && result.count == 3 && ids[1] == 8 && ids[2] == 4294967295u, "Whitespace around numbers, full 32 bits range");
+            }
+            checkTest(parse("").count == 0 && parse(" \n ").error == onut::eParseError::NONE, "Nothing but whitespace gives no numbers");
+            {
+                auto result = parse("1,2,\n3,x,5");
+                checkTest(result.error == onut::eParseError::EXPECTED_NUMBER && result.count == 3 && result.position == 7 && result.line == 2 && result.column == 3, "Error position, line and column");
+            }
+            checkTest(parse("1,,2").error == onut::eParseError::EXPECTED_NUMBER, "Empty value");
+            checkTest(parse("1,2,").error == onut::eParseError::EXPECTED_NUMBER, "Trailing delimiter");
+            checkTest(parse("1 2").error == onut::eParseError::UNEXPECTED_CHARACTER, "Missing delimiter");
+            checkTest(parse("12a").error == onut::eParseError::UNEXPECTED_CHARACTER, "Letter after a number");
+            checkTest(parse("-1").error == onut::eParseError::EXPECTED_NUMBER, "No sign for unsigned");
+            {
+                auto result = parse("1,4294967296");
+                checkTest(result.error == onut::eParseError::OUT_OF_RANGE && result.position == 2, "Out of range");
+            }
+            checkTest(parse("1,2,3", 2).error == onut::eParseError::TOO_MANY_NUMBERS, "More numbers than the capacity");
+            {
+                int32_t values[4];
+                auto result = onut::parseIntList("-2147483648;2147483647;-5", 25, values, 4, ';');
+                checkTest(result.error == onut::eParseError::NONE && result.count == 3 && values[0] == INT32_MIN && values[1] == INT32_MAX && values[2] == -5, "Signed, other delimiter");
+                checkTest(onut::parseIntList("2147483648", 10, values, 4).error == onut::eParseError::OUT_OF_RANGE, "Signed out of range");
+            }
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Integer lists benchmark");
+        {
+            // A 1024x1024 csv layer, the way Tiled writes it
+            stringstream ss;
+            ss << "\n";
+            for (int y = 0; y < 1024; ++y)
+            {
+                for (int x = 0; x < 1024; ++x)
+                {
+                    ss << (rand() % 300);
+                    if (x < 1023 || y < 1023) ss << ",";
+                }
+                ss << "\n";
+            }
+            auto csv = ss.str();
+            vector<uint32_t> tileIds(1024 * 1024);
+            benchmark("splitString then stoul", 2, [&]
+            {
+                auto csvData = onut::splitString(csv, ',');
+                for (size_t i = 0; i < csvData.size(); ++i) tileIds[i] = static_cast<uint32_t>(std::stoul(csvData[i]));
+            });
+            onut::sParseResult result;
+            benchmark("parseIntList", 10, [&]
+            {
+                result = onut::parseIntList(csv.data(), csv.size(), tileIds.data(), tileIds.size());
+            });
+            checkTest(result.error == onut::eParseError::NONE && result.count == tileIds.size(), "Every tile parsed");
+            cout << setColor(7) << endl;
+        }
+    }
+
+    majorTest("Base64");
+    {
+        onut::eSimdPath simdPaths[] = {onut::eSimdPath::SCALAR, onut::eSimdPath::SSE2, onut::eSimdPath::AVX2, onut::eSimdPath::NEON};
+        const char* simdPathNames[] = {"Scalar", "SSE2", "AVX2", "NEON"};
+
+        subTest("Encoding and decoding");
+        {
+            auto decode = [](const string& encoded, onut::eSimdPath path, vector<uint8_t>& decoded) -> bool
+            {
+                decoded.resize(onut::base64_decoded_size(encoded.size()) + 32);
+                size_t size = 0;
+                auto ret = onut::base64_decode(encoded.data(), encoded.size(), decoded.data(), decoded.size(), size, path);
+                decoded.resize(size);
+                return ret;
+            };
+
+            const char* rfc4648[][2] = {{"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"}, {"foob", "Zm9vYg=="}, {"fooba", "Zm9vYmE="}, {"foobar", "Zm9vYmFy"}};
+            bool isEncoded = true;
+            bool isDecoded = true;
+            for (auto& test : rfc4648)
+            {
+                auto encoded = onut::base64_encode(reinterpret_cast<const uint8_t*>(test[0]), static_cast<unsigned int>(strlen(test[0])));
+                if (encoded != test[1]) isEncoded = false;
+                vector<uint8_t> decoded;
+                if (!decode(test[1], onut::eSimdPath::SCALAR, decoded) || string(decoded.begin(), decoded.end()) != test[0]) isDecoded = false;
+            }
+            checkTest(isEncoded, "RFC 4648 vectors encode");
+            checkTest(isDecoded, "RFC 4648 vectors decode");
+
+            vector<uint8_t> decoded;
+            checkTest(decode("\n   Zm9v\n   YmFy\n  ", onut::eSimdPath::SCALAR, decoded) && string(decoded.begin(), decoded.end()) == "foobar", "Whitespace is skipped");
+            checkTest(decode("Zg", onut::eSimdPath::SCALAR, decoded) && string(decoded.begin(), decoded.end()) == "f", "Padding is optional");
+            bool isRejected = true;
+            for (auto invalid : {"Zm9v!mFy", "Zg=", "Zg===", "Zm9v=", "Zg==Zg==", "Zg== a", "Z", "Zm9vY", "\xC3\xA9"})
+            {
+                if (decode(invalid, onut::eSimdPath::SCALAR, decoded)) isRejected = false;
+            }
+            checkTest(isRejected, "Invalid characters and bad padding are rejected");
+            {
+                uint8_t small[5];
+                size_t size = 0;
+                checkTest(!onut::base64_decode("Zm9vYmFy", 8, small, 5, size) && size == 3, "Too small a buffer fails after what fits");
+            }
+            checkTest(onut::base64_decode(string("Zm9vYmFy")).size() == 6 && onut::base64_decode(string("Zm9v!mFy")).empty(), "std::string overload, empty when invalid");
+
+            // Random data of every size around the vector widths, with and without whitespace
+            vector<uint8_t> data(300);
+            for (auto& byte : data) byte = static_cast<uint8_t>(rand());
+            vector<string> encodings;
+            for (size_t size = 0; size < data.size(); ++size)
+            {
+                encodings.push_back(onut::base64_encode(data.data(), static_cast<unsigned int>(size)));
+            }
+            bool isRoundTrip = true;
+            for (size_t size = 0; size < data.size(); ++size)
+            {
+                auto& encoded = encodings[size];
+                auto spaced = "\n   " + encoded.substr(0, encoded.size() / 3) + "\r\n\t" + encoded.substr(encoded.size() / 3) + "\n  ";
+                if (!decode(encoded, onut::eSimdPath::SCALAR, decoded) || !equal(decoded.begin(), decoded.end(), data.begin()) || decoded.size() != size) isRoundTrip = false;
+                if (!decode(spaced, onut::eSimdPath::SCALAR, decoded) || !equal(decoded.begin(), decoded.end(), data.begin()) || decoded.size() != size) isRoundTrip = false;
+            }
+            checkTest(isRoundTrip, "Scalar round trips 0 to 300 bytes");
+
+            for (int i = 1; i < 4; ++i)
+            {
+                if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                bool isExact = true;
+                for (size_t size = 0; size < data.size(); ++size)
+                {
+                    string encoded(onut::base64_encoded_size(size), '\0');
+                    onut::base64_encode(data.data(), size, &encoded[0], simdPaths[i]);
+                    if (encoded != encodings[size]) isExact = false;
+
+                    // Exact capacity, so the end is left to the scalar loop
+                    vector<uint8_t> exact(size);
+                    size_t exactSize = 0;
+                    if (!onut::base64_decode(encoded.data(), encoded.size(), exact.data(), size, exactSize, simdPaths[i]) || exactSize != size) isExact = false;
+                    if (!equal(exact.begin(), exact.end(), data.begin())) isExact = false;
+
+                    auto spaced = "\n   " + encoded.substr(0, encoded.size() / 3) + "\r\n\t" + encoded.substr(encoded.size() / 3) + "\n  ";
+                    if (!decode(spaced, simdPaths[i], decoded) || decoded.size() != size || !equal(decoded.begin(), decoded.end(), data.begin())) isExact = false;
+                }
+
+                // Every byte, at every place of a block
+                auto encoded = encodings[96];
+                for (int c = 0; c < 256; ++c)
+                {
+                    for (size_t at = 0; at < 64; at += 7)
+                    {
+                        auto corrupted = encoded;
+                        corrupted[at] = static_cast<char>(c);
+                        vector<uint8_t> expected;
+                        auto isExpected = decode(corrupted, onut::eSimdPath::SCALAR, expected);
+                        if (decode(corrupted, simdPaths[i], decoded) != isExpected || decoded != expected) isExact = false;
+                    }
+                }
+                checkTest(isExact, string(simdPathNames[i]) + " is bit-exact with scalar");
+            }
+
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Base64 benchmark");
+        {
+            // About a 1024x1024 layer
+            vector<uint8_t> data(4 * 1024 * 1024);
+            for (auto& byte : data) byte = static_cast<uint8_t>(rand());
+            string encoded(onut::base64_encoded_size(data.size()), '\0');
+            vector<uint8_t> decoded(onut::base64_decoded_size(encoded.size()));
+            auto printRate = [&](double ms)
+            {
+                cout << "            " << static_cast<int>(static_cast<double>(data.size()) / ms / 1000.0) << " MB/s" << endl;
+            };
+            for (int i = 0; i < 4; ++i)
+            {
+                if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                printRate(benchmark(string(simdPathNames[i]) + " encode 4 MB", 10, [&]
+                {
+                    onut::base64_encode(data.data(), data.size(), &encoded[0], simdPaths[i]);
+                }));
+            }
+            for (int i = 0; i < 4; ++i)
+            {
+                if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                printRate(benchmark(string(simdPathNames[i]) + " decode 4 MB", 10, [&]
+                {
+                    size_t size = 0;
+                    onut::base64_decode(encoded.data(), encoded.size(), decoded.data(), decoded.size(), size, simdPaths[i]);
+                }));
+            }
+            vector<uint8_t> reused;
+            printRate(benchmark("Decode 4 MB into a std::vector", 10, [&]
+            {
+                onut::base64_decode(encoded.data(), encoded.size(), reused);
+            }));
+            checkTest(reused == data, "Decoded what was encoded");
+
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
     }
 
     majorTest("File search");
@@ -962,6 +1234,2381 @@ int main(int argc, char** args)
         cout << setColor(7) << endl;
     }
 
+    majorTest("Image utilities");
+    {
+        onut::eSimdPath simdPaths[] = {onut::eSimdPath::SCALAR, onut::eSimdPath::SSE2, onut::eSimdPath::AVX2, onut::eSimdPath::NEON};
+        const char* simdPathNames[] = {"Scalar", "SSE2", "AVX2", "NEON"};
+
+        subTest("Premultiplied alpha");
+        {
+            // Every color/alpha combination
+            vector<uint8_t> source(256 * 256 * 4);
+            for (int a = 0; a < 256; ++a)
+            {
+                for (int c = 0; c < 256; ++c)
+                {
+                    auto pPixel = source.data() + (a * 256 + c) * 4;
+                    pPixel[0] = static_cast<uint8_t>(c);
+                    pPixel[1] = static_cast<uint8_t>(255 - c);
+                    pPixel[2] = static_cast<uint8_t>(c ^ 0x5a);
+                    pPixel[3] = static_cast<uint8_t>(a);
+                }
+            }
+
+            auto expected = source;
+            onut::premultiplyAlpha(expected.data(), 256 * 256, onut::eSimdPath::SCALAR);
+            bool isRounded = true;
+            for (int i = 0; i < 256 * 256 * 4; ++i)
+            {
+                auto a = source[(i / 4) * 4 + 3];
+                auto rounded = (i % 4 == 3) ? a : static_cast<uint8_t>(static_cast<double>(source[i]) * static_cast<double>(a) / 255.0 + .5);
+                if (expected[i] != rounded) isRounded = false;
+            }
+            checkTest(isRounded, "Scalar rounds to nearest and leaves alpha untouched");
+
+            for (int i = 0; i < 4; ++i)
+            {
+                if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                bool isExact = true;
+
+                // Odd counts exercise the tails
+                for (size_t count : {size_t(0), size_t(1), size_t(3), size_t(7), size_t(9), size_t(31), size_t(256 * 256 - 5), size_t(256 * 256)})
+                {
+                    vector<uint8_t> pixels(source.begin(), source.begin() + count * 4);
+                    onut::premultiplyAlpha(pixels.data(), count, simdPaths[i]);
+                    if (!equal(pixels.begin(), pixels.end(), expected.begin())) isExact = false;
+                }
+                checkTest(isExact, string(simdPathNames[i]) + " is bit-exact with scalar");
+            }
+
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Premultiplied alpha benchmark");
+        {
+            for (uint32_t size = 256; size <= 4096; size *= 4)
+            {
+                vector<uint8_t> pixels(size * size * 4);
+                for (auto& c : pixels) c = static_cast<uint8_t>(rand());
+                for (int i = 0; i < 4; ++i)
+                {
+                    if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                    stringstream ss;
+                    ss << simdPathNames[i] << " " << size << "x" << size;
+                    benchmark(ss.str(), 4, [&]
+                    {
+                        onut::premultiplyAlpha(pixels.data(), size * size, simdPaths[i]);
+                    });
+                }
+            }
+
+            cout << setColor(7) << endl;
+        }
+        subTest("Mip chain");
+        {
+            auto layout = onut::getMipLevels(5, 3);
+            checkTest(layout.size() == 3, "5x3 has 3 levels");
+            if (layout.size() == 3)
+            {
+                checkTest(layout[1].width == 2 && layout[1].height == 1 && layout[1].offset == 5 * 3 * 4, "Level 1 is 2x1 right after level 0");
+                checkTest(layout[2].width == 1 && layout[2].height == 1, "Level 2 is 1x1");
+                checkTest(onut::getMipChainSize(layout) == (15 + 2 + 1) * 4, "Chain size is the sum of all levels");
+            }
+
+            {
+                uint8_t chain[(4 + 1) * 4] = {
+                    0, 10, 255, 255, 1, 10, 255, 255,
+                    2, 20, 0, 255, 2, 21, 0, 255};
+                onut::generateMipChain(chain, onut::getMipLevels(2, 2), false, onut::eSimdPath::SCALAR);
+                checkTest(chain[16] == 1 && chain[17] == 15 && chain[18] == 128 && chain[19] == 255, "2x2 box filter rounds to nearest");
+            }
+
+            bool isExact = true;
+            uint32_t sizes[][2] = {{1, 1}, {1, 9}, {9, 1}, {3, 5}, {17, 9}, {64, 64}, {100, 37}, {257, 255}};
+            for (auto& size : sizes)
+            {
+                auto sizeLevels = onut::getMipLevels(size[0], size[1]);
+                vector<uint8_t> expected(onut::getMipChainSize(sizeLevels));
+                for (size_t i = 0; i < sizeLevels[0].size; ++i) expected[i] = static_cast<uint8_t>(rand());
+                auto source = expected;
+                onut::generateMipChain(expected.data(), sizeLevels, false, onut::eSimdPath::SCALAR);
+                for (int i = 1; i < 4; ++i)
+                {
+                    if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                    auto chain = source;
+                    onut::generateMipChain(chain.data(), sizeLevels, false, simdPaths[i]);
+                    if (chain != expected) isExact = false;
+                }
+            }
+            checkTest(isExact, "SIMD paths are bit-exact with scalar on non power of two sizes");
+
+            {
+                // Black and white checker averages to mid gray in linear space
+                auto checkerLevels = onut::getMipLevels(2, 2);
+                uint8_t chain[(4 + 1) * 4] = {
+                    0, 0, 0, 255, 255, 255, 255, 255,
+                    255, 255, 255, 255, 0, 0, 0, 255};
+                onut::generateMipChain(chain, checkerLevels, true);
+                checkTest(chain[16] >= 186 && chain[16] <= 190 && chain[19] == 255, "Gamma correct average of black and white is ~188");
+            }
+
+            {
+                // 4 whites sum to the top of the linear range
+                auto whiteLevels = onut::getMipLevels(4, 4);
+                vector<uint8_t> chain(onut::getMipChainSize(whiteLevels), 255);
+                onut::generateMipChain(chain.data(), whiteLevels, true);
+                checkTest(all_of(chain.begin(), chain.end(), [](uint8_t c) { return c == 255; }), "Gamma correct mips of white stay white");
+            }
+
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Mip chain benchmark");
+        {
+            for (uint32_t size = 256; size <= 4096; size *= 2)
+            {
+                auto sizeLevels = onut::getMipLevels(size, size);
+                vector<uint8_t> chain(onut::getMipChainSize(sizeLevels));
+                for (size_t i = 0; i < sizeLevels[0].size; ++i) chain[i] = static_cast<uint8_t>(rand());
+
+                stringstream ss;
+                ss << size << "x" << size;
+                benchmark("Legacy " + ss.str(), 2, [&]
+                {
+                    legacyGenerateMips(chain.data(), size, size);
+                });
+                for (int i = 0; i < 4; ++i)
+                {
+                    if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                    benchmark(string(simdPathNames[i]) + " " + ss.str(), 2, [&]
+                    {
+                        onut::generateMipChain(chain.data(), sizeLevels, false, simdPaths[i]);
+                    });
+                }
+                benchmark("Gamma correct " + ss.str(), 2, [&]
+                {
+                    onut::generateMipChain(chain.data(), sizeLevels, true);
+                });
+            }
+
+            cout << setColor(7) << endl;
+        }
+
+        subTest("PNG decoding into caller buffers");
+        {
+            struct sFormat
+            {
+                LodePNGColorType colorType;
+                unsigned bitDepth;
+            } formats[] = {
+                {LCT_GREY, 1}, {LCT_GREY, 4}, {LCT_GREY, 8}, {LCT_GREY, 16},
+                {LCT_RGB, 8}, {LCT_RGB, 16}, {LCT_PALETTE, 2}, {LCT_PALETTE, 8},
+                {LCT_GREY_ALPHA, 8}, {LCT_RGBA, 8}, {LCT_RGBA, 16}};
+            const unsigned w = 37, h = 11;
+            const size_t pitch = w * 4 + 12;
+            bool isSame = true;
+            bool isPaddingUntouched = true;
+            for (auto& format : formats)
+            {
+                for (unsigned interlace = 0; interlace < 2; ++interlace)
+                {
+                    lodepng::State state;
+                    state.encoder.auto_convert = LAC_NO;
+                    state.info_raw.colortype = state.info_png.color.colortype = format.colorType;
+                    state.info_raw.bitdepth = state.info_png.color.bitdepth = format.bitDepth;
+                    state.info_png.interlace_method = interlace;
+                    if (format.colorType == LCT_PALETTE)
+                    {
+                        for (unsigned i = 0; i < (1u << format.bitDepth); ++i)
+                        {
+                            lodepng_palette_add(&state.info_raw, rand() % 256, rand() % 256, rand() % 256, rand() % 256);
+                            auto& raw = state.info_raw;
+                            lodepng_palette_add(&state.info_png.color,
+                                raw.palette[i * 4], raw.palette[i * 4 + 1], raw.palette[i * 4 + 2], raw.palette[i * 4 + 3]);
+                        }
+                    }
+                    vector<unsigned char> raw(lodepng_get_raw_size(w, h, &state.info_raw));
+                    for (auto& b : raw) b = static_cast<unsigned char>(rand());
+                    vector<unsigned char> png;
+                    lodepng::encode(png, raw, w, h, state);
+
+                    vector<unsigned char> expected;
+                    unsigned expectedW, expectedH;
+                    lodepng::decode(expected, expectedW, expectedH, png);
+                    onut::premultiplyAlpha(expected.data(), w * h);
+
+                    uint32_t pngW, pngH;
+                    onut::getPngSize(png.data(), png.size(), pngW, pngH);
+                    vector<uint8_t> buffer(pitch * h, 0xcd);
+                    if (!onut::decodePng(png.data(), png.size(), buffer.data(), pitch, pngW, pngH)) isSame = false;
+                    for (unsigned y = 0; y < h; ++y)
+                    {
+                        if (memcmp(buffer.data() + y * pitch, expected.data() + y * w * 4, w * 4)) isSame = false;
+                        for (size_t x = w * 4; x < pitch; ++x)
+                        {
+                            if (buffer[y * pitch + x] != 0xcd) isPaddingUntouched = false;
+                        }
+                    }
+                }
+            }
+            checkTest(isSame, "Same pixels as decode then premultiply, for every color type and interlacing");
+            checkTest(isPaddingUntouched, "Bytes past each row are untouched");
+
+            vector<unsigned char> png;
+            unsigned char pixel[4] = {255, 255, 255, 255};
+            lodepng::encode(png, pixel, 1, 1);
+            uint8_t out[8] = {0};
+            checkTest(!onut::decodePng(png.data(), png.size(), out, 8, 2, 1), "Refuses a buffer sized for another image");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("PNG decoding benchmark");
+        {
+            const unsigned size = 2048;
+            vector<unsigned char> raw(size * size * 4);
+            for (size_t i = 0; i < raw.size(); ++i) raw[i] = static_cast<unsigned char>((i * 7) ^ (i >> 11));
+            vector<unsigned char> png;
+            lodepng::encode(png, raw, size, size);
+
+            benchmark("lodepng::decode then premultiply 2048x2048", 2, [&]
+            {
+                vector<unsigned char> image;
+                unsigned w, h;
+                lodepng::decode(image, w, h, png);
+                onut::premultiplyAlpha(image.data(), w * h);
+            });
+            vector<uint8_t> buffer(size * size * 4);
+            benchmark("decodePng into buffer 2048x2048", 2, [&]
+            {
+                onut::decodePng(png.data(), png.size(), buffer.data(), size * 4, size, size);
+            });
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("onut::TextureCache");
+    {
+        subTest("Store and find entries");
+        {
+            {
+                ofstream source("textureCacheSource.png", ios::binary);
+                source << "not really a png";
+            }
+            onut::TextureCache cache("textureCacheTest");
+            onut::TextureCache::sEntry entry;
+            checkTest(!cache.find("textureCacheSource.png", true, entry), "No entry before store");
+
+            auto levels = onut::getMipLevels(5, 3);
+            vector<uint8_t> chain(onut::getMipChainSize(levels));
+            for (size_t i = 0; i < chain.size(); ++i) chain[i] = static_cast<uint8_t>(i);
+            checkTest(cache.store("textureCacheSource.png", 5, 3, chain.data(), static_cast<uint32_t>(levels.size())), "Store 5x3 with mips");
+            checkTest(cache.find("textureCacheSource.png", true, entry), "Find it back");
+            checkTest(entry.width == 5 && entry.height == 3 && entry.levelCount == 3, "Same size and level count");
+            checkTest(entry.pMipChain && memcmp(entry.pMipChain, chain.data(), chain.size()) == 0, "Same pixels");
+            entry = onut::TextureCache::sEntry();
+
+            checkTest(cache.store("textureCacheSource.png", 5, 3, chain.data(), 1), "Replace with level 0 only");
+            checkTest(!cache.find("textureCacheSource.png", true, entry), "Not enough levels when mips are needed");
+            checkTest(cache.find("textureCacheSource.png", false, entry), "Found when mips are not needed");
+            entry = onut::TextureCache::sEntry();
+
+            {
+                ofstream source("textureCacheSource.png", ios::binary);
+                source << "the source changed";
+            }
+            checkTest(!cache.find("textureCacheSource.png", false, entry), "Stale once the source changes");
+
+            remove(cache.getEntryFilename("textureCacheSource.png").c_str());
+            remove("textureCacheSource.png");
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("onut::RectPacker");
+    {
+        subTest("Packing");
+        {
+            onut::RectPacker packer(64, 64);
+            onut::RectPacker::sRect placed;
+            checkTest(packer.insert(64, 64, placed) && placed.x == 0 && placed.y == 0, "Exact fit");
+            checkTest(!packer.insert(1, 1, placed), "Full bin refuses more");
+            checkTest(packer.getOccupancy() == 1.f, "Full occupancy");
+
+            onut::RectPacker packer2(256, 256);
+            vector<onut::RectPacker::sRect> rects;
+            for (int i = 0; i < 200; ++i)
+            {
+                if (packer2.insert(4 + rand() % 28, 4 + rand() % 28, placed)) rects.push_back(placed);
+            }
+            bool isValid = true;
+            for (size_t i = 0; i < rects.size(); ++i)
+            {
+                auto& a = rects[i];
+                if (a.x + a.width > 256 || a.y + a.height > 256) isValid = false;
+                for (size_t j = i + 1; j < rects.size(); ++j)
+                {
+                    auto& b = rects[j];
+                    if (a.x < b.x + b.width && b.x < a.x + a.width &&
+                        a.y < b.y + b.height && b.y < a.y + a.height) isValid = false;
+                }
+            }
+            checkTest(isValid, "Rectangles are inside the bin and never overlap");
+
+            onut::AtlasRegion region;
+            region.uvs = {.5f, .25f, 1.f, .75f};
+            auto uvs = region.remap({0.f, .5f, .5f, 1.f});
+            checkTest(uvs.x == .5f && uvs.y == .5f && uvs.z == .75f && uvs.w == .75f, "Atlas region remaps local UVs");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Packing benchmark");
+        {
+            vector<pair<uint32_t, uint32_t>> sizes;
+            for (int i = 0; i < 1000; ++i)
+            {
+                sizes.push_back({8 + rand() % 120, 8 + rand() % 120});
+            }
+            sort(sizes.begin(), sizes.end(), [](const pair<uint32_t, uint32_t>& a, const pair<uint32_t, uint32_t>& b)
+            {
+                return max(a.first, a.second) > max(b.first, b.second);
+            });
+
+            vector<onut::RectPacker> pages;
+            benchmark("1000 random rects in 2048x2048 pages", 1, [&]
+            {
+                onut::RectPacker::sRect placed;
+                for (auto& size : sizes)
+                {
+                    bool isPlaced = false;
+                    for (auto& page : pages)
+                    {
+                        if (page.insert(size.first, size.second, placed))
+                        {
+                            isPlaced = true;
+                            break;
+                        }
+                    }
+                    if (!isPlaced)
+                    {
+                        pages.emplace_back(2048, 2048);
+                        pages.back().insert(size.first, size.second, placed);
+                    }
+                }
+            });
+            for (size_t i = 0; i < pages.size(); ++i)
+            {
+                cout << "            Page " << i << " occupancy: " << pages[i].getOccupancy() * 100.f << "%" << endl;
+            }
+            checkTest(pages.size() > 1 && pages[0].getOccupancy() > .9f, "First page is over 90% full");
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("Sprite sorting");
+    {
+        subTest("Radix sort");
+        {
+            vector<onut::sSortKey> keys, scratch;
+            for (uint32_t i = 0; i < 10000; ++i)
+            {
+                keys.push_back({(static_cast<uint64_t>(rand() % 50) << 32) | static_cast<uint64_t>(rand() % 7), i});
+            }
+            auto expected = keys;
+            stable_sort(expected.begin(), expected.end(), [](const onut::sSortKey& a, const onut::sSortKey& b)
+            {
+                return a.key < b.key;
+            });
+            onut::radixSort(keys, scratch);
+            bool isSame = true;
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                if (keys[i].key != expected[i].key || keys[i].index != expected[i].index) isSame = false;
+            }
+            checkTest(isSame, "Same order as stable_sort");
+
+            float depths[] = {-1000.f, -1.5f, -0.f, 0.f, .25f, 1.f, 3.f, 1e20f};
+            bool isOrdered = true;
+            for (int i = 1; i < 8; ++i)
+            {
+                if (onut::getSortableFloatBits(depths[i - 1]) > onut::getSortableFloatBits(depths[i])) isOrdered = false;
+            }
+            checkTest(isOrdered, "Sortable float bits keep the float order");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Batches in a UI scene");
+        {
+            // Each widget draws a panel, then 8 glyphs from 2 font pages, then an icon
+            vector<uint32_t> textures;
+            for (int widget = 0; widget < 500; ++widget)
+            {
+                textures.push_back(0);
+                for (int glyph = 0; glyph < 8; ++glyph) textures.push_back(1 + (glyph & 1));
+                textures.push_back(3);
+            }
+            auto countBatches = [&](const vector<onut::sSortKey>& keys)
+            {
+                int batchCount = 0;
+                uint32_t current = 0xffffffff;
+                for (auto& key : keys)
+                {
+                    if (textures[key.index] != current) ++batchCount;
+                    current = textures[key.index];
+                }
+                return batchCount;
+            };
+
+            vector<onut::sSortKey> keys, scratch;
+            for (uint32_t i = 0; i < textures.size(); ++i) keys.push_back({textures[i], i});
+            auto immediateCount = countBatches(keys);
+            benchmark("Sort 5000 sprites by texture", 100, [&]
+            {
+                for (uint32_t i = 0; i < textures.size(); ++i) keys[i] = {textures[i], i};
+                onut::radixSort(keys, scratch);
+            });
+            auto sortedCount = countBatches(keys);
+            cout << "            Batches: " << immediateCount << " immediate, " << sortedCount << " sorted by texture" << endl;
+            checkTest(sortedCount == 4, "One batch per texture");
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("Headless batching");
+    {
+        subTest("Sprite batches");
+        {
+            onut::RecordingRenderBackend backend(300);
+            onut::SpriteBatch spriteBatch(&backend);
+            auto pTexA = backend.createTexture({32, 32});
+            auto pTexB = backend.createTexture({16, 16});
+
+            spriteBatch.begin();
+            spriteBatch.drawRect(pTexA, {10, 20, 30, 40}, Color(1, 0, 0, 1));
+            spriteBatch.end();
+            auto& commands = backend.getCommands();
+            auto& vertices = backend.getVertices();
+            checkTest(backend.getDrawCallCount() == 1 && commands[0].pTexture == pTexA && commands[0].vertexCount == 4, "One rect is one draw of 4 vertices");
+            checkTest(vertices[0].position == Vector2(10, 20) && vertices[2].position == Vector2(40, 60) && vertices[2].texCoord == Vector2(1, 1), "Rect vertices");
+
+            backend.clear();
+            spriteBatch.begin();
+            spriteBatch.drawRect(nullptr, {0, 0, 1, 1});
+            spriteBatch.end();
+            checkTest(commands[0].pTexture == backend.getWhiteTexture(), "No texture uses the white one");
+
+            backend.clear();
+            spriteBatch.begin();
+            for (int i = 0; i < 100; ++i) spriteBatch.drawRect((i & 1) ? pTexB : pTexA, {0, 0, 1, 1});
+            spriteBatch.end();
+            checkTest(backend.getDrawCallCount() == 100, "Alternating textures draw once per sprite");
+
+            backend.clear();
+            spriteBatch.begin(onut::SpriteBatch::eBlendMode::PRE_MULT, onut::SpriteBatch::eSortMode::TEXTURE);
+            for (int i = 0; i < 100; ++i) spriteBatch.drawRect((i & 1) ? pTexB : pTexA, {static_cast<float>(i), 0, 1, 1});
+            spriteBatch.end();
+            checkTest(backend.getDrawCallCount() == 2, "Sorted by texture draws once per texture");
+            checkTest(commands[0].pTexture == pTexA && vertices[4].position.x == 2.f, "Call order is kept within a texture");
+
+            backend.clear();
+            spriteBatch.begin(onut::SpriteBatch::eBlendMode::PRE_MULT, onut::SpriteBatch::eSortMode::DEPTH_TEXTURE);
+            spriteBatch.setDepth(1.f);
+            spriteBatch.drawRect(pTexA, {0, 0, 1, 1});
+            spriteBatch.drawRect(pTexB, {0, 0, 1, 1});
+            spriteBatch.drawRect(pTexA, {0, 0, 1, 1});
+            spriteBatch.setDepth(-1.f);
+            spriteBatch.drawRect(pTexB, {0, 0, 1, 1});
+            spriteBatch.end();
+            checkTest(backend.getDrawCallCount() == 3 && commands[0].pTexture == pTexB && commands[1].vertexCount == 8, "Sorted by depth, then texture");
+
+            backend.clear();
+            spriteBatch.begin();
+            for (int i = 0; i < 700; ++i) spriteBatch.drawRect(pTexA, {0, 0, 1, 1});
+            spriteBatch.end();
+            checkTest(backend.getDrawCallCount() == 3 && commands[2].vertexCount == 100 * 4, "Full batches are flushed");
+
+            backend.clear();
+            backend.setScissor(true, {1, 2, 3, 4});
+            checkTest(commands.size() == 1 && commands[0].type == onut::RecordingRenderBackend::eCommandType::SCISSOR && commands[0].scissor.z == 3, "Scissor changes are recorded");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Primitive batches");
+        {
+            onut::RecordingRenderBackend backend(300, 10);
+            onut::PrimitiveBatch primitiveBatch(&backend);
+            primitiveBatch.begin(onut::ePrimitiveType::LINE_STRIP);
+            for (int i = 0; i < 15; ++i) primitiveBatch.draw(Vector2(static_cast<float>(i), 0));
+            primitiveBatch.end();
+            auto& commands = backend.getCommands();
+            auto& vertices = backend.getVertices();
+            checkTest(commands.size() == 2 && commands[0].primitiveType == onut::ePrimitiveType::LINE_STRIP, "Line strip split in 2 draws");
+            checkTest(commands[1].vertexCount == 6 && vertices[10].position.x == 9.f, "Second part starts from the last point");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Vertex generation benchmark");
+        {
+            onut::RecordingRenderBackend backend(300, 1200, false);
+            onut::SpriteBatch spriteBatch(&backend);
+            auto pTexA = backend.createTexture({32, 32});
+            auto pTexB = backend.createTexture({32, 32});
+            benchmark("100000 drawRect", 10, [&]
+            {
+                spriteBatch.begin();
+                for (int i = 0; i < 100000; ++i) spriteBatch.drawRect(pTexA, {static_cast<float>(i & 1023), 0, 32, 32});
+                spriteBatch.end();
+            });
+            benchmark("100000 rotated drawSprite", 10, [&]
+            {
+                spriteBatch.begin();
+                for (int i = 0; i < 100000; ++i) spriteBatch.drawSprite(pTexA, {static_cast<float>(i & 1023), 0}, Color::White, static_cast<float>(i), 1.f);
+                spriteBatch.end();
+            });
+            backend.clear();
+            benchmark("100000 drawRect, 2 textures sorted", 1, [&]
+            {
+                spriteBatch.begin(onut::SpriteBatch::eBlendMode::PRE_MULT, onut::SpriteBatch::eSortMode::TEXTURE);
+                for (int i = 0; i < 100000; ++i) spriteBatch.drawRect((i & 1) ? pTexB : pTexA, {static_cast<float>(i & 1023), 0, 32, 32});
+                spriteBatch.end();
+            });
+            cout << "            Draw calls: " << backend.getDrawCallCount() << endl;
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("Batched sprites");
+    {
+        onut::eSimdPath simdPaths[] = {onut::eSimdPath::SCALAR, onut::eSimdPath::SSE2, onut::eSimdPath::AVX2, onut::eSimdPath::NEON};
+        const char* simdPathNames[] = {"Scalar", "SSE2", "AVX2", "NEON"};
+        onut::RecordingRenderBackend backend(300);
+        onut::SpriteBatch spriteBatch(&backend);
+        auto pTexA = backend.createTexture({32, 16});
+        auto pTexB = backend.createTexture({8, 8});
+        vector<onut::SpriteInstance> instances(1003);
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            auto& instance = instances[i];
+            instance.pTexture = (i < 500) ? pTexA : pTexB;
+            instance.position = Vector2(static_cast<float>(i % 97), static_cast<float>(i / 7));
+            instance.rotation = static_cast<float>(i * 37 % 1440) - 720.f + .25f * static_cast<float>(i);
+            instance.scale = .5f + static_cast<float>(i % 5);
+            instance.uvs = Vector4(.1f * static_cast<float>(i % 3), .2f, .9f, .7f);
+            instance.color = Color(static_cast<float>(i % 2), .5f, .25f, 1.f);
+        }
+
+        subTest("Same quads as drawSpriteWithUVs");
+        {
+            spriteBatch.begin();
+            for (auto& instance : instances) spriteBatch.drawSpriteWithUVs(instance.pTexture, instance.position, instance.uvs, instance.color, instance.rotation, instance.scale);
+            spriteBatch.end();
+            auto reference = backend.getVertices();
+            backend.clear();
+
+            spriteBatch.begin();
+            spriteBatch.drawSprites(instances, onut::eSimdPath::SCALAR);
+            spriteBatch.end();
+            auto scalar = backend.getVertices();
+            auto& commands = backend.getCommands();
+            checkTest(commands.size() == 4 && commands[1].vertexCount == 200 * 4 && commands[2].pTexture == pTexB, "Batches split on texture and size");
+            float maxDiff = 0.f;
+            bool sameAttributes = scalar.size() == reference.size();
+            for (size_t i = 0; sameAttributes && i < scalar.size(); ++i)
+            {
+                maxDiff = std::max(maxDiff, (scalar[i].position - reference[i].position).Length());
+                sameAttributes = scalar[i].texCoord == reference[i].texCoord && scalar[i].color == reference[i].color;
+            }
+            checkTest(sameAttributes && maxDiff < .001f, "Positions within 0.001");
+
+            for (int i = 1; i < 4; ++i)
+            {
+                if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                backend.clear();
+                spriteBatch.begin();
+                spriteBatch.drawSprites(instances, simdPaths[i]);
+                spriteBatch.end();
+                auto& vertices = backend.getVertices();
+                checkTest(vertices.size() == scalar.size() && memcmp(vertices.data(), scalar.data(), sizeof(onut::sRenderVertex) * scalar.size()) == 0, string(simdPathNames[i]) + " is bit-exact with scalar");
+            }
+
+            backend.clear();
+            spriteBatch.begin(onut::SpriteBatch::eBlendMode::PRE_MULT, onut::SpriteBatch::eSortMode::TEXTURE);
+            spriteBatch.drawSprites(instances.data() + 400, 200);
+            spriteBatch.drawSprites(instances.data(), 400);
+            spriteBatch.end();
+            checkTest(backend.getDrawCallCount() == 3 && commands[0].vertexCount == 300 * 4 && commands[2].pTexture == pTexB, "Sorted modes take batches too");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Ties and signed zeros");
+        {
+            // Half quadrants round to even, and zero sized sprites at -0 keep the sign of every zero
+            float rotations[] = {0.f, -0.f, 45.f, 135.f, 225.f, -45.f, -135.f, 90.f, 180.f, 270.f, -90.f, -180.f, 315.f, 360.f, 405.f, 450.f};
+            vector<onut::SpriteInstance> zeros(16);
+            for (size_t i = 0; i < zeros.size(); ++i)
+            {
+                zeros[i].pTexture = pTexA;
+                zeros[i].position = Vector2(-0.f, -0.f);
+                zeros[i].uvs = Vector4(.5f, .5f, .5f, .5f);
+                zeros[i].rotation = rotations[i];
+            }
+            backend.clear();
+            spriteBatch.begin();
+            spriteBatch.drawSprites(zeros, onut::eSimdPath::SCALAR);
+            spriteBatch.end();
+            auto scalar = backend.getVertices();
+            for (int i = 1; i < 4; ++i)
+            {
+                if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                backend.clear();
+                spriteBatch.begin();
+                spriteBatch.drawSprites(zeros, simdPaths[i]);
+                spriteBatch.end();
+                auto& vertices = backend.getVertices();
+                checkTest(vertices.size() == scalar.size() && memcmp(vertices.data(), scalar.data(), sizeof(onut::sRenderVertex) * scalar.size()) == 0, string(simdPathNames[i]) + " is bit-exact with scalar");
+            }
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Quad generation benchmark");
+        {
+            onut::RecordingRenderBackend benchBackend(300, 1200, false);
+            onut::SpriteBatch benchBatch(&benchBackend);
+            auto pTexture = benchBackend.createTexture({32, 32});
+            vector<onut::SpriteInstance> particles(100000);
+            for (size_t i = 0; i < particles.size(); ++i)
+            {
+                particles[i].pTexture = pTexture;
+                particles[i].position = Vector2(static_cast<float>(i & 1023), static_cast<float>(i >> 10));
+                particles[i].rotation = static_cast<float>(i);
+                particles[i].scale = 1.f + static_cast<float>(i & 3);
+            }
+            auto printRate = [&](double ms)
+            {
+                cout << "            " << static_cast<int>(static_cast<double>(particles.size() * 4) / ms / 1000.0) << " M vertices/s" << endl;
+            };
+            printRate(benchmark("100000 drawSprite calls", 10, [&]
+            {
+                benchBatch.begin();
+                for (auto& particle : particles) benchBatch.drawSprite(particle.pTexture, particle.position, particle.color, particle.rotation, particle.scale);
+                benchBatch.end();
+            }));
+            for (int i = 0; i < 4; ++i)
+            {
+                if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                printRate(benchmark(string(simdPathNames[i]) + " drawSprites", 10, [&]
+                {
+                    benchBatch.begin();
+                    benchBatch.drawSprites(particles, simdPaths[i]);
+                    benchBatch.end();
+                }));
+            }
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("Multi-threaded sprite recording");
+    {
+        onut::RecordingRenderBackend backend(300);
+        auto pTexA = backend.createTexture({32, 32});
+        auto pTexB = backend.createTexture({16, 16});
+        auto recordSprites = [&](onut::SpriteBatch& spriteBatch, int first, int count)
+        {
+            for (int i = first; i < first + count; ++i)
+            {
+                auto pTexture = ((i / 50) & 1) ? pTexB : pTexA;
+                spriteBatch.drawSprite(pTexture, Vector2(static_cast<float>(i & 1023), static_cast<float>(i >> 10)), Color::White, static_cast<float>(i), 1.f);
+            }
+        };
+
+        subTest("Same result as one thread");
+        {
+            onut::SpriteBatch spriteBatch(&backend);
+            spriteBatch.begin();
+            recordSprites(spriteBatch, 0, 4000);
+            spriteBatch.end();
+            auto expectedCommands = backend.getCommands();
+            auto expectedVertices = backend.getVertices();
+            backend.clear();
+
+            vector<onut::SpriteCommandList> commandLists(4, onut::SpriteCommandList(&backend));
+            vector<future<void>> jobs;
+            for (int i = 0; i < 4; ++i)
+            {
+                jobs.push_back(async(launch::async, [&, i]
+                {
+                    onut::SpriteBatch listBatch(&commandLists[i]);
+                    listBatch.begin();
+                    recordSprites(listBatch, i * 1000, 1000);
+                    listBatch.end();
+                }));
+            }
+            for (auto& job : jobs) job.wait();
+            checkTest(commandLists[1].getSpriteCount() == 1000 && commandLists[1].getRuns().size() == 20, "Lists keep one run per texture change");
+
+            spriteBatch.begin();
+            for (auto& commandList : commandLists) spriteBatch.draw(commandList);
+            spriteBatch.end();
+            auto& commands = backend.getCommands();
+            auto& vertices = backend.getVertices();
+            bool sameCommands = commands.size() == expectedCommands.size();
+            for (size_t i = 0; sameCommands && i < commands.size(); ++i)
+            {
+                sameCommands = commands[i].pTexture == expectedCommands[i].pTexture && commands[i].vertexCount == expectedCommands[i].vertexCount;
+            }
+            checkTest(sameCommands, "Same batches");
+            checkTest(vertices.size() == expectedVertices.size() && memcmp(vertices.data(), expectedVertices.data(), sizeof(onut::sRenderVertex) * vertices.size()) == 0, "Same vertices");
+
+            commandLists[0].clear();
+            checkTest(commandLists[0].getSpriteCount() == 0 && commandLists[0].getRuns().empty(), "Lists can be reused");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Scaling benchmark");
+        {
+            onut::RecordingRenderBackend benchBackend(300, 1200, false);
+            onut::SpriteBatch spriteBatch(&benchBackend);
+            const int spriteCount = 400000;
+            auto maxThreadCount = max(1, static_cast<int>(thread::hardware_concurrency()));
+            for (int threadCount = 1; threadCount <= maxThreadCount; threadCount *= 2)
+            {
+                vector<onut::SpriteCommandList> commandLists(threadCount, onut::SpriteCommandList(&benchBackend));
+                stringstream ss;
+                ss << spriteCount << " sprites on " << threadCount << " thread(s)";
+                benchmark(ss.str(), 5, [&]
+                {
+                    vector<future<void>> jobs;
+                    for (int i = 0; i < threadCount; ++i)
+                    {
+                        jobs.push_back(async(launch::async, [&, i]
+                        {
+                            auto first = spriteCount * i / threadCount;
+                            auto last = spriteCount * (i + 1) / threadCount;
+                            commandLists[i].clear();
+                            onut::SpriteBatch listBatch(&commandLists[i]);
+                            listBatch.begin();
+                            recordSprites(listBatch, first, last - first);
+                            listBatch.end();
+                        }));
+                    }
+                    for (auto& job : jobs) job.wait();
+                    spriteBatch.begin();
+                    for (auto& commandList : commandLists) spriteBatch.draw(commandList);
+                    spriteBatch.end();
+                    benchBackend.clear();
+                });
+            }
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("onut::DynamicBufferRing");
+    {
+        subTest("Offsets");
+        {
+            onut::DynamicBufferRing ring(100);
+            onut::DynamicBufferRing::eMapMode mapMode;
+            checkTest(ring.reserve(40, mapMode) == 0 && mapMode == onut::DynamicBufferRing::eMapMode::DISCARD, "First map discards");
+            ring.commit(30);
+            checkTest(ring.reserve(40, mapMode) == 30 && mapMode == onut::DynamicBufferRing::eMapMode::NO_OVERWRITE, "Appends after what was committed");
+            ring.commit(40);
+            checkTest(ring.reserve(30, mapMode) == 70 && mapMode == onut::DynamicBufferRing::eMapMode::NO_OVERWRITE, "Fills up to the end");
+            ring.commit(0);
+            checkTest(ring.reserve(31, mapMode) == 0 && mapMode == onut::DynamicBufferRing::eMapMode::DISCARD && ring.getWrapCount() == 1, "Wraps with a discard when it doesn't fit");
+            ring.commit(31);
+            checkTest(ring.getOffset() == 31, "Offset after wrapping");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Sprite frame benchmark");
+        {
+            // 10000 sprites, texture changing every 500. Legacy is the old 300 sprites buffer discarded on every map
+            const uint32_t spriteCount = 10000;
+            const uint32_t spritesPerTexture = 500;
+            uint32_t capacities[] = {300, 4096, 32768};
+            uint32_t maxBatches[] = {300, 1024, 8192};
+            for (int i = 0; i < 3; ++i)
+            {
+                onut::DynamicBufferRing ring(capacities[i] * 4);
+                vector<onut::sRenderVertex> buffer(ring.getCapacity());
+                onut::sRenderVertex vertex = {Vector2(1, 2), Vector2(0, 1), Color::White};
+                size_t mapCount = 0;
+                size_t discardCount = 0;
+                stringstream ss;
+                ss << "Capacity " << capacities[i] << ", batches of " << maxBatches[i];
+                const int frameCount = 20;
+                benchmark(ss.str(), frameCount, [&]
+                {
+                    onut::DynamicBufferRing::eMapMode mapMode;
+                    uint32_t written = 0;
+                    while (written < spriteCount)
+                    {
+                        ++mapCount;
+                        auto offset = ring.reserve(maxBatches[i] * 4, mapMode);
+                        if (mapMode == onut::DynamicBufferRing::eMapMode::DISCARD) ++discardCount;
+                        auto textureEnd = (written / spritesPerTexture + 1) * spritesPerTexture;
+                        auto batchCount = min(maxBatches[i], textureEnd - written);
+                        fill(buffer.begin() + offset, buffer.begin() + offset + batchCount * 4, vertex);
+                        ring.commit(batchCount * 4);
+                        written += batchCount;
+                    }
+                });
+                cout << "            " << mapCount / frameCount << " maps, " << discardCount / frameCount << " discards per frame" << endl;
+            }
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("Packed sprites");
+    {
+        onut::RecordingRenderBackend backend(300);
+        auto pTexture = backend.createTexture({32, 16});
+        vector<onut::SpriteInstance> instances(1003);
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            auto& instance = instances[i];
+            instance.pTexture = pTexture;
+            instance.position = Vector2(static_cast<float>(i % 97), static_cast<float>(i / 7));
+            instance.rotation = static_cast<float>(i * 37 % 1440) - 720.f;
+            instance.scale = .5f + static_cast<float>(i % 5);
+            instance.uvs = Vector4(.1f * static_cast<float>(i % 3), .2f, .9f, .7f);
+            instance.color = Color(static_cast<float>(i % 3) * .5f - .2f, static_cast<float>(i % 256) / 255.f, .25f, 1.5f);
+        }
+
+        subTest("Packing");
+        {
+            vector<onut::sPackedSprite> scalar(instances.size());
+            onut::packSprites(instances.data(), instances.size(), pTexture->getSizef(), scalar.data(), onut::eSimdPath::SCALAR);
+            checkTest(scalar[0].color == 0xff400000 && scalar[1].color == 0xff40014c, "Colors clamped and rounded to RGBA8");
+            checkTest((scalar[1].halfSize - Vector2(19.2f, 6.f)).Length() < .0001f && scalar[1].uvs == instances[1].uvs, "Half size includes scale and uvs");
+
+            vector<onut::sPackedSprite> packed(instances.size());
+            onut::packSprites(instances.data(), instances.size(), pTexture->getSizef(), packed.data(), onut::eSimdPath::SSE2);
+            checkTest(memcmp(packed.data(), scalar.data(), sizeof(onut::sPackedSprite) * scalar.size()) == 0, "Vectorized is bit-exact with scalar");
+
+            // What the vertex shader does, against the quads
+            onut::SpriteBatch spriteBatch(&backend);
+            spriteBatch.begin();
+            spriteBatch.drawSprites(instances);
+            spriteBatch.end();
+            auto& vertices = backend.getVertices();
+            Vector2 corners[4] = {{-1, -1}, {-1, 1}, {1, 1}, {1, -1}};
+            float maxDiff = 0.f;
+            for (size_t i = 0; i < scalar.size(); ++i)
+            {
+                auto& sprite = scalar[i];
+                Vector2 right(cos(sprite.rotation) * sprite.halfSize.x, sin(sprite.rotation) * sprite.halfSize.x);
+                Vector2 down(-sin(sprite.rotation) * sprite.halfSize.y, cos(sprite.rotation) * sprite.halfSize.y);
+                for (int k = 0; k < 4; ++k)
+                {
+                    auto position = sprite.position + right * corners[k].x + down * corners[k].y;
+                    maxDiff = max(maxDiff, (position - vertices[i * 4 + k].position).Length());
+                }
+            }
+            checkTest(maxDiff < .001f, "Expands to the same quads");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Instanced drawing");
+        {
+            backend.clear();
+            backend.setMaxPackedSpriteCount(400);
+            onut::SpriteBatch spriteBatch(&backend);
+            spriteBatch.begin();
+            spriteBatch.drawRect(pTexture, {0, 0, 1, 1});
+            spriteBatch.drawSprites(instances);
+            spriteBatch.drawRect(pTexture, {0, 0, 1, 1});
+            spriteBatch.end();
+            auto& commands = backend.getCommands();
+            checkTest(commands.size() == 5 && commands[0].type == onut::RecordingRenderBackend::eCommandType::SPRITES &&
+                      commands[1].type == onut::RecordingRenderBackend::eCommandType::PACKED_SPRITES && commands[1].vertexCount == 400 &&
+                      commands[3].vertexCount == 203 && commands[4].type == onut::RecordingRenderBackend::eCommandType::SPRITES, "Drawn in order, split at the max");
+            checkTest(backend.getPackedSprites().size() == instances.size() && abs(backend.getPackedSprites()[500].rotation - DirectX::XMConvertToRadians(instances[500].rotation)) < .00001f, "One record per sprite");
+
+            backend.clear();
+            spriteBatch.begin(onut::SpriteBatch::eBlendMode::PRE_MULT, onut::SpriteBatch::eSortMode::DEPTH);
+            spriteBatch.drawSprites(instances);
+            spriteBatch.end();
+            checkTest(backend.getPackedSprites().empty() && backend.getVertices().size() == instances.size() * 4, "Sorted modes still use quads");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Write bandwidth benchmark");
+        {
+            onut::RecordingRenderBackend benchBackend(8192, 1200, false);
+            onut::SpriteBatch spriteBatch(&benchBackend);
+            vector<onut::SpriteInstance> particles(100000);
+            for (size_t i = 0; i < particles.size(); ++i)
+            {
+                particles[i].pTexture = pTexture;
+                particles[i].position = Vector2(static_cast<float>(i & 1023), static_cast<float>(i >> 10));
+                particles[i].rotation = static_cast<float>(i);
+            }
+            benchmark("100000 sprites as quads, 12.8 MB", 10, [&]
+            {
+                spriteBatch.begin();
+                spriteBatch.drawSprites(particles);
+                spriteBatch.end();
+            });
+            benchBackend.setMaxPackedSpriteCount(8192);
+            benchmark("100000 sprites packed, 4 MB", 10, [&]
+            {
+                spriteBatch.begin();
+                spriteBatch.drawSprites(particles);
+                spriteBatch.end();
+            });
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("Static sprite batches");
+    {
+        // 64x64 tiles of 16 pixels, in regions of 256: 4x4 regions of 256 tiles
+        onut::RecordingRenderBackend backend(300);
+        auto pTexA = backend.createTexture({16, 16});
+        auto pTexB = backend.createTexture({16, 16});
+        auto recordTiles = [&](onut::SpriteCommandList& commandList, const Rect& area)
+        {
+            onut::SpriteBatch listBatch(&commandList);
+            listBatch.begin();
+            for (int y = 0; y < 64; ++y)
+            {
+                for (int x = 0; x < 64; ++x)
+                {
+                    Rect tile(static_cast<float>(x * 16), static_cast<float>(y * 16), 16, 16);
+                    auto centerX = tile.x + 8.f;
+                    auto centerY = tile.y + 8.f;
+                    if (centerX < area.x || centerY < area.y || centerX >= area.x + area.z || centerY >= area.y + area.w) continue;
+                    listBatch.drawRect(((x + y) & 1) ? pTexB : pTexA, tile);
+                }
+            }
+            listBatch.end();
+        };
+        onut::StaticSpriteBatch staticBatch(&backend, 256.f);
+        onut::SpriteCommandList commandList(&backend);
+        recordTiles(commandList, {0, 0, 1024, 1024});
+        staticBatch.add(commandList);
+        onut::SpriteBatch spriteBatch(&backend);
+
+        subTest("Recording");
+        {
+            checkTest(staticBatch.getSpriteCount() == 4096 && staticBatch.getRegionCount() == 16, "Sprites split in regions");
+            spriteBatch.begin();
+            staticBatch.draw(spriteBatch);
+            spriteBatch.end();
+            checkTest(backend.getVertices().size() == 4096 * 4, "Every sprite drawn");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Transform and scissor");
+        {
+            backend.clear();
+            spriteBatch.begin();
+            staticBatch.draw(spriteBatch, Matrix::CreateTranslation(100, 50, 0), {100, 50, 200, 200});
+            spriteBatch.end();
+            auto& commands = backend.getCommands();
+            checkTest(commands.front().type == onut::RecordingRenderBackend::eCommandType::SCISSOR && commands.front().scissorEnabled &&
+                      commands.back().type == onut::RecordingRenderBackend::eCommandType::SCISSOR && !commands.back().scissorEnabled, "Scissor set around the draw");
+            checkTest(backend.getVertices().size() == 256 * 4, "Only the visible region drawn");
+            checkTest(backend.getVertices()[0].position == Vector2(100, 50), "Transform applied");
+
+            backend.clear();
+            spriteBatch.begin();
+            spriteBatch.setScissor(true, {0, 0, 150, 150});
+            staticBatch.draw(spriteBatch, Matrix::CreateTranslation(100, 50, 0), {100, 50, 200, 200});
+            spriteBatch.end();
+            checkTest(commands.size() >= 3 && commands[1].type == onut::RecordingRenderBackend::eCommandType::SCISSOR && commands[1].scissor == Rect(100, 50, 50, 100) &&
+                      commands.back().type == onut::RecordingRenderBackend::eCommandType::SCISSOR && commands.back().scissorEnabled &&
+                      commands.back().scissor == Rect(0, 0, 150, 150) && spriteBatch.getScissor() == Rect(0, 0, 150, 150), "Within the batch's scissor, put back after");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Partial invalidation");
+        {
+            auto cleared = staticBatch.invalidate({300, 300, 10, 300});
+            checkTest(cleared == Rect(256, 256, 256, 512) && staticBatch.getSpriteCount() == 4096 - 512, "Touched regions cleared");
+            onut::SpriteCommandList updateList(&backend);
+            recordTiles(updateList, cleared);
+            staticBatch.add(updateList);
+            checkTest(staticBatch.getSpriteCount() == 4096 && staticBatch.getRegionCount() == 16, "Recorded again");
+
+            cleared = staticBatch.invalidate({0, 0, 256, 256});
+            checkTest(cleared == Rect(0, 0, 256, 256) && staticBatch.getSpriteCount() == 4096 - 256, "Rect ending on a region boundary only clears its region");
+            onut::SpriteCommandList cornerList(&backend);
+            recordTiles(cornerList, cleared);
+            staticBatch.add(cornerList);
+            checkTest(staticBatch.getSpriteCount() == 4096 && staticBatch.getRegionCount() == 16, "Corner recorded again");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Static vs resubmitted benchmark");
+        {
+            onut::RecordingRenderBackend benchBackend(300, 1200, false);
+            onut::SpriteBatch benchBatch(&benchBackend);
+            benchmark("4096 tiles with drawRect", 100, [&]
+            {
+                benchBatch.begin();
+                for (int y = 0; y < 64; ++y)
+                {
+                    for (int x = 0; x < 64; ++x)
+                    {
+                        benchBatch.drawRect(((x + y) & 1) ? pTexB : pTexA, Rect(static_cast<float>(x * 16), static_cast<float>(y * 16), 16, 16));
+                    }
+                }
+                benchBatch.end();
+            });
+            benchmark("4096 static tiles", 100, [&]
+            {
+                benchBatch.begin();
+                staticBatch.draw(benchBatch);
+                benchBatch.end();
+            });
+            benchmark("4096 static tiles, 300x300 view", 100, [&]
+            {
+                benchBatch.begin();
+                staticBatch.draw(benchBatch, Matrix::Identity, {100, 100, 300, 300});
+                benchBatch.end();
+            });
+            benchBackend.clear();
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("Render statistics");
+    {
+        onut::RecordingRenderBackend backend(300);
+        auto pTexA = backend.createTexture({16, 16});
+        auto pTexB = backend.createTexture({16, 16});
+        auto& stats = *backend.getStats();
+
+        subTest("Counters");
+        {
+            onut::SpriteBatch spriteBatch(&backend);
+            onut::PrimitiveBatch primitiveBatch(&backend);
+            spriteBatch.begin();
+            spriteBatch.drawRect(pTexA, {0, 0, 16, 16});
+            spriteBatch.drawRect(pTexA, {16, 0, 16, 16});
+            spriteBatch.drawRect(pTexB, {32, 0, 16, 16});
+            spriteBatch.setScissor(true, {0, 0, 32, 32});
+            spriteBatch.drawRect(pTexB, {0, 16, 16, 16});
+            spriteBatch.end();
+            primitiveBatch.begin(onut::ePrimitiveType::TRIANGLES);
+            primitiveBatch.draw({0, 0});
+            primitiveBatch.draw({1, 0});
+            primitiveBatch.draw({0, 1});
+            primitiveBatch.end();
+            stats.nextFrame();
+
+            auto& frame = stats.getFrame();
+            checkTest(frame.spriteBatchCount == 1 && frame.spriteCount == 4 && frame.spriteFlushCount == 3, "Sprites and flushes");
+            checkTest(frame.textureSwitchCount == 1, "Texture switches");
+            checkTest(frame.scissorChangeCount == 1, "Scissor changes");
+            checkTest(frame.primitiveBatchCount == 1 && frame.primitiveFlushCount == 1, "Primitive flushes");
+            checkTest(frame.vertexCount == 4 * 4 + 3, "Vertices");
+            checkTest(frame.getDrawCallCount() == backend.getDrawCallCount(), "Draw calls match the backend");
+            checkTest(stats.getCurrentFrame().spriteCount == 0, "Next frame starts from 0");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Command lists");
+        {
+            onut::SpriteCommandList commandList(&backend);
+            onut::SpriteBatch listBatch(&commandList);
+            listBatch.begin();
+            listBatch.drawRect(pTexA, {0, 0, 16, 16});
+            listBatch.end();
+            checkTest(stats.getCurrentFrame().spriteCount == 0, "Recording on a list is not counted");
+            onut::SpriteBatch spriteBatch(&backend);
+            spriteBatch.begin();
+            spriteBatch.draw(commandList);
+            spriteBatch.end();
+            checkTest(stats.getCurrentFrame().spriteCount == 1, "Counted when drawn");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("History");
+        {
+            onut::RenderStats history(4);
+            for (uint32_t i = 1; i <= 6; ++i)
+            {
+                history.getCurrentFrame().spriteCount = i;
+                history.nextFrame();
+            }
+            checkTest(history.getFrameCount() == 4, "Ring buffer size");
+            checkTest(history.getFrame(0).spriteCount == 6 && history.getFrame(3).spriteCount == 3, "Frames from the last");
+            checkTest(history.getPeak().spriteCount == 6, "Peak");
+            stringstream ss;
+            history.dump(ss);
+            auto csv = ss.str();
+            checkTest(count(csv.begin(), csv.end(), '\n') == 5, "CSV dump");
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("Primitive tessellation");
+    {
+        onut::RecordingRenderBackend backend(300, 1200);
+        auto getArea = [&]
+        {
+            float area = 0.f;
+            auto& vertices = backend.getVertices();
+            for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+            {
+                auto& a = vertices[i].position;
+                auto& b = vertices[i + 1].position;
+                auto& c = vertices[i + 2].position;
+                area += std::abs((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x)) * .5f;
+            }
+            return area;
+        };
+        onut::PrimitiveBatch primitiveBatch(&backend);
+
+        subTest("Lines");
+        {
+            vector<Vector2> points;
+            for (int i = 0; i < 2002; ++i)
+            {
+                points.push_back(Vector2(static_cast<float>(rand() % 1000), static_cast<float>(rand() % 1000)));
+            }
+            points[11] = points[10]; // Empty segment
+            primitiveBatch.begin(onut::ePrimitiveType::TRIANGLES);
+            primitiveBatch.drawLines(points, 2.f, Color::White, onut::eSimdPath::SCALAR);
+            primitiveBatch.end();
+            auto scalarVertices = backend.getVertices();
+            bool splitBetweenTriangles = true;
+            for (auto& command : backend.getCommands()) splitBetweenTriangles &= (command.vertexCount % 3 == 0);
+            checkTest(scalarVertices.size() == 1001 * 6 && backend.getDrawCallCount() == 6 && splitBetweenTriangles, "Split in whole triangles");
+
+            onut::eSimdPath simdPaths[] = {onut::eSimdPath::SSE2, onut::eSimdPath::AVX2, onut::eSimdPath::NEON};
+            const char* simdPathNames[] = {"SSE2", "AVX2", "NEON"};
+            for (int i = 0; i < 3; ++i)
+            {
+                if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                backend.clear();
+                primitiveBatch.begin(onut::ePrimitiveType::TRIANGLES);
+                primitiveBatch.drawLines(points, 2.f, Color::White, simdPaths[i]);
+                primitiveBatch.end();
+                checkTest(backend.getVertices().size() == scalarVertices.size() &&
+                          memcmp(backend.getVertices().data(), scalarVertices.data(), sizeof(onut::sRenderVertex) * scalarVertices.size()) == 0,
+                          string(simdPathNames[i]) + " same as scalar");
+            }
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Polylines");
+        {
+            vector<Vector2> square = {{0, 0}, {100, 0}, {100, 100}, {0, 100}};
+            onut::eLineJoin joins[] = {onut::eLineJoin::NONE, onut::eLineJoin::BEVEL, onut::eLineJoin::MITER};
+            size_t triangleCounts[] = {8, 12, 16};
+            float areas[] = {4000.f, 4050.f, 4100.f}; // Segments overlap at the inside of the corners
+            for (int i = 0; i < 3; ++i)
+            {
+                backend.clear();
+                primitiveBatch.begin(onut::ePrimitiveType::TRIANGLES);
+                primitiveBatch.drawPolyline(square, 10.f, Color::White, joins[i], true);
+                primitiveBatch.end();
+                checkTest(backend.getVertices().size() == triangleCounts[i] * 3 && std::abs(getArea() - areas[i]) < .01f, "Closed square, join " + to_string(i));
+            }
+            backend.clear();
+            primitiveBatch.begin(onut::ePrimitiveType::TRIANGLES);
+            primitiveBatch.drawPolyline(square, 10.f, Color::White, onut::eLineJoin::ROUND);
+            primitiveBatch.end();
+            bool insideRadius = true;
+            for (auto& vertex : backend.getVertices())
+            {
+                if (vertex.position.x > 100.f && vertex.position.y < 0.f) insideRadius &= Vector2::Distance(vertex.position, {100, 0}) < 5.001f;
+            }
+            checkTest(insideRadius, "Round join");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Circles and polygons");
+        {
+            backend.clear();
+            primitiveBatch.begin(onut::ePrimitiveType::TRIANGLES);
+            primitiveBatch.drawCircle({0, 0}, 100.f);
+            primitiveBatch.end();
+            checkTest(std::abs(getArea() - DirectX::XM_PI * 100.f * 100.f) < 150.f, "Filled circle");
+
+            backend.clear();
+            primitiveBatch.begin(onut::ePrimitiveType::TRIANGLES);
+            primitiveBatch.drawCircleOutline({0, 0}, 100.f, 10.f);
+            primitiveBatch.end();
+            checkTest(std::abs(getArea() - DirectX::XM_PI * (105.f * 105.f - 95.f * 95.f)) < 50.f, "Outlined circle");
+
+            vector<Vector2> shape = {{0, 0}, {10, 0}, {10, 2}, {2, 2}, {2, 10}, {0, 10}};
+            for (int winding = 0; winding < 2; ++winding)
+            {
+                backend.clear();
+                primitiveBatch.begin(onut::ePrimitiveType::TRIANGLES);
+                primitiveBatch.drawPolygon(shape);
+                primitiveBatch.end();
+                checkTest(backend.getVertices().size() == 4 * 3 && std::abs(getArea() - 36.f) < .001f, winding ? "Concave, clockwise" : "Concave, counter clockwise");
+                reverse(shape.begin(), shape.end());
+            }
+            cout << setColor(7) << endl;
+        }
+
+        subTest("100k segments benchmark");
+        {
+            onut::RecordingRenderBackend benchBackend(300, 12000, false);
+            onut::PrimitiveBatch benchBatch(&benchBackend);
+            vector<Vector2> points;
+            float angle = 0.f;
+            Vector2 position;
+            for (int i = 0; i < 200000; ++i)
+            {
+                angle += static_cast<float>(rand() % 100 - 50) * .005f;
+                position += Vector2(std::cos(angle), std::sin(angle)) * 5.f;
+                points.push_back(position);
+            }
+            benchmark("Vertex by vertex, LINES", 20, [&]
+            {
+                benchBatch.begin(onut::ePrimitiveType::LINES);
+                for (auto& point : points) benchBatch.draw(point);
+                benchBatch.end();
+            });
+            onut::eSimdPath simdPaths[] = {onut::eSimdPath::SCALAR, onut::eSimdPath::SSE2, onut::eSimdPath::AVX2, onut::eSimdPath::NEON};
+            const char* simdPathNames[] = {"Scalar", "SSE2", "AVX2", "NEON"};
+            for (int i = 0; i < 4; ++i)
+            {
+                if (!onut::isSimdPathSupported(simdPaths[i])) continue;
+                benchmark(string("drawLines ") + simdPathNames[i], 20, [&]
+                {
+                    benchBatch.begin(onut::ePrimitiveType::TRIANGLES);
+                    benchBatch.drawLines(points, 2.f, Color::White, simdPaths[i]);
+                    benchBatch.end();
+                });
+            }
+            const char* joinNames[] = {"none", "bevel", "miter", "round"};
+            for (int i = 0; i < 4; ++i)
+            {
+                benchmark(string("drawPolyline, join ") + joinNames[i], 20, [&]
+                {
+                    benchBatch.begin(onut::ePrimitiveType::TRIANGLES);
+                    benchBatch.drawPolyline(points.data(), 100001, 2.f, Color::White, static_cast<onut::eLineJoin>(i));
+                    benchBatch.end();
+                });
+            }
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("Sprite clipping");
+    {
+        onut::RecordingRenderBackend backend(300);
+        auto pTexA = backend.createTexture({16, 16});
+        auto pTexB = backend.createTexture({16, 16});
+        onut::SpriteBatch spriteBatch(&backend);
+        auto countScissors = [&]
+        {
+            size_t count = 0;
+            for (auto& command : backend.getCommands()) count += (command.type == onut::RecordingRenderBackend::eCommandType::SCISSOR) ? 1 : 0;
+            return count;
+        };
+
+        subTest("Culling and cutting");
+        {
+            spriteBatch.begin();
+            spriteBatch.setClip(true, {0, 0, 100, 100});
+            spriteBatch.drawRect(pTexA, {10, 10, 20, 20});
+            spriteBatch.drawRect(pTexA, {200, 10, 20, 20});
+            spriteBatch.drawRectWithUVs(pTexA, {50, 50, 100, 100}, {0, 0, 1, 1});
+            spriteBatch.setClip(false, {});
+            spriteBatch.end();
+            auto& vertices = backend.getVertices();
+            checkTest(vertices.size() == 8 && backend.getDrawCallCount() == 1 && countScissors() == 0, "Culled outside, no scissor");
+            checkTest(vertices[4].position == Vector2(50, 50) && vertices[6].position == Vector2(100, 100), "Cut to the clip");
+            checkTest(vertices[4].texCoord == Vector2(0, 0) && vertices[6].texCoord == Vector2(.5f, .5f), "Texture coordinates follow");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Scrolling list");
+        {
+            // Items of a list clipped to its view, as UIContext::pushClip does for each one
+            backend.clear();
+            spriteBatch.begin();
+            for (int i = 0; i < 100; ++i)
+            {
+                spriteBatch.setClip(true, {0, 0, 200, 300});
+                spriteBatch.drawRect((i & 1) ? pTexB : pTexA, {0, static_cast<float>(i * 32 - 50), 200, 32});
+                spriteBatch.setClip(false, {});
+                spriteBatch.drawRect((i & 1) ? pTexB : pTexA, {200, static_cast<float>(i * 32), 16, 16});
+            }
+            spriteBatch.end();
+            checkTest(countScissors() == 0, "No scissor for axis aligned sprites");
+            checkTest(backend.getVertices().size() == (10 + 100) * 4, "Hidden items culled");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Rotated sprites");
+        {
+            backend.clear();
+            spriteBatch.begin();
+            spriteBatch.setClip(true, {0, 0, 100, 100});
+            spriteBatch.drawSprite(pTexA, {50, 50}, Color::White, 45.f, 2.f); // Inside
+            spriteBatch.drawSprite(pTexA, {100, 50}, Color::White, 45.f); // On the edge
+            spriteBatch.drawSprite(pTexA, {90, 50}, Color::White, 45.f);
+            spriteBatch.setClip(false, {});
+            spriteBatch.drawSprite(pTexA, {300, 50}, Color::White, 45.f);
+            spriteBatch.end();
+            auto& commands = backend.getCommands();
+            checkTest(commands.size() == 5 &&
+                      commands[0].type == onut::RecordingRenderBackend::eCommandType::SPRITES && commands[0].vertexCount == 4 &&
+                      commands[1].type == onut::RecordingRenderBackend::eCommandType::SCISSOR && commands[1].scissorEnabled &&
+                      commands[2].vertexCount == 8 &&
+                      commands[3].type == onut::RecordingRenderBackend::eCommandType::SCISSOR && !commands[3].scissorEnabled &&
+                      commands[4].vertexCount == 4, "Scissor only around the ones crossing the edge");
+
+            backend.clear();
+            spriteBatch.begin();
+            spriteBatch.setScissor(true, {50, 0, 400, 400});
+            spriteBatch.setClip(true, {0, 0, 100, 100});
+            spriteBatch.drawSprite(pTexA, {90, 50}, Color::White, 45.f);
+            spriteBatch.setClip(false, {});
+            spriteBatch.drawSprite(pTexA, {300, 50}, Color::White, 45.f);
+            spriteBatch.end();
+            checkTest(commands.size() == 5 &&
+                      commands[1].type == onut::RecordingRenderBackend::eCommandType::SCISSOR && commands[1].scissor == Rect(50, 0, 50, 100) &&
+                      commands[3].type == onut::RecordingRenderBackend::eCommandType::SCISSOR && commands[3].scissorEnabled && commands[3].scissor == Rect(50, 0, 400, 400) &&
+                      commands[4].vertexCount == 4, "Within setScissor()'s, which is put back after");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Sorted");
+        {
+            backend.clear();
+            spriteBatch.begin(onut::SpriteBatch::eBlendMode::PRE_MULT, onut::SpriteBatch::eSortMode::TEXTURE);
+            for (int i = 0; i < 10; ++i)
+            {
+                spriteBatch.setClip(true, {static_cast<float>(i * 100), 0, 50, 50});
+                spriteBatch.drawRect((i & 1) ? pTexB : pTexA, {static_cast<float>(i * 100), 0, 100, 100});
+            }
+            spriteBatch.setClip(false, {});
+            spriteBatch.end();
+            bool cutToOwnClip = true;
+            for (auto& vertex : backend.getVertices())
+            {
+                auto x = fmodf(vertex.position.x, 100.f);
+                cutToOwnClip &= (x <= 50.f && vertex.position.y <= 50.f);
+            }
+            checkTest(backend.getDrawCallCount() == 2 && backend.getVertices().size() == 40 && cutToOwnClip, "Each sprite keeps its clip");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Clip changes benchmark");
+        {
+            onut::RecordingRenderBackend benchBackend(300, 1200, false);
+            onut::SpriteBatch benchBatch(&benchBackend);
+            benchmark("1000 clipped items, end/setScissor/begin", 100, [&]
+            {
+                benchBatch.begin();
+                for (int i = 0; i < 1000; ++i)
+                {
+                    benchBatch.end();
+                    benchBackend.setScissor(true, {0, 0, 200, 300});
+                    benchBatch.begin();
+                    benchBatch.drawRect(pTexA, {0, static_cast<float>(i * 32 - 50), 200, 32});
+                }
+                benchBatch.end();
+            });
+            benchmark("1000 clipped items, setClip", 100, [&]
+            {
+                benchBatch.begin();
+                for (int i = 0; i < 1000; ++i)
+                {
+                    benchBatch.setClip(true, {0, 0, 200, 300});
+                    benchBatch.drawRect(pTexA, {0, static_cast<float>(i * 32 - 50), 200, 32});
+                }
+                benchBatch.setClip(false, {});
+                benchBatch.end();
+            });
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("Tiled map chunks");
+    {
+        // 40x40 tiles of 16 pixels, so the last chunks are partial. Every 7th tile is empty
+        auto writeMap = [](const string& filename, int size)
+        {
+            vector<uint32_t> tileIds(size * size);
+            for (int i = 0; i < size * size; ++i)
+            {
+                tileIds[i] = (i % 7) ? 1 + (i % 16) : 0;
+            }
+            ofstream file(filename);
+            file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+            file << "<map version=\"1.0\" orientation=\"orthogonal\" width=\"" << size << "\" height=\"" << size << "\" tilewidth=\"16\" tileheight=\"16\">\n";
+            file << " <tileset firstgid=\"1\" name=\"tiles\" tilewidth=\"16\" tileheight=\"16\">\n";
+            file << "  <image source=\"tiles.png\" width=\"64\" height=\"64\"/>\n";
+            file << " </tileset>\n";
+            file << " <layer name=\"ground\" width=\"" << size << "\" height=\"" << size << "\">\n";
+            file << "  <data encoding=\"base64\">" << onut::base64_encode(reinterpret_cast<const uint8_t*>(tileIds.data()), static_cast<unsigned int>(tileIds.size() * 4)) << "</data>\n";
+            file << " </layer>\n";
+            file << "</map>\n";
+        };
+        auto countTiles = [](int size, int left, int top, int right, int bottom)
+        {
+            size_t count = 0;
+            for (int y = top; y <= bottom; ++y)
+            {
+                for (int x = left; x <= right; ++x)
+                {
+                    if ((y * size + x) % 7) ++count;
+                }
+            }
+            return count;
+        };
+
+        onut::RecordingRenderBackend backend(4096);
+        onut::ContentManager<> contentManager;
+        contentManager.addResource<OTexture>("./tiles.png", backend.createTexture({64, 64}, false));
+        writeMap("./tiledMapTest.tmx", 40);
+        onut::TiledMap tiledMap("./tiledMapTest.tmx", &contentManager, &backend);
+        onut::SpriteBatch spriteBatch(&backend);
+        tiledMap.setSpriteBatch(&spriteBatch);
+        auto pLayer = dynamic_cast<onut::TiledMap::sTileLayer*>(tiledMap.getLayer("ground"));
+
+        subTest("Chunks");
+        {
+            tiledMap.render({0, 0, 39, 39});
+            auto& vertices = backend.getVertices();
+            checkTest(vertices.size() == countTiles(40, 0, 0, 39, 39) * 4, "Every tile drawn");
+            checkTest(backend.getDrawCallCount() == 1, "One draw call for the whole layer");
+            checkTest(vertices[4].position == Vector2(32, 0) && vertices[4].texCoord == Vector2(.5f, 0), "Tile vertices");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Culling");
+        {
+            backend.clear();
+            tiledMap.render({20, 20, 25, 25});
+            checkTest(backend.getVertices().size() == countTiles(40, 16, 16, 31, 31) * 4, "Only the chunk touching the view");
+            backend.clear();
+            tiledMap.render({30, -10, 100, 10});
+            checkTest(backend.getVertices().size() == countTiles(40, 16, 0, 39, 15) * 4, "Clamped to the layer");
+            backend.clear();
+            tiledMap.render({50, 50, 60, 60});
+            checkTest(backend.getVertices().empty(), "Nothing outside of the layer");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Tile changes");
+        {
+            tiledMap.setTileId(pLayer, 17, 18, 0);
+            tiledMap.setTileId(pLayer, 18, 18, 6);
+            backend.clear();
+            tiledMap.render({16, 16, 31, 31});
+            auto& vertices = backend.getVertices();
+            checkTest(vertices.size() == (countTiles(40, 16, 16, 31, 31) - 1) * 4, "Removed tile");
+            size_t changed = 0;
+            while (changed < vertices.size() && vertices[changed].position != Vector2(18 * 16, 18 * 16)) changed += 4;
+            checkTest(changed < vertices.size() && vertices[changed].texCoord == Vector2(.25f, .25f), "Changed tile");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Tilesets");
+        {
+            // 40x24, a second tileset of 4x2 tiles. One of its tiles near the bottom left
+            contentManager.addResource<OTexture>("./tiles2.png", backend.createTexture({64, 32}, false));
+            {
+                ofstream file("./tiledMapTilesets.tmx");
+                file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+                file << "<map version=\"1.0\" orientation=\"orthogonal\" width=\"40\" height=\"24\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << " <tileset firstgid=\"1\" name=\"tiles\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << "  <image source=\"tiles.png\" width=\"64\" height=\"64\"/>\n";
+                file << " </tileset>\n";
+                file << " <tileset firstgid=\"17\" name=\"tiles2\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << "  <image source=\"tiles2.png\" width=\"64\" height=\"32\"/>\n";
+                file << " </tileset>\n";
+                file << " <layer name=\"ground\" width=\"40\" height=\"24\">\n";
+                file << "  <data encoding=\"csv\">\n";
+                for (int i = 0; i < 40 * 24; ++i)
+                {
+                    file << ((i == 20 * 40 + 3) ? 22 : 1) << ((i < 40 * 24 - 1) ? "," : "\n");
+                }
+                file << "  </data>\n";
+                file << " </layer>\n";
+                file << "</map>\n";
+            }
+            onut::TiledMap tilesetMap("./tiledMapTilesets.tmx", &contentManager, &backend);
+            tilesetMap.setSpriteBatch(&spriteBatch);
+            backend.clear();
+            tilesetMap.render({0, 0, 39, 23});
+            auto& vertices = backend.getVertices();
+            auto& commands = backend.getCommands();
+            checkTest(vertices.size() == 40 * 24 * 4, "Every tile drawn");
+            auto pTexture2 = contentManager.getResource<OTexture>("./tiles2.png");
+            auto it = find_if(commands.begin(), commands.end(), [pTexture2](const onut::RecordingRenderBackend::sCommand& command) { return command.pTexture == pTexture2; });
+            checkTest(it != commands.end() && it->vertexCount == 4 && commands.size() == 3, "Grouped by tileset");
+            auto first = (it != commands.end()) ? it->firstVertex : 0;
+            checkTest(vertices[first].position == Vector2(48, 320), "Position from the layer width");
+            checkTest(vertices[first].texCoord == Vector2(.25f, .5f) && vertices[first + 2].texCoord == Vector2(.5f, 1), "UVs in the second tileset");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Compiled maps");
+        {
+            {
+                ofstream file("./tiledMapCompiled.tmx");
+                file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+                file << "<map version=\"1.0\" orientation=\"orthogonal\" width=\"40\" height=\"24\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << " <tileset firstgid=\"1\" name=\"tiles\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << "  <image source=\"tiles.png\" width=\"64\" height=\"64\"/>\n";
+                file << " </tileset>\n";
+                file << " <tileset firstgid=\"17\" name=\"tiles2\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << "  <image source=\"tiles2.png\" width=\"64\" height=\"32\"/>\n";
+                file << " </tileset>\n";
+                file << " <layer name=\"ground\" width=\"40\" height=\"24\">\n";
+                file << "  <data encoding=\"csv\">\n";
+                for (int i = 0; i < 40 * 24; ++i)
+                {
+                    file << (i % 25) << ((i < 40 * 24 - 1) ? "," : "\n");
+                }
+                file << "  </data>\n";
+                file << " </layer>\n";
+                file << " <objectgroup name=\"spawns\" visible=\"0\">\n";
+                file << "  <object id=\"1\" name=\"player\" type=\"spawn\" x=\"32\" y=\"48\" width=\"16\" height=\"16\">\n";
+                file << "   <properties>\n";
+                file << "    <property name=\"team\" value=\"red\"/>\n";
+                file << "    <property name=\"lives\" value=\"3\"/>\n";
+                file << "   </properties>\n";
+                file << "  </object>\n";
+                file << "  <object id=\"2\" name=\"enemy\" type=\"spawn\" x=\"320\" y=\"64.5\" width=\"32\" height=\"16\">\n";
+                file << "   <properties>\n";
+                file << "    <property name=\"team\" value=\"blue\"/>\n";
+                file << "   </properties>\n";
+                file << "  </object>\n";
+                file << " </objectgroup>\n";
+                file << "</map>\n";
+            }
+            checkTest(onut::TiledMap::compile("./tiledMapCompiled.tmx", "./tiledMapCompiled.otm"), "Compile");
+
+            onut::TiledMap xmlMap("./tiledMapCompiled.tmx", &contentManager, &backend);
+            onut::TiledMap compiledMap("./tiledMapCompiled.otm", &contentManager, &backend);
+            auto pXMLLayer = dynamic_cast<onut::TiledMap::sTileLayer*>(xmlMap.getLayer("ground"));
+            auto pCompiledLayer = dynamic_cast<onut::TiledMap::sTileLayer*>(compiledMap.getLayer("ground"));
+            checkTest(compiledMap.getLayerCount() == 2 && compiledMap.getWidth() == 40 && compiledMap.getHeight() == 24 &&
+                      pCompiledLayer && pCompiledLayer->width == 40 && pCompiledLayer->height == 24 &&
+                      !memcmp(pCompiledLayer->tileIds, pXMLLayer->tileIds, 40 * 24 * 4), "Same layers");
+
+            xmlMap.setSpriteBatch(&spriteBatch);
+            compiledMap.setSpriteBatch(&spriteBatch);
+            backend.clear();
+            xmlMap.render({0, 0, 39, 23});
+            auto xmlVertices = backend.getVertices();
+            backend.clear();
+            compiledMap.render({0, 0, 39, 23});
+            auto& compiledVertices = backend.getVertices();
+            checkTest(xmlVertices.size() == compiledVertices.size() &&
+                      !memcmp(xmlVertices.data(), compiledVertices.data(), xmlVertices.size() * sizeof(onut::sRenderVertex)), "Same vertices");
+
+            auto pObjects = dynamic_cast<onut::TiledMap::sObjectLayer*>(compiledMap.getLayer("spawns"));
+            checkTest(pObjects && !pObjects->isVisible && pObjects->objectCount == 2, "Object layer");
+            if (pObjects && pObjects->objectCount == 2)
+            {
+                auto& enemy = pObjects->pObjects[1];
+                auto pLives = pObjects->pObjects[0].getProperty(compiledMap.getPropertyKey("lives"));
+                auto pTeam = enemy.getProperty(compiledMap.getPropertyKey("team"));
+                checkTest(pObjects->pObjects[0].name == "player" && pLives && *pLives == "3" && pObjects->pObjects[0].properties.size() == 2 &&
+                          enemy.id == 2 && enemy.type == "spawn" && enemy.position == Vector2(320, 64.5f) && enemy.size == Vector2(32, 16) &&
+                          enemy.properties.size() == 1 && pTeam && *pTeam == "blue", "Objects and properties");
+            }
+
+            compiledMap.setTileId(pCompiledLayer, 3, 2, 17);
+            onut::TiledMap reloadedMap("./tiledMapCompiled.otm", &contentManager, &backend);
+            auto pReloadedLayer = dynamic_cast<onut::TiledMap::sTileLayer*>(reloadedMap.getLayer("ground"));
+            checkTest(pCompiledLayer->tileIds[2 * 40 + 3] == 17 && pReloadedLayer->tileIds[2 * 40 + 3] == pXMLLayer->tileIds[2 * 40 + 3], "Changed tiles don't touch the file");
+
+            checkTest(compiledMap.save("./tiledMapCompiled.otm"), "Save over its own mapped file");
+            onut::TiledMap savedMap("./tiledMapCompiled.otm", &contentManager, &backend);
+            auto pSavedLayer = dynamic_cast<onut::TiledMap::sTileLayer*>(savedMap.getLayer("ground"));
+            checkTest(pSavedLayer->tileIds[2 * 40 + 3] == 17 && compiledMap.getTileId(pCompiledLayer, 3, 2) == 17 &&
+                      !memcmp(pSavedLayer->tileIds, pCompiledLayer->tileIds, 40 * 24 * 4), "Saved tiles, still readable after");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Layer decoding");
+        {
+            // Layers of different sizes in every encoding, decoded by several threads
+            auto compressLayer = [](const vector<uint32_t>& tileIds, bool isGzip)
+            {
+                z_stream stream = {};
+                deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, isGzip ? 31 : 15, 8, Z_DEFAULT_STRATEGY);
+                vector<uint8_t> compressed(deflateBound(&stream, static_cast<uLong>(tileIds.size() * 4)));
+                stream.next_in = reinterpret_cast<Bytef*>(const_cast<uint32_t*>(tileIds.data()));
+                stream.avail_in = static_cast<uInt>(tileIds.size() * 4);
+                stream.next_out = compressed.data();
+                stream.avail_out = static_cast<uInt>(compressed.size());
+                deflate(&stream, Z_FINISH);
+                compressed.resize(stream.total_out);
+                deflateEnd(&stream);
+                return onut::base64_encode(compressed.data(), static_cast<unsigned int>(compressed.size()));
+            };
+            auto writeLayers = [&](const string& filename, int layerCount, int size, vector<vector<uint32_t>>& layers)
+            {
+                static const char* encodings[] = {"encoding=\"csv\"", "encoding=\"base64\"", "encoding=\"base64\" compression=\"zlib\"", "encoding=\"base64\" compression=\"gzip\""};
+                ofstream file(filename);
+                file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+                file << "<map version=\"1.0\" orientation=\"orthogonal\" width=\"" << size << "\" height=\"" << size << "\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << " <tileset firstgid=\"1\" name=\"tiles\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << "  <image source=\"tiles.png\" width=\"64\" height=\"64\"/>\n";
+                file << " </tileset>\n";
+                layers.resize(layerCount);
+                for (int l = 0; l < layerCount; ++l)
+                {
+                    auto layerSize = size - (l % 3) * size / 4;
+                    auto& tileIds = layers[l];
+                    tileIds.resize(layerSize * layerSize);
+                    for (int i = 0; i < layerSize * layerSize; ++i)
+                    {
+                        tileIds[i] = (i * 7 + l) % 17;
+                    }
+                    file << " <layer name=\"layer" << l << "\" width=\"" << layerSize << "\" height=\"" << layerSize << "\">\n";
+                    file << "  <data " << encodings[l % 4] << ">\n";
+                    switch (l % 4)
+                    {
+                        case 0:
+                            for (size_t i = 0; i < tileIds.size(); ++i)
+                            {
+                                file << tileIds[i] << ((i < tileIds.size() - 1) ? "," : "\n");
+                            }
+                            break;
+                        case 1:
+                            file << "   " << onut::base64_encode(reinterpret_cast<const uint8_t*>(tileIds.data()), static_cast<unsigned int>(tileIds.size() * 4)) << "\n";
+                            break;
+                        default:
+                            file << "   " << compressLayer(tileIds, l % 4 == 3) << "\n";
+                            break;
+                    }
+                    file << "  </data>\n";
+                    file << " </layer>\n";
+                }
+                file << "</map>\n";
+            };
+
+            vector<vector<uint32_t>> layers;
+            writeLayers("./tiledMapLayers.tmx", 12, 48, layers);
+            onut::TiledMap layersMap("./tiledMapLayers.tmx", &contentManager, &backend);
+            checkTest(layersMap.getLayerCount() == 12 && layersMap.getWidth() == 48, "Every layer");
+            bool isSame = true;
+            bool isInOrder = true;
+            for (int l = 0; l < 12; ++l)
+            {
+                auto pTileLayer = dynamic_cast<onut::TiledMap::sTileLayer*>(layersMap.getLayer(l));
+                isInOrder = isInOrder && pTileLayer && pTileLayer->name == "layer" + to_string(l);
+                isSame = isSame && pTileLayer &&
+                    static_cast<size_t>(pTileLayer->width * pTileLayer->height) == layers[l].size() &&
+                    equal(layers[l].begin(), layers[l].end(), pTileLayer->tileIds);
+            }
+            checkTest(isInOrder, "Layers in document order");
+            checkTest(isSame, "Same tiles in every encoding");
+
+            writeLayers("./tiledMapLayersBench.tmx", 12, 512, layers);
+            benchmark("12 layers of up to 512x512", 2, [&]
+            {
+                onut::TiledMap benchMap("./tiledMapLayersBench.tmx", &contentManager, &backend);
+            });
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Flipped tiles");
+        {
+            // Tiled keeps the flips in the top 3 bits of the gids, in every encoding
+            uint32_t flipped[] = {0xA0000001, 0x40000002}; // Rotated 90 degrees clockwise, flipped vertically
+            {
+                ofstream file("./tiledMapFlipped.tmx");
+                file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+                file << "<map version=\"1.0\" orientation=\"orthogonal\" width=\"2\" height=\"1\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << " <tileset firstgid=\"1\" name=\"tiles\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << "  <image source=\"tiles.png\" width=\"64\" height=\"64\"/>\n";
+                file << " </tileset>\n";
+                file << " <layer name=\"csv\" width=\"2\" height=\"1\">\n";
+                file << "  <data encoding=\"csv\">" << flipped[0] << "," << flipped[1] << "</data>\n";
+                file << " </layer>\n";
+                file << " <layer name=\"base64\" width=\"2\" height=\"1\">\n";
+                file << "  <data encoding=\"base64\">" << onut::base64_encode(reinterpret_cast<const uint8_t*>(flipped), 8) << "</data>\n";
+                file << " </layer>\n";
+                file << " <layer name=\"xml\" width=\"2\" height=\"1\">\n";
+                file << "  <data><tile gid=\"" << flipped[0] << "\"/><tile gid=\"" << flipped[1] << "\"/></data>\n";
+                file << " </layer>\n";
+                file << "</map>\n";
+            }
+            onut::TiledMap flippedMap("./tiledMapFlipped.tmx", &contentManager, &backend);
+            bool isSame = true;
+            for (int l = 0; l < 3; ++l)
+            {
+                auto pTileLayer = dynamic_cast<onut::TiledMap::sTileLayer*>(flippedMap.getLayer(l));
+                isSame = isSame && pTileLayer && flippedMap.getTileId(pTileLayer, 0, 0) == flipped[0] && flippedMap.getTileId(pTileLayer, 1, 0) == flipped[1];
+            }
+            checkTest(isSame, "Loaded with their flips");
+
+            flippedMap.setSpriteBatch(&spriteBatch);
+            backend.clear();
+            flippedMap.renderLayer({0, 0, 1, 0}, "base64");
+            auto& vertices = backend.getVertices();
+            Vector2 expected[] = {{0, .25f}, {.25f, .25f}, {.25f, 0}, {0, 0}, {.25f, .25f}, {.25f, 0}, {.5f, 0}, {.5f, .25f}};
+            bool isFlipped = vertices.size() == 8;
+            for (size_t i = 0; isFlipped && i < 8; ++i) isFlipped = vertices[i].texCoord == expected[i];
+            checkTest(isFlipped, "Drawn flipped");
+
+            // Zoomed out, more than MAX_CACHED_CHUNK_VIEW chunks are drawn without keeping them
+            {
+                vector<uint32_t> tileIds(400 * 400);
+                for (size_t i = 0; i < tileIds.size(); ++i) tileIds[i] = static_cast<uint32_t>(1 + i % 16) | (static_cast<uint32_t>(i % 8) << 29);
+                ofstream file("./tiledMapFlippedLarge.tmx");
+                file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+                file << "<map version=\"1.0\" orientation=\"orthogonal\" width=\"400\" height=\"400\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << " <tileset firstgid=\"1\" name=\"tiles\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << "  <image source=\"tiles.png\" width=\"64\" height=\"64\"/>\n";
+                file << " </tileset>\n";
+                file << " <layer name=\"ground\" width=\"400\" height=\"400\">\n";
+                file << "  <data encoding=\"base64\">" << onut::base64_encode(reinterpret_cast<const uint8_t*>(tileIds.data()), static_cast<unsigned int>(tileIds.size() * 4)) << "</data>\n";
+                file << " </layer>\n";
+                file << "</map>\n";
+            }
+            onut::TiledMap largeMap("./tiledMapFlippedLarge.tmx", &contentManager, &backend);
+            largeMap.setSpriteBatch(&spriteBatch);
+            backend.clear();
+            largeMap.render({0, 0, 399, 399});
+            auto zoomedOut = backend.getVertices();
+            backend.clear();
+            largeMap.render({0, 0, 399, 319}); // 25x20 chunks, kept
+            largeMap.render({0, 320, 399, 399});
+            auto& chunked = backend.getVertices();
+            checkTest(zoomedOut.size() == 400 * 400 * 4 && zoomedOut.size() == chunked.size() &&
+                      !memcmp(zoomedOut.data(), chunked.data(), sizeof(onut::sRenderVertex) * zoomedOut.size()), "Zoomed out, same as the chunks");
+            cout << setColor(7) << endl;
+        }
+
+        subTest("Object queries");
+        {
+            // Objects of 0 to 64 pixels, some of them points, over 512x512 tiles
+            auto writeObjects = [](const string& filename, int objectCount)
+            {
+                ofstream file(filename);
+                file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+                file << "<map version=\"1.0\" orientation=\"orthogonal\" width=\"4\" height=\"4\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << " <tileset firstgid=\"1\" name=\"tiles\" tilewidth=\"16\" tileheight=\"16\">\n";
+                file << "  <image source=\"tiles.png\" width=\"64\" height=\"64\"/>\n";
+                file << " </tileset>\n";
+                file << " <layer name=\"ground\" width=\"4\" height=\"4\">\n";
+                file << "  <data encoding=\"csv\">1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1</data>\n";
+                file << " </layer>\n";
+                file << " <objectgroup name=\"objects\">\n";
+                unsigned int seed = 1234;
+                auto random = [&seed](int range) { seed = seed * 1103515245 + 12345; return static_cast<int>((seed >> 8) % range); };
+                for (int i = 0; i < objectCount; ++i)
+                {
+                    auto size = (i % 5) ? random(64) : 0;
+                    file << "  <object id=\"" << i + 1 << "\" x=\"" << random(8192) << "\" y=\"" << random(8192) << "\" width=\"" << size << "\" height=\"" << size << "\">\n";
+                    file << "   <properties><property name=\"" << ((i % 3) ? "trigger" : "spawn") << "\" value=\"" << i << "\"/><property name=\"team\" value=\"red\"/></properties>\n";
+                    file << "  </object>\n";
+                }
+                file << " </objectgroup>\n";
+                file << "</map>\n";
+            };
+            auto isTouching = [](const onut::TiledMap::sObject& object, float left, float top, float right, float bottom)
+            {
+                return object.position.x <= right && object.position.x + object.size.x >= left &&
+                       object.position.y <= bottom && object.position.y + object.size.y >= top;
+            };
+            auto getIds = [](vector<onut::TiledMap::sObject*>& objects)
+            {
+                vector<uint32_t> ids;
+                for (auto pObject : objects) ids.push_back(pObject->id);
+                sort(ids.begin(), ids.end());
+                return ids;
+            };
+
+            writeObjects("./tiledMapObjects.tmx", 2000);
+            onut::TiledMap objectMap("./tiledMapObjects.tmx", &contentManager, &backend);
+            auto pObjects = dynamic_cast<onut::TiledMap::sObjectLayer*>(objectMap.getLayer("objects"));
+            vector<onut::TiledMap::sObject*> found;
+            vector<onut::TiledMap::sObject*> expected;
+            bool isSameRects = true;
+            bool isSamePoints = true;
+            bool isSameRadiuses = true;
+            for (int i = 0; i < 200; ++i)
+            {
+                auto x = static_cast<float>((i * 977) % 8400) - 100.f;
+                auto y = static_cast<float>((i * 631) % 8400) - 100.f;
+                auto size = static_cast<float>(i % 700);
+
+                found.clear();
+                expected.clear();
+                objectMap.getObjectsInRect(pObjects, Rect(x, y, size, size), found);
+                for (uint32_t j = 0; j < pObjects->objectCount; ++j)
+                {
+                    if (isTouching(pObjects->pObjects[j], x, y, x + size, y + size)) expected.push_back(pObjects->pObjects + j);
+                }
+                isSameRects = isSameRects && found.size() == expected.size() && getIds(found) == getIds(expected);
+
+                found.clear();
+                expected.clear();
+                auto& target = pObjects->pObjects[i];
+                auto point = target.position + target.size * .5f;
+                objectMap.getObjectsAt(pObjects, point, found);
+                for (uint32_t j = 0; j < pObjects->objectCount; ++j)
+                {
+                    if (isTouching(pObjects->pObjects[j], point.x, point.y, point.x, point.y)) expected.push_back(pObjects->pObjects + j);
+                }
+                isSamePoints = isSamePoints && !found.empty() && found.size() == expected.size() && getIds(found) == getIds(expected);
+
+                found.clear();
+                expected.clear();
+                auto radius = size * .5f;
+                objectMap.getObjectsInRadius(pObjects, Vector2(x, y), radius, found);
+                for (uint32_t j = 0; j < pObjects->objectCount; ++j)
+                {
+                    auto& object = pObjects->pObjects[j];
+                    auto closest = Vector2(max(object.position.x, min(x, object.position.x + object.size.x)), max(object.position.y, min(y, object.position.y + object.size.y)));
+                    if (Vector2::DistanceSquared(closest, Vector2(x, y)) <= radius * radius) expected.push_back(pObjects->pObjects + j);
+                }
+                isSameRadiuses = isSameRadiuses && found.size() == expected.size() && getIds(found) == getIds(expected);
+            }
+            checkTest(isSameRects, "Rects, each object once");
+            checkTest(isSamePoints, "Points");
+            checkTest(isSameRadiuses, "Radiuses");
+
+            pObjects->pObjects[0].position = Vector2(-500, -500);
+            objectMap.updateObjectIndex(pObjects);
+            found.clear();
+            objectMap.getObjectsAt(pObjects, pObjects->pObjects[0].position, found);
+            checkTest(found.size() == 1 && found[0] == pObjects->pObjects, "Moved object");
+
+            auto spawn = objectMap.getPropertyKey("spawn");
+            auto team = objectMap.getPropertyKey("team");
+            auto pSpawn = pObjects->pObjects[3].getProperty(spawn);
+            auto pTeam = pObjects->pObjects[4].getProperty(team);
+            checkTest(pSpawn && *pSpawn == "3" && !pObjects->pObjects[4].getProperty(spawn) && pTeam && *pTeam == "red" &&
+                      objectMap.getPropertyName(team) == "team" && objectMap.getPropertyKey("speed") == onut::TiledMap::NO_PROPERTY, "Interned property keys");
+
+            writeObjects("./tiledMapObjectsBench.tmx", 100000);
+            onut::TiledMap benchMap("./tiledMapObjectsBench.tmx", &contentManager, &backend);
+            auto pBenchObjects = dynamic_cast<onut::TiledMap::sObjectLayer*>(benchMap.getLayer("objects"));
+            found.reserve(pBenchObjects->objectCount);
+            benchmark("100k objects, 1000 rects of 256x256, scanning", 2, [&]
+            {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    found.clear();
+                    auto x = static_cast<float>((i * 977) % 8192);
+                    auto y = static_cast<float>((i * 631) % 8192);
+                    for (uint32_t j = 0; j < pBenchObjects->objectCount; ++j)
+                    {
+                        if (isTouching(pBenchObjects->pObjects[j], x, y, x + 256, y + 256)) found.push_back(pBenchObjects->pObjects + j);
+                    }
+                }
+            });
+            benchmark("100k objects, 1000 rects of 256x256, indexed", 20, [&]
+            {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    found.clear();
+                    benchMap.getObjectsInRect(pBenchObjects, Rect(static_cast<float>((i * 977) % 8192), static_cast<float>((i * 631) % 8192), 256, 256), found);
+                }
+            });
+            benchmark("100k objects, 1000 points, indexed", 20, [&]
+            {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    found.clear();
+                    benchMap.getObjectsAt(pBenchObjects, Vector2(static_cast<float>((i * 977) % 8192), static_cast<float>((i * 631) % 8192)), found);
+                }
+            });
+            benchmark("100k objects, 1000 radiuses of 128, indexed", 20, [&]
+            {
+                for (int i = 0; i < 1000; ++i)
+                {
+                    found.clear();
+                    benchMap.getObjectsInRadius(pBenchObjects, Vector2(static_cast<float>((i * 977) % 8192), static_cast<float>((i * 631) % 8192)), 128, found);
+                }
+            });
+            auto benchTeam = benchMap.getPropertyKey("team");
+            benchmark("100k objects, property by key", 20, [&]
+            {
+                size_t count = 0;
+                for (uint32_t j = 0; j < pBenchObjects->objectCount; ++j)
+                {
+                    auto pValue = pBenchObjects->pObjects[j].getProperty(benchTeam);
+                    if (pValue && !pValue->empty()) ++count;
+                }
+                found.resize(count ? 0 : 1);
+            });
+            cout << setColor(7) << endl;
+        }
+
+        subTest("1024x1024 map benchmark");
+        {
+            onut::RecordingRenderBackend benchBackend(4096, 1200, false);
+            contentManager.addResource<OTexture>("./tiles.png", benchBackend.createTexture({64, 64}, false));
+            writeMap("./tiledMapBench.tmx", 1024);
+            onut::TiledMap benchMap("./tiledMapBench.tmx", &contentManager, &benchBackend);
+            onut::SpriteBatch benchBatch(&benchBackend);
+            benchMap.setSpriteBatch(&benchBatch);
+            auto pTexture = contentManager.getResource<OTexture>("./tiles.png");
+            auto pBenchLayer = dynamic_cast<onut::TiledMap::sTileLayer*>(benchMap.getLayer("ground"));
+            static const LONG viewSizes[] = {40, 160, 640, 1024};
+            for (auto viewSize : viewSizes)
+            {
+                RECT view = {512 - viewSize / 2, 512 - viewSize / 2, 512 + viewSize / 2 - 1, 512 + viewSize / 2 - 1};
+                stringstream ss;
+                ss << viewSize << "x" << viewSize << " tiles, ";
+                benchmark(ss.str() + "tile by tile", 10, [&]
+                {
+                    benchBatch.begin();
+                    for (LONG y = view.top; y <= view.bottom; ++y)
+                    {
+                        for (LONG x = view.left; x <= view.right; ++x)
+                        {
+                            auto tileId = pBenchLayer->tileIds[y * 1024 + x];
+                            if (!tileId) continue;
+                            auto onTextureId = tileId - 1;
+                            Vector4 uvs((onTextureId % 4) * .25f, (onTextureId / 4) * .25f, (onTextureId % 4 + 1) * .25f, (onTextureId / 4 + 1) * .25f);
+                            benchBatch.drawRectWithUVs(pTexture, Rect(static_cast<float>(x * 16), static_cast<float>(y * 16), 16, 16), uvs);
+                        }
+                    }
+                    benchBatch.end();
+                });
+                benchMap.render(view); // Builds the chunks seen for the first time
+                benchmark(ss.str() + "chunks", 10, [&]
+                {
+                    benchMap.render(view);
+                });
+                benchBackend.clear();
+            }
+            cout << setColor(7) << endl;
+        }
+
+        subTest("1024x1024 map loading benchmark");
+        {
+            onut::TiledMap::compile("./tiledMapBench.tmx", "./tiledMapBench.otm");
+            benchmark(".tmx, base64", 2, [&]
+            {
+                onut::TiledMap benchMap("./tiledMapBench.tmx", &contentManager, &backend);
+            });
+            benchmark("Compiled", 20, [&]
+            {
+                onut::TiledMap benchMap("./tiledMapBench.otm", &contentManager, &backend);
+            });
+            cout << setColor(7) << endl;
+        }
+        subTest("Streamed maps");
+        {
+            // 200x200, so 4x4 regions with partial ones on the edges
+            writeMap("./tiledMapStreamed.tmx", 200);
+            checkTest(onut::TiledMap::compile("./tiledMapStreamed.tmx", "./tiledMapStreamed.ots", true), "Compile");
+            onut::TiledMap xmlMap("./tiledMapStreamed.tmx", &contentManager, &backend);
+            onut::TiledMap streamedMap("./tiledMapStreamed.ots", &contentManager, &backend);
+            streamedMap.setSpriteBatch(&spriteBatch);
+            auto pXMLLayer = dynamic_cast<onut::TiledMap::sTileLayer*>(xmlMap.getLayer("ground"));
+            auto pStreamedLayer = dynamic_cast<onut::TiledMap::sTileLayer*>(streamedMap.getLayer("ground"));
+            auto regionBytes = (sizeof(uint32_t) + 4 * sizeof(onut::sRenderVertex)) * onut::TiledMap::REGION_SIZE * onut::TiledMap::REGION_SIZE; // Gids and chunk vertices
+            checkTest(streamedMap.isStreamed() && streamedMap.getWidth() == 200 && !streamedMap.isRegionResident(0, 0) && !streamedMap.getTileId(pStreamedLayer, 1, 0), "Nothing loaded before a focus");
+
+            streamedMap.setStreamingFocus(Vector2(10, 10));
+            streamedMap.updateStreaming();
+            streamedMap.finishStreaming();
+            checkTest(streamedMap.isRegionResident(0, 0) && streamedMap.isRegionResident(1, 1) && !streamedMap.isRegionResident(2, 0) &&
+                      streamedMap.getResidentMemory() == 4 * regionBytes, "Regions around the focus");
+            bool isSame = true;
+            for (int y = 0; y < 128; ++y)
+            {
+                for (int x = 0; x < 128; ++x)
+                {
+                    isSame = isSame && streamedMap.getTileId(pStreamedLayer, x, y) == pXMLLayer->tileIds[y * 200 + x];
+                }
+            }
+            checkTest(isSame, "Same tiles");
+            backend.clear();
+            streamedMap.render({0, 0, 199, 199});
+            checkTest(backend.getVertices().size() == countTiles(200, 0, 0, 127, 127) * 4, "Only resident regions drawn");
+
+            streamedMap.setStreamingMemoryCap(2 * regionBytes);
+            streamedMap.setStreamingFocus(Vector2(199, 199));
+            streamedMap.updateStreaming();
+            checkTest(!streamedMap.isRegionResident(0, 0) && streamedMap.getResidentMemory() == 0, "Out of focus regions unloaded");
+            streamedMap.finishStreaming();
+            checkTest(streamedMap.isRegionResident(3, 3) && streamedMap.getResidentMemory() == 2 * regionBytes, "Nearest regions within the memory cap");
+            checkTest(streamedMap.getTileId(pStreamedLayer, 199, 199) == pXMLLayer->tileIds[199 * 200 + 199], "Partial region");
+            streamedMap.setTileId(pStreamedLayer, 199, 199, 3);
+            checkTest(streamedMap.getTileId(pStreamedLayer, 199, 199) == 3, "Changed tile");
+            backend.clear();
+            streamedMap.render({0, 0, 199, 199});
+            checkTest(!backend.getVertices().empty() && backend.getVertices().back().position.x <= 200 * 16, "Drawn after moving");
+            streamedMap.setStreamingFocus(Vector2(10, 10));
+            streamedMap.updateStreaming();
+            streamedMap.setStreamingFocus(Vector2(199, 10));
+            streamedMap.updateStreaming();
+            streamedMap.finishStreaming();
+            streamedMap.updateStreaming(); // Loads of the first focus counted in the cap until they arrived
+            streamedMap.finishStreaming();
+            checkTest(!streamedMap.isRegionResident(0, 0) && streamedMap.isRegionResident(3, 0) && streamedMap.getResidentMemory() == 2 * regionBytes, "Focus moved while loading");
+
+            onut::TiledMap::compile("./tiledMapBench.tmx", "./tiledMapBench.ots", true);
+            onut::TiledMap benchMap("./tiledMapBench.ots", &contentManager, &backend);
+            benchmark("Focus across 1024x1024, 16 steps", 5, [&]
+            {
+                for (int i = 0; i < 16; ++i)
+                {
+                    benchMap.setStreamingFocus(Vector2(static_cast<float>(i * 64), static_cast<float>(i * 64)));
+                    benchMap.updateStreaming();
+                    benchMap.finishStreaming();
+                }
+            });
+            cout << setColor(7) << endl;
+        }
+        subTest("CPU minimap");
+        {
+            // 4x4 tiles of 16 pixels. The first 8 are opaque, the others half transparent
+            vector<uint8_t> tilesImage(64 * 64 * 4);
+            for (int y = 0; y < 64; ++y)
+            {
+                for (int x = 0; x < 64; ++x)
+                {
+                    auto tile = (y / 16) * 4 + x / 16;
+                    auto pPixel = tilesImage.data() + (y * 64 + x) * 4;
+                    pPixel[0] = static_cast<uint8_t>(tile * 16);
+                    pPixel[1] = static_cast<uint8_t>(255 - tile * 16);
+                    pPixel[2] = static_cast<uint8_t>((x & 1) ? 255 : 0); // Averages to 128
+                    pPixel[3] = static_cast<uint8_t>((tile < 8) ? 255 : 128);
+                }
+            }
+            lodepng::encode("./tiles.png", tilesImage, 64, 64);
+
+            vector<uint8_t> minimap(40 * 40 * 4);
+            tiledMap.buildMinimap(minimap.data());
+            auto getPixel = [](const vector<uint8_t>& pixels, int width, int x, int y)
+            {
+                uint32_t pixel;
+                memcpy(&pixel, pixels.data() + (y * width + x) * 4, 4);
+                return pixel;
+            };
+            checkTest(getPixel(minimap, 40, 0, 0) == 0 && getPixel(minimap, 40, 1, 0) == 0xFF80EF10 && getPixel(minimap, 40, 2, 0) == 0xFF80DF20, "Average tile colors");
+
+            vector<uint8_t> layersMinimap(48 * 48 * 4);
+            onut::TiledMap layersMap("./tiledMapLayers.tmx", &contentManager, &backend);
+            layersMap.buildMinimap(layersMinimap.data(), onut::eSimdPath::SCALAR);
+            auto blend = [](uint32_t dst, uint32_t src)
+            {
+                uint32_t result = 0;
+                for (int c = 0; c < 4; ++c)
+                {
+                    auto d = (dst >> (c * 8)) & 0xFF;
+                    result |= (((src >> (c * 8)) & 0xFF) + (d * (255 - (src >> 24)) + 127) / 255) << (c * 8);
+                }
+                return result;
+            };
+            // Layer 8 has an opaque tile on the first pixel, then 3 half transparent ones
+            auto expected = 0xFF808F70;
+            for (uint32_t tile = 8; tile < 11; ++tile)
+            {
+                auto alpha = 128;
+                auto premultiplied = [alpha](uint32_t c) { return (c * alpha + 127) / 255; };
+                expected = blend(expected, premultiplied(tile * 16) | (premultiplied(255 - tile * 16) << 8) | (((premultiplied(255) + premultiplied(0) + 1) / 2) << 16) | (alpha << 24));
+            }
+            checkTest(getPixel(layersMinimap, 48, 0, 0) == expected, "Layers blended in order");
+            bool isSame = true;
+            for (auto path : {onut::eSimdPath::SSE2, onut::eSimdPath::AVX2, onut::eSimdPath::NEON})
+            {
+                if (!onut::isSimdPathSupported(path)) continue;
+                vector<uint8_t> pathMinimap(48 * 48 * 4);
+                layersMap.buildMinimap(pathMinimap.data(), path);
+                isSame = isSame && pathMinimap == layersMinimap;
+            }
+            checkTest(isSame, "Every path is bit-exact");
+
+            vector<uint8_t> streamedMinimap(200 * 200 * 4);
+            onut::TiledMap streamedMap("./tiledMapStreamed.ots", &contentManager, &backend);
+            streamedMap.setStreamingFocus(Vector2(10, 10), 0);
+            streamedMap.updateStreaming();
+            streamedMap.finishStreaming();
+            streamedMap.buildMinimap(streamedMinimap.data());
+            checkTest(getPixel(streamedMinimap, 200, 1, 0) == 0xFF80EF10 && getPixel(streamedMinimap, 200, 199, 199) == 0, "Resident regions of streamed maps");
+
+            onut::TiledMap benchMap("./tiledMapBench.tmx", &contentManager, &backend);
+            vector<uint8_t> benchMinimap(1024 * 1024 * 4);
+            benchMap.buildMinimap(benchMinimap.data());
+            for (auto path : {onut::eSimdPath::SCALAR, onut::eSimdPath::SSE2, onut::eSimdPath::AVX2, onut::eSimdPath::NEON})
+            {
+                static const char* names[] = {"", "Scalar", "SSE2", "AVX2", "NEON"};
+                if (!onut::isSimdPathSupported(path)) continue;
+                benchmark(string("1024x1024 map, ") + names[static_cast<int>(path)], 20, [&]
+                {
+                    benchMap.buildMinimap(benchMinimap.data(), path);
+                });
+            }
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
+    majorTest("onut::NavMesh");
+    {
+        // Walkable area by marching squares, from the grid: each cell between 4 tile centers is walkable by
+        // 1/8 per lone corner, 1/2 for a side, 7/8 for 3 corners
+        auto getGridArea = [](const bool* pTiles, int width, int height)
+        {
+            auto isWalkable = [&](int i, int j) { return i >= 0 && j >= 0 && i < width && j < height && !pTiles[j * width + i]; };
+            double area = 0;
+            for (int j = -1; j < height; ++j)
+            {
+                for (int i = -1; i < width; ++i)
+                {
+                    bool corners[4] = {isWalkable(i, j), isWalkable(i + 1, j), isWalkable(i + 1, j + 1), isWalkable(i, j + 1)};
+                    auto count = corners[0] + corners[1] + corners[2] + corners[3];
+                    if (count == 1) area += .125;
+                    else if (count == 2) area += (corners[0] == corners[2]) ? .25 : .5;
+                    else if (count == 3) area += .875;
+                    else if (count == 4) area += 1.;
+                }
+            }
+            return area;
+        };
+
+        // 4-connected regions of walkable tiles
+        auto getRegionCount = [](const bool* pTiles, int width, int height)
+        {
+            vector<bool> isVisited(width * height, false);
+            int count = 0;
+            for (int start = 0; start < width * height; ++start)
+            {
+                if (pTiles[start] || isVisited[start]) continue;
+                ++count;
+                vector<int> stack = {start};
+                isVisited[start] = true;
+                while (!stack.empty())
+                {
+                    auto tile = stack.back();
+                    stack.pop_back();
+                    int x = tile % width, y = tile / width;
+                    int neighbors[4][2] = {{x - 1, y}, {x + 1, y}, {x, y - 1}, {x, y + 1}};
+                    for (auto& neighbor : neighbors)
+                    {
+                        if (neighbor[0] < 0 || neighbor[1] < 0 || neighbor[0] >= width || neighbor[1] >= height) continue;
+                        auto index = neighbor[1] * width + neighbor[0];
+                        if (pTiles[index] || isVisited[index]) continue;
+                        isVisited[index] = true;
+                        stack.push_back(index);
+                    }
+                }
+            }
+            return count;
+        };
+
+        auto getTriangleArea = [](const onut::NavMesh::sNode& node)
+        {
+            auto& c = node.corners;
+            return ((c[2] - c[0]) * (c[5] - c[1]) - (c[3] - c[1]) * (c[4] - c[0])) * .5;
+        };
+
+        auto isInside = [&](const onut::NavMesh::sNode& node, float x, float y)
+        {
+            auto& c = node.corners;
+            for (int k = 0; k < 3; ++k)
+            {
+                auto ax = c[k * 2], ay = c[k * 2 + 1];
+                auto bx = c[(k + 1) % 3 * 2], by = c[(k + 1) % 3 * 2 + 1];
+                if ((bx - ax) * (y - ay) - (by - ay) * (x - ax) < -1e-4f) return false;
+            }
+            return true;
+        };
+
+        struct sCheck
+        {
+            bool isAreaExact = true;
+            bool isOriented = true;
+            bool isSymmetric = true;
+            bool isConnected = true;
+            bool isCovered = true;
+        };
+        auto check = [&](const bool* pTiles, int width, int height, sCheck& result)
+        {
+            onut::NavMesh navMesh(pTiles, width, height);
+            int count;
+            auto pNodes = navMesh.getNodes(count);
+            double area = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                auto triangleArea = getTriangleArea(pNodes[i]);
+                if (triangleArea <= 0) result.isOriented = false;
+                area += triangleArea;
+                for (int n = 0; n < pNodes[i].neighborCount; ++n)
+                {
+                    auto& neighbor = pNodes[i].pNeighbors[n];
+                    bool isBack = false;
+                    for (int m = 0; m < neighbor.pNode->neighborCount; ++m)
+                    {
+                        auto& back = neighbor.pNode->pNeighbors[m];
+                        if (back.pNode == pNodes + i && back.cost == neighbor.cost) isBack = true;
+                    }
+                    if (!isBack) result.isSymmetric = false;
+                }
+            }
+            if (std::abs(area - getGridArea(pTiles, width, height)) > 1e-3 * (1. + area)) result.isAreaExact = false;
+
+            // As many islands of nodes as there are regions of tiles
+            vector<bool> isVisited(count, false);
+            int islandCount = 0;
+            for (int start = 0; start < count; ++start)
+            {
+                if (isVisited[start]) continue;
+                ++islandCount;
+                vector<int> stack = {start};
+                isVisited[start] = true;
+                while (!stack.empty())
+                {
+                    auto& node = pNodes[stack.back()];
+                    stack.pop_back();
+                    for (int n = 0; n < node.neighborCount; ++n)
+                    {
+                        auto index = static_cast<int>(node.pNeighbors[n].pNode - pNodes);
+                        if (isVisited[index]) continue;
+                        isVisited[index] = true;
+                        stack.push_back(index);
+                    }
+                }
+            }
+            if (islandCount != getRegionCount(pTiles, width, height)) result.isConnected = false;
+
+            // Centers of walkable tiles are in a triangle, the others aren't
+            if (width * height <= 64 * 64)
+            {
+                for (int y = 0; y < height; ++y)
+                {
+                    for (int x = 0; x < width; ++x)
+                    {
+                        bool isFound = false;
+                        for (int i = 0; i < count && !isFound; ++i)
+                        {
+                            isFound = isInside(pNodes[i], x + .5f, y + .5f);
+                        }
+                        if (isFound == pTiles[y * width + x]) result.isCovered = false;
+                    }
+                }
+            }
+        };
+
+        subTest("Triangulation");
+        {
+            {
+                unique_ptr<bool[]> tiles(new bool[8 * 8]);
+                fill(tiles.get(), tiles.get() + 8 * 8, false);
+                onut::NavMesh navMesh(tiles.get(), 8, 8);
+                int count;
+                auto pNodes = navMesh.getNodes(count);
+                double area = 0;
+                for (int i = 0; i < count; ++i) area += getTriangleArea(pNodes[i]);
+                checkTest(count > 0 && std::abs(area - (64. - .5)) < 1e-4, "Open 8x8 grid, corners cut by marching squares");
+
+                fill(tiles.get(), tiles.get() + 8 * 8, true);
+                onut::NavMesh blocked(tiles.get(), 8, 8);
+                blocked.getNodes(count);
+                checkTest(count == 0, "Nothing walkable, no nodes");
+                onut::NavMesh empty(nullptr, 0, 0);
+                empty.getNodes(count);
+                checkTest(count == 0, "Empty grid");
+            }
+            {
+                // A block in the middle, and a lone tile in a corner
+                unique_ptr<bool[]> tiles(new bool[12 * 12]);
+                fill(tiles.get(), tiles.get() + 12 * 12, false);
+                for (int y = 4; y < 8; ++y) for (int x = 4; x < 8; ++x) tiles[y * 12 + x] = true;
+                tiles[1 * 12 + 0] = true;
+                tiles[1 * 12 + 1] = true;
+                tiles[0 * 12 + 1] = true;
+                sCheck result;
+                check(tiles.get(), 12, 12, result);
+                checkTest(result.isAreaExact && result.isOriented, "Hole, area matches the contours");
+                checkTest(result.isConnected, "Hole, around it is connected and the lone tile isn't");
+                checkTest(result.isCovered, "Hole, every walkable tile center is covered");
+            }
+            {
+                sCheck result;
+                for (int i = 0; i < 20; ++i)
+                {
+                    int width = 8 + rand() % 57;
+                    int height = 8 + rand() % 57;
+                    int percent = 10 + i * 3;
+                    unique_ptr<bool[]> tiles(new bool[width * height]);
+                    for (int t = 0; t < width * height; ++t) tiles[t] = rand() % 100 < percent;
+                    check(tiles.get(), width, height, result);
+                }
+                checkTest(result.isAreaExact, "Random grids, area matches the contours");
+                checkTest(result.isOriented, "Random grids, triangles have the same winding");
+                checkTest(result.isSymmetric, "Random grids, neighbors link both ways with the same cost");
+                checkTest(result.isConnected, "Random grids, one island of nodes per region of tiles");
+                checkTest(result.isCovered, "Random grids, only walkable tile centers are covered");
+            }
+            cout << setColor(7) << endl;
+        }
+
+        subTest("1024x1024 benchmark");
+        {
+            const int size = 1024;
+            unique_ptr<bool[]> pillars(new bool[size * size]);
+            for (int i = 0; i < size * size; ++i) pillars[i] = rand() % 100 < 2;
+
+            // Cellular automaton caves
+            unique_ptr<bool[]> caves(new bool[size * size]);
+            unique_ptr<bool[]> next(new bool[size * size]);
+            for (int i = 0; i < size * size; ++i) caves[i] = rand() % 100 < 45;
+            for (int step = 0; step < 4; ++step)
+            {
+                for (int y = 0; y < size; ++y)
+                {
+                    for (int x = 0; x < size; ++x)
+                    {
+                        int walls = 0;
+                        for (int j = y - 1; j <= y + 1; ++j)
+                        {
+                            for (int i = x - 1; i <= x + 1; ++i)
+                            {
+                                if (i < 0 || j < 0 || i >= size || j >= size || caves[j * size + i]) ++walls;
+                            }
+                        }
+                        next[y * size + x] = walls >= 5;
+                    }
+                }
+                swap(caves, next);
+            }
+
+            int count = 0;
+            benchmark("Open field, 2% pillars", 2, [&]
+            {
+                onut::NavMesh navMesh(pillars.get(), size, size);
+                navMesh.getNodes(count);
+            });
+            cout << "            " << count << " nodes" << endl;
+            benchmark("Caves", 2, [&]
+            {
+                onut::NavMesh navMesh(caves.get(), size, size);
+                navMesh.getNodes(count);
+            });
+            cout << "            " << count << " nodes" << endl;
+
+            sCheck result;
+            check(caves.get(), size, size, result);
+            checkTest(result.isAreaExact && result.isOriented && result.isSymmetric && result.isConnected, "Caves mesh is sound");
+            cout << setColor(7) << endl;
+        }
+        cout << setColor(7) << endl;
+    }
+
     system("pause");
     return errCount;
 }